@@ -0,0 +1,52 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/eventloop/epoll.c" "CMakeFiles/psychic-ninja.dir/src/eventloop/epoll.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/eventloop/epoll.c.o.d"
+  "/root/repo/src/eventloop/eventloop.c" "CMakeFiles/psychic-ninja.dir/src/eventloop/eventloop.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/eventloop/eventloop.c.o.d"
+  "/root/repo/src/eventloop/kqueue.c" "CMakeFiles/psychic-ninja.dir/src/eventloop/kqueue.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/eventloop/kqueue.c.o.d"
+  "/root/repo/src/eventloop/poll.c" "CMakeFiles/psychic-ninja.dir/src/eventloop/poll.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/eventloop/poll.c.o.d"
+  "/root/repo/src/eventloop/shard.c" "CMakeFiles/psychic-ninja.dir/src/eventloop/shard.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/eventloop/shard.c.o.d"
+  "/root/repo/src/eventloop/timer.c" "CMakeFiles/psychic-ninja.dir/src/eventloop/timer.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/eventloop/timer.c.o.d"
+  "/root/repo/src/eventloop/uring.c" "CMakeFiles/psychic-ninja.dir/src/eventloop/uring.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/eventloop/uring.c.o.d"
+  "/root/repo/src/hash/hashtable.c" "CMakeFiles/psychic-ninja.dir/src/hash/hashtable.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/hash/hashtable.c.o.d"
+  "/root/repo/src/irc/casemap.c" "CMakeFiles/psychic-ninja.dir/src/irc/casemap.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/irc/casemap.c.o.d"
+  "/root/repo/src/irc/chanlog.c" "CMakeFiles/psychic-ninja.dir/src/irc/chanlog.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/irc/chanlog.c.o.d"
+  "/root/repo/src/irc/chansearch.c" "CMakeFiles/psychic-ninja.dir/src/irc/chansearch.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/irc/chansearch.c.o.d"
+  "/root/repo/src/irc/hostmask.c" "CMakeFiles/psychic-ninja.dir/src/irc/hostmask.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/irc/hostmask.c.o.d"
+  "/root/repo/src/irc/job.c" "CMakeFiles/psychic-ninja.dir/src/irc/job.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/irc/job.c.o.d"
+  "/root/repo/src/irc/parser.c" "CMakeFiles/psychic-ninja.dir/src/irc/parser.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/irc/parser.c.o.d"
+  "/root/repo/src/irc/reconnect.c" "CMakeFiles/psychic-ninja.dir/src/irc/reconnect.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/irc/reconnect.c.o.d"
+  "/root/repo/src/irc/snapshot.c" "CMakeFiles/psychic-ninja.dir/src/irc/snapshot.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/irc/snapshot.c.o.d"
+  "/root/repo/src/irc/state.c" "CMakeFiles/psychic-ninja.dir/src/irc/state.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/irc/state.c.o.d"
+  "/root/repo/src/log/log.c" "CMakeFiles/psychic-ninja.dir/src/log/log.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/log/log.c.o.d"
+  "/root/repo/src/main.c" "CMakeFiles/psychic-ninja.dir/src/main.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/main.c.o.d"
+  "/root/repo/src/memory/arena.c" "CMakeFiles/psychic-ninja.dir/src/memory/arena.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/memory/arena.c.o.d"
+  "/root/repo/src/memory/pool.c" "CMakeFiles/psychic-ninja.dir/src/memory/pool.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/memory/pool.c.o.d"
+  "/root/repo/src/metrics/metrics.c" "CMakeFiles/psychic-ninja.dir/src/metrics/metrics.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/metrics/metrics.c.o.d"
+  "/root/repo/src/module/module.c" "CMakeFiles/psychic-ninja.dir/src/module/module.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/module/module.c.o.d"
+  "/root/repo/src/socket/flood.c" "CMakeFiles/psychic-ninja.dir/src/socket/flood.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/socket/flood.c.o.d"
+  "/root/repo/src/socket/recvbuf.c" "CMakeFiles/psychic-ninja.dir/src/socket/recvbuf.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/socket/recvbuf.c.o.d"
+  "/root/repo/src/socket/resolver.c" "CMakeFiles/psychic-ninja.dir/src/socket/resolver.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/socket/resolver.c.o.d"
+  "/root/repo/src/socket/sendq.c" "CMakeFiles/psychic-ninja.dir/src/socket/sendq.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/socket/sendq.c.o.d"
+  "/root/repo/src/socket/socket.c" "CMakeFiles/psychic-ninja.dir/src/socket/socket.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/socket/socket.c.o.d"
+  "/root/repo/src/socket/tls.c" "CMakeFiles/psychic-ninja.dir/src/socket/tls.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/socket/tls.c.o.d"
+  "/root/repo/src/thread/mpscqueue.c" "CMakeFiles/psychic-ninja.dir/src/thread/mpscqueue.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/thread/mpscqueue.c.o.d"
+  "/root/repo/src/thread/mpscring.c" "CMakeFiles/psychic-ninja.dir/src/thread/mpscring.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/thread/mpscring.c.o.d"
+  "/root/repo/src/thread/workers.c" "CMakeFiles/psychic-ninja.dir/src/thread/workers.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/thread/workers.c.o.d"
+  "/root/repo/src/thread/wsdeque.c" "CMakeFiles/psychic-ninja.dir/src/thread/wsdeque.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/thread/wsdeque.c.o.d"
+  "/root/repo/src/vector/vec.c" "CMakeFiles/psychic-ninja.dir/src/vector/vec.c.o" "gcc" "CMakeFiles/psychic-ninja.dir/src/vector/vec.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
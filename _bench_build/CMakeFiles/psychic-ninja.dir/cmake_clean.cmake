@@ -0,0 +1,77 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/epoll.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/epoll.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/eventloop.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/eventloop.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/kqueue.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/kqueue.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/poll.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/poll.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/shard.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/shard.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/timer.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/timer.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/uring.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/eventloop/uring.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/hash/hashtable.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/hash/hashtable.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/irc/casemap.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/irc/casemap.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/irc/chanlog.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/irc/chanlog.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/irc/chansearch.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/irc/chansearch.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/irc/hostmask.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/irc/hostmask.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/irc/job.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/irc/job.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/irc/parser.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/irc/parser.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/irc/reconnect.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/irc/reconnect.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/irc/snapshot.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/irc/snapshot.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/irc/state.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/irc/state.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/log/log.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/log/log.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/main.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/main.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/memory/arena.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/memory/arena.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/memory/pool.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/memory/pool.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/metrics/metrics.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/metrics/metrics.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/module/module.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/module/module.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/socket/flood.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/socket/flood.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/socket/recvbuf.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/socket/recvbuf.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/socket/resolver.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/socket/resolver.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/socket/sendq.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/socket/sendq.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/socket/socket.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/socket/socket.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/socket/tls.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/socket/tls.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/thread/mpscqueue.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/thread/mpscqueue.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/thread/mpscring.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/thread/mpscring.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/thread/workers.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/thread/workers.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/thread/wsdeque.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/thread/wsdeque.c.o.d"
+  "CMakeFiles/psychic-ninja.dir/src/vector/vec.c.o"
+  "CMakeFiles/psychic-ninja.dir/src/vector/vec.c.o.d"
+  "psychic-ninja"
+  "psychic-ninja.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/psychic-ninja.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
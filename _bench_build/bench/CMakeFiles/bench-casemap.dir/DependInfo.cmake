@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/irc/casemap.c" "bench/CMakeFiles/bench-casemap.dir/__/src/irc/casemap.c.o" "gcc" "bench/CMakeFiles/bench-casemap.dir/__/src/irc/casemap.c.o.d"
+  "/root/repo/src/vector/vec.c" "bench/CMakeFiles/bench-casemap.dir/__/src/vector/vec.c.o" "gcc" "bench/CMakeFiles/bench-casemap.dir/__/src/vector/vec.c.o.d"
+  "/root/repo/bench/casemap.c" "bench/CMakeFiles/bench-casemap.dir/casemap.c.o" "gcc" "bench/CMakeFiles/bench-casemap.dir/casemap.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench-casemap.dir/__/src/irc/casemap.c.o"
+  "CMakeFiles/bench-casemap.dir/__/src/irc/casemap.c.o.d"
+  "CMakeFiles/bench-casemap.dir/__/src/vector/vec.c.o"
+  "CMakeFiles/bench-casemap.dir/__/src/vector/vec.c.o.d"
+  "CMakeFiles/bench-casemap.dir/casemap.c.o"
+  "CMakeFiles/bench-casemap.dir/casemap.c.o.d"
+  "bench-casemap"
+  "bench-casemap.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/bench-casemap.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench-hashtable.dir/__/src/hash/hashtable.c.o"
+  "CMakeFiles/bench-hashtable.dir/__/src/hash/hashtable.c.o.d"
+  "CMakeFiles/bench-hashtable.dir/__/src/vector/vec.c.o"
+  "CMakeFiles/bench-hashtable.dir/__/src/vector/vec.c.o.d"
+  "CMakeFiles/bench-hashtable.dir/hashtable.c.o"
+  "CMakeFiles/bench-hashtable.dir/hashtable.c.o.d"
+  "bench-hashtable"
+  "bench-hashtable.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/bench-hashtable.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,25 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/hash/hashtable.c" "bench/CMakeFiles/bench-hostmask.dir/__/src/hash/hashtable.c.o" "gcc" "bench/CMakeFiles/bench-hostmask.dir/__/src/hash/hashtable.c.o.d"
+  "/root/repo/src/irc/casemap.c" "bench/CMakeFiles/bench-hostmask.dir/__/src/irc/casemap.c.o" "gcc" "bench/CMakeFiles/bench-hostmask.dir/__/src/irc/casemap.c.o.d"
+  "/root/repo/src/irc/hostmask.c" "bench/CMakeFiles/bench-hostmask.dir/__/src/irc/hostmask.c.o" "gcc" "bench/CMakeFiles/bench-hostmask.dir/__/src/irc/hostmask.c.o.d"
+  "/root/repo/src/log/log.c" "bench/CMakeFiles/bench-hostmask.dir/__/src/log/log.c.o" "gcc" "bench/CMakeFiles/bench-hostmask.dir/__/src/log/log.c.o.d"
+  "/root/repo/src/memory/pool.c" "bench/CMakeFiles/bench-hostmask.dir/__/src/memory/pool.c.o" "gcc" "bench/CMakeFiles/bench-hostmask.dir/__/src/memory/pool.c.o.d"
+  "/root/repo/src/vector/vec.c" "bench/CMakeFiles/bench-hostmask.dir/__/src/vector/vec.c.o" "gcc" "bench/CMakeFiles/bench-hostmask.dir/__/src/vector/vec.c.o.d"
+  "/root/repo/bench/hostmask.c" "bench/CMakeFiles/bench-hostmask.dir/hostmask.c.o" "gcc" "bench/CMakeFiles/bench-hostmask.dir/hostmask.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,23 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench-hostmask.dir/__/src/hash/hashtable.c.o"
+  "CMakeFiles/bench-hostmask.dir/__/src/hash/hashtable.c.o.d"
+  "CMakeFiles/bench-hostmask.dir/__/src/irc/casemap.c.o"
+  "CMakeFiles/bench-hostmask.dir/__/src/irc/casemap.c.o.d"
+  "CMakeFiles/bench-hostmask.dir/__/src/irc/hostmask.c.o"
+  "CMakeFiles/bench-hostmask.dir/__/src/irc/hostmask.c.o.d"
+  "CMakeFiles/bench-hostmask.dir/__/src/log/log.c.o"
+  "CMakeFiles/bench-hostmask.dir/__/src/log/log.c.o.d"
+  "CMakeFiles/bench-hostmask.dir/__/src/memory/pool.c.o"
+  "CMakeFiles/bench-hostmask.dir/__/src/memory/pool.c.o.d"
+  "CMakeFiles/bench-hostmask.dir/__/src/vector/vec.c.o"
+  "CMakeFiles/bench-hostmask.dir/__/src/vector/vec.c.o.d"
+  "CMakeFiles/bench-hostmask.dir/hostmask.c.o"
+  "CMakeFiles/bench-hostmask.dir/hostmask.c.o.d"
+  "bench-hostmask"
+  "bench-hostmask.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/bench-hostmask.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench-loadgen.dir/__/src/vector/vec.c.o"
+  "CMakeFiles/bench-loadgen.dir/__/src/vector/vec.c.o.d"
+  "CMakeFiles/bench-loadgen.dir/loadgen.c.o"
+  "CMakeFiles/bench-loadgen.dir/loadgen.c.o.d"
+  "bench-loadgen"
+  "bench-loadgen.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/bench-loadgen.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench-parser.dir/__/src/irc/parser.c.o"
+  "CMakeFiles/bench-parser.dir/__/src/irc/parser.c.o.d"
+  "CMakeFiles/bench-parser.dir/__/src/vector/vec.c.o"
+  "CMakeFiles/bench-parser.dir/__/src/vector/vec.c.o.d"
+  "CMakeFiles/bench-parser.dir/parser.c.o"
+  "CMakeFiles/bench-parser.dir/parser.c.o.d"
+  "bench-parser"
+  "bench-parser.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/bench-parser.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench-recvbuf.dir/__/src/socket/recvbuf.c.o"
+  "CMakeFiles/bench-recvbuf.dir/__/src/socket/recvbuf.c.o.d"
+  "CMakeFiles/bench-recvbuf.dir/__/src/vector/vec.c.o"
+  "CMakeFiles/bench-recvbuf.dir/__/src/vector/vec.c.o.d"
+  "CMakeFiles/bench-recvbuf.dir/recvbuf.c.o"
+  "CMakeFiles/bench-recvbuf.dir/recvbuf.c.o.d"
+  "bench-recvbuf"
+  "bench-recvbuf.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/bench-recvbuf.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,19 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench-sendq.dir/__/src/log/log.c.o"
+  "CMakeFiles/bench-sendq.dir/__/src/log/log.c.o.d"
+  "CMakeFiles/bench-sendq.dir/__/src/memory/pool.c.o"
+  "CMakeFiles/bench-sendq.dir/__/src/memory/pool.c.o.d"
+  "CMakeFiles/bench-sendq.dir/__/src/socket/sendq.c.o"
+  "CMakeFiles/bench-sendq.dir/__/src/socket/sendq.c.o.d"
+  "CMakeFiles/bench-sendq.dir/__/src/vector/vec.c.o"
+  "CMakeFiles/bench-sendq.dir/__/src/vector/vec.c.o.d"
+  "CMakeFiles/bench-sendq.dir/sendq.c.o"
+  "CMakeFiles/bench-sendq.dir/sendq.c.o.d"
+  "bench-sendq"
+  "bench-sendq.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/bench-sendq.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
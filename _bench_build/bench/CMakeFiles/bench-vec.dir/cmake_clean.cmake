@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench-vec.dir/__/src/vector/vec.c.o"
+  "CMakeFiles/bench-vec.dir/__/src/vector/vec.c.o.d"
+  "CMakeFiles/bench-vec.dir/vec.c.o"
+  "CMakeFiles/bench-vec.dir/vec.c.o.d"
+  "bench-vec"
+  "bench-vec.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/bench-vec.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,134 @@
+#pragma once
+
+#define HAVE_SYS_TYPES_H 1
+#define HAVE_STDINT_H 1
+#define HAVE_FCNTL_H 1
+#define HAVE_STDDEF_H 1
+#define HAVE_BACKTRACE 1
+#define HAVE_SETJMP_H 1
+#define HAVE_SYS_EPOLL_H 1
+#define HAVE_LINUX_IO_URING_H 1
+#define HAVE_GETTIMEOFDAY 1
+#define HAVE_CLOCK_GETTIME 1
+/* #undef HAVE_SETGRENT */
+/* #undef HAVE_STRCASECMP */
+/* #undef HAVE_STRICMP */
+/* #undef HAVE_STRINGS_H */
+/* #undef HAVE_STRLCAT */
+/* #undef HAVE_STRLCPY */
+/* #undef HAVE_SYS_SELECT_H */
+/* #undef HAVE_UMASK */
+/* #undef HAVE_EVENTFD */
+#define HAVE_DLSYM 1
+#define HAVE_DLFCN_H 1
+#define HAVE_EXECINFO_H 1
+/* #undef HAVE_STRNDUPA */
+#define HAVE_STRNLEN 1
+/* #undef HAVE_KQUEUE */
+#define HAVE_POLL 1
+#define HAVE_SELECT 1
+#define HAVE_OPENSSL 1
+#define HAVE_SSL_OP_ENABLE_KTLS 1
+/* #undef HAVE_AVX2 */
+#define HAVE_SSE2 1
+/* #undef HAVE_NEON */
+/* #undef CLANG_CXXABI */
+/* #undef HAS_CXXABI_H */
+
+#define VERSION_MAJOR        1
+#define VERSION_MINOR        0
+#define VERSION_PATCH        0
+#define VERSION              "1.0.0"
+#define VERSION_GIT          "4032e55"
+#define VERSION_FULL         "1.0.0-4032e55"
+#define GIT_SHA_SUM          "4032e557b45f1d2f6f32d891f1f0c5b30fce6273"
+#define COMPILED_NAME        "psychic-ninja"
+#define COMPILED_ARCH        ""
+#define C_COMPILER_NAME      "GNU"
+#define CXX_COMPILER_NAME    ""
+#define CMAKE_INSTALL_PREFIX "/usr/local"
+#define LOG_COMPILED_LEVEL   0
+
+#define HAVE_UINT8_T 1
+#define HAVE_U_INT8_T 1
+#define HAVE_INT16_T 1
+#define HAVE_UINT16_T 1
+#define HAVE_U_INT16_T 1
+/* #undef HAVE_INT32_T */
+#define HAVE_UINT32_T 1
+#define HAVE_U_INT32_T 1
+
+//#ifdef HAVE_SETJMP_H
+//# include <setjmp.h>
+//#endif
+#ifdef HAVE_SYS_TYPES_H
+# include <sys/types.h>
+#endif
+#ifdef HAVE_STDINT_H
+# include <stdint.h>
+#endif
+#ifdef HAVE_STDDEF_H
+# include <stddef.h>
+#endif
+
+#ifdef HAVE_UINT8_T
+typedef uint8_t uint8;
+#else
+# ifdef HAVE_U_INT8_T
+typedef u_int8_t uint8;
+# else
+#  ifdef _WIN32
+typedef unsigned __int8 uint8;
+#  else
+typedef unsigned short uint8;
+#  endif
+# endif
+#endif
+
+#ifdef HAVE_INT16_T
+typedef int16_t int16;
+#else
+# ifdef _WIN32
+typedef signed __int16 int16;
+# else
+typedef int int16;
+# endif
+#endif
+
+#ifdef HAVE_UINT16_T
+typedef uint16_t uint16;
+#else
+# ifdef HAVE_U_INT16_T
+typedef u_int16_t uint16;
+# else
+#  ifdef _WIN32
+typedef unsigned __int16 uint16;
+#  else
+typedef unsigned int uint16;
+#  endif
+# endif
+#endif
+
+#ifdef HAVE_INT32_T
+typedef int32_t int32;
+#else
+# ifdef _WIN32
+typedef signed __int32 int32;
+# else
+typedef long int32;
+# endif
+#endif
+
+#ifdef HAVE_UINT32_T
+typedef uint32_t uint32;
+#else
+# ifdef HAVE_U_INT32_T
+typedef u_int32_t uint32;
+# else
+#  ifdef _WIN32
+typedef unsigned __int32 uint32;
+#  else
+typedef unsigned long uint32;
+#  endif
+# endif
+#endif
@@ -0,0 +1,83 @@
+// What the benchmarks have in common. Every benchmark prints what it
+// measured for people to read, followed by one line per number in the
+// form
+//
+//   result <name> <value> <unit>
+//
+// which is what `make bench-regress' compares against baseline.txt.
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vector/vec.h"
+#include "socket/recvbuf.h" // for strview_t
+
+#ifndef BENCH_CORPUS_DIR
+# define BENCH_CORPUS_DIR "corpus"
+#endif
+
+// The corpus every benchmark uses unless it's given another.
+#define BENCH_CORPUS BENCH_CORPUS_DIR "/irc-traffic.txt"
+
+typedef vec_t(strview_t) benchlines_t;
+
+// Seconds since some unspecified point, as a double for easy arithmetic.
+static inline double Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Read the whole file into memory.
+static inline char *ReadFile(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	char *data = malloc(size + 1);
+	if (data && fread(data, 1, size, f) != (size_t)size)
+	{
+		free(data);
+		data = NULL;
+	}
+
+	fclose(f);
+	*len = size;
+	return data;
+}
+
+// Split the corpus into lines (without their \r\n) up front so only the
+// code being benchmarked is timed.
+static inline int SplitLines(char *corpus, size_t len, benchlines_t *lines)
+{
+	vec_init(lines);
+	for (char *p = corpus, *end = corpus + len; p < end;)
+	{
+		char *nl = memchr(p, '\n', end - p);
+		if (!nl)
+			nl = end;
+
+		strview_t line = { p, nl - p };
+		if (line.len && p[line.len - 1] == '\r')
+			line.len--;
+		if (line.len && vec_push(lines, line))
+			return 0;
+
+		p = nl + 1;
+	}
+
+	return lines->length > 0;
+}
+
+// Print one number for bench-regress to pick up.
+static inline void Report(const char *name, double value, const char *unit)
+{
+	printf("result %s %.2f %s\n", name, value, unit);
+}
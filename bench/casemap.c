@@ -0,0 +1,112 @@
+// A microbenchmark for the case mapping kernels. The nicks and channel
+// names are taken from the corpus, then hashed and compared against an
+// upper cased copy of themselves (so every comparison has to go all the
+// way to the end) under rfc1459, the way every message looks them up.
+//
+// Usage: bench-casemap [corpus file] [seconds to run each for]
+#include <ctype.h>
+#include "irc/casemap.h"
+#include "bench.h"
+
+// Pull the nick out of the prefix and every channel name out of a line.
+static void CollectNames(strview_t line, benchlines_t *names)
+{
+	const char *p = line.ptr, *end = line.ptr + line.len;
+
+	if (p < end && *p == ':')
+	{
+		const char *nick = ++p;
+		while (p < end && *p != '!' && *p != ' ')
+			p++;
+		if (p < end && *p == '!' && p > nick)
+			vec_push(names, ((strview_t){ nick, p - nick }));
+	}
+
+	for (; p < end; ++p)
+	{
+		if (*p != '#' || (p > line.ptr && p[-1] != ' ' && p[-1] != ':' && p[-1] != ','))
+			continue;
+
+		const char *name = p;
+		while (p < end && *p != ' ' && *p != ',')
+			p++;
+		vec_push(names, ((strview_t){ name, p - name }));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : BENCH_CORPUS;
+	double seconds   = argc > 2 ? atof(argv[2]) : 1.0;
+
+	size_t len;
+	char *corpus = ReadFile(path, &len);
+	benchlines_t lines, names;
+	if (!corpus || !SplitLines(corpus, len, &lines))
+	{
+		fprintf(stderr, "Failed to read the corpus %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	vec_init(&names);
+	for (int i = 0; i < lines.length; ++i)
+		CollectNames(lines.data[i], &names);
+
+	// The same names in upper case, which rfc1459 says are equal.
+	size_t bytes = 0;
+	for (int i = 0; i < names.length; ++i)
+		bytes += names.data[i].len;
+
+	char *upper = malloc(bytes + 1);
+	if (!names.length || !upper)
+	{
+		fprintf(stderr, "No names in the corpus %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0, pos = 0; i < names.length; ++i)
+	{
+		for (size_t j = 0; j < names.data[i].len; ++j)
+			upper[pos + j] = toupper((unsigned char)names.data[i].ptr[j]);
+		pos += names.data[i].len;
+	}
+
+	const unsigned char *map = GetIRCCaseMap(IRC_CASEMAP_RFC1459);
+	unsigned long hashes = 0, compares = 0, equal = 0;
+	uint32_t checksum = 0;
+	double start, elapsed;
+
+	start = Now();
+	do
+	{
+		for (int i = 0; i < names.length; ++i)
+			checksum += IRCHashString(map, names.data[i].ptr, names.data[i].len);
+		hashes += names.length;
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+	double hashrate = hashes / elapsed;
+
+	start = Now();
+	do
+	{
+		for (int i = 0, pos = 0; i < names.length; ++i)
+		{
+			equal += IRCStringEquals(map, names.data[i].ptr, names.data[i].len, upper + pos, names.data[i].len);
+			pos += names.data[i].len;
+		}
+		compares += names.length;
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+	double comparerate = compares / elapsed;
+
+	printf("casemap: %d names averaging %.1f bytes, %.0f hashes/sec, %.0f compares/sec (%lu equal, checksum %08x)\n",
+	       names.length, (double)bytes / names.length, hashrate, comparerate, equal, checksum);
+	Report("casemap_hashes_per_sec", hashrate, "hashes/s");
+	Report("casemap_compares_per_sec", comparerate, "compares/s");
+
+	free(upper);
+	vec_deinit(&names);
+	vec_deinit(&lines);
+	free(corpus);
+	return equal == compares ? EXIT_SUCCESS : EXIT_FAILURE;
+}
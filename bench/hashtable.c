@@ -0,0 +1,122 @@
+// A microbenchmark for the hash table, keyed by nick the way the network
+// state uses it. Times inserting a network's worth of users, looking up
+// ones that are there and ones that aren't, and removing them all again.
+//
+// Usage: bench-hashtable [users] [seconds to run each for]
+#include <stdint.h>
+#include "hash/hashtable.h"
+#include "bench.h"
+
+// A user, with its key in it like the network state's users.
+typedef struct
+{
+	char nick[16];
+	size_t len;
+} user_t;
+
+typedef struct
+{
+	const char *nick;
+	size_t len;
+} nickkey_t;
+
+// FNV-1a, good enough to spread nicks around the table.
+static uint32_t HashNick(const char *nick, size_t len)
+{
+	uint32_t hash = 2166136261U;
+	for (size_t i = 0; i < len; ++i)
+		hash = (hash ^ (unsigned char)nick[i]) * 16777619U;
+	return hash;
+}
+
+static int MatchNick(const void *item, const void *key)
+{
+	const user_t *user = item;
+	const nickkey_t *k = key;
+	return user->len == k->len && !memcmp(user->nick, k->nick, k->len);
+}
+
+int main(int argc, char **argv)
+{
+	int count      = argc > 1 ? atoi(argv[1]) : 10000;
+	double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+	if (count < 1)
+		count = 1;
+
+	// The users that get inserted, and as many which never are.
+	user_t *users = calloc(count * 2, sizeof(user_t));
+	uint32_t *hashes = calloc(count * 2, sizeof(uint32_t));
+	if (!users || !hashes)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < count * 2; ++i)
+	{
+		users[i].len = snprintf(users[i].nick, sizeof(users[i].nick), "guest%d", i);
+		hashes[i] = HashNick(users[i].nick, users[i].len);
+	}
+
+	unsigned long inserts = 0, hits = 0, misses = 0, removes = 0, found = 0;
+	double inserttime = 0, hittime = 0, misstime = 0, removetime = 0;
+	double start = Now();
+
+	// Fill, look up and empty the table until we've run long enough. A
+	// fresh table each time so the inserts include growing it.
+	while (Now() - start < seconds * 4)
+	{
+		hashtable_t table;
+		if (!InitializeHashTable(&table, 0))
+		{
+			fprintf(stderr, "Out of memory\n");
+			return EXIT_FAILURE;
+		}
+
+		double t = Now();
+		for (int i = 0; i < count; ++i)
+			InsertHashItem(&table, hashes[i], &users[i]);
+		inserttime += Now() - t;
+		inserts += count;
+
+		t = Now();
+		for (int i = 0; i < count; ++i)
+		{
+			nickkey_t key = { users[i].nick, users[i].len };
+			found += FindHashItem(&table, hashes[i], MatchNick, &key) != NULL;
+		}
+		hittime += Now() - t;
+		hits += count;
+
+		t = Now();
+		for (int i = count; i < count * 2; ++i)
+		{
+			nickkey_t key = { users[i].nick, users[i].len };
+			found += FindHashItem(&table, hashes[i], MatchNick, &key) != NULL;
+		}
+		misstime += Now() - t;
+		misses += count;
+
+		t = Now();
+		for (int i = 0; i < count; ++i)
+		{
+			nickkey_t key = { users[i].nick, users[i].len };
+			found += RemoveHashItem(&table, hashes[i], MatchNick, &key) != NULL;
+		}
+		removetime += Now() - t;
+		removes += count;
+
+		DestroyHashTable(&table);
+	}
+
+	printf("hashtable: %d users, %.0f inserts/sec, %.0f hits/sec, %.0f misses/sec, %.0f removes/sec (found %lu)\n",
+	       count, inserts / inserttime, hits / hittime, misses / misstime, removes / removetime, found);
+	Report("hashtable_inserts_per_sec", inserts / inserttime, "inserts/s");
+	Report("hashtable_hits_per_sec", hits / hittime, "lookups/s");
+	Report("hashtable_misses_per_sec", misses / misstime, "lookups/s");
+	Report("hashtable_removes_per_sec", removes / removetime, "removes/s");
+
+	free(users);
+	free(hashes);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+// A microbenchmark for matching hostmasks against a mask set, the way the
+// ignore list sees every message. The set is filled with an ignore list's
+// worth of masks of each kind (host bans, nick bans, exact hostmasks and
+// a few with wildcards at both ends) and the prefixes from the corpus are
+// matched against it, which almost never match, just like real traffic.
+// Matching each mask in turn is timed too, for comparison.
+//
+// Usage: bench-hostmask [corpus file] [masks] [seconds to run each for]
+#include "irc/hostmask.h"
+#include "bench.h"
+
+// Pull the nick!user@host out of the prefix of a line.
+static void CollectPrefix(strview_t line, benchlines_t *prefixes)
+{
+	if (!line.len || line.ptr[0] != ':')
+		return;
+
+	size_t len = 1;
+	while (len < line.len && line.ptr[len] != ' ')
+		len++;
+
+	strview_t prefix = { line.ptr + 1, len - 1 };
+	if (memchr(prefix.ptr, '!', prefix.len))
+		vec_push(prefixes, prefix);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : BENCH_CORPUS;
+	int count        = argc > 2 ? atoi(argv[2]) : 1000;
+	double seconds   = argc > 3 ? atof(argv[3]) : 1.0;
+	if (count < 4)
+		count = 4;
+
+	size_t len;
+	char *corpus = ReadFile(path, &len);
+	benchlines_t lines, prefixes;
+	if (!corpus || !SplitLines(corpus, len, &lines))
+	{
+		fprintf(stderr, "Failed to read the corpus %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	vec_init(&prefixes);
+	for (int i = 0; i < lines.length; ++i)
+		CollectPrefix(lines.data[i], &prefixes);
+
+	if (!prefixes.length)
+	{
+		fprintf(stderr, "No hostmasks in the corpus %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	const unsigned char *map = GetIRCCaseMap(IRC_CASEMAP_RFC1459);
+	ircmaskset_t set;
+	strview_t *masks = calloc(count, sizeof(strview_t));
+	if (!masks || !InitializeIRCMaskSet(&set, map))
+	{
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		char mask[64];
+		switch (i % 8)
+		{
+			case 7:
+				snprintf(mask, sizeof(mask), "*spam%d*", i);
+				break;
+			case 6:
+				snprintf(mask, sizeof(mask), "troll%d!user@host%d.example.net", i, i);
+				break;
+			case 4:
+			case 5:
+				snprintf(mask, sizeof(mask), "flooder%d!*@*", i);
+				break;
+			default:
+				snprintf(mask, sizeof(mask), "*!*@*.host%d.example.com", i);
+				break;
+		}
+
+		masks[i].len = strlen(mask);
+		if (!(masks[i].ptr = strdup(mask)) || !AddIRCMask(&set, masks[i], NULL))
+		{
+			fprintf(stderr, "Failed to add %s\n", mask);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Both ways have to agree on what matches before either is timed.
+	int hits = 0;
+	for (int i = 0; i < prefixes.length; ++i)
+	{
+		int hit = 0;
+		for (int j = 0; j < count && !hit; ++j)
+			hit = IRCMaskMatches(map, masks[j], prefixes.data[i]);
+
+		if (hit != (MatchIRCMaskSet(&set, prefixes.data[i]) != NULL))
+		{
+			fprintf(stderr, "The set and the masks disagree about %.*s\n", (int)prefixes.data[i].len, prefixes.data[i].ptr);
+			return EXIT_FAILURE;
+		}
+		hits += hit;
+	}
+
+	unsigned long matches = 0, scans = 0, found = 0;
+	double start, elapsed;
+
+	start = Now();
+	do
+	{
+		for (int i = 0; i < prefixes.length; ++i)
+			found += MatchIRCMaskSet(&set, prefixes.data[i]) != NULL;
+		matches += prefixes.length;
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+	double matchrate = matches / elapsed;
+
+	start = Now();
+	do
+	{
+		for (int i = 0; i < prefixes.length; ++i)
+		{
+			for (int j = 0; j < count; ++j)
+			{
+				if (IRCMaskMatches(map, masks[j], prefixes.data[i]))
+					break;
+			}
+		}
+		scans += prefixes.length;
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+	double scanrate = scans / elapsed;
+
+	printf("hostmask: %d hostmasks (%d matching) against %d masks, %.0f matches/sec, %.0f matching each mask in turn (%lu found)\n",
+	       prefixes.length, hits, count, matchrate, scanrate, found);
+	Report("hostmask_matches_per_sec", matchrate, "matches/s");
+
+	for (int i = 0; i < count; ++i)
+		free((char*)masks[i].ptr);
+	free(masks);
+	DestroyIRCMaskSet(&set);
+	vec_deinit(&prefixes);
+	vec_deinit(&lines);
+	free(corpus);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,378 @@
+// A load test for the whole bot. We play a fake IRC server on loopback,
+// start the bot connecting to it N times over (as N different networks)
+// and send every connection the corpus over and over as fast as the bot
+// reads it. Every couple of seconds each connection also gets a PING and
+// we time how long the PONG takes to come back, which includes working
+// through everything that was sent before it.
+//
+// Reports how many lines per second the bot took in altogether and the
+// median and 99th percentile PING round trip.
+//
+// Usage: bench-loadgen <bot> [connections] [seconds] [threads]
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "bench.h"
+
+// The most connections we'll drive at once.
+#define MAX_CONNECTIONS 256
+
+// How often (in seconds) each connection is pinged. The bot's flood
+// limits let a PONG through every 2 seconds, any faster and we'd be
+// timing those instead.
+#define PING_INTERVAL 2.1
+
+// How much of the corpus we hand the kernel at once.
+#define SEND_SIZE 16384
+
+// How much the kernel may hold for each connection on our side. Loopback
+// buffers grow to megabytes, which would have the PINGs waiting behind
+// the kernel rather than the bot.
+#define SEND_BUFFER 65536
+
+// How long (in seconds) we wait for the bot to connect to us.
+#define CONNECT_TIMEOUT 10.0
+
+// One of the bot's connections to us.
+typedef struct
+{
+	int fd;
+	size_t pos;          // Where in the traffic we're up to.
+	const char *out;     // What we're in the middle of sending.
+	size_t outlen;
+	unsigned long lines; // Lines in `out', counted once it's all gone.
+	char ping[64];
+	double pingsent;     // When the PING we're waiting on went out, 0 if none.
+	double nextping;     // When to send the next one.
+	char in[4096];       // What the bot sent us, up to a newline.
+	size_t inlen;
+} conn_t;
+
+typedef vec_t(double) samples_t;
+
+static int CompareDoubles(const void *a, const void *b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+// Build what the server sends from the corpus, leaving out everything the
+// bot would answer (apart from our PINGs) or which would end the connection.
+static char *BuildTraffic(char *corpus, size_t len, size_t *trafficlen)
+{
+	benchlines_t lines;
+	if (!SplitLines(corpus, len, &lines))
+		return NULL;
+
+	char *traffic = malloc(len + lines.length * 2 + 1);
+	size_t pos = 0;
+	for (int i = 0; traffic && i < lines.length; ++i)
+	{
+		strview_t line = lines.data[i];
+		char text[1024];
+		snprintf(text, sizeof(text), "%.*s", (int)line.len, line.ptr);
+
+		if (!strncmp(text, "PING", 4) || !strncmp(text, "ERROR", 5) || strstr(text, " 001 ") ||
+		    strstr(text, " 433 ") || strstr(text, " :!") || strstr(text, " :\x01"))
+			continue;
+
+		memcpy(traffic + pos, line.ptr, line.len);
+		memcpy(traffic + pos + line.len, "\r\n", 2);
+		pos += line.len + 2;
+	}
+
+	vec_deinit(&lines);
+	*trafficlen = pos;
+	if (traffic && !pos)
+	{
+		free(traffic);
+		return NULL;
+	}
+
+	return traffic;
+}
+
+// Start the bot, connecting to our port `count' times.
+static pid_t StartBot(const char *bot, int port, int count, const char *threads)
+{
+	char server[32];
+	snprintf(server, sizeof(server), "127.0.0.1:%d", port);
+
+	char **args = calloc(count + 4, sizeof(char*));
+	if (!args)
+		return -1;
+
+	int n = 0;
+	args[n++] = (char*)bot;
+	if (threads)
+	{
+		args[n++] = "-t";
+		args[n++] = (char*)threads;
+	}
+	for (int i = 0; i < count; ++i)
+		args[n++] = server;
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		// The bot says a lot, none of it matters here.
+		int null = open("/dev/null", O_WRONLY);
+		if (null != -1)
+		{
+			dup2(null, STDOUT_FILENO);
+			dup2(null, STDERR_FILENO);
+		}
+
+		execv(bot, args);
+		_exit(127);
+	}
+
+	free(args);
+	return pid;
+}
+
+// Read what the bot sent, timing any PONGs.
+static int ReadBot(conn_t *c, samples_t *samples, double now)
+{
+	for (;;)
+	{
+		ssize_t n = recv(c->fd, c->in + c->inlen, sizeof(c->in) - c->inlen, 0);
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 1;
+		if (n <= 0)
+			return 0;
+
+		c->inlen += n;
+
+		char *start = c->in, *end = c->in + c->inlen, *nl;
+		while ((nl = memchr(start, '\n', end - start)))
+		{
+			if (c->pingsent && nl - start >= 4 && !memcmp(start, "PONG", 4))
+			{
+				vec_push(samples, (now - c->pingsent) * 1000.0);
+				c->pingsent = 0;
+			}
+			start = nl + 1;
+		}
+
+		// Lines too long for the buffer are thrown away.
+		c->inlen = end - start;
+		if (c->inlen == sizeof(c->in))
+			c->inlen = 0;
+		memmove(c->in, start, c->inlen);
+	}
+}
+
+// Send the bot as much as it'll take.
+static int WriteBot(conn_t *c, const char *traffic, size_t trafficlen, unsigned long *sent, double now)
+{
+	for (;;)
+	{
+		if (!c->outlen)
+		{
+			*sent += c->lines;
+			c->lines = 0;
+
+			if (!c->pingsent && now >= c->nextping)
+			{
+				static unsigned long seq;
+				c->outlen = snprintf(c->ping, sizeof(c->ping), "PING :%lu\r\n", ++seq);
+				c->out = c->ping;
+				c->pingsent = now;
+				c->nextping = now + PING_INTERVAL;
+			}
+			else
+			{
+				// Stop at the end of a line so a PING never lands in the middle of one.
+				size_t len = trafficlen - c->pos < SEND_SIZE ? trafficlen - c->pos : SEND_SIZE;
+				while (len && traffic[c->pos + len - 1] != '\n')
+					len--;
+				if (!len)
+					len = trafficlen - c->pos;
+
+				c->out = traffic + c->pos;
+				c->outlen = len;
+				for (size_t i = 0; i < len; ++i)
+					c->lines += traffic[c->pos + i] == '\n';
+				c->pos = (c->pos + len) % trafficlen;
+			}
+		}
+
+		ssize_t n = send(c->fd, c->out, c->outlen, MSG_NOSIGNAL);
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 1;
+		if (n <= 0)
+			return 0;
+
+		c->out += n;
+		c->outlen -= n;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s <bot> [connections] [seconds] [threads]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char *bot = argv[1];
+	int count       = argc > 2 ? atoi(argv[2]) : 16;
+	double seconds  = argc > 3 ? atof(argv[3]) : 10.0;
+	const char *threads = argc > 4 ? argv[4] : NULL;
+	if (count < 1 || count > MAX_CONNECTIONS)
+	{
+		fprintf(stderr, "The number of connections must be between 1 and %d.\n", MAX_CONNECTIONS);
+		return EXIT_FAILURE;
+	}
+
+	size_t len, trafficlen;
+	char *corpus = ReadFile(BENCH_CORPUS, &len);
+	char *traffic = corpus ? BuildTraffic(corpus, len, &trafficlen) : NULL;
+	if (!traffic)
+	{
+		fprintf(stderr, "Failed to read the corpus %s\n", BENCH_CORPUS);
+		return EXIT_FAILURE;
+	}
+
+	int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in sin;
+	socklen_t sinlen = sizeof(sin);
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (listenfd == -1 || bind(listenfd, (struct sockaddr*)&sin, sizeof(sin)) == -1 ||
+	    listen(listenfd, MAX_CONNECTIONS) == -1 || getsockname(listenfd, (struct sockaddr*)&sin, &sinlen) == -1)
+	{
+		fprintf(stderr, "Failed to listen on loopback: %s (%d)\n", strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+
+	pid_t pid = StartBot(bot, ntohs(sin.sin_port), count, threads);
+	if (pid == -1)
+	{
+		fprintf(stderr, "Failed to start %s: %s (%d)\n", bot, strerror(errno), errno);
+		return EXIT_FAILURE;
+	}
+
+	// Wait for every connection, welcoming each one as it comes.
+	conn_t *conns = calloc(count, sizeof(conn_t));
+	int connected = 0;
+	double deadline = Now() + CONNECT_TIMEOUT;
+	while (conns && connected < count && Now() < deadline)
+	{
+		struct pollfd pfd = { listenfd, POLLIN, 0 };
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+
+		int fd = accept(listenfd, NULL, NULL);
+		if (fd == -1)
+			continue;
+
+		static const char welcome[] = ":bench.example.net 001 psychic-ninja :Welcome to the benchmark\r\n";
+		if (send(fd, welcome, sizeof(welcome) - 1, MSG_NOSIGNAL) != sizeof(welcome) - 1)
+		{
+			close(fd);
+			continue;
+		}
+
+		int sndbuf = SEND_BUFFER;
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		conns[connected].fd = fd;
+		conns[connected].pos = (trafficlen / count) * connected;
+		while (conns[connected].pos && traffic[conns[connected].pos - 1] != '\n')
+			conns[connected].pos--;
+		connected++;
+	}
+
+	if (connected < count)
+	{
+		fprintf(stderr, "Only %d of %d connections came in.\n", connected, count);
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+		return EXIT_FAILURE;
+	}
+
+	// Give the bot a moment to register everywhere before the clock starts.
+	double start = Now() + 0.5;
+	for (int i = 0; i < count; ++i)
+		conns[i].nextping = start + PING_INTERVAL * i / count;
+
+	struct pollfd *pfds = calloc(count, sizeof(struct pollfd));
+	samples_t samples;
+	vec_init(&samples);
+	unsigned long sent = 0;
+	int alive = count;
+	double now;
+
+	while (alive && (now = Now()) < start + seconds)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			pfds[i].fd = conns[i].fd;
+			pfds[i].events = POLLIN | (now >= start ? POLLOUT : 0);
+		}
+
+		if (poll(pfds, count, 50) == -1 && errno != EINTR)
+			break;
+
+		now = Now();
+		for (int i = 0; i < count; ++i)
+		{
+			if (conns[i].fd == -1)
+				continue;
+
+			int ok = 1;
+			if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+				ok = ReadBot(&conns[i], &samples, now);
+			if (ok && now >= start)
+				ok = WriteBot(&conns[i], traffic, trafficlen, &sent, now);
+
+			if (!ok)
+			{
+				close(conns[i].fd);
+				conns[i].fd = -1;
+				pfds[i].fd = -1;
+				alive--;
+			}
+		}
+	}
+
+	double elapsed = Now() - start;
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+
+	if (alive < count)
+		fprintf(stderr, "%d of %d connections were closed early.\n", count - alive, count);
+
+	qsort(samples.data, samples.length, sizeof(double), CompareDoubles);
+	double p50 = samples.length ? samples.data[samples.length / 2] : 0;
+	double p99 = samples.length ? samples.data[samples.length * 99 / 100] : 0;
+
+	printf("loadgen: %d connections, %lu lines in %.3fs, %.0f lines/sec, PING round trip p50 %.3fms p99 %.3fms (%d pings)\n",
+	       count, sent, elapsed, sent / elapsed, p50, p99, samples.length);
+	Report("loadgen_lines_per_sec", sent / elapsed, "lines/s");
+	Report("loadgen_ping_p99_ms", p99, "ms");
+
+	for (int i = 0; i < count; ++i)
+		if (conns[i].fd != -1)
+			close(conns[i].fd);
+	close(listenfd);
+	int ok = alive == count && samples.length;
+	vec_deinit(&samples);
+	free(pfds);
+	free(conns);
+	free(traffic);
+	free(corpus);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
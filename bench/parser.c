@@ -0,0 +1,56 @@
+// A microbenchmark for the IRC message parser. Every line of a captured
+// traffic corpus is parsed over and over and we report how many messages
+// per second the parser gets through.
+//
+// Usage: bench-parser [corpus file] [seconds to run for]
+#include "irc/parser.h"
+#include "bench.h"
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : BENCH_CORPUS;
+	double seconds   = argc > 2 ? atof(argv[2]) : 2.0;
+
+	size_t len;
+	char *corpus = ReadFile(path, &len);
+	if (!corpus)
+	{
+		fprintf(stderr, "Failed to read the corpus %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	benchlines_t lines;
+	if (!SplitLines(corpus, len, &lines))
+	{
+		fprintf(stderr, "The corpus %s has no lines in it\n", path);
+		return EXIT_FAILURE;
+	}
+
+	// Add up the parameters so the compiler can't throw the parsing away.
+	unsigned long messages = 0, params = 0, failed = 0;
+	double start = Now(), elapsed;
+	ircmsg_t msg;
+
+	do
+	{
+		// Check the clock only once per pass over the corpus.
+		for (int i = 0; i < lines.length; ++i)
+		{
+			if (ParseIRCMessage(lines.data[i], &msg))
+				params += msg.nparams + msg.numeric;
+			else
+				failed++;
+		}
+
+		messages += lines.length;
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+
+	printf("parser: %lu messages in %.3fs, %.0f messages/sec (%d lines in corpus, %lu failed, checksum %lu)\n",
+	       messages, elapsed, messages / elapsed, lines.length, failed, params);
+	Report("parser_messages_per_sec", messages / elapsed, "messages/s");
+
+	vec_deinit(&lines);
+	free(corpus);
+	return EXIT_SUCCESS;
+}
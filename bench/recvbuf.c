@@ -0,0 +1,95 @@
+// A microbenchmark for the receive buffer's line splitter. The corpus is
+// fed through FillRecvBufferWith in kernel sized reads, as if the server
+// were sending it over and over, and every line is taken out again with
+// NextRecvLine. Reports how many lines and megabytes per second that is.
+//
+// Usage: bench-recvbuf [corpus file] [seconds to run for]
+#include <sys/types.h>
+#include "bench.h"
+
+// How much each fake read hands over, about what a busy socket gives us.
+#define READ_SIZE 4096
+
+// Where the fake server is in the corpus.
+typedef struct
+{
+	const char *data;
+	size_t len;
+	size_t pos;
+	unsigned long bytes;
+} feeder_t;
+
+// Reads from the corpus the way read() reads from a socket, starting over
+// at the end so there's always more.
+static ssize_t FeedCorpus(void *data, void *buffer, size_t len)
+{
+	feeder_t *f = data;
+	if (len > READ_SIZE)
+		len = READ_SIZE;
+
+	size_t done = 0;
+	while (done < len)
+	{
+		size_t chunk = f->len - f->pos < len - done ? f->len - f->pos : len - done;
+		memcpy((char*)buffer + done, f->data + f->pos, chunk);
+		done += chunk;
+		f->pos = (f->pos + chunk) % f->len;
+	}
+
+	f->bytes += done;
+	return done;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : BENCH_CORPUS;
+	double seconds   = argc > 2 ? atof(argv[2]) : 2.0;
+
+	size_t len;
+	char *corpus = ReadFile(path, &len);
+	if (!corpus || !len)
+	{
+		fprintf(stderr, "Failed to read the corpus %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	recvbuf_t buf;
+	if (!InitializeRecvBuffer(&buf, RECVBUF_SIZE))
+	{
+		fprintf(stderr, "Failed to allocate the receive buffer\n");
+		return EXIT_FAILURE;
+	}
+
+	feeder_t feeder = { corpus, len, 0, 0 };
+	unsigned long lines = 0, checksum = 0;
+	double start = Now(), elapsed;
+	strview_t line;
+
+	do
+	{
+		for (int i = 0; i < 64; ++i)
+		{
+			if (FillRecvBufferWith(&buf, FeedCorpus, &feeder) == (size_t)-1)
+			{
+				fprintf(stderr, "The receive buffer failed to fill\n");
+				return EXIT_FAILURE;
+			}
+
+			while (NextRecvLine(&buf, &line))
+			{
+				checksum += line.len;
+				lines++;
+			}
+		}
+
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+
+	printf("recvbuf: %lu lines in %.3fs, %.0f lines/sec, %.1f MB/sec (checksum %lu)\n",
+	       lines, elapsed, lines / elapsed, feeder.bytes / elapsed / 1e6, checksum);
+	Report("recvbuf_lines_per_sec", lines / elapsed, "lines/s");
+
+	DestroyRecvBuffer(&buf);
+	free(corpus);
+	return EXIT_SUCCESS;
+}
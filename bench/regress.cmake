@@ -0,0 +1,143 @@
+# Runs the benchmarks and compares their results against the baseline,
+# see CMakeLists.txt for how it's called. Takes:
+#
+#   COMMANDS   the benchmarks to run, one command line each
+#   MODE       run, regress or baseline
+#   BASELINE   the baseline file
+#   TOLERANCE  how far (in percent) results may fall behind the baseline
+#   REPEAT     how many times to run each benchmark, the best run counts
+#
+# Every line of the baseline is `<name> <value> [tolerance]'. Results
+# ending in _ms are times, where less is better, everything else is a
+# rate where more is better. Lines starting with # are comments.
+
+# Read the baseline, if there is one.
+set(names)
+if (EXISTS "${BASELINE}")
+	file(STRINGS "${BASELINE}" lines)
+	foreach(line ${lines})
+		if (line MATCHES "^([a-z0-9_]+)[ \t]+([0-9.]+)([ \t]+([0-9.]+))?")
+			list(APPEND names ${CMAKE_MATCH_1})
+			set(baseline_${CMAKE_MATCH_1} ${CMAKE_MATCH_2})
+			set(tolerance_${CMAKE_MATCH_1} ${CMAKE_MATCH_4})
+		endif ()
+	endforeach(line)
+elseif (MODE STREQUAL "regress")
+	message(FATAL_ERROR "There's no baseline to compare against, record one with `make bench-baseline' first.")
+endif ()
+
+# CMake can't do floating point maths, so leave it to awk.
+find_program(AWK awk REQUIRED)
+
+if (NOT REPEAT)
+	set(REPEAT 1)
+endif (NOT REPEAT)
+
+# Run everything, picking the results out of what it prints. Other things
+# running on the machine only ever make a benchmark slower, so the best of
+# a few runs is the most repeatable number.
+set(results)
+set(failed 0)
+foreach(command ${COMMANDS})
+	separate_arguments(args UNIX_COMMAND "${command}")
+	foreach(run RANGE 1 ${REPEAT})
+		execute_process(COMMAND ${args} RESULT_VARIABLE status OUTPUT_VARIABLE output)
+		message("${output}")
+
+		if (NOT status EQUAL 0)
+			message(SEND_ERROR "${command} failed (${status})")
+			set(failed 1)
+		endif (NOT status EQUAL 0)
+
+		string(REGEX MATCHALL "result [a-z0-9_]+ [0-9.]+" found "${output}")
+		foreach(result ${found})
+			string(REGEX MATCH "result ([a-z0-9_]+) ([0-9.]+)" result "${result}")
+			set(name ${CMAKE_MATCH_1})
+			set(value ${CMAKE_MATCH_2})
+
+			if (NOT DEFINED result_${name})
+				list(APPEND results ${name})
+				set(result_${name} ${value})
+				continue()
+			endif (NOT DEFINED result_${name})
+
+			set(lower 0)
+			if (name MATCHES "_ms$")
+				set(lower 1)
+			endif (name MATCHES "_ms$")
+
+			execute_process(
+				COMMAND ${AWK} -v "a=${value}" -v "b=${result_${name}}" -v "lower=${lower}"
+					"BEGIN { exit (lower ? a < b : a > b) ? 0 : 1 }"
+				RESULT_VARIABLE worse
+			)
+			if (NOT worse)
+				set(result_${name} ${value})
+			endif (NOT worse)
+		endforeach(result)
+	endforeach(run)
+endforeach(command)
+
+if (MODE STREQUAL "baseline")
+	if (failed)
+		message(FATAL_ERROR "Not writing a baseline, some of the benchmarks failed.")
+	endif (failed)
+
+	set(text "# Benchmark results to compare against, see bench/CMakeLists.txt.\n")
+	string(APPEND text "# <name> <value> [tolerance in percent, if not the default]\n")
+	foreach(name ${results})
+		string(APPEND text "${name} ${result_${name}}")
+		if (tolerance_${name})
+			string(APPEND text " ${tolerance_${name}}")
+		endif (tolerance_${name})
+		string(APPEND text "\n")
+	endforeach(name)
+
+	file(WRITE "${BASELINE}" "${text}")
+	message("Wrote ${BASELINE}")
+	return()
+endif (MODE STREQUAL "baseline")
+
+if (NOT MODE STREQUAL "regress")
+	if (failed)
+		message(FATAL_ERROR "Some of the benchmarks failed.")
+	endif (failed)
+	return()
+endif (NOT MODE STREQUAL "regress")
+
+foreach(name ${names})
+	if (NOT DEFINED result_${name})
+		message(SEND_ERROR "${name}: no result, did the benchmark go away?")
+		set(failed 1)
+		continue()
+	endif (NOT DEFINED result_${name})
+
+	set(tolerance ${TOLERANCE})
+	if (tolerance_${name})
+		set(tolerance ${tolerance_${name}})
+	endif (tolerance_${name})
+
+	set(lower 0)
+	if (name MATCHES "_ms$")
+		set(lower 1)
+	endif (name MATCHES "_ms$")
+
+	execute_process(
+		COMMAND ${AWK} -v "value=${result_${name}}" -v "base=${baseline_${name}}" -v "tol=${tolerance}" -v "lower=${lower}"
+			"BEGIN { change = base > 0 ? (value - base) * 100 / base : 0; if (lower) change = -change;
+			         printf \"%+.1f%%\", change; exit (change < -tol) ? 1 : 0 }"
+		RESULT_VARIABLE worse
+		OUTPUT_VARIABLE change
+	)
+
+	if (worse)
+		message(SEND_ERROR "${name}: ${result_${name}} against ${baseline_${name}} (${change}, more than ${tolerance}% worse)")
+		set(failed 1)
+	else (worse)
+		message("${name}: ${result_${name}} against ${baseline_${name}} (${change})")
+	endif (worse)
+endforeach(name)
+
+if (failed)
+	message(FATAL_ERROR "Benchmarks regressed.")
+endif (failed)
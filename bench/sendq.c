@@ -0,0 +1,120 @@
+// A microbenchmark for the send queue. Bursts of lines from the corpus
+// are appended the way replies are and then flushed through a fake
+// writev() which takes everything, so we time the copying and coalescing
+// rather than the kernel. Reports lines per second and how many lines
+// shared each system call.
+//
+// Usage: bench-sendq [corpus file] [seconds to run for]
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "socket/sendq.h"
+#include "bench.h"
+
+// How many lines go out together, about what one batch of events queues.
+#define BURST 32
+
+// What the fake writev() was handed.
+typedef struct
+{
+	unsigned long calls;
+	unsigned long iovecs;
+	unsigned long bytes;
+} sink_t;
+
+// Takes everything it's given, the way writev() does when the kernel has room.
+static ssize_t Sink(void *data, const struct iovec *iov, int count)
+{
+	sink_t *sink = data;
+	size_t total = 0;
+	for (int i = 0; i < count; ++i)
+		total += iov[i].iov_len;
+
+	sink->calls++;
+	sink->iovecs += count;
+	sink->bytes += total;
+	return total;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : BENCH_CORPUS;
+	double seconds   = argc > 2 ? atof(argv[2]) : 2.0;
+
+	size_t len;
+	char *corpus = ReadFile(path, &len);
+	benchlines_t lines;
+	if (!corpus || !SplitLines(corpus, len, &lines))
+	{
+		fprintf(stderr, "Failed to read the corpus %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	// Put the \r\n back, the queue gets whole messages.
+	char *wire = malloc(len + lines.length * 2);
+	vec_t(strview_t) messages;
+	vec_init(&messages);
+	if (!wire)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0, pos = 0; i < lines.length; ++i)
+	{
+		strview_t msg = { wire + pos, lines.data[i].len + 2 };
+		memcpy(wire + pos, lines.data[i].ptr, lines.data[i].len);
+		memcpy(wire + pos + lines.data[i].len, "\r\n", 2);
+		pos += msg.len;
+		vec_push(&messages, msg);
+	}
+
+	pool_t pool;
+	sendq_t q;
+	if (!InitializePool(&pool, SENDQ_CHUNK_SIZE, POOL_CACHELINE, 16))
+	{
+		fprintf(stderr, "Failed to initialize the pool\n");
+		return EXIT_FAILURE;
+	}
+	InitializeSendQueue(&q, &pool);
+
+	sink_t sink = { 0, 0, 0 };
+	unsigned long appended = 0;
+	int next = 0;
+	double start = Now(), elapsed;
+
+	do
+	{
+		for (int i = 0; i < 1000; ++i)
+		{
+			for (int j = 0; j < BURST; ++j)
+			{
+				strview_t msg = messages.data[next];
+				next = (next + 1) % messages.length;
+				if (!AppendSendQueue(&q, msg.ptr, msg.len))
+				{
+					fprintf(stderr, "Out of memory\n");
+					return EXIT_FAILURE;
+				}
+			}
+
+			FlushSendQueueWith(&q, Sink, &sink);
+			appended += BURST;
+		}
+
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+
+	printf("sendq: %lu lines in %.3fs, %.0f lines/sec, %.1f MB/sec, %.1f lines per call, %.1f lines per iovec\n",
+	       appended, elapsed, appended / elapsed, sink.bytes / elapsed / 1e6,
+	       (double)appended / sink.calls, (double)appended / sink.iovecs);
+	Report("sendq_lines_per_sec", appended / elapsed, "lines/s");
+	Report("sendq_lines_per_iovec", (double)appended / sink.iovecs, "lines");
+
+	DestroySendQueue(&q);
+	DestroyPool(&pool);
+	vec_deinit(&messages);
+	vec_deinit(&lines);
+	free(wire);
+	free(corpus);
+	return EXIT_SUCCESS;
+}
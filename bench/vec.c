@@ -0,0 +1,105 @@
+// A microbenchmark for vec_t. Times pushing onto a growing vector,
+// removing from the middle of one (with vec_splice, which moves everything
+// after the gap down) and swapping elements, and reports how many of each
+// we get through per second.
+//
+// Usage: bench-vec [seconds to run each for]
+#include <stdint.h>
+#include "bench.h"
+
+// How many elements the push test grows each vector to.
+#define PUSH_COUNT 100000
+
+// How big the vector is that elements are removed from and swapped in,
+// about the size of a busy channel's nick list.
+#define WORKING_SET 1024
+
+// Pick the next index, a cheap xorshift so the clock isn't what we time.
+static inline uint32_t NextIndex(uint32_t *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return *seed % WORKING_SET;
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+	unsigned long checksum = 0;
+	double start, elapsed;
+
+	// Push, starting from an empty vector each time so the reallocs count.
+	unsigned long pushes = 0;
+	start = Now();
+	do
+	{
+		vec_t(int) v;
+		vec_init(&v);
+		for (int i = 0; i < PUSH_COUNT; ++i)
+		{
+			if (vec_push(&v, i))
+			{
+				fprintf(stderr, "Out of memory\n");
+				return EXIT_FAILURE;
+			}
+		}
+
+		checksum += v.data[v.length - 1];
+		pushes += v.length;
+		vec_deinit(&v);
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+
+	double pushrate = pushes / elapsed;
+
+	vec_t(int) v;
+	vec_init(&v);
+	for (int i = 0; i < WORKING_SET; ++i)
+		vec_push(&v, i);
+
+	// Remove from anywhere and push onto the end, the size stays the same.
+	unsigned long removes = 0;
+	uint32_t seed = 2463534242U;
+	start = Now();
+	do
+	{
+		for (int i = 0; i < 1000; ++i)
+		{
+			int idx = NextIndex(&seed);
+			int value = v.data[idx];
+			vec_splice(&v, idx, 1);
+			vec_push(&v, value);
+		}
+
+		removes += 1000;
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+
+	double removerate = removes / elapsed;
+
+	unsigned long swaps = 0;
+	start = Now();
+	do
+	{
+		for (int i = 0; i < 1000; ++i)
+			vec_swap(&v, NextIndex(&seed), NextIndex(&seed));
+
+		swaps += 1000;
+		elapsed = Now() - start;
+	} while (elapsed < seconds);
+
+	double swaprate = swaps / elapsed;
+
+	// Add it all up so the compiler can't throw any of it away.
+	for (int i = 0; i < v.length; ++i)
+		checksum += (unsigned long)v.data[i] * i;
+	vec_deinit(&v);
+
+	printf("vec: %.0f pushes/sec, %.0f removes/sec from %d elements, %.0f swaps/sec (checksum %lu)\n",
+	       pushrate, removerate, WORKING_SET, swaprate, checksum);
+	Report("vec_pushes_per_sec", pushrate, "pushes/s");
+	Report("vec_removes_per_sec", removerate, "removes/s");
+	Report("vec_swaps_per_sec", swaprate, "swaps/s");
+	return EXIT_SUCCESS;
+}
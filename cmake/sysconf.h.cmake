@@ -7,7 +7,9 @@
 #cmakedefine HAVE_BACKTRACE 1
 #cmakedefine HAVE_SETJMP_H 1
 #cmakedefine HAVE_SYS_EPOLL_H 1
+#cmakedefine HAVE_LINUX_IO_URING_H 1
 #cmakedefine HAVE_GETTIMEOFDAY 1
+#cmakedefine HAVE_CLOCK_GETTIME 1
 #cmakedefine HAVE_SETGRENT 1
 #cmakedefine HAVE_STRCASECMP 1
 #cmakedefine HAVE_STRICMP 1
@@ -25,6 +27,11 @@
 #cmakedefine HAVE_KQUEUE 1
 #cmakedefine HAVE_POLL 1
 #cmakedefine HAVE_SELECT 1
+#cmakedefine HAVE_OPENSSL 1
+#cmakedefine HAVE_SSL_OP_ENABLE_KTLS 1
+#cmakedefine HAVE_AVX2 1
+#cmakedefine HAVE_SSE2 1
+#cmakedefine HAVE_NEON 1
 #cmakedefine CLANG_CXXABI 1
 #cmakedefine HAS_CXXABI_H 1
 
@@ -40,6 +47,7 @@
 #define C_COMPILER_NAME      "@CMAKE_C_COMPILER_ID@"
 #define CXX_COMPILER_NAME    "@CMAKE_CXX_COMPILER_ID@"
 #define CMAKE_INSTALL_PREFIX "@CMAKE_INSTALL_PREFIX@"
+#define LOG_COMPILED_LEVEL   @LOG_COMPILED_LEVEL@
 
 #cmakedefine HAVE_UINT8_T 1
 #cmakedefine HAVE_U_INT8_T 1
@@ -58,3 +58,66 @@ function(GetGitRevision)
     set(GIT_REVISION_LONG ${VERSION_STR} PARENT_SCOPE)
     set(GIT_REVISION_SHORT ${VERSION_GIT} PARENT_SCOPE)
 endfunction(GetGitRevision)
+
+# Work out which vector instructions the case mapping kernels can use,
+# setting HAVE_AVX2, HAVE_SSE2 and HAVE_NEON. SIMD picks them: "auto" uses
+# whatever the compiler already targets (SSE2 on x86-64, NEON on 64 bit
+# ARM, AVX2 only with eg. -march=native in CMAKE_C_FLAGS), "avx2" builds
+# for AVX2 even if the compiler doesn't by default (the binary then needs
+# a CPU which has it), "none" sticks to plain C.
+macro(CheckSIMD)
+	include(CheckCSourceCompiles)
+
+	set(SIMD_AVX2_TEST "
+		#include <immintrin.h>
+		int main(void)
+		{
+			__m256i v = _mm256_set1_epi8(1);
+			return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, v)) == -1 ? 0 : 1;
+		}")
+	set(SIMD_SSE2_TEST "
+		#include <emmintrin.h>
+		int main(void)
+		{
+			__m128i v = _mm_set1_epi8(1);
+			return _mm_movemask_epi8(_mm_cmpeq_epi8(v, v)) == 0xFFFF ? 0 : 1;
+		}")
+	set(SIMD_NEON_TEST "
+		#include <arm_neon.h>
+		int main(void)
+		{
+			uint8x16_t v = vdupq_n_u8(1);
+			return vminvq_u8(vceqq_u8(v, v)) == 0xFF ? 0 : 1;
+		}")
+
+	# The checks cache their results under their own names, HAVE_* are
+	# plain variables set from whichever mode was picked. Older builds
+	# cached HAVE_* themselves, drop those so switching SIMD to "none"
+	# or "avx2" doesn't keep what "auto" found.
+	unset(HAVE_AVX2 CACHE)
+	unset(HAVE_SSE2 CACHE)
+	unset(HAVE_NEON CACHE)
+	set(HAVE_AVX2 0)
+	set(HAVE_SSE2 0)
+	set(HAVE_NEON 0)
+
+	if (SIMD STREQUAL "avx2")
+		set(CMAKE_REQUIRED_FLAGS -mavx2)
+		check_c_source_compiles("${SIMD_AVX2_TEST}" HAVE_MAVX2)
+		unset(CMAKE_REQUIRED_FLAGS)
+		if (NOT HAVE_MAVX2)
+			message(FATAL_ERROR "SIMD is avx2 but the compiler can't build AVX2 code")
+		endif (NOT HAVE_MAVX2)
+		add_compile_options(-mavx2)
+		set(HAVE_AVX2 1)
+	elseif (SIMD STREQUAL "auto")
+		check_c_source_compiles("${SIMD_AVX2_TEST}" SIMD_AUTO_AVX2)
+		check_c_source_compiles("${SIMD_SSE2_TEST}" SIMD_AUTO_SSE2)
+		check_c_source_compiles("${SIMD_NEON_TEST}" SIMD_AUTO_NEON)
+		set(HAVE_AVX2 ${SIMD_AUTO_AVX2})
+		set(HAVE_SSE2 ${SIMD_AUTO_SSE2})
+		set(HAVE_NEON ${SIMD_AUTO_NEON})
+	elseif (NOT SIMD STREQUAL "none")
+		message(FATAL_ERROR "SIMD must be auto, avx2 or none, not ${SIMD}")
+	endif (SIMD STREQUAL "avx2")
+endmacro(CheckSIMD)
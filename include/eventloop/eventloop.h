@@ -0,0 +1,95 @@
+#pragma once
+#include <stddef.h>
+#include "sysconf.h"
+#include "memory/arena.h"
+
+// Pick which interface the kernel gives us to wait on file descriptors.
+// io_uring is preferred on Linux, with epoll for kernels which won't give
+// us a ring. kqueue is used on the BSDs (and macOS) and plain poll() is
+// used everywhere else since it is part of POSIX.
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_EPOLL_H)
+# define EVENTLOOP_URING 1
+# define EVENTLOOP_EPOLL 1
+#elif defined(HAVE_SYS_EPOLL_H)
+# define EVENTLOOP_EPOLL 1
+#elif defined(HAVE_KQUEUE)
+# define EVENTLOOP_KQUEUE 1
+#else
+# define EVENTLOOP_POLL 1
+#endif
+
+// Flags describing what we want to know about a file descriptor and
+// what actually happened to it. EVENT_ERROR is only ever reported, you
+// will always be told about errors whether you asked or not.
+#define EVENT_READ  0x1 // There is data waiting to be read.
+#define EVENT_WRITE 0x2 // There is room in the kernel to write more data.
+#define EVENT_ERROR 0x4 // Something went wrong with the file descriptor.
+
+// The function called when something happens on a file descriptor.
+// `events' is a combination of the EVENT_* flags above and `data' is
+// whatever pointer was given to AddEventSource.
+typedef void (*EventHandler)(int fd, int events, void *data);
+
+// Forward declare the socket structure so we don't have to include socket.h
+struct socket_s;
+struct msghdr;
+
+// Forward declare our functions for use outside the file
+extern int InitializeEventLoop(void);
+extern int DestroyEventLoop(void);
+extern int AddEventSource(int fd, int events, EventHandler handler, void *data);
+extern int ModifyEventSource(int fd, int events);
+extern int RemoveEventSource(int fd);
+extern int ProcessEvents(int timeout);
+extern arena_t *GetEventArena(void);
+extern const char *GetEventLoopBackend(void);
+extern int64_t GetMonotonicTime(void);
+
+// io_uring can do the reading and writing on a descriptor itself instead
+// of only saying when it would work. The buffer (or message) handed over
+// has to stay put until the result comes back: the handler is called with
+// EVENT_READ once a receive finished and EVENT_WRITE once a send did, and
+// collects what it did with TakeEventResult. Other backends fail these
+// with ENOSYS, check EventLoopDoesIO first.
+extern int EventLoopDoesIO(void);
+extern int ReceiveOnEventSource(int fd, void *buffer, size_t len);
+extern int SendOnEventSource(int fd, const struct msghdr *msg);
+extern int TakeEventResult(int fd, int event, size_t *result);
+
+// Convenience functions to watch a socket_t and call its OnReadable,
+// OnWritable and OnError callbacks.
+extern int RegisterSocket(struct socket_s *sock, int events);
+extern int UpdateSocket(struct socket_s *sock, int events);
+extern int UnregisterSocket(struct socket_s *sock);
+
+// These are implemented by whichever backend (uring.c, epoll.c, kqueue.c
+// or poll.c) was selected above and are only meant to be called by eventloop.c
+extern int BackendInitialize(void);
+extern int BackendDestroy(void);
+extern int BackendAdd(int fd, int events);
+extern int BackendModify(int fd, int oldevents, int events);
+extern int BackendRemove(int fd, int events);
+extern int BackendWait(int timeout);
+extern const char *BackendName(void);
+
+// Called by the backend from inside BackendWait for every ready descriptor,
+// or by a handler to have a descriptor dispatched again in the same batch.
+extern void QueueEvent(int fd, int events);
+
+#ifdef EVENTLOOP_URING
+// Only uring.c can read and write for us, see EventLoopDoesIO.
+extern int BackendDoesIO(void);
+extern int BackendReceive(int fd, void *buffer, size_t len);
+extern int BackendSend(int fd, const struct msghdr *msg);
+extern int BackendResult(int fd, int event, size_t *result);
+
+// With io_uring, epoll.c implements these instead and uring.c calls them
+// whenever the kernel didn't give us a ring.
+extern int EpollInitialize(void);
+extern int EpollDestroy(void);
+extern int EpollAdd(int fd, int events);
+extern int EpollModify(int fd, int oldevents, int events);
+extern int EpollRemove(int fd, int events);
+extern int EpollWait(int timeout);
+extern const char *EpollName(void);
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+#include <pthread.h>
+#include <stdatomic.h>
+#include "thread/mpscqueue.h"
+
+// A shard is a thread running an event loop of its own, with its own
+// sockets, resolver cache and pools. Connections are spread over the
+// shards and stay on the one they were created on, so nothing a shard
+// owns is ever touched by another thread and none of it needs locks.
+// When another thread wants something done with a shard's connections
+// (eg, relaying a message from one network to another) it sends the
+// shard a message with SendToShard, which the shard runs from its loop.
+
+// The most shards we'll ever start.
+#define SHARD_MAX 64
+
+typedef struct shard_s shard_t;
+
+// A message sent to a shard, called from the shard's event loop.
+typedef void (*ShardCallback)(shard_t *shard, void *data);
+// Frees a message's data if the shard stops before running it.
+typedef void (*ShardRelease)(void *data);
+
+struct shard_s
+{
+		mpscqueue_t inbox;       // Messages other threads sent us.
+		atomic_int notified;     // Whether a wake up is already waiting in `wakepipe'.
+		int wakepipe[2];         // Written to when there's something in `inbox'.
+		int id;                  // Which shard this is, 0 to GetShardCount() - 1.
+		int running;             // Cleared to stop the loop (shard's thread only).
+		int status;              // 0 while starting, 1 once running, -1 if it failed to start.
+		pthread_t thread;
+};
+
+// Forward declare our functions for use outside the file
+extern int StartShards(int count);
+extern void StopShards(void);
+extern int GetShardCount(void);
+extern shard_t *GetShard(int idx);
+extern shard_t *GetCurrentShard(void);
+extern int SendToShard(shard_t *shard, ShardCallback callback, void *data, ShardRelease release);
+extern int SyncShards(void);
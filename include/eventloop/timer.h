@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+
+// Timers for the event loop. Every thread with an event loop has a
+// hierarchical timing wheel (Varghese and Lauck, the same layout the Linux
+// kernel used for years): 256 slots of one millisecond each and four more
+// wheels of 64 slots, each slot as long as the whole wheel below it.
+// Starting and stopping a timer is O(1) no matter how many there are and
+// ProcessEvents only ever looks at the timers which are due, so having
+// thousands of connections doesn't mean thousands of checks per wake up.
+//
+// Timers are meant to be embedded in whatever they time (eg, socket_t)
+// so the wheel never allocates anything. Deadlines are in the same
+// monotonic milliseconds GetMonotonicTime returns. Anything further away
+// than the wheels reach (~49 days) just waits at the top until it's close.
+
+typedef struct evtimer_s evtimer_t;
+
+// The function called once the timer is due. It's free to start or stop
+// any timer, including the one which fired.
+typedef void (*TimerCallback)(evtimer_t *timer, void *data);
+
+struct evtimer_s
+{
+		evtimer_t *next;        // The next timer in the same slot.
+		evtimer_t **pprev;      // Whatever points at us, NULL if we're not pending.
+		int slot;               // Which slot of the wheel we're in.
+		int64_t deadline;       // When (in monotonic milliseconds) we're due.
+		TimerCallback callback; // Called once we're due.
+		void *data;             // User-supplied pointer passed to the callback.
+};
+
+// Forward declare our functions for use outside the file
+extern void InitializeTimer(evtimer_t *timer, TimerCallback callback, void *data);
+extern void StartTimer(evtimer_t *timer, int64_t delay);
+extern void StartTimerAt(evtimer_t *timer, int64_t deadline);
+extern void StopTimer(evtimer_t *timer);
+extern int IsTimerPending(const evtimer_t *timer);
+
+// These are only meant to be called by eventloop.c
+extern void InitializeTimers(void);
+extern int GetTimerTimeout(void);
+extern int RunTimers(void);
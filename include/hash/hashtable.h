@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// An open addressing hash table of pointers. The table doesn't know what
+// the items are or what their keys look like: the caller hashes the key
+// and gives us a function to check whether an item matches it. The items
+// themselves hold the key (eg. a user holds its nick) so the table is
+// just an array of hashes and pointers which is very cache friendly.
+//
+// Collisions are resolved by looking at the next slot (linear probing)
+// and removal moves later items back into the gap instead of leaving
+// tombstones, so lookups never get slower as items come and go.
+
+// One slot in the table, an empty slot has a NULL item.
+typedef struct
+{
+		uint32_t hash;
+		void *item;
+} hashslot_t;
+
+typedef struct
+{
+		hashslot_t *slots;
+		uint32_t mask;   // The number of slots minus 1, it is always a power of 2.
+		uint32_t count;  // How many items are in the table.
+} hashtable_t;
+
+// Return true if `item' has the key `key'.
+typedef int (*HashMatch)(const void *item, const void *key);
+
+// Forward declare our functions for use outside the file
+extern int InitializeHashTable(hashtable_t *table, uint32_t expected);
+extern void DestroyHashTable(hashtable_t *table);
+extern void ClearHashTable(hashtable_t *table);
+extern void *FindHashItem(const hashtable_t *table, uint32_t hash, HashMatch match, const void *key);
+extern int InsertHashItem(hashtable_t *table, uint32_t hash, void *item);
+extern void *RemoveHashItem(hashtable_t *table, uint32_t hash, HashMatch match, const void *key);
+extern void *NextHashItem(const hashtable_t *table, uint32_t *iter);
+
+// Mix two pointers into a hash, for tables keyed by pairs of objects.
+static inline uint32_t HashPointers(const void *a, const void *b)
+{
+		uint64_t x = (uint64_t)(uintptr_t)a * 0x9E3779B97F4A7C15ULL ^ (uint64_t)(uintptr_t)b;
+		x ^= x >> 33;
+		x *= 0xFF51AFD7ED558CCDULL;
+		x ^= x >> 33;
+		return (uint32_t)x;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "socket/recvbuf.h" // for strview_t
+
+// IRC compares nicks and channel names without caring about case, but
+// what counts as "case" depends on the server. RFC 1459 came out of
+// Scandinavia where []\~ are the upper case versions of {}|^, so those
+// are equal too. Servers tell us which rules they use with the
+// CASEMAPPING token in RPL_ISUPPORT (005).
+//
+// Nicks and channel names are compared on every message, so folding,
+// comparing and hashing them is done a vector at a time where the build
+// has the instructions (SSE2, AVX2 or NEON, see CheckSIMD in CMake).
+typedef enum
+{
+		IRC_CASEMAP_RFC1459,        // A-Z and []\~ fold to a-z and {}|^ (the default).
+		IRC_CASEMAP_STRICT_RFC1459, // Like rfc1459 but ~ and ^ are different.
+		IRC_CASEMAP_ASCII,          // Only A-Z fold to a-z.
+		IRC_CASEMAPS
+} irccasemap_t;
+
+// Forward declare our functions for use outside the file
+extern const unsigned char *GetIRCCaseMap(irccasemap_t casemap);
+extern irccasemap_t ParseIRCCaseMap(strview_t name);
+extern void IRCFoldString(const unsigned char *map, char *dst, const char *str, size_t len);
+extern uint32_t IRCHashString(const unsigned char *map, const char *str, size_t len);
+extern int IRCStringEquals(const unsigned char *map, const char *a, size_t alen, const char *b, size_t blen);
@@ -0,0 +1,100 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "vector/vec.h"
+#include "hash/hashtable.h"
+#include "eventloop/timer.h"
+#include "socket/recvbuf.h" // for strview_t
+#include "irc/chansearch.h"
+
+// An append-only log of what was said in each channel of a network. Every
+// channel has a directory of segment files which are allocated up front
+// and mapped into memory, so logging a line is a memcpy instead of a
+// write() (or worse, an fprintf). The pages are handed to the kernel in
+// batches by a timer on the event loop which owns the log.
+//
+// Each record is a line of text: the time in milliseconds since the epoch,
+// a space and the line the server sent us, eg.
+//
+//   1791972000123 :nick!user@host PRIVMSG #chan :hello
+//
+// so the segments can still be read with grep. Unused space at the end of
+// a segment is zeroes, which never show up in an IRC line.
+//
+// Every CHANLOG_INDEX_STRIDE bytes (and at the start of every segment) the
+// time and position of the record is added to the channel's index, which
+// is also kept on disk. Looking something up by time is a binary search of
+// the index and then reading at most a stride of records, and reading the
+// log backwards (for !last and !seen) never has to start at the beginning.
+//
+// The words said in every segment are indexed as well (see chansearch.h)
+// so SearchChannelLog finds lines without reading the log at all.
+//
+// The log is written by the event loop it belongs to, but can be read
+// from any thread (eg, by a worker running a command) while that goes on.
+
+// How big each segment file is.
+#define CHANLOG_SEGMENT_SIZE (8 << 20)
+
+// How many bytes of records there are (at most) between index entries.
+#define CHANLOG_INDEX_STRIDE 4096
+
+// How long (in milliseconds) new records wait before they're flushed.
+#define CHANLOG_FLUSH_INTERVAL 1000
+
+// The most words SearchChannelLog looks for at once.
+#define CHANLOG_QUERY_MAX 8
+
+// One entry of a channel's index, the same on disk as in memory.
+typedef struct
+{
+		int64_t time;     // When the record was logged.
+		uint32_t segment; // Which segment it's in.
+		uint32_t offset;  // Where in the segment it starts.
+} chanlogindex_t;
+
+// One channel's log. Everything in here belongs to the event loop which
+// writes the log, apart from what's noted as being guarded by the lock.
+typedef struct
+{
+		char *name;           // The channel, as we first saw it.
+		size_t namelen;
+		uint32_t hash;        // The case mapped hash of the name.
+		char *dir;            // The directory with the channel's files.
+		int indexfd;          // The index file, opened for appending.
+		vec_t(chanlogindex_t) index; // Guarded by the lock.
+		int flushed;          // How many entries of `index' are on disk.
+		uint32_t segment;     // The segment we're writing, guarded by the lock.
+		char *map;            // The segment we're writing.
+		atomic_size_t length; // How much of the segment is written.
+		size_t synced;        // How much of it was flushed.
+		size_t indexed;       // Where the last index entry points in the segment.
+		int dirty;            // Whether the channel is waiting to be flushed.
+		chansearch_t *search; // The index of `segment', guarded by the lock.
+} chanlogchannel_t;
+
+typedef struct
+{
+		char *dir;             // Every channel has a directory in here.
+		const unsigned char *map; // How channel names are compared.
+		hashtable_t channels;  // chanlogchannel_t's by name, guarded by the lock.
+		pthread_rwlock_t lock; // Held by readers while they look things up.
+		vec_t(chanlogchannel_t*) dirty; // The channels waiting to be flushed.
+		evtimer_t timer;       // Due when it's time to flush them.
+} chanlog_t;
+
+// Called for every record read from the log, with the line without the \n.
+// Return 0 to stop reading.
+typedef int (*ChanLogCallback)(int64_t time, strview_t line, void *data);
+
+// Forward declare our functions for use outside the file
+extern int InitializeChannelLog(chanlog_t *log, const char *dir, const char *network);
+extern void CloseChannelLog(chanlog_t *log);
+extern void DestroyChannelLog(chanlog_t *log);
+extern int AppendChannelLog(chanlog_t *log, strview_t channel, strview_t line);
+extern void FlushChannelLog(chanlog_t *log);
+extern int ReadChannelLog(chanlog_t *log, strview_t channel, int64_t since, ChanLogCallback callback, void *data);
+extern int ReadChannelLogBackwards(chanlog_t *log, strview_t channel, ChanLogCallback callback, void *data);
+extern int SearchChannelLog(chanlog_t *log, strview_t channel, strview_t query, ChanLogCallback callback, void *data);
@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "vector/vec.h"
+#include "hash/hashtable.h"
+#include "memory/arena.h"
+#include "socket/recvbuf.h" // for strview_t
+
+// An inverted index of the words said in one segment of a channel log:
+// for every word, the offsets of the records it's in. Offsets only ever
+// grow so each list is stored as the differences between them, written
+// as varints (7 bits a byte), which makes most postings a single byte.
+//
+// The index of the segment being written lives in memory and is updated
+// as records are appended. The lists are chains of blocks which never
+// move, so a worker can walk them while the event loop adds to them: the
+// lock is only taken to look a word up (or add a new one), never while
+// reading a list. Once a segment is full its index is written next to it
+// (as NNNNNNNN.idx) with the words sorted, and searching it is a binary
+// search of the mapped file.
+//
+// Words are runs of letters and digits (any byte above 0x7F counts as a
+// letter so UTF-8 text works), ASCII is folded to lower case and only the
+// first CHANSEARCH_TOKEN_MAX bytes of a word count.
+
+// The longest a word in the index can be.
+#define CHANSEARCH_TOKEN_MAX 24
+
+// Words shorter than this aren't worth indexing.
+#define CHANSEARCH_TOKEN_MIN 2
+
+// How many bytes of postings each block of a list holds.
+#define CHANSEARCH_BLOCK_SIZE 48
+
+typedef struct chansearchblock_s
+{
+		struct chansearchblock_s *next;
+		unsigned char data[CHANSEARCH_BLOCK_SIZE];
+} chansearchblock_t;
+
+// One word and where it was said.
+typedef struct
+{
+		char token[CHANSEARCH_TOKEN_MAX]; // Padded with zeroes.
+		size_t len;
+		uint32_t hash;
+		uint32_t count;           // How many postings there are.
+		uint32_t last;            // The last offset added.
+		chansearchblock_t *head;  // The first block of the list.
+		chansearchblock_t *tail;  // The block being written.
+		atomic_size_t bytes;      // How much of the list readers may read.
+} chansearchterm_t;
+
+// The index of a segment which is still being written.
+typedef struct
+{
+		atomic_int refs;        // Released by whoever is done with it last.
+		pthread_rwlock_t lock;  // Guards `terms' against the writer adding to it.
+		hashtable_t terms;      // chansearchterm_t's by word.
+		arena_t arena;          // Where the terms and blocks come from.
+} chansearch_t;
+
+// The index of a full segment, read from its file.
+typedef struct
+{
+		const char *map;
+		size_t size;
+		uint32_t nterms;
+		const struct chansearchentry_s *terms;
+} chansearchfile_t;
+
+// The offsets of the records a word is in, in the order they were logged.
+typedef vec_t(uint32_t) chansearchpostings_t;
+
+// Forward declare our functions for use outside the file
+extern chansearch_t *CreateSearchIndex(void);
+extern chansearch_t *AcquireSearchIndex(chansearch_t *search);
+extern void ReleaseSearchIndex(chansearch_t *search);
+extern int AddSearchRecord(chansearch_t *search, uint32_t offset, strview_t line);
+extern int GetSearchPostings(chansearch_t *search, const char *token, size_t len, chansearchpostings_t *out);
+extern int WriteSearchIndex(chansearch_t *search, const char *path);
+extern int OpenSearchFile(chansearchfile_t *file, const char *path);
+extern void CloseSearchFile(chansearchfile_t *file);
+extern int GetSearchFilePostings(const chansearchfile_t *file, const char *token, size_t len, chansearchpostings_t *out);
+extern int NextSearchToken(strview_t *text, char *token, size_t *len);
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "vector/vec.h"
+#include "memory/pool.h"
+#include "hash/hashtable.h"
+#include "irc/casemap.h"
+
+// A set of wildcard masks (eg. *!*@*.example.com) which a nick!user@host
+// is matched against all at once, for ban, ignore and access lists. `*'
+// matches any number of bytes and `?' exactly one, everything else is
+// compared under the set's case map.
+//
+// Testing every mask in turn doesn't scale past a few, so the masks are
+// sorted by the literal text they have to match:
+//
+//   - Masks without wildcards are looked up in a hash table.
+//   - Masks ending in literal text (*!*@host.example.com) go in a trie of
+//     their endings, read backwards. Walking the end of the hostmask down
+//     the trie once finds every mask whose ending it has.
+//   - Masks starting with literal text (nick!*@*) go in a trie of their
+//     beginnings, read forwards. A mask with both goes in whichever trie
+//     its literal is longer for, that's the more selective one.
+//   - The rest (*foo* and the like) are matched one by one, but only once
+//     the longest literal in them turns up somewhere in the hostmask.
+//
+// Only the masks found in the tries are matched in full, so the cost of a
+// lookup depends on how many masks look like the hostmask rather than how
+// many there are. The trie edges live in a hash table keyed by the node
+// and the byte, so adding or removing a mask only touches its own path.
+
+typedef struct ircmasknode_s ircmasknode_t;
+
+// A mask in the set.
+typedef struct
+{
+		void *data;           // What the mask was added with, handed back on a match.
+		ircmasknode_t *node;  // Where it's kept in a trie, NULL otherwise.
+		uint32_t hash;        // The hash of the mask, for masks without wildcards.
+		uint16_t literal;     // Where the longest literal starts, for the rest,
+		uint16_t literallen;  // and how long it is.
+		size_t len;
+		char mask[];          // The mask, folded through the case map.
+} ircmask_t;
+
+typedef vec_t(ircmask_t*) ircmasklist_t;
+
+// Where a trie walk has got to: every mask kept here has the literal text
+// on the path from the root.
+struct ircmasknode_s
+{
+		ircmasknode_t *parent;
+		unsigned char byte;    // The (folded) byte on the edge from the parent.
+		int children;          // How many edges lead on from here.
+		ircmasklist_t masks;
+};
+
+typedef struct
+{
+		const unsigned char *map;  // How bytes are compared.
+		hashtable_t exact;         // Masks without wildcards.
+		hashtable_t edges;         // The edges of both tries.
+		ircmasknode_t suffixes;    // The root of the trie of endings.
+		ircmasknode_t prefixes;    // The root of the trie of beginnings.
+		ircmasklist_t others;      // Masks with wildcards at both ends.
+		pool_t nodepool;
+		uint32_t count;            // How many masks there are.
+} ircmaskset_t;
+
+// Forward declare our functions for use outside the file
+extern int InitializeIRCMaskSet(ircmaskset_t *set, const unsigned char *map);
+extern void DestroyIRCMaskSet(ircmaskset_t *set);
+extern int AddIRCMask(ircmaskset_t *set, strview_t mask, void *data);
+extern int RemoveIRCMask(ircmaskset_t *set, strview_t mask);
+extern ircmask_t *MatchIRCMaskSet(const ircmaskset_t *set, strview_t hostmask);
+extern int IRCMaskMatches(const unsigned char *map, strview_t mask, strview_t str);
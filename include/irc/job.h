@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "thread/workers.h"
+#include "eventloop/shard.h"
+#include "socket/socket.h"
+#include "irc/parser.h"
+
+// Hands IRC messages to the worker pool and sends the replies back to the
+// connection the message came in on. The message (and the line it points
+// into) is copied so the event loop can carry on reading into its buffer.
+//
+// The handler runs on a worker thread so it must not touch the socket or
+// anything else belonging to the event loop, all it gets is the message
+// and a way to reply to it. If the connection went away in the meantime
+// the reply is quietly dropped.
+
+typedef struct ircjob_s ircjob_t;
+
+// Called on a worker thread with the message to handle.
+typedef void (*IRCJobHandler)(const ircjob_t *job);
+
+struct ircjob_s
+{
+		workjob_t work;        // Must be first, the workers only know about this.
+		IRCJobHandler handler; // What to do with the message.
+		shard_t *shard;        // The event loop the connection lives on.
+		uint64_t sockid;       // The connection the message came from.
+		void *owner;           // The socket's `data' (eg, the network it belongs to).
+		void *data;            // Whatever was given to SubmitIRCMessage.
+		ircmsg_t msg;          // The parsed message, pointing into `line'.
+		size_t len;            // How long the line is.
+		char line[];           // Our copy of the line.
+};
+
+// Forward declare our functions for use outside the file
+extern int SubmitIRCMessage(socket_t *sock, strview_t line, const ircmsg_t *msg, IRCJobHandler handler, void *data);
+extern int ReplyToIRCJob(const ircjob_t *job, floodlane_t lane, const void *message, size_t len);
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "socket/recvbuf.h" // for strview_t
+
+// RFC 1459 allows a command to have at most 15 parameters.
+#define IRC_MAX_PARAMS 15
+
+// A piece of an IRC line, stored as where it starts in the line and how
+// long it is. Lines are never longer than 512 bytes plus 8191 bytes of
+// tags so 16 bits is plenty and keeps the message small.
+typedef struct
+{
+		uint16_t off;
+		uint16_t len;
+} ircspan_t;
+
+// A parsed IRC message. Nothing is copied, every piece points into the
+// line which was parsed, so the message is only valid as long as the line
+// is (eg, until the next ReceiveSocket for lines from ReadSocketLine).
+//
+//   @tags :nick!user@host COMMAND param param :trailing param
+typedef struct
+{
+		const char *line;    // The line all the spans below point into.
+		ircspan_t tags;      // The IRCv3 message tags without the '@'.
+		ircspan_t prefix;    // Where the message came from without the ':'.
+		ircspan_t command;   // The command (eg, PRIVMSG) or numeric (eg, 001).
+		int numeric;         // The numeric as a number, or 0 if it's not a numeric.
+		int nparams;         // How many parameters there are.
+		ircspan_t params[IRC_MAX_PARAMS]; // The parameters, the trailing one without its ':'.
+} ircmsg_t;
+
+// Forward declare our functions for use outside the file
+extern int ParseIRCMessage(strview_t line, ircmsg_t *msg);
+extern int IRCSpanEquals(const ircmsg_t *msg, ircspan_t span, const char *str);
+
+// Turn one of the message's spans back into a pointer and a length.
+static inline strview_t IRCSpan(const ircmsg_t *msg, ircspan_t span)
+{
+		strview_t view = { msg->line + span.off, span.len };
+		return view;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include "vector/vec.h"
+#include "eventloop/timer.h"
+#include "socket/socket.h"
+#include "irc/state.h"
+
+// Brings a connection back after we lost it. The socket is kept (along
+// with the addresses it last resolved to, see CloseSocket) and connected
+// again after a delay which doubles with every failure in a row. The delay
+// is jittered so a netsplit doesn't have every bot of a fleet knocking on
+// the same server at the same moment. Once the server has let us back in
+// we rejoin the channels we were in, packing as many into each JOIN as
+// fit on a line: rejoining 40 channels costs a couple of lines of flood
+// penalty instead of 40.
+
+// How long (in milliseconds) we wait before reconnecting the first time.
+#define RECONNECT_MIN_DELAY 2000
+
+// The most (in milliseconds) we ever wait between two attempts.
+#define RECONNECT_MAX_DELAY 300000
+
+// How long (in milliseconds) a connection needs to have been up before we
+// count it as working and start over with the shortest delay. A server
+// which lets us in only to drop us straight away keeps us backing off.
+#define RECONNECT_STABLE_TIME 60000
+
+// How long a line to the server may be, including the \r\n.
+#define IRC_LINE_MAX 512
+
+typedef struct
+{
+		socket_t *sock;        // The connection we bring back.
+		evtimer_t timer;       // Due when it's time for the next attempt.
+		int failures;          // How many times in a row we lost the connection.
+		uint32_t seed;         // For the jitter.
+		int64_t registered;    // When the server last let us in, -1 if it hasn't since.
+		vec_t(char*) channels; // What to join once we're back.
+} ircreconnect_t;
+
+// Forward declare our functions for use outside the file
+extern void InitializeReconnect(ircreconnect_t *r, socket_t *sock);
+extern void DestroyReconnect(ircreconnect_t *r);
+extern int AddReconnectChannel(ircreconnect_t *r, const char *name);
+extern int64_t ScheduleReconnect(ircreconnect_t *r, const ircstate_t *st);
+extern int FinishReconnect(ircreconnect_t *r);
+extern int QueueJoinLines(socket_t *sock, char *const *channels, int count);
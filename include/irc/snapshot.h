@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <pthread.h>
+#include "eventloop/timer.h"
+#include "irc/state.h"
+#include "irc/reconnect.h"
+
+// Keeps a copy of a network's state (which channels we're in, who else is
+// in them and with which modes) on disk so a restarted bot starts out
+// knowing it instead of with empty tables and only the channels it was
+// told about on the command line.
+//
+// Every SNAPSHOT_INTERVAL the event loop which owns the state checks
+// whether anything changed since the last snapshot. If it did, the tables
+// are packed into one buffer there and then (a few hundred microseconds
+// for thousands of users, without touching the disk) and a worker writes
+// it out next to the old file and renames it over it, so the file is
+// always either the old snapshot or the new one.
+//
+// The file is a header followed by fixed-size entries for the users,
+// channels and memberships and then the names they point at. At startup
+// it is mapped and walked in place. The restored channels are marked as
+// stale: once we're back in one, what the server tells us replaces them.
+// If we can't get back in, they're forgotten.
+
+// How long (in milliseconds) between checks for a new snapshot.
+#define SNAPSHOT_INTERVAL 60000
+
+typedef struct
+{
+		char *path;          // The snapshot file.
+		ircstate_t *state;   // What we take snapshots of.
+		evtimer_t timer;     // Due when it's time to check again.
+		uint64_t changes;    // The state's `changes' at the last snapshot.
+		uint64_t taken;      // How many snapshots were taken.
+		pthread_mutex_t lock; // Held while a snapshot is written.
+		uint64_t written;    // Which of them is on disk, guarded by the lock.
+} ircsnapshot_t;
+
+// Forward declare our functions for use outside the file
+extern int InitializeSnapshot(ircsnapshot_t *snap, const char *dir, const char *network, ircstate_t *st);
+extern int LoadSnapshot(ircsnapshot_t *snap, ircreconnect_t *r);
+extern int SaveSnapshot(ircsnapshot_t *snap, int wait);
+extern void CloseSnapshot(ircsnapshot_t *snap);
+extern void DestroySnapshot(ircsnapshot_t *snap);
@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "vector/vec.h"
+#include "memory/pool.h"
+#include "hash/hashtable.h"
+#include "irc/casemap.h"
+#include "irc/parser.h"
+
+// A user's status in a channel, these are the modes shown as prefixes in
+// front of nicks in NAMES replies (eg. @nick for an operator).
+#define IRC_MEMBER_VOICE  0x01 // +v, shown as +
+#define IRC_MEMBER_HALFOP 0x02 // +h, shown as %
+#define IRC_MEMBER_OP     0x04 // +o, shown as @
+#define IRC_MEMBER_ADMIN  0x08 // +a, shown as &
+#define IRC_MEMBER_OWNER  0x10 // +q, shown as ~
+
+typedef struct ircmember_s ircmember_t;
+
+// Someone we share at least one channel with. This is the only copy of
+// their nick, channel member lists point at the user instead of keeping
+// a copy of their own so a NICK change only has to update it here.
+typedef struct
+{
+		char *nick;      // The nick, spelled the way the user last used it.
+		size_t nicklen;  // How long the nick is.
+		uint32_t hash;   // The case mapped hash of the nick.
+		vec_sbo_t(ircmember_t*, 4) channels; // The channels they're in, most users are in only a few.
+} ircuser_t;
+
+// A channel we're in.
+typedef struct
+{
+		char *name;      // The channel name, spelled like the server first sent it.
+		size_t namelen;  // How long the name is.
+		uint32_t hash;   // The case mapped hash of the name.
+		vec_t(ircmember_t*) members; // Everyone in the channel, including us.
+		int stale;       // Restored from a snapshot, we haven't joined it since.
+} ircchannel_t;
+
+// A user being in a channel. It knows where it is in both the user's and
+// the channel's lists so it can be taken out of them without searching.
+struct ircmember_s
+{
+		ircuser_t *user;
+		ircchannel_t *channel;
+		int modes;     // IRC_MEMBER_* flags.
+		int useridx;   // Where we are in user->channels.
+		int chanidx;   // Where we are in channel->members.
+};
+
+// Everything we know about the network we're connected to.
+typedef struct
+{
+		hashtable_t users;      // ircuser_t's by nick.
+		hashtable_t channels;   // ircchannel_t's by name.
+		hashtable_t members;    // ircmember_t's by their user and channel.
+		pool_t userpool;
+		pool_t channelpool;
+		pool_t memberpool;
+		irccasemap_t casemap;   // How the server compares names.
+		const unsigned char *map; // The case map table for `casemap'.
+		ircuser_t *self;        // Us, once the server has told us our nick.
+		uint64_t changes;       // Bumped whenever who is where changes.
+} ircstate_t;
+
+// Forward declare our functions for use outside the file
+extern int InitializeIRCState(ircstate_t *st);
+extern void DestroyIRCState(ircstate_t *st);
+extern void ClearIRCState(ircstate_t *st);
+extern int SetIRCCaseMap(ircstate_t *st, irccasemap_t casemap);
+extern ircuser_t *FindIRCUser(const ircstate_t *st, strview_t nick);
+extern ircchannel_t *FindIRCChannel(const ircstate_t *st, strview_t name);
+extern ircmember_t *FindIRCMember(const ircstate_t *st, const ircuser_t *user, const ircchannel_t *channel);
+extern ircmember_t *JoinIRCChannel(ircstate_t *st, strview_t nick, strview_t name);
+extern int PartIRCChannel(ircstate_t *st, strview_t nick, strview_t name);
+extern int QuitIRCUser(ircstate_t *st, strview_t nick);
+extern int RenameIRCUser(ircstate_t *st, strview_t oldnick, strview_t newnick);
+extern void ForgetIRCChannel(ircstate_t *st, ircchannel_t *channel);
+extern void UpdateIRCState(ircstate_t *st, const ircmsg_t *msg);
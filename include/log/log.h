@@ -0,0 +1,71 @@
+#pragma once
+#include <stddef.h>
+#include <stdatomic.h>
+#include "sysconf.h"
+
+// Logging which never makes the caller wait on stderr. Every thread that
+// logs gets a ring of its own which only it pushes to and only the writer
+// thread pops from, so logging is formatting the message into the ring
+// and a couple of atomic loads and stores, no locks and no system calls.
+// The writer drains every ring in the background and writes the lot out
+// in one go. A ring that fills up (stderr is a pipe nobody reads, say)
+// drops what doesn't fit instead of blocking, and the writer says how
+// much was lost.
+//
+// Messages below LOG_COMPILED_LEVEL aren't compiled in at all, the ones
+// below the runtime level (SetLogLevel) are thrown away before their
+// arguments are even formatted. A call site that logs more than LOG_BURST
+// messages in a second is quiet for the rest of that second, the next
+// message it logs afterwards says how many were suppressed. That keeps
+// a connect storm from flooding the log with thousands of copies of the
+// same failure.
+//
+// Every line goes out as `key=value' pairs, eg:
+//
+//   time=2026-10-14T09:30:01.123456Z level=error thread=shard0 at=socket.c:395 msg="Connection to ..."
+//
+// Until StartLogging (and after StopLogging) messages are written to
+// stderr straight away instead.
+
+typedef enum
+{
+		LOGLEVEL_DEBUG,
+		LOGLEVEL_INFO,
+		LOGLEVEL_WARNING,
+		LOGLEVEL_ERROR,
+		LOGLEVELS
+} loglevel_t;
+
+// The least important messages compiled in, set with -DLOG_LEVEL=...
+#ifndef LOG_COMPILED_LEVEL
+# define LOG_COMPILED_LEVEL LOGLEVEL_DEBUG
+#endif
+
+// How many messages each thread can have waiting for the writer.
+#define LOG_RING_SIZE 1024
+// How long a message can be, anything longer is cut short.
+#define LOG_MESSAGE_MAX 256
+// How many messages a call site may log each second.
+#define LOG_BURST 10
+
+// The least important messages logged, see SetLogLevel.
+extern _Atomic int loglevel;
+
+#define Log(level, ...) \
+		do { \
+				if ((level) >= LOG_COMPILED_LEVEL && (level) >= atomic_load_explicit(&loglevel, memory_order_relaxed)) \
+						WriteLog((level), __FILE__, __LINE__, __VA_ARGS__); \
+		} while (0)
+
+#define LogDebug(...)   Log(LOGLEVEL_DEBUG, __VA_ARGS__)
+#define LogInfo(...)    Log(LOGLEVEL_INFO, __VA_ARGS__)
+#define LogWarning(...) Log(LOGLEVEL_WARNING, __VA_ARGS__)
+#define LogError(...)   Log(LOGLEVEL_ERROR, __VA_ARGS__)
+
+// Forward declare our functions for use outside the file
+extern int StartLogging(void);
+extern void StopLogging(void);
+extern void SetLogLevel(loglevel_t level);
+extern int ParseLogLevel(const char *name);
+extern void SetLogThreadName(const char *name);
+extern void WriteLog(loglevel_t level, const char *file, int line, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
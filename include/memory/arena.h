@@ -0,0 +1,61 @@
+#pragma once
+#include <stddef.h>
+#include "vector/vec.h"
+
+// An arena hands out memory by bumping a pointer through big blocks and
+// frees all of it at once with ResetArena. This is perfect for data that
+// only lives while we handle one line or one batch of events: there's no
+// free() to forget and allocating is a few additions instead of a trip
+// through malloc. The blocks are kept between resets so a warmed up arena
+// doesn't allocate at all.
+//
+// Arenas aren't thread safe, only use one from the thread that owns it.
+
+// How big each block is unless the arena is told otherwise.
+#define ARENA_BLOCK_SIZE 16384
+
+typedef struct arenablock_s
+{
+		struct arenablock_s *next;
+		size_t size;  // How many bytes `data' holds.
+		size_t used;  // How many of them are handed out.
+		_Alignas(max_align_t) char data[];
+} arenablock_t;
+
+typedef struct
+{
+		arenablock_t *first;   // The first block, the others follow it.
+		arenablock_t *current; // The block we're allocating out of.
+		size_t blocksize;      // How big new blocks are.
+		void *last;            // The most recent allocation, ArenaRealloc can grow it in place.
+} arena_t;
+
+// Where an arena was up to, see SaveArena.
+typedef struct
+{
+		arenablock_t *block;
+		size_t used;
+} arenamark_t;
+
+// Forward declare our functions for use outside the file
+extern void InitializeArena(arena_t *arena, size_t blocksize);
+extern void DestroyArena(arena_t *arena);
+extern void ResetArena(arena_t *arena);
+extern void *ArenaAlloc(arena_t *arena, size_t size);
+extern void *ArenaAllocAligned(arena_t *arena, size_t size, size_t align);
+extern void *ArenaRealloc(arena_t *arena, void *ptr, size_t oldsize, size_t newsize);
+extern char *ArenaStrndup(arena_t *arena, const char *str, size_t len);
+extern arenamark_t SaveArena(const arena_t *arena);
+extern void RestoreArena(arena_t *arena, arenamark_t mark);
+extern int vec_arena_expand_(char **data, int *length, int *capacity, int memsz, arena_t *arena, int n);
+
+// vec_t's which take their memory from an arena. Use these instead of
+// vec_push and vec_reserve, every other vec_ macro which doesn't allocate
+// works as usual. Never vec_deinit or vec_compact them, the memory goes
+// away when the arena is reset.
+#define vec_arena_push(v, arena, val)\
+  ( vec_arena_expand_(vec_unpack_(v), arena, (v)->length + 1) ? -1 :\
+    ((v)->data[(v)->length++] = (val), 0) )
+
+#define vec_arena_reserve(v, arena, n)\
+  vec_arena_expand_(vec_unpack_(v), arena, n)
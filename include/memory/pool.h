@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h>
+
+// A pool hands out fixed-size objects carved out of big blocks of memory
+// (slabs) instead of asking malloc for each one. Freed objects go onto a
+// list and are handed out again before any new memory is allocated, so
+// once a program has warmed up it stops allocating altogether and the
+// heap can't get fragmented by thousands of connections coming and going.
+// The flip side is that slabs are only given back by DestroyPool, a pool
+// stays as big as it ever had to be.
+//
+// Pools aren't thread safe, only use one from the thread that owns it.
+
+// The size of a cache line on pretty much every CPU we run on. Objects
+// which are aligned to it never share a cache line with their neighbours.
+#define POOL_CACHELINE 64
+
+// How many objects each slab holds unless the pool is told otherwise.
+#define POOL_SLAB_OBJECTS 64
+
+typedef struct
+{
+		size_t objsize;  // The size of each object, rounded up to the alignment.
+		size_t align;    // What every object is aligned to.
+		size_t perslab;  // How many objects each slab holds.
+		size_t header;   // Bytes at the start of each slab before the first object.
+		void *freelist;  // Objects which are free to hand out, linked through their first bytes.
+		void *slabs;     // Every slab we've allocated, linked through their headers.
+		size_t inuse;    // How many objects are handed out right now.
+		size_t total;    // How many objects all the slabs hold.
+} pool_t;
+
+// Forward declare our functions for use outside the file
+extern int InitializePool(pool_t *pool, size_t objsize, size_t align, size_t perslab);
+extern void DestroyPool(pool_t *pool);
+extern int ReservePool(pool_t *pool, size_t count);
+extern void *PoolAlloc(pool_t *pool);
+extern void *PoolCalloc(pool_t *pool);
+extern void PoolFree(pool_t *pool, void *ptr);
@@ -0,0 +1,112 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Counters for what the bot is doing, cheap enough to always be on. Every
+// event loop, worker and socket has a set of its own which only the thread
+// it belongs to ever writes, so counting is a plain load and store (no
+// locked instructions, no cache lines bouncing between cores). The sets
+// are only added up when someone reads them, see FormatMetrics.
+//
+// Latencies go into histograms in the style of HdrHistogram: every power
+// of two is split into METRICS_SUB_BUCKETS linear buckets, so recording a
+// value is a couple of shifts and any quantile read back is within 1/16th
+// (6.25%) of the real one, from a microsecond up to days.
+//
+// StartMetricsServer serves all of it in the Prometheus text format on a
+// Unix socket, either raw (eg, `socat - UNIX-CONNECT:path') or over HTTP
+// (eg, `curl --unix-socket path http://localhost/metrics').
+
+// How many linear buckets each power of two is split into.
+#define METRICS_SUB_BUCKETS 16
+// Values below this are counted exactly.
+#define METRICS_EXACT (METRICS_SUB_BUCKETS * 2)
+// The biggest power of two we keep apart, anything bigger lands in the last bucket.
+#define METRICS_MAX_POWER 40
+#define METRICS_BUCKETS (METRICS_EXACT + (METRICS_MAX_POWER - 5) * METRICS_SUB_BUCKETS)
+
+// What a set of metrics belongs to.
+typedef enum
+{
+		METRICS_LOOP,   // An event loop (shard) thread.
+		METRICS_WORKER, // A worker thread.
+		METRICS_SOCKET, // A connection.
+		METRICS_KINDS
+} metricskind_t;
+
+typedef enum
+{
+		// Event loops.
+		METRIC_WAKEUPS,      // Times the loop woke up from waiting for events.
+		METRIC_EVENTS,       // Events (and timers) it handled.
+		METRIC_SYSCALLS,     // Waits, reads and writes it made.
+		METRIC_JOBS_DROPPED, // Commands the workers had no room for.
+
+		// Workers.
+		METRIC_JOBS,         // Commands they ran.
+
+		// Sockets.
+		METRIC_BYTES_IN,     // Bytes received.
+		METRIC_BYTES_OUT,    // Bytes sent.
+		METRIC_LINES_IN,     // Lines received.
+		METRIC_LINES_OUT,    // Messages queued to be sent.
+		METRIC_READS,        // Times we read from the socket.
+		METRIC_WRITES,       // Times we wrote to it.
+		METRIC_ERRORS,       // Reads and writes which failed.
+		METRIC_FLOOD_STALL,  // Milliseconds messages were held back by the flood limits.
+		METRIC_SENDQ_BYTES,  // Bytes waiting for the kernel to take them (a gauge).
+		METRIC_FLOOD_QUEUED, // Messages waiting for the flood limits (a gauge).
+		METRICS_COUNT
+} metric_t;
+
+typedef enum
+{
+		HISTOGRAM_LOOP_BUSY,   // Microseconds a loop spent on each batch of events.
+		HISTOGRAM_FLOOD_STALL, // Microseconds each stall of a socket's flood limits lasted.
+		HISTOGRAM_HANDLER,     // Microseconds each command took to run.
+		METRICS_HISTOGRAMS
+} metrichistogram_t;
+
+typedef struct
+{
+		_Atomic uint64_t count;
+		_Atomic uint64_t sum;
+		_Atomic uint64_t buckets[METRICS_BUCKETS];
+} metricshistogram_t;
+
+typedef struct
+{
+		metricskind_t kind;
+		char name[64];       // Tells the sets of one kind apart, eg. the shard's number.
+		int index;           // Where the set is in the list of every set.
+		_Atomic uint64_t values[METRICS_COUNT];
+		metricshistogram_t *histograms; // NULL for sockets.
+} metrics_t;
+
+// The metrics of the thread we're on, NULL if it doesn't have any.
+extern _Thread_local metrics_t *threadmetrics;
+
+// Adds to one of the set's counters, only ever call this from the thread
+// the set belongs to. Does nothing if `m' is NULL.
+static inline void AddMetric(metrics_t *m, metric_t metric, uint64_t n)
+{
+		if (m)
+				atomic_store_explicit(&m->values[metric], atomic_load_explicit(&m->values[metric], memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Sets one of the set's gauges, same rules as AddMetric.
+static inline void SetMetric(metrics_t *m, metric_t metric, uint64_t value)
+{
+		if (m)
+				atomic_store_explicit(&m->values[metric], value, memory_order_relaxed);
+}
+
+// Forward declare our functions for use outside the file
+extern metrics_t *CreateMetrics(metricskind_t kind, const char *name);
+extern void DestroyMetrics(metrics_t *m);
+extern void RecordMetric(metrics_t *m, metrichistogram_t histogram, uint64_t value);
+extern uint64_t GetMetricsClock(void);
+extern char *FormatMetrics(size_t *len);
+extern int StartMetricsServer(const char *path);
+extern void StopMetricsServer(void);
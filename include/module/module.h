@@ -0,0 +1,67 @@
+#pragma once
+#include "sysconf.h"
+#include "socket/socket.h"
+#include "irc/parser.h"
+#include "irc/job.h"
+
+// Modules are shared objects with handlers for IRC commands (eg, "JOIN"
+// or "001") and bot triggers (the first word of a PRIVMSG, eg. "!ping").
+// They can be loaded, unloaded and reloaded while the bot is running so
+// deploying a fixed handler doesn't mean dropping every connection. The
+// handlers run on the workers exactly like any other IRCJobHandler.
+//
+// Messages are dispatched through a table sorted by hook type and key,
+// found with a binary search instead of comparing against every handler.
+// The table is never changed once it's published: loading or unloading
+// a module builds a new one and swaps it in, the event loops pick it up
+// on their next message without taking any locks. Before a module is
+// closed we wait for every event loop to have moved on (SyncShards) and
+// for the jobs already handed to the workers to finish.
+//
+// A module exports a moduleinfo_t named by MODULE_SYMBOL:
+//
+//   static const modulehook_t hooks[] = {
+//       { MODULE_HOOK_TRIGGER, "!hello", HandleHello },
+//       { MODULE_HOOK_COMMAND, "JOIN",   HandleJoin  },
+//       { 0, NULL, NULL }
+//   };
+//   const moduleinfo_t psychic_module = { MODULE_ABI_VERSION, "hello", hooks, NULL, NULL };
+
+// Bumped whenever moduleinfo_t, modulehook_t or ircjob_t change.
+#define MODULE_ABI_VERSION 2
+
+// The symbol we look for in every module.
+#define MODULE_SYMBOL "psychic_module"
+
+// The longest command or trigger a hook can be for.
+#define MODULE_KEY_MAX 32
+
+typedef enum
+{
+		MODULE_HOOK_COMMAND, // Called for every message with the command (case insensitive).
+		MODULE_HOOK_TRIGGER  // Called for PRIVMSGs starting with the word (case insensitive).
+} modulehooktype_t;
+
+typedef struct
+{
+		modulehooktype_t type;
+		const char *key;       // The command or trigger, NULL ends the list.
+		IRCJobHandler handler; // Run on a worker for every message matching.
+} modulehook_t;
+
+typedef struct
+{
+		int abi;                    // Always MODULE_ABI_VERSION.
+		const char *name;           // What to call the module in messages.
+		const modulehook_t *hooks;  // The handlers, ended by one without a key.
+		int (*OnLoad)(void);        // Called before the hooks are added, may be NULL.
+		void (*OnUnload)(void);     // Called once nothing runs the hooks any more, may be NULL.
+} moduleinfo_t;
+
+// Forward declare our functions for use outside the file
+extern int RegisterModule(const moduleinfo_t *info);
+extern int LoadModule(const char *path);
+extern int UnloadModule(const char *path);
+extern int ReloadModules(void);
+extern void DestroyModules(void);
+extern int DispatchIRCMessage(socket_t *sock, strview_t line, const ircmsg_t *msg);
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "vector/vec.h"
+#include "socket/sendq.h"
+
+// RFC 1459 section 8.10 describes how servers stop clients from flooding:
+// every client has a timer which starts at the current time and every
+// message moves it 2 seconds forward. Once it's more than 10 seconds ahead
+// of the clock the server stops reading from the client and, if the
+// client carries on, disconnects it for "Excess Flood". We keep a copy of
+// that timer ourselves and only send a message once the server would
+// accept it.
+//
+// How far (in milliseconds) a message moves the timer forward.
+#define FLOOD_PENALTY 2000
+// How far (in milliseconds) ahead of the clock the timer may get. Servers
+// allow 10 seconds, we stay 2 seconds short because the server starts its
+// clock when a message arrives and network delays can bunch ours up.
+#define FLOOD_BURST 8000
+// Many servers also charge for long lines, this is how many bytes add an
+// extra second of penalty. Set the connection's bytepenalty to 0 to turn
+// that off.
+#define FLOOD_PENALTY_BYTES 120
+
+// The lanes messages wait in, the first lane always goes first so a
+// slow bulk transfer can't get us disconnected for missing a PING.
+typedef enum
+{
+		FLOOD_LANE_URGENT, // PONGs and registration.
+		FLOOD_LANE_REPLY,  // Replies to what users asked for.
+		FLOOD_LANE_BULK,   // Everything else, eg. long listings.
+		FLOOD_LANES
+} floodlane_t;
+
+// The messages waiting in one lane, one after the other in `bytes'.
+typedef struct
+{
+		vec_t(char) bytes;  // The messages, the first one starts at `head'.
+		vec_t(int) lengths; // How long each message is, the first one is at `next'.
+		int head;           // Where the oldest message starts in `bytes'.
+		int next;           // Index of the oldest message in `lengths'.
+} floodqueue_t;
+
+typedef struct
+{
+		floodqueue_t lanes[FLOOD_LANES];
+		int64_t timer;    // Our copy of the server's penalty timer in monotonic milliseconds.
+		int penalty;      // Milliseconds each message costs, defaults to FLOOD_PENALTY.
+		int bytepenalty;  // Bytes per extra second of penalty, defaults to FLOOD_PENALTY_BYTES.
+		int burst;        // How far ahead the timer may get, defaults to FLOOD_BURST.
+} floodctl_t;
+
+// Forward declare our functions for use outside the file
+extern void InitializeFloodControl(floodctl_t *f);
+extern void DestroyFloodControl(floodctl_t *f);
+extern void ClearFloodControl(floodctl_t *f);
+extern int QueueFloodMessage(floodctl_t *f, floodlane_t lane, const void *data, size_t len);
+extern int ReleaseFloodMessages(floodctl_t *f, int64_t now, sendq_t *out);
+extern int64_t GetFloodDeadline(const floodctl_t *f);
+extern int GetFloodQueued(const floodctl_t *f);
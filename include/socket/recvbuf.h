@@ -0,0 +1,43 @@
+#pragma once
+#include <stddef.h>
+#include <sys/types.h>
+
+// How many bytes each socket can hold before we've split them into lines.
+// IRC lines are at most 512 bytes plus 8191 bytes of IRCv3 tags, so this
+// always fits at least one whole line with plenty of room to spare.
+#define RECVBUF_SIZE 16384
+
+// A view into somebody else's memory: the text is NOT null-terminated and
+// is only valid for as long as the memory it points into.
+typedef struct
+{
+		const char *ptr;
+		size_t len;
+} strview_t;
+
+// The buffer data is read into from the kernel. Lines never wrap around
+// the end of the buffer (we move the unfinished line back to the start
+// instead) so every line can be handed out as one pointer and a length
+// without copying it anywhere.
+typedef struct
+{
+		char *data;      // The memory we read into.
+		size_t size;     // How big `data' is.
+		size_t head;     // Where the first byte we haven't handed out is.
+		size_t tail;     // Where the next read from the kernel goes.
+		size_t scanned;  // How far past `head' we already know there's no newline.
+		int discarding;  // Whether we're throwing away a line that was too long.
+} recvbuf_t;
+
+// Reads up to `len' bytes the way read() does, eg. through TLS.
+typedef ssize_t (*RecvFunction)(void *data, void *buffer, size_t len);
+
+// Forward declare our functions for use outside the file
+extern int InitializeRecvBuffer(recvbuf_t *buf, size_t size);
+extern void DestroyRecvBuffer(recvbuf_t *buf);
+extern void ResetRecvBuffer(recvbuf_t *buf);
+extern char *PrepareRecvBuffer(recvbuf_t *buf, size_t *len);
+extern void CommitRecvBuffer(recvbuf_t *buf, size_t bytes);
+extern size_t FillRecvBuffer(recvbuf_t *buf, int fd);
+extern size_t FillRecvBufferWith(recvbuf_t *buf, RecvFunction receiver, void *data);
+extern int NextRecvLine(recvbuf_t *buf, strview_t *line);
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+// How many threads sit around waiting to call getaddrinfo for us.
+#define RESOLVER_THREADS 4
+
+// How long (in seconds) we trust a successful lookup before asking again.
+// getaddrinfo doesn't tell us the TTL of the records it found so we use a
+// fixed TTL that's around what most IRC networks use for their round-robins.
+#define RESOLVER_CACHE_TTL 300
+
+// How long (in seconds) we remember that a host doesn't exist.
+#define RESOLVER_NEGATIVE_TTL 30
+
+// The function called once a lookup finished. `adr' is a copy of the
+// addresses which belongs to the callback (free it with FreeAddresses) or
+// NULL if the lookup failed, in which case `error' is the getaddrinfo error.
+typedef void (*ResolveCallback)(struct addrinfo *adr, int error, void *data);
+
+// Forward declare our functions for use outside the file
+extern int InitializeResolver(void);
+extern int DestroyResolver(void);
+extern int ResolveHost(const char *host, const char *port, ResolveCallback callback, void *data);
+extern void CancelResolve(ResolveCallback callback, void *data);
+extern int LookupHostCache(const char *host, const char *port, struct addrinfo **adr, int *error);
+extern struct addrinfo *CopyAddresses(const struct addrinfo *list);
+extern void FreeAddresses(struct addrinfo *list);
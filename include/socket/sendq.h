@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "vector/vec.h"
+#include "memory/pool.h"
+
+// How big each block of queued data is. Lines are copied into the end of
+// the last block so lots of small lines share one block and go out with a
+// single entry in the writev() array.
+#define SENDQ_CHUNK_SIZE 4096
+
+// The most blocks we hand to the kernel in one go. POSIX only promises 16
+// but every system we care about allows far more.
+#define SENDQ_MAX_IOV 64
+
+// A block of queued data, bytes from `start' to `end' still need sending.
+typedef struct
+{
+		char *data;
+		size_t start;
+		size_t end;
+} sendchunk_t;
+
+// The data waiting to be sent on a socket, oldest block first.
+typedef struct
+{
+		vec_t(sendchunk_t) chunks; // The blocks, the live ones start at `head'.
+		int head;                  // Index of the oldest block still being sent.
+		size_t bytes;              // How many bytes are waiting to be sent.
+		char *spare;               // An empty block kept around so we don't malloc for every burst.
+		pool_t *pool;              // Where the blocks come from, NULL means malloc.
+} sendq_t;
+
+// Sends (some of) the blocks the way sendmsg() does, eg. through TLS.
+typedef ssize_t (*SendFunction)(void *data, const struct iovec *iov, int count);
+
+// Forward declare our functions for use outside the file
+extern void InitializeSendQueue(sendq_t *q, pool_t *pool);
+extern void DestroySendQueue(sendq_t *q);
+extern void ClearSendQueue(sendq_t *q);
+extern int AppendSendQueue(sendq_t *q, const void *data, size_t len);
+extern int GatherSendQueue(const sendq_t *q, struct iovec *iov, int max, size_t *bytes);
+extern void ConsumeSendQueue(sendq_t *q, size_t sent);
+extern size_t FlushSendQueue(sendq_t *q, int fd);
+extern size_t FlushSendQueueWith(sendq_t *q, SendFunction sender, void *data);
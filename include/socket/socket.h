@@ -4,6 +4,12 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include "vector/vec.h"
+#include "socket/recvbuf.h"
+#include "socket/sendq.h"
+#include "socket/flood.h"
+#include "eventloop/timer.h"
+#include "metrics/metrics.h"
 
 // A union to make switching between these types easier.
 typedef union
@@ -16,7 +22,41 @@ typedef union
 		struct sockaddr     sa;
 } sockaddr_t;
 
+// How long (in milliseconds) we wait for a single address to accept
+// our connection before giving up on it.
+#define SOCKET_CONNECT_TIMEOUT 10000
+
+// How long (in milliseconds) we give a connection attempt before we start
+// racing the next address alongside it. 250ms is what RFC 8305 (Happy
+// Eyeballs) recommends, it's short enough that a broken IPv6 path barely
+// slows us down and long enough not to hammer servers that are just slow.
+#define SOCKET_ATTEMPT_DELAY 250
+
+// A single in-flight connect() to one of the host's addresses.
 typedef struct
+{
+		int fd;               // The descriptor this attempt is connecting on.
+		struct addrinfo *adr; // The address this attempt is connecting to.
+		int64_t deadline;     // When (in monotonic milliseconds) this attempt gives up.
+} connattempt_t;
+
+// The states a socket can be in.
+typedef enum
+{
+		SOCKET_CLOSED,     // Not connected to anything.
+		SOCKET_RESOLVING,  // Waiting on the resolver to look the host up.
+		SOCKET_CONNECTING, // Waiting on the kernel to finish connecting us.
+		SOCKET_HANDSHAKING, // Connected, waiting on the TLS handshake to finish.
+		SOCKET_CONNECTED   // Ready to send and receive data.
+} socketstate_t;
+
+// Forward declare the socket type so the callbacks can refer to it.
+typedef struct socket_s socket_t;
+
+// The type of function called by the event loop when something happens on a socket.
+typedef void (*SocketCallback)(socket_t *sock);
+
+struct socket_s
 {
 		int fd;         // This is the file descriptor used to associate this socket with our applcation inside the kernel.
 		short int port; // This is the port we're connecting on.
@@ -26,13 +66,72 @@ typedef struct
 		// Internal structures
 		sockaddr_t *sa; // The internal socket address structures.
 		struct addrinfo *adr; // The address info of the socket in binary form.
-} socket_t;
+
+		// Connection state
+		socketstate_t state;      // Whether we're connected, connecting or neither.
+		struct addrinfo *nextaddr; // The next address we haven't tried to connect to yet.
+		int64_t nextattempt;       // When (in monotonic milliseconds) to start racing `nextaddr'.
+		vec_sbo_t(connattempt_t, 4) attempts; // The connection attempts currently racing each other.
+		int connecttimeout;        // How long each attempt (and the TLS handshake) gets, defaults to SOCKET_CONNECT_TIMEOUT.
+
+		// TLS, set `tls' (and `tlsinsecure') before calling ConnectSocket.
+		int tls;                   // Whether to talk TLS to the server.
+		int tlsinsecure;           // Don't check the server's certificate (eg, it's self-signed).
+		struct ssl_st *ssl;        // The TLS connection, NULL for plaintext.
+		int64_t handshakedeadline; // When (in monotonic milliseconds) we give up on the handshake.
+		int resumed;               // Whether the handshake resumed our last session with the host.
+		int offloaded;             // Whether the kernel encrypts what we send (kTLS).
+
+		// Data we've received but not handed out as lines yet.
+		recvbuf_t recvbuf;
+
+		// Data waiting for the kernel to have room for it.
+		sendq_t sendq;
+
+		// With io_uring the kernel reads and writes for us (see EventLoopDoesIO)
+		// and the message it sends from has to stay put until it's done.
+		int ringio;                // Whether it does for this connection.
+		int receiving;             // Whether a read is with the kernel (or its result is waiting).
+		int sending;               // Likewise for a send.
+		struct msghdr sendhdr;
+		struct iovec sendiov[SENDQ_MAX_IOV];
+
+		// Messages waiting for the server's flood limits to let them through.
+		floodctl_t flood;
+		int64_t stalled;           // When the flood limits started holding messages back, 0 if they aren't.
+		int64_t stallcounted;      // How much of the stall is in the metrics already.
+
+		// What we've sent and received, see metrics.h.
+		metrics_t *metrics;
+
+		// Due at the earliest of the deadlines above which applies to the
+		// state we're in (the attempts, the handshake or the flood limits).
+		evtimer_t timer;
+
+		// Event loop callbacks, any of these may be NULL.
+		SocketCallback OnReadable; // Called when there is data to be read.
+		SocketCallback OnWritable; // Called when we can write more data.
+		SocketCallback OnError;    // Called when the socket had an error or was closed.
+		SocketCallback OnConnected; // Called once the connection was established.
+		void *data;                // Whatever the owner of this socket wants to keep with it.
+		int registered;            // Whether the socket was added to the event loop.
+		int index;                 // Where the socket is in the list of all sockets.
+		uint64_t id;               // Unique for the life of the process, unlike the pointer which is reused.
+};
 
 // Forward declare our functions for use outside the file
 extern int InitializeSockets(void);
 extern int DestroySockets(void);
 extern socket_t *CreateSocket(const char *host, const char *port);
 extern int ConnectSocket(socket_t *sock);
+extern void CloseSocket(socket_t *sock);
 extern void DestroySocket(socket_t *sock);
+extern socket_t *FindSocket(uint64_t id);
 extern size_t ReadSocket(socket_t *sock, void *buffer, size_t bufferlen);
 extern size_t WriteSocket(socket_t *sock, const void *buffer, size_t bufferlen);
+extern int FlushSocket(socket_t *sock);
+extern int ContinueReceiving(socket_t *sock);
+extern int QueueSocketMessage(socket_t *sock, floodlane_t lane, const void *message, size_t len);
+extern size_t GetSocketQueueDepth(const socket_t *sock);
+extern size_t ReceiveSocket(socket_t *sock);
+extern int ReadSocketLine(socket_t *sock, strview_t *line);
@@ -0,0 +1,24 @@
+#pragma once
+#include <stddef.h>
+#include <sys/types.h>
+#include "sysconf.h"
+
+// TLS for sockets, using OpenSSL. The handshake runs in the event loop
+// like connect() does and once it's done ReadTLS and WriteTLS take the
+// place of read() and write().
+//
+// Every event loop thread has its own context and remembers the last
+// session it got from each host, so reconnecting resumes the session
+// (one round trip, no certificate checks or key exchange) instead of
+// doing a full handshake. Where OpenSSL and the kernel support it the
+// encryption of what we send is handed over to the kernel (kTLS) and the
+// send queue can go straight to sendmsg() like a plaintext socket.
+
+// Forward declare our functions for use outside the file
+extern int StartTLS(struct socket_s *sock);
+extern int ContinueTLSHandshake(struct socket_s *sock, int *events);
+extern ssize_t ReadTLS(struct socket_s *sock, void *buffer, size_t len);
+extern ssize_t WriteTLS(struct socket_s *sock, const void *buffer, size_t len);
+extern size_t GetTLSPending(struct socket_s *sock);
+extern void CloseTLS(struct socket_s *sock);
+extern void DestroyTLS(void);
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdatomic.h>
+#include "memory/pool.h" // for POOL_CACHELINE
+
+// A queue many threads can push onto at once and one thread pops from,
+// without any locks. Nodes are intrusive: embed an mpscnode_t in whatever
+// you're queueing and get back to it from the node once it's popped.
+// Pushing never waits on anything, not even other pushers, so it's safe
+// to push from a thread which must not block (eg, an event loop).
+//
+// This is Dmitry Vyukov's intrusive MPSC queue: pushers swap themselves
+// in as the new head and then link the old head to themselves. Between
+// those two steps the queue is briefly cut in two, a pop which runs into
+// that says the queue is empty and the pusher's wake up (which always
+// comes after it linked itself in) makes the consumer look again.
+
+typedef struct mpscnode_s
+{
+		_Atomic(struct mpscnode_s*) next;
+} mpscnode_t;
+
+typedef struct
+{
+		// Pushers and the popper each get a cache line of their own so they
+		// don't slow each other down.
+		_Alignas(POOL_CACHELINE) _Atomic(mpscnode_t*) head; // Where new nodes are pushed.
+		_Alignas(POOL_CACHELINE) mpscnode_t *tail;          // The oldest node, only touched by the popper.
+		mpscnode_t stub;                                     // Keeps the queue non-empty so pushers never touch `tail'.
+} mpscqueue_t;
+
+// Forward declare our functions for use outside the file
+extern void InitializeMPSCQueue(mpscqueue_t *q);
+extern void PushMPSCQueue(mpscqueue_t *q, mpscnode_t *node);
+extern mpscnode_t *PopMPSCQueue(mpscqueue_t *q);
@@ -0,0 +1,40 @@
+#pragma once
+#include <stddef.h>
+#include <stdatomic.h>
+#include "memory/pool.h" // for POOL_CACHELINE
+
+// A fixed size ring of pointers which many threads can push onto at once
+// and one thread pops from, without locks. Unlike mpscqueue_t it never
+// allocates, so it's full at some point: pushing then fails straight away
+// instead of waiting, and the caller decides what to do with the item.
+//
+// This is Dmitry Vyukov's bounded queue cut down to a single consumer.
+// Every cell has a sequence number saying whose turn it is: pushers claim
+// a position by bumping `tail' and publish the item by moving the cell's
+// sequence on, the popper only takes cells whose sequence says they were
+// published. A pusher which claimed a cell but hasn't published it yet
+// makes the ring look empty to the popper until it's done.
+
+typedef struct
+{
+		atomic_size_t seq;  // Whose turn the cell is, see above.
+		void *data;         // The item, once published.
+} mpsccell_t;
+
+typedef struct
+{
+		// Set up once and only read afterwards.
+		mpsccell_t *cells;
+		size_t mask;        // The number of cells minus one.
+
+		// Pushers and the popper each get a cache line of their own so they
+		// don't slow each other down.
+		_Alignas(POOL_CACHELINE) atomic_size_t tail; // The next position to push to.
+		_Alignas(POOL_CACHELINE) size_t head;        // The next position to pop, only touched by the popper.
+} mpscring_t;
+
+// Forward declare our functions for use outside the file
+extern int InitializeMPSCRing(mpscring_t *ring, size_t size);
+extern void DestroyMPSCRing(mpscring_t *ring);
+extern int PushMPSCRing(mpscring_t *ring, void *item);
+extern void *PopMPSCRing(mpscring_t *ring);
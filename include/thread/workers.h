@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "thread/mpscring.h"
+#include "memory/arena.h"
+
+// A pool of threads for work which is too slow to do on an event loop
+// (eg, fetching a URL's title or looking something up in a database).
+// The event loops hand work over with SubmitWork and go straight back to
+// reading their sockets, so a slow command never delays a PONG.
+//
+// Each worker has a queue the event loops push onto and a work stealing
+// deque it runs jobs from. A worker with nothing to do steals the oldest
+// job of a busy one, so one slow job only holds up the worker running it.
+
+// How many jobs the event loops can queue for each worker before
+// SubmitWork fails.
+#define WORKER_QUEUE_SIZE 1024
+
+// The most workers we'll ever start.
+#define WORKER_MAX 64
+
+typedef struct workjob_s workjob_t;
+
+// Runs the job on a worker thread. The job belongs to the function, which
+// frees it when it's done. Anything it takes from GetWorkerArena is freed
+// for it once it returns.
+typedef void (*WorkFunction)(workjob_t *job);
+
+// Embed this at the start of whatever you're handing to the workers.
+struct workjob_s
+{
+		WorkFunction run;
+};
+
+// Forward declare our functions for use outside the file
+extern int StartWorkerPool(int count);
+extern void StopWorkerPool(void);
+extern int GetWorkerCount(void);
+extern arena_t *GetWorkerArena(void);
+extern int SubmitWork(workjob_t *job, uint32_t key);
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <stdatomic.h>
+#include "memory/pool.h" // for POOL_CACHELINE
+#include "vector/vec.h"
+
+// A work stealing deque (Chase and Lev, using the C11 atomics from Lê et
+// al.'s "Correct and Efficient Work-Stealing for Weak Memory Models").
+// One thread owns it and pushes and takes items at the bottom like a
+// stack, which needs no atomic read-modify-writes at all unless the deque
+// is down to its last item. Any other thread can steal the oldest item
+// from the top, which costs one compare and swap.
+//
+// The array grows when it fills up. Thieves may still be reading the old
+// one so it's kept around until the deque is destroyed; each one is half
+// the size of the next so this never wastes more than the deque uses.
+
+typedef struct
+{
+		int64_t mask;             // The number of items it holds minus one.
+		_Atomic(void*) items[];
+} wsarray_t;
+
+typedef struct
+{
+		// Thieves move the top, the owner the bottom. Keep them apart so
+		// stealing doesn't slow the owner's pushes down.
+		_Alignas(POOL_CACHELINE) _Atomic int64_t top;
+		_Alignas(POOL_CACHELINE) _Atomic int64_t bottom;
+		_Atomic(wsarray_t*) array;
+		vec_t(wsarray_t*) retired; // Arrays we grew out of (owner only).
+} wsdeque_t;
+
+// Forward declare our functions for use outside the file
+extern int InitializeWSDeque(wsdeque_t *d, int64_t size);
+extern void DestroyWSDeque(wsdeque_t *d);
+extern int PushWSDeque(wsdeque_t *d, void *item);
+extern void *TakeWSDeque(wsdeque_t *d);
+extern void *StealWSDeque(wsdeque_t *d);
+extern int64_t GetWSDequeSize(wsdeque_t *d);
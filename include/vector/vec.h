@@ -29,6 +29,18 @@
 #define VEC_VERSION "0.1.0"
 
 
+/* How much a vector grows by when it runs out of room: the new capacity is
+ * capacity + capacity * VEC_GROWTH_NUM / VEC_GROWTH_DEN. The default doubles
+ * it, build with -DVEC_GROWTH_NUM=1 -DVEC_GROWTH_DEN=2 for 1.5x which wastes
+ * less memory on big vectors at the cost of a few more reallocs. */
+#ifndef VEC_GROWTH_NUM
+# define VEC_GROWTH_NUM 1
+#endif
+#ifndef VEC_GROWTH_DEN
+# define VEC_GROWTH_DEN 1
+#endif
+
+
 #define vec_unpack_(v)\
   (char**)&(v)->data, &(v)->length, &(v)->capacity, sizeof(*(v)->data)
 
@@ -46,9 +58,11 @@
     vec_init(v) ) 
 
 
+/* Evaluates to 0 on success and -1 (with errno set to ENOMEM) if the vector
+ * couldn't grow, in which case it is left untouched. */
 #define vec_push(v, val)\
-  ( vec_expand_(vec_unpack_(v)),\
-    (v)->data[(v)->length++] = (val) )
+  ( vec_expand_(vec_unpack_(v)) ? -1 :\
+    ((v)->data[(v)->length++] = (val), 0) )
 
 
 #define vec_pop(v)\
@@ -61,9 +75,9 @@
 
 
 #define vec_insert(v, idx, val)\
-  ( vec_insert_(vec_unpack_(v), idx),\
-    (v)->data[idx] = (val),\
-    (v)->length++ )
+  ( vec_insert_(vec_unpack_(v), idx) ? -1 :\
+    ((v)->data[idx] = (val),\
+    (v)->length++, 0) )
     
 
 #define vec_sort(v, fn)\
@@ -90,6 +104,7 @@
   (v)->data[(v)->length - 1]
 
 
+/* Evaluates to 0 on success and -1 (with errno set to ENOMEM) on failure. */
 #define vec_reserve(v, n)\
   vec_reserve_(vec_unpack_(v), n)
 
@@ -125,12 +140,13 @@
 
 
 #define vec_reverse(v)\
-  do {\
-    int i__ = (v)->length / 2;\
-    while (i__--) {\
-      vec_swap((v), i__, (v)->length - (i__ + 1));\
-    }\
-  } while (0)
+  vec_reverse_(vec_unpack_(v))
+
+
+/* Moves every element `n' places towards the front, the ones which fall
+ * off the front go on the end. A negative `n' rotates the other way. */
+#define vec_rotate(v, n)\
+  vec_rotate_(vec_unpack_(v), n)
 
 
 #define vec_foreach(v, var, iter)\
@@ -162,12 +178,116 @@
 
 
 
-void vec_expand_(char **data, int *length, int *capacity, int memsz);
-void vec_reserve_(char **data, int *length, int *capacity, int memsz, int n);
+int vec_expand_(char **data, int *length, int *capacity, int memsz);
+int vec_reserve_(char **data, int *length, int *capacity, int memsz, int n);
 void vec_compact_(char **data, int *length, int *capacity, int memsz);
 void vec_splice_(char **data, int *length, int *capacity, int memsz, int start, int count);
-void vec_insert_(char **data, int *length, int *capacity, int memsz, int idx);
+int vec_insert_(char **data, int *length, int *capacity, int memsz, int idx);
 void vec_swap_(char **data, int *length, int *capacity, int memsz, int idx1, int idx2);
+void vec_reverse_(char **data, int *length, int *capacity, int memsz);
+void vec_rotate_(char **data, int *length, int *capacity, int memsz, int n);
+
+
+/* vecz_t is vec_t with size_t lengths for vectors which may hold more than
+ * 2^31 elements. Every vec_ macro which doesn't allocate (vec_init,
+ * vec_deinit, vec_pop, vec_clear, vec_truncate, vec_first, vec_last,
+ * vec_sort, vec_foreach and vec_foreach_ptr) works on it as-is, the ones
+ * below replace the rest. */
+
+#define vecz_unpack_(v)\
+  (char**)&(v)->data, &(v)->length, &(v)->capacity, sizeof(*(v)->data)
+
+
+#define vecz_t(T)\
+  struct { T *data; size_t length, capacity; }
+
+
+#define vecz_push(v, val)\
+  ( vecz_expand_(vecz_unpack_(v)) ? -1 :\
+    ((v)->data[(v)->length++] = (val), 0) )
+
+
+#define vecz_splice(v, start, count)\
+  ( vecz_splice_(vecz_unpack_(v), start, count),\
+    (v)->length -= (count) )
+
+
+#define vecz_insert(v, idx, val)\
+  ( vecz_insert_(vecz_unpack_(v), idx) ? -1 :\
+    ((v)->data[idx] = (val),\
+    (v)->length++, 0) )
+
+
+#define vecz_reserve(v, n)\
+  vecz_reserve_(vecz_unpack_(v), n)
+
+
+#define vecz_compact(v)\
+  vecz_compact_(vecz_unpack_(v))
+
+
+#define vecz_foreach_rev(v, var, iter)\
+  for ( (iter) = (v)->length;\
+        (iter)-- > 0 && (((var) = (v)->data[(iter)]), 1);\
+        )
+
+
+int vecz_expand_(char **data, size_t *length, size_t *capacity, size_t memsz);
+int vecz_reserve_(char **data, size_t *length, size_t *capacity, size_t memsz, size_t n);
+void vecz_compact_(char **data, size_t *length, size_t *capacity, size_t memsz);
+void vecz_splice_(char **data, size_t *length, size_t *capacity, size_t memsz, size_t start, size_t count);
+int vecz_insert_(char **data, size_t *length, size_t *capacity, size_t memsz, size_t idx);
+
+
+/* vec_sbo_t(T, N) is a vec_t with room for N elements inside the structure
+ * itself, it only touches the heap once it grows past N. A zeroed structure
+ * (eg. from calloc) is a valid empty vector just like with vec_t. Since the
+ * data can point into the structure it must never be copied or moved with
+ * memcpy while it holds elements.
+ *
+ * Every vec_ macro which doesn't allocate works on it as-is (vec_pop,
+ * vec_splice, vec_clear, vec_truncate, vec_first, vec_last, vec_sort,
+ * vec_find, vec_remove, vec_swap, vec_reverse, vec_rotate and the
+ * vec_foreach family), use the vec_sbo_ versions below for the rest.
+ * vec_compact must not be used on it. */
+
+#define vec_sbo_unpack_(v)\
+  vec_unpack_(v), (char*)(v)->sbo_, (int)(sizeof((v)->sbo_) / sizeof(*(v)->sbo_))
+
+
+#define vec_sbo_t(T, N)\
+  struct { T *data; int length, capacity; T sbo_[N]; }
+
+
+#define vec_sbo_init(v)\
+  ( (v)->data = (v)->sbo_,\
+    (v)->length = 0,\
+    (v)->capacity = (int)(sizeof((v)->sbo_) / sizeof(*(v)->sbo_)) )
+
+
+#define vec_sbo_deinit(v)\
+  ( (v)->data != (v)->sbo_ ? free((v)->data) : (void)0,\
+    vec_sbo_init(v) )
+
+
+#define vec_sbo_push(v, val)\
+  ( vec_sbo_expand_(vec_sbo_unpack_(v)) ? -1 :\
+    ((v)->data[(v)->length++] = (val), 0) )
+
+
+#define vec_sbo_insert(v, idx, val)\
+  ( vec_sbo_insert_(vec_sbo_unpack_(v), idx) ? -1 :\
+    ((v)->data[idx] = (val),\
+    (v)->length++, 0) )
+
+
+#define vec_sbo_reserve(v, n)\
+  vec_sbo_reserve_(vec_sbo_unpack_(v), n)
+
+
+int vec_sbo_expand_(char **data, int *length, int *capacity, int memsz, char *sbo, int sbocap);
+int vec_sbo_reserve_(char **data, int *length, int *capacity, int memsz, char *sbo, int sbocap, int n);
+int vec_sbo_insert_(char **data, int *length, int *capacity, int memsz, char *sbo, int sbocap, int idx);
 
 
 typedef vec_t(void*)  vec_void_t;
@@ -0,0 +1,118 @@
+#include "eventloop/eventloop.h"
+
+// This file is only compiled in when epoll was selected in eventloop.h
+#ifdef EVENTLOOP_EPOLL
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+// uring.c falls back on us when the kernel won't give it a ring.
+#ifdef EVENTLOOP_URING
+# define BackendInitialize EpollInitialize
+# define BackendDestroy    EpollDestroy
+# define BackendAdd        EpollAdd
+# define BackendModify     EpollModify
+# define BackendRemove     EpollRemove
+# define BackendWait       EpollWait
+# define BackendName       EpollName
+#endif
+
+// The maximum number of events we'll take from the kernel at once. If
+// more descriptors than this are ready, the rest are returned on the next
+// call to epoll_wait so nothing is lost.
+#define MAX_EPOLL_EVENTS 128
+
+// The epoll descriptor the kernel gives us to manage our event list,
+// one for each thread running an event loop.
+static _Thread_local int epollfd = -1;
+
+// Convert our EVENT_* flags into epoll's flags.
+static unsigned int ToEpollEvents(int events)
+{
+		unsigned int ev = 0;
+		if (events & EVENT_READ)
+				ev |= EPOLLIN;
+		if (events & EVENT_WRITE)
+				ev |= EPOLLOUT;
+		return ev;
+}
+
+int BackendInitialize(void)
+{
+		epollfd = epoll_create1(EPOLL_CLOEXEC);
+		return epollfd != -1;
+}
+
+int BackendDestroy(void)
+{
+		if (epollfd != -1)
+				close(epollfd);
+		epollfd = -1;
+		return 1;
+}
+
+int BackendAdd(int fd, int events)
+{
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = ToEpollEvents(events);
+		ev.data.fd = fd;
+
+		return epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) != -1;
+}
+
+int BackendModify(int fd, int oldevents, int events)
+{
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = ToEpollEvents(events);
+		ev.data.fd = fd;
+
+		return epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &ev) != -1;
+}
+
+int BackendRemove(int fd, int events)
+{
+		// Kernels before 2.6.9 require a non-NULL event even though it's ignored.
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+
+		return epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, &ev) != -1;
+}
+
+int BackendWait(int timeout)
+{
+		struct epoll_event events[MAX_EPOLL_EVENTS];
+
+		int count = epoll_wait(epollfd, events, MAX_EPOLL_EVENTS, timeout);
+		if (count == -1)
+				return -1;
+
+		for (int i = 0; i < count; ++i)
+		{
+				int flags = 0;
+
+				if (events[i].events & EPOLLIN)
+						flags |= EVENT_READ;
+				if (events[i].events & EPOLLOUT)
+						flags |= EVENT_WRITE;
+				// A hangup is reported as readable so the reader sees EOF and
+				// any data the remote end sent before it hung up.
+				if (events[i].events & EPOLLHUP)
+						flags |= EVENT_READ;
+				if (events[i].events & EPOLLERR)
+						flags |= EVENT_ERROR;
+
+				QueueEvent(events[i].data.fd, flags);
+		}
+
+		return count;
+}
+
+const char *BackendName(void)
+{
+		return "epoll";
+}
+
+#endif // EVENTLOOP_EPOLL
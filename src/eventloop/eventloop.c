@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include "vector/vec.h"
+#include "socket/socket.h"
+#include "eventloop/timer.h"
+#include "metrics/metrics.h"
+#include "log/log.h"
+
+// Include our event loop types and function declarations.
+#include "eventloop/eventloop.h"
+
+// Everything we need to remember about a file descriptor we're watching.
+typedef struct
+{
+		EventHandler handler; // Function to call when something happens.
+		void *data;           // User-supplied pointer passed to the handler.
+		int events;           // The EVENT_* flags we're currently watching for.
+} eventsource_t;
+
+// An event the backend told us about which hasn't been dispatched yet.
+typedef struct
+{
+		int fd;
+		int events;
+} firedevent_t;
+
+// Everything below is per thread: every thread which calls
+// InitializeEventLoop gets an event loop of its own (see shard.c) and
+// only ever sees the descriptors it added itself.
+
+// A table of event sources indexed directly by their file descriptor.
+// The kernel always hands out the lowest free descriptor so this stays
+// small and lets us find the handler for any descriptor in O(1).
+static _Thread_local vec_t(eventsource_t) sources;
+
+// Events collected during BackendWait. We collect them all first and then
+// dispatch them so handlers are free to add or remove sources (including
+// other sources which fired in the same batch) without confusing the backend.
+static _Thread_local vec_t(firedevent_t) fired;
+
+// Scratch memory for the handlers, everything in it is freed once the
+// batch of events it was allocated in has been dispatched.
+static _Thread_local arena_t arena;
+
+/*******************************************************************
+ * Function: GetSource                                             *
+ *                                                                 *
+ * Arguments: (int) file descriptor                                *
+ *                                                                 *
+ * Returns: (eventsource_t*) The slot for the descriptor or NULL   *
+ * if the descriptor is outside the table.                         *
+ *                                                                 *
+ *******************************************************************/
+static eventsource_t *GetSource(int fd)
+{
+		if (fd < 0 || fd >= sources.length)
+				return NULL;
+		return &sources.data[fd];
+}
+
+/*******************************************************************
+ * Function: InitializeEventLoop                                   *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Initializes the event loop's tables and asks the   *
+ * kernel for whatever event notification object the backend       *
+ * needs (eg, an epoll or kqueue descriptor).                      *
+ *                                                                 *
+ *******************************************************************/
+int InitializeEventLoop(void)
+{
+		vec_init(&sources);
+		vec_init(&fired);
+		InitializeArena(&arena, 0);
+		InitializeTimers();
+
+		if (!BackendInitialize())
+		{
+				LogError("Failed to initialize the %s event loop: %s (%d)", BackendName(), strerror(errno), errno);
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: DestroyEventLoop                                      *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Releases the backend and our tables. Sources which *
+ * are still registered are forgotten, the descriptors themselves  *
+ * are not closed since we don't own them.                         *
+ *                                                                 *
+ *******************************************************************/
+int DestroyEventLoop(void)
+{
+		BackendDestroy();
+		vec_deinit(&sources);
+		vec_deinit(&fired);
+		DestroyArena(&arena);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: AddEventSource                                        *
+ *                                                                 *
+ * Arguments: (int) fd, (int) events, EventHandler, void*          *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Start watching a file descriptor for the events    *
+ * given. The handler is called from ProcessEvents whenever one of *
+ * those events (or an error) happens on the descriptor.           *
+ *                                                                 *
+ *******************************************************************/
+int AddEventSource(int fd, int events, EventHandler handler, void *data)
+{
+		assert(fd >= 0 && handler);
+
+		// Grow the table so the descriptor has a slot.
+		if (fd >= sources.length)
+		{
+				int oldlength = sources.length;
+				if (vec_reserve(&sources, fd + 1))
+						return 0;
+
+				memset(sources.data + oldlength, 0, (fd + 1 - oldlength) * sizeof(eventsource_t));
+				sources.length = fd + 1;
+		}
+
+		eventsource_t *src = GetSource(fd);
+
+		// Someone is already watching this descriptor.
+		if (src->handler)
+		{
+				errno = EEXIST;
+				return 0;
+		}
+
+		if (!BackendAdd(fd, events))
+		{
+				LogError("Failed to add descriptor %d to the event loop: %s (%d)", fd, strerror(errno), errno);
+				return 0;
+		}
+
+		src->handler = handler;
+		src->data    = data;
+		src->events  = events;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ModifyEventSource                                     *
+ *                                                                 *
+ * Arguments: (int) fd, (int) events                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Change which events we're watching a descriptor    *
+ * for, eg. to start watching for EVENT_WRITE when we have queued  *
+ * data and stop once the queue is empty again.                    *
+ *                                                                 *
+ *******************************************************************/
+int ModifyEventSource(int fd, int events)
+{
+		eventsource_t *src = GetSource(fd);
+
+		if (!src || !src->handler)
+		{
+				errno = ENOENT;
+				return 0;
+		}
+
+		// Nothing changed, don't bother the kernel.
+		if (src->events == events)
+				return 1;
+
+		if (!BackendModify(fd, src->events, events))
+		{
+				LogError("Failed to modify descriptor %d in the event loop: %s (%d)", fd, strerror(errno), errno);
+				return 0;
+		}
+
+		src->events = events;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: RemoveEventSource                                     *
+ *                                                                 *
+ * Arguments: (int) fd                                             *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Stop watching the descriptor. This must be called  *
+ * before the descriptor is closed. It is safe to call this from   *
+ * inside an event handler, any events still waiting to be         *
+ * dispatched for the descriptor are dropped.                      *
+ *                                                                 *
+ *******************************************************************/
+int RemoveEventSource(int fd)
+{
+		eventsource_t *src = GetSource(fd);
+
+		if (!src || !src->handler)
+		{
+				errno = ENOENT;
+				return 0;
+		}
+
+		BackendRemove(fd, src->events);
+		memset(src, 0, sizeof(eventsource_t));
+		return 1;
+}
+
+/*******************************************************************
+ * Function: QueueEvent                                            *
+ *                                                                 *
+ * Arguments: (int) fd, (int) events                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called by the backend for each ready descriptor,   *
+ * and by handlers which know a descriptor has more to give than   *
+ * the kernel thinks (eg, data OpenSSL decrypted but we had no     *
+ * room for). Events queued by a handler are dispatched later in   *
+ * the same batch.                                                 *
+ *                                                                 *
+ *******************************************************************/
+void QueueEvent(int fd, int events)
+{
+		firedevent_t ev = { fd, events };
+		vec_push(&fired, ev);
+}
+
+/*******************************************************************
+ * Function: ProcessEvents                                         *
+ *                                                                 *
+ * Arguments: (int) timeout in milliseconds, -1 to wait forever    *
+ *                                                                 *
+ * Returns: (int) The number of events dispatched and timers run   *
+ * or -1 on error.                                                 *
+ *                                                                 *
+ * Description: Sleeps in the kernel until at least one of our     *
+ * descriptors is ready, the next timer is due or the timeout      *
+ * expires and calls the handlers of every descriptor which became *
+ * ready, then the callbacks of every timer which is due. This is  *
+ * what keeps the bot at ~0% CPU while idle. The event arena is    *
+ * reset once every handler has run.                               *
+ *                                                                 *
+ *******************************************************************/
+int ProcessEvents(int timeout)
+{
+		vec_clear(&fired);
+
+		// Don't sleep past the next timer.
+		int timers = GetTimerTimeout();
+		if (timers != -1 && (timeout == -1 || timers < timeout))
+				timeout = timers;
+
+		if (BackendWait(timeout) == -1)
+		{
+				// A signal interrupting us isn't an error, just return to the caller
+				// so it can check whether it should keep running.
+				if (errno == EINTR)
+						return 0;
+
+				LogError("Failed to wait for events: %s (%d)", strerror(errno), errno);
+				return -1;
+		}
+
+		// Only loops with metrics pay for reading the clock.
+		uint64_t start = threadmetrics ? GetMetricsClock() : 0;
+
+		firedevent_t *ev;
+		int i;
+		vec_foreach_ptr(&fired, ev, i)
+		{
+				eventsource_t *src = GetSource(ev->fd);
+
+				// The source may have been removed by an earlier handler.
+				if (!src || !src->handler)
+						continue;
+
+				src->handler(ev->fd, ev->events, src->data);
+		}
+
+		int ran = RunTimers();
+
+		// Nothing the handlers allocated from the arena outlives the batch.
+		ResetArena(&arena);
+
+		if (threadmetrics)
+		{
+				AddMetric(threadmetrics, METRIC_WAKEUPS, 1);
+				AddMetric(threadmetrics, METRIC_SYSCALLS, 1);
+				AddMetric(threadmetrics, METRIC_EVENTS, fired.length + ran);
+				RecordMetric(threadmetrics, HISTOGRAM_LOOP_BUSY, GetMetricsClock() - start);
+		}
+
+		return fired.length + ran;
+}
+
+/*******************************************************************
+ * Function: GetEventArena                                         *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (arena_t*) The event loop's scratch arena.             *
+ *                                                                 *
+ * Description: Handlers can allocate whatever temporary data they *
+ * need from this without freeing it, it's all thrown away at once *
+ * after the current batch of events. Don't keep pointers into it  *
+ * past the handler returning.                                     *
+ *                                                                 *
+ *******************************************************************/
+arena_t *GetEventArena(void)
+{
+		return &arena;
+}
+
+/*******************************************************************
+ * Function: EventLoopDoesIO                                       *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Whether this thread's backend can receive and send *
+ * for us, see ReceiveOnEventSource and SendOnEventSource.         *
+ *                                                                 *
+ *******************************************************************/
+int EventLoopDoesIO(void)
+{
+#ifdef EVENTLOOP_URING
+		return BackendDoesIO();
+#else
+		return 0;
+#endif
+}
+
+/*******************************************************************
+ * Function: ReceiveOnEventSource                                  *
+ *                                                                 *
+ * Arguments: (int) fd, void* buffer, (size_t) length              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Has the backend read from the descriptor into the  *
+ * buffer as soon as there's something to read. The handler is     *
+ * called with EVENT_READ once it has. Only one receive can be     *
+ * waiting at a time.                                              *
+ *                                                                 *
+ *******************************************************************/
+int ReceiveOnEventSource(int fd, void *buffer, size_t len)
+{
+		eventsource_t *src = GetSource(fd);
+
+		if (!src || !src->handler)
+		{
+				errno = ENOENT;
+				return 0;
+		}
+
+#ifdef EVENTLOOP_URING
+		return BackendReceive(fd, buffer, len);
+#else
+		(void)buffer;
+		(void)len;
+		errno = ENOSYS;
+		return 0;
+#endif
+}
+
+/*******************************************************************
+ * Function: SendOnEventSource                                     *
+ *                                                                 *
+ * Arguments: (int) fd, (const struct msghdr*) what to send        *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Has the backend send the message on the descriptor *
+ * as soon as there's room. The handler is called with EVENT_WRITE *
+ * once it has, which may be after only part of it went out. Only  *
+ * one send can be waiting at a time.                              *
+ *                                                                 *
+ *******************************************************************/
+int SendOnEventSource(int fd, const struct msghdr *msg)
+{
+		eventsource_t *src = GetSource(fd);
+
+		if (!src || !src->handler)
+		{
+				errno = ENOENT;
+				return 0;
+		}
+
+#ifdef EVENTLOOP_URING
+		return BackendSend(fd, msg);
+#else
+		(void)msg;
+		errno = ENOSYS;
+		return 0;
+#endif
+}
+
+/*******************************************************************
+ * Function: TakeEventResult                                       *
+ *                                                                 *
+ * Arguments: (int) fd, (int) EVENT_READ or EVENT_WRITE, (size_t*) *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Collects what the descriptor's receive             *
+ * (EVENT_READ) or send (EVENT_WRITE) did: the number of bytes, 0  *
+ * if a receive found the connection closed, or -1 with errno set. *
+ * Returns false if it hasn't finished.                            *
+ *                                                                 *
+ *******************************************************************/
+int TakeEventResult(int fd, int event, size_t *result)
+{
+#ifdef EVENTLOOP_URING
+		return BackendResult(fd, event, result);
+#else
+		(void)fd;
+		(void)event;
+		(void)result;
+		return 0;
+#endif
+}
+
+/*******************************************************************
+ * Function: GetEventLoopBackend                                   *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (const char*) The name of the backend in use.          *
+ *                                                                 *
+ *******************************************************************/
+const char *GetEventLoopBackend(void)
+{
+		return BackendName();
+}
+
+/*******************************************************************
+ * Function: GetMonotonicTime                                      *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int64_t) Milliseconds since some unspecified point.   *
+ *                                                                 *
+ * Description: Returns a clock which only ever moves forward, so  *
+ * deadlines aren't thrown off when someone changes the system     *
+ * time (which gettimeofday would be affected by).                 *
+ *                                                                 *
+ *******************************************************************/
+int64_t GetMonotonicTime(void)
+{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*******************************************************************
+ * Function: SocketEventHandler                                    *
+ *                                                                 *
+ * Arguments: (int) fd, (int) events, void* (the socket_t)         *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Translates events on a socket's descriptor into    *
+ * calls to the socket's OnError, OnReadable and OnWritable        *
+ * callbacks, flushing the socket's send queue when it's writable. *
+ * Any of the callbacks may destroy the socket so we check it's    *
+ * still registered before calling the next one.                   *
+ *                                                                 *
+ *******************************************************************/
+static void SocketEventHandler(int fd, int events, void *data)
+{
+		socket_t *sock = data;
+
+		if (events & EVENT_ERROR)
+		{
+				if (sock->OnError)
+						sock->OnError(sock);
+				return;
+		}
+
+		if ((events & EVENT_READ) && sock->OnReadable)
+		{
+				sock->OnReadable(sock);
+
+				// Make sure the socket wasn't destroyed by the callback.
+				eventsource_t *src = GetSource(fd);
+				if (!src || src->data != sock)
+						return;
+
+				// If the backend reads for us, the next read can only start once
+				// the owner is done with what the last one got.
+				if (!ContinueReceiving(sock))
+				{
+						if (sock->OnError)
+								sock->OnError(sock);
+						return;
+				}
+		}
+
+		if (events & EVENT_WRITE)
+		{
+				// Send whatever WriteSocket queued up before telling the owner.
+				if (!FlushSocket(sock))
+				{
+						if (sock->OnError)
+								sock->OnError(sock);
+						return;
+				}
+
+				if (sock->OnWritable)
+						sock->OnWritable(sock);
+		}
+}
+
+/*******************************************************************
+ * Function: RegisterSocket                                        *
+ *                                                                 *
+ * Arguments: socket_t*, (int) events                              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Add a socket to the event loop. The socket's       *
+ * OnReadable, OnWritable and OnError callbacks are called when    *
+ * the matching events happen.                                     *
+ *                                                                 *
+ *******************************************************************/
+int RegisterSocket(socket_t *sock, int events)
+{
+		assert(sock);
+
+		if (!AddEventSource(sock->fd, events, SocketEventHandler, sock))
+				return 0;
+
+		sock->registered = 1;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: UpdateSocket                                          *
+ *                                                                 *
+ * Arguments: socket_t*, (int) events                              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Change the events we're watching the socket for.   *
+ *                                                                 *
+ *******************************************************************/
+int UpdateSocket(socket_t *sock, int events)
+{
+		assert(sock);
+		return ModifyEventSource(sock->fd, events);
+}
+
+/*******************************************************************
+ * Function: UnregisterSocket                                      *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Remove the socket from the event loop.             *
+ *                                                                 *
+ *******************************************************************/
+int UnregisterSocket(socket_t *sock)
+{
+		assert(sock);
+
+		if (!sock->registered)
+				return 1;
+
+		sock->registered = 0;
+		return RemoveEventSource(sock->fd);
+}
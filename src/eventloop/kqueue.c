@@ -0,0 +1,104 @@
+#include "eventloop/eventloop.h"
+
+// This file is only compiled in when kqueue was selected in eventloop.h
+#ifdef EVENTLOOP_KQUEUE
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+
+// The maximum number of events we'll take from the kernel at once.
+#define MAX_KQUEUE_EVENTS 128
+
+// The kqueue descriptor the kernel gives us to manage our event list,
+// one for each thread running an event loop.
+static _Thread_local int kq = -1;
+
+// kqueue watches reading and writing as two separate "filters" so we have
+// to add or delete each of them depending on which flags changed.
+static int ApplyFilters(int fd, int oldevents, int events)
+{
+		struct kevent changes[2];
+		int nchanges = 0;
+
+		if ((oldevents ^ events) & EVENT_READ)
+				EV_SET(&changes[nchanges++], fd, EVFILT_READ, (events & EVENT_READ) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+		if ((oldevents ^ events) & EVENT_WRITE)
+				EV_SET(&changes[nchanges++], fd, EVFILT_WRITE, (events & EVENT_WRITE) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+
+		if (!nchanges)
+				return 1;
+
+		return kevent(kq, changes, nchanges, NULL, 0, NULL) != -1;
+}
+
+int BackendInitialize(void)
+{
+		kq = kqueue();
+		return kq != -1;
+}
+
+int BackendDestroy(void)
+{
+		if (kq != -1)
+				close(kq);
+		kq = -1;
+		return 1;
+}
+
+int BackendAdd(int fd, int events)
+{
+		return ApplyFilters(fd, 0, events);
+}
+
+int BackendModify(int fd, int oldevents, int events)
+{
+		return ApplyFilters(fd, oldevents, events);
+}
+
+int BackendRemove(int fd, int events)
+{
+		return ApplyFilters(fd, events, 0);
+}
+
+int BackendWait(int timeout)
+{
+		struct kevent events[MAX_KQUEUE_EVENTS];
+		struct timespec ts, *tsp = NULL;
+
+		// A negative timeout means wait forever, which kqueue spells as NULL.
+		if (timeout >= 0)
+		{
+				ts.tv_sec  = timeout / 1000;
+				ts.tv_nsec = (timeout % 1000) * 1000000L;
+				tsp = &ts;
+		}
+
+		int count = kevent(kq, NULL, 0, events, MAX_KQUEUE_EVENTS, tsp);
+		if (count == -1)
+				return -1;
+
+		for (int i = 0; i < count; ++i)
+		{
+				int flags = 0;
+
+				if (events[i].flags & EV_ERROR)
+						flags |= EVENT_ERROR;
+				else if (events[i].filter == EVFILT_READ)
+						flags |= EVENT_READ; // EV_EOF is also reported here, read() will return 0.
+				else if (events[i].filter == EVFILT_WRITE)
+						flags |= EVENT_WRITE;
+
+				QueueEvent((int)events[i].ident, flags);
+		}
+
+		return count;
+}
+
+const char *BackendName(void)
+{
+		return "kqueue";
+}
+
+#endif // EVENTLOOP_KQUEUE
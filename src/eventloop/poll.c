@@ -0,0 +1,116 @@
+#include "eventloop/eventloop.h"
+
+// This file is only compiled in when poll was selected in eventloop.h
+#ifdef EVENTLOOP_POLL
+#include <errno.h>
+#include <poll.h>
+#include "vector/vec.h"
+
+// poll() doesn't keep any state in the kernel so we keep the array of
+// descriptors ourselves and hand the whole thing to the kernel each time.
+static _Thread_local vec_t(struct pollfd) pollfds;
+
+// Where each descriptor lives in `pollfds', indexed by descriptor, so we
+// can modify and remove entries without searching the array.
+static _Thread_local vec_int_t positions;
+
+// Convert our EVENT_* flags into poll's flags.
+static short ToPollEvents(int events)
+{
+		short ev = 0;
+		if (events & EVENT_READ)
+				ev |= POLLIN;
+		if (events & EVENT_WRITE)
+				ev |= POLLOUT;
+		return ev;
+}
+
+int BackendInitialize(void)
+{
+		vec_init(&pollfds);
+		vec_init(&positions);
+		return 1;
+}
+
+int BackendDestroy(void)
+{
+		vec_deinit(&pollfds);
+		vec_deinit(&positions);
+		return 1;
+}
+
+int BackendAdd(int fd, int events)
+{
+		// Make sure the position table has a slot for this descriptor.
+		if (fd >= positions.length)
+		{
+				if (vec_reserve(&positions, fd + 1))
+						return 0;
+
+				while (positions.length <= fd)
+						positions.data[positions.length++] = -1;
+		}
+
+		struct pollfd pfd = { fd, ToPollEvents(events), 0 };
+		if (vec_push(&pollfds, pfd))
+				return 0;
+		positions.data[fd] = pollfds.length - 1;
+		return 1;
+}
+
+int BackendModify(int fd, int oldevents, int events)
+{
+		pollfds.data[positions.data[fd]].events = ToPollEvents(events);
+		return 1;
+}
+
+int BackendRemove(int fd, int events)
+{
+		// Move the last entry into the removed entry's place so we don't
+		// have to shift the rest of the array down.
+		int idx = positions.data[fd];
+		struct pollfd last = vec_pop(&pollfds);
+
+		if (idx != pollfds.length)
+		{
+				pollfds.data[idx] = last;
+				positions.data[last.fd] = idx;
+		}
+
+		positions.data[fd] = -1;
+		return 1;
+}
+
+int BackendWait(int timeout)
+{
+		int count = poll(pollfds.data, pollfds.length, timeout);
+		if (count <= 0)
+				return count;
+
+		struct pollfd *pfd;
+		int i;
+		vec_foreach_ptr(&pollfds, pfd, i)
+		{
+				if (!pfd->revents)
+						continue;
+
+				int flags = 0;
+				if (pfd->revents & (POLLIN | POLLHUP))
+						flags |= EVENT_READ;
+				if (pfd->revents & POLLOUT)
+						flags |= EVENT_WRITE;
+				if (pfd->revents & (POLLERR | POLLNVAL))
+						flags |= EVENT_ERROR;
+
+				QueueEvent(pfd->fd, flags);
+		}
+
+		return count;
+}
+
+const char *BackendName(void)
+{
+		return "poll";
+}
+
+#endif // EVENTLOOP_POLL
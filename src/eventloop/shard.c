@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <signal.h>
+#include "eventloop/eventloop.h"
+#include "socket/socket.h"
+#include "socket/resolver.h"
+#include "metrics/metrics.h"
+#include "log/log.h"
+
+// Include our shard types and function declarations.
+#include "eventloop/shard.h"
+
+// A message waiting in a shard's inbox.
+typedef struct
+{
+		mpscnode_t node;          // Must be first, we get back here from the node.
+		ShardCallback callback;
+		void *data;
+		ShardRelease release;     // Frees `data' if the message is dropped, may be NULL.
+} shardmsg_t;
+
+// Every shard we started. Only changed by StartShards and StopShards.
+static shard_t *shards;
+static int nshards;
+
+// The shard the calling thread runs, NULL on any other thread.
+static _Thread_local shard_t *current;
+
+// StartShards waits on this for each shard to say whether it started.
+static pthread_mutex_t startlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t startcond = PTHREAD_COND_INITIALIZER;
+
+// SyncShards waits on this for each shard to get to its message.
+static pthread_mutex_t synclock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t synccond = PTHREAD_COND_INITIALIZER;
+static int synced;
+
+/*******************************************************************
+ * Function: ShardEventHandler                                     *
+ *                                                                 *
+ * Arguments: (int) fd, (int) events, void* (the shard_t)          *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called by the shard's event loop when another      *
+ * thread sent it messages, runs every message in the inbox.       *
+ *                                                                 *
+ *******************************************************************/
+static void ShardEventHandler(int fd, int events, void *data)
+{
+		shard_t *shard = data;
+
+		// Empty the pipe, we only care that we were woken up.
+		char buffer[64];
+		while (read(fd, buffer, sizeof(buffer)) > 0)
+				;
+
+		// Let senders wake us up again before looking at the inbox. Anything
+		// pushed after we look will see this and write to the pipe. The fence
+		// keeps the inbox reads below from moving above the store.
+		atomic_store(&shard->notified, 0);
+		atomic_thread_fence(memory_order_seq_cst);
+
+		mpscnode_t *node;
+		while ((node = PopMPSCQueue(&shard->inbox)))
+		{
+				shardmsg_t *msg = (shardmsg_t*)node;
+				msg->callback(shard, msg->data);
+				free(msg);
+		}
+}
+
+/*******************************************************************
+ * Function: StopShard                                             *
+ *                                                                 *
+ * Arguments: shard_t*, void* (unused)                             *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Sent to a shard by StopShards to stop its loop.    *
+ *                                                                 *
+ *******************************************************************/
+static void StopShard(shard_t *shard, void *unused)
+{
+		shard->running = 0;
+}
+
+/*******************************************************************
+ * Function: SetShardStatus                                        *
+ *                                                                 *
+ * Arguments: shard_t*, (int) status                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void SetShardStatus(shard_t *shard, int status)
+{
+		pthread_mutex_lock(&startlock);
+		shard->status = status;
+		pthread_cond_broadcast(&startcond);
+		pthread_mutex_unlock(&startlock);
+}
+
+/*******************************************************************
+ * Function: ShardThread                                           *
+ *                                                                 *
+ * Arguments: void* (the shard_t)                                  *
+ *                                                                 *
+ * Returns: (void*) Always NULL.                                   *
+ *                                                                 *
+ * Description: Sets up the shard's sockets, event loop and        *
+ * resolver and runs the loop until StopShards tells it to stop.   *
+ * Sockets the shard still has are closed before it exits.         *
+ *                                                                 *
+ *******************************************************************/
+static void *ShardThread(void *arg)
+{
+		shard_t *shard = arg;
+		current = shard;
+
+		char name[16];
+		snprintf(name, sizeof(name), "shard%d", shard->id);
+		SetLogThreadName(name);
+
+		if (!InitializeSockets())
+				goto failed;
+
+		if (!InitializeEventLoop())
+				goto failedloop;
+
+		if (!InitializeResolver())
+				goto failedresolver;
+
+		if (!AddEventSource(shard->wakepipe[0], EVENT_READ, ShardEventHandler, shard))
+				goto failedwake;
+
+		// The loop carries on without metrics if there's no memory for them.
+		snprintf(name, sizeof(name), "%d", shard->id);
+		threadmetrics = CreateMetrics(METRICS_LOOP, name);
+
+		shard->running = 1;
+		SetShardStatus(shard, 1);
+		LogDebug("Waiting for events with %s", GetEventLoopBackend());
+
+		// ProcessEvents sleeps in the kernel until something happens (or a
+		// timer is due) so idle shards don't waste CPU.
+		while (shard->running)
+		{
+				if (ProcessEvents(-1) == -1)
+						break;
+		}
+
+		// Messages sent after we were told to stop are dropped, along with
+		// whatever they carried.
+		mpscnode_t *node;
+		while ((node = PopMPSCQueue(&shard->inbox)))
+		{
+				shardmsg_t *msg = (shardmsg_t*)node;
+				if (msg->release)
+						msg->release(msg->data);
+				free(msg);
+		}
+
+		DestroySockets();
+		DestroyResolver();
+		DestroyEventLoop();
+		DestroyMetrics(threadmetrics);
+		threadmetrics = NULL;
+		current = NULL;
+		return NULL;
+
+failedwake:
+		DestroyResolver();
+failedresolver:
+		DestroyEventLoop();
+failedloop:
+		DestroySockets();
+failed:
+		current = NULL;
+		SetShardStatus(shard, -1);
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: StartShards                                           *
+ *                                                                 *
+ * Arguments: (int) number of shards                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Starts the shard threads and waits until each one  *
+ * is running its event loop. If any of them fail to start, the    *
+ * ones which did are stopped again. The threads are started with  *
+ * every signal blocked so signals go to the calling thread.       *
+ *                                                                 *
+ *******************************************************************/
+int StartShards(int count)
+{
+		assert(!shards && count > 0 && count <= SHARD_MAX);
+
+		// The inbox is cache line aligned so the shards must be too.
+		shards = aligned_alloc(POOL_CACHELINE, count * sizeof(shard_t));
+		if (!shards)
+		{
+				LogError("Failed to allocate the shards: %s (%d)", strerror(errno), errno);
+				return 0;
+		}
+		memset(shards, 0, count * sizeof(shard_t));
+
+		sigset_t all, old;
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+
+		for (nshards = 0; nshards < count; ++nshards)
+		{
+				shard_t *shard = &shards[nshards];
+				shard->id = nshards;
+				InitializeMPSCQueue(&shard->inbox);
+				atomic_init(&shard->notified, 0);
+
+				// Neither end may block, senders must never wait on the shard.
+				if (pipe(shard->wakepipe) == -1)
+				{
+						LogError("Failed to create the shard pipe: %s (%d)", strerror(errno), errno);
+						break;
+				}
+
+				for (int i = 0; i < 2; ++i)
+				{
+						fcntl(shard->wakepipe[i], F_SETFL, fcntl(shard->wakepipe[i], F_GETFL) | O_NONBLOCK);
+						fcntl(shard->wakepipe[i], F_SETFD, FD_CLOEXEC);
+				}
+
+				int error = pthread_create(&shard->thread, NULL, ShardThread, shard);
+				if (error)
+				{
+						LogError("Failed to start a shard thread: %s (%d)", strerror(error), error);
+						close(shard->wakepipe[0]);
+						close(shard->wakepipe[1]);
+						break;
+				}
+
+				pthread_mutex_lock(&startlock);
+				while (!shard->status)
+						pthread_cond_wait(&startcond, &startlock);
+				pthread_mutex_unlock(&startlock);
+
+				if (shard->status == -1)
+				{
+						LogError("Shard %d failed to start", shard->id);
+						pthread_join(shard->thread, NULL);
+						close(shard->wakepipe[0]);
+						close(shard->wakepipe[1]);
+						break;
+				}
+		}
+
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+		if (nshards < count)
+		{
+				StopShards();
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: StopShards                                            *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Tells every shard to stop and waits for them to    *
+ * exit. Messages sent to a shard before this are run first.       *
+ *                                                                 *
+ *******************************************************************/
+void StopShards(void)
+{
+		assert(!current);
+
+		for (int i = 0; i < nshards; ++i)
+		{
+				// If we can't even allocate the message, all we can do is wait
+				// for the shard to stop on its own.
+				if (!SendToShard(&shards[i], StopShard, NULL, NULL))
+						LogError("Failed to stop shard %d", i);
+		}
+
+		for (int i = 0; i < nshards; ++i)
+		{
+				pthread_join(shards[i].thread, NULL);
+				close(shards[i].wakepipe[0]);
+				close(shards[i].wakepipe[1]);
+		}
+
+		free(shards);
+		shards = NULL;
+		nshards = 0;
+}
+
+/*******************************************************************
+ * Function: GetShardCount                                         *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) How many shards are running.                     *
+ *                                                                 *
+ *******************************************************************/
+int GetShardCount(void)
+{
+		return nshards;
+}
+
+/*******************************************************************
+ * Function: GetShard                                              *
+ *                                                                 *
+ * Arguments: (int) index                                          *
+ *                                                                 *
+ * Returns: (shard_t*) The shard with the index.                   *
+ *                                                                 *
+ *******************************************************************/
+shard_t *GetShard(int idx)
+{
+		assert(idx >= 0 && idx < nshards);
+		return &shards[idx];
+}
+
+/*******************************************************************
+ * Function: GetCurrentShard                                       *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (shard_t*) The shard running on the calling thread or  *
+ * NULL if the caller isn't a shard.                               *
+ *                                                                 *
+ *******************************************************************/
+shard_t *GetCurrentShard(void)
+{
+		return current;
+}
+
+/*******************************************************************
+ * Function: SendToShard                                           *
+ *                                                                 *
+ * Arguments: shard_t*, ShardCallback, void*, ShardRelease         *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Has the shard call the callback from its event     *
+ * loop. Safe to call from any thread (including the shard itself, *
+ * the callback then runs on the next turn of the loop) and never  *
+ * blocks. Messages from one thread run in the order they were     *
+ * sent. If the shard stops before getting to the message, release *
+ * (unless it's NULL) is called with the data instead. Returns     *
+ * false if we ran out of memory.                                  *
+ *                                                                 *
+ *******************************************************************/
+int SendToShard(shard_t *shard, ShardCallback callback, void *data, ShardRelease release)
+{
+		assert(shard && callback);
+
+		shardmsg_t *msg = malloc(sizeof(shardmsg_t));
+		if (!msg)
+				return 0;
+
+		msg->callback = callback;
+		msg->data     = data;
+		msg->release  = release;
+		PushMPSCQueue(&shard->inbox, &msg->node);
+
+		// Only the first message since the shard last emptied its inbox has
+		// to wake it up. The fence pairs with the one in ShardEventHandler so
+		// either we see `notified' cleared or the shard sees our message.
+		atomic_thread_fence(memory_order_seq_cst);
+		if (!atomic_exchange(&shard->notified, 1))
+		{
+				// If the pipe is full the shard has plenty of wake ups waiting.
+				char c = 0;
+				ssize_t written = write(shard->wakepipe[1], &c, 1);
+				(void)written;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: SyncShard                                             *
+ *                                                                 *
+ * Arguments: shard_t*, void* (unused)                             *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Sent to every shard by SyncShards to say it got    *
+ * this far.                                                       *
+ *                                                                 *
+ *******************************************************************/
+static void SyncShard(shard_t *shard, void *unused)
+{
+		pthread_mutex_lock(&synclock);
+		synced++;
+		pthread_cond_signal(&synccond);
+		pthread_mutex_unlock(&synclock);
+}
+
+/*******************************************************************
+ * Function: SyncShards                                            *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Waits until every shard has finished whatever it   *
+ * was doing when this was called. Once this returns no shard can  *
+ * still be holding on to something it read before the call, eg.   *
+ * a table which has since been replaced. Must not be called from  *
+ * a shard. Returns false if a shard couldn't be reached.          *
+ *                                                                 *
+ *******************************************************************/
+int SyncShards(void)
+{
+		assert(!current);
+
+		pthread_mutex_lock(&synclock);
+		synced = 0;
+		pthread_mutex_unlock(&synclock);
+
+		int sent = 0;
+		for (int i = 0; i < nshards; ++i)
+				sent += SendToShard(&shards[i], SyncShard, NULL, NULL);
+
+		pthread_mutex_lock(&synclock);
+		while (synced < sent)
+				pthread_cond_wait(&synccond, &synclock);
+		pthread_mutex_unlock(&synclock);
+
+		return sent == nshards;
+}
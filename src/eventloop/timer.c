@@ -0,0 +1,485 @@
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include "eventloop/eventloop.h"
+
+// Include our timer types and function declarations.
+#include "eventloop/timer.h"
+
+// The root wheel has a slot for every millisecond of the next 256, each
+// wheel above it has 64 slots as long as the whole wheel below it. With
+// four of those a timer can be up to 2^32 milliseconds away.
+#define WHEEL_ROOT_BITS  8
+#define WHEEL_ROOT_SIZE  (1 << WHEEL_ROOT_BITS)
+#define WHEEL_ROOT_MASK  (WHEEL_ROOT_SIZE - 1)
+#define WHEEL_LEVEL_BITS 6
+#define WHEEL_LEVEL_SIZE (1 << WHEEL_LEVEL_BITS)
+#define WHEEL_LEVEL_MASK (WHEEL_LEVEL_SIZE - 1)
+#define WHEEL_LEVELS     4
+#define WHEEL_SLOTS      (WHEEL_ROOT_SIZE + WHEEL_LEVELS * WHEEL_LEVEL_SIZE)
+#define WHEEL_SPAN       (INT64_C(1) << (WHEEL_ROOT_BITS + WHEEL_LEVELS * WHEEL_LEVEL_BITS))
+
+// How far (in bits) the slots of a level above the root are apart.
+#define LEVEL_SHIFT(level) (WHEEL_ROOT_BITS + (level) * WHEEL_LEVEL_BITS)
+
+// The root wheel's occupancy is in the first 4 words of the bitmap, each
+// level above it gets a word of its own.
+#define WHEEL_ROOT_WORDS (WHEEL_ROOT_SIZE / 64)
+
+// The slot number of a timer which was taken out of the wheel to be run
+// (or moved down a level) but is still pending.
+#define SLOT_DETACHED -1
+
+typedef struct
+{
+		int64_t current;                 // The next millisecond we haven't run the timers of yet.
+		int count;                       // How many timers are pending.
+		uint64_t map[WHEEL_SLOTS / 64];  // Which slots have timers in them.
+		evtimer_t *slots[WHEEL_SLOTS];   // The root wheel first, then each level above it.
+} timerwheel_t;
+
+// Like the rest of the event loop, every thread has a wheel of its own.
+static _Thread_local timerwheel_t wheel;
+
+/*******************************************************************
+ * Function: LowestBit                                             *
+ *                                                                 *
+ * Arguments: (uint64_t) a value which isn't 0                     *
+ *                                                                 *
+ * Returns: (int) The index of the lowest bit set in the value.    *
+ *                                                                 *
+ * Description: Uses a de Bruijn sequence so it's a multiply and a *
+ * table lookup on every compiler instead of a loop.               *
+ *                                                                 *
+ *******************************************************************/
+static int LowestBit(uint64_t v)
+{
+		static const unsigned char table[64] = {
+				0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+				62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+				63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+				46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+		};
+
+		assert(v);
+		return table[((v & -v) * UINT64_C(0x03f79d71b4cb0a89)) >> 58];
+}
+
+/*******************************************************************
+ * Function: LinkTimer                                             *
+ *                                                                 *
+ * Arguments: evtimer_t*, (int) slot                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void LinkTimer(evtimer_t *timer, int slot)
+{
+		evtimer_t **head = &wheel.slots[slot];
+
+		timer->next = *head;
+		if (timer->next)
+				timer->next->pprev = &timer->next;
+		timer->pprev = head;
+		timer->slot  = slot;
+		*head = timer;
+
+		wheel.map[slot / 64] |= UINT64_C(1) << (slot % 64);
+		wheel.count++;
+}
+
+/*******************************************************************
+ * Function: UnlinkTimer                                           *
+ *                                                                 *
+ * Arguments: evtimer_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Takes a pending timer out of whichever list it's   *
+ * in. The pprev pointer means we never have to look for it.       *
+ *                                                                 *
+ *******************************************************************/
+static void UnlinkTimer(evtimer_t *timer)
+{
+		*timer->pprev = timer->next;
+		if (timer->next)
+				timer->next->pprev = timer->pprev;
+
+		if (timer->slot != SLOT_DETACHED && !wheel.slots[timer->slot])
+				wheel.map[timer->slot / 64] &= ~(UINT64_C(1) << (timer->slot % 64));
+
+		timer->next  = NULL;
+		timer->pprev = NULL;
+		wheel.count--;
+}
+
+/*******************************************************************
+ * Function: DetachSlot                                            *
+ *                                                                 *
+ * Arguments: (int) slot, evtimer_t** list                         *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Moves every timer in the slot onto `list', where   *
+ * they're still pending and can be stopped or started again as    *
+ * usual while we walk through them.                               *
+ *                                                                 *
+ *******************************************************************/
+static void DetachSlot(int slot, evtimer_t **list)
+{
+		*list = wheel.slots[slot];
+		wheel.slots[slot] = NULL;
+		wheel.map[slot / 64] &= ~(UINT64_C(1) << (slot % 64));
+
+		if (*list)
+				(*list)->pprev = list;
+
+		for (evtimer_t *t = *list; t; t = t->next)
+				t->slot = SLOT_DETACHED;
+}
+
+/*******************************************************************
+ * Function: ScheduleTimer                                         *
+ *                                                                 *
+ * Arguments: evtimer_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Puts the timer in the slot its deadline falls in:  *
+ * the root wheel if it's due within 256ms, otherwise the lowest   *
+ * level which reaches far enough. Deadlines which have passed go  *
+ * in the current slot so they run as soon as possible.            *
+ *                                                                 *
+ *******************************************************************/
+static void ScheduleTimer(evtimer_t *timer)
+{
+		int64_t expires = timer->deadline;
+		int64_t ticks = expires - wheel.current;
+
+		if (ticks < 0)
+		{
+				expires = wheel.current;
+				ticks = 0;
+		}
+		else if (ticks >= WHEEL_SPAN)
+		{
+				// Too far away to tell apart from the end of the wheel, it's moved
+				// back down to wherever it belongs once it gets there.
+				expires = wheel.current + WHEEL_SPAN - 1;
+				ticks = WHEEL_SPAN - 1;
+		}
+
+		if (ticks < WHEEL_ROOT_SIZE)
+		{
+				LinkTimer(timer, (int)(expires & WHEEL_ROOT_MASK));
+				return;
+		}
+
+		int level = 0;
+		while (ticks >= INT64_C(1) << (LEVEL_SHIFT(level) + WHEEL_LEVEL_BITS))
+				level++;
+
+		int idx = (int)((expires >> LEVEL_SHIFT(level)) & WHEEL_LEVEL_MASK);
+		LinkTimer(timer, WHEEL_ROOT_SIZE + level * WHEEL_LEVEL_SIZE + idx);
+}
+
+/*******************************************************************
+ * Function: Cascade                                               *
+ *                                                                 *
+ * Arguments: (int) level                                          *
+ *                                                                 *
+ * Returns: (int) The index of the slot we cascaded.               *
+ *                                                                 *
+ * Description: Moves the timers in the level's slot for the       *
+ * current time down to the wheels below, now that they're close   *
+ * enough for those to tell them apart.                            *
+ *                                                                 *
+ *******************************************************************/
+static int Cascade(int level)
+{
+		int idx = (int)((wheel.current >> LEVEL_SHIFT(level)) & WHEEL_LEVEL_MASK);
+
+		evtimer_t *list;
+		DetachSlot(WHEEL_ROOT_SIZE + level * WHEEL_LEVEL_SIZE + idx, &list);
+
+		evtimer_t *timer;
+		while ((timer = list))
+		{
+				UnlinkTimer(timer);
+				ScheduleTimer(timer);
+		}
+
+		return idx;
+}
+
+/*******************************************************************
+ * Function: AdvanceWheel                                          *
+ *                                                                 *
+ * Arguments: (int64_t) the millisecond to move to                 *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Moves the wheel's current time forward. Whenever   *
+ * the root wheel starts a new lap the next slot of the level      *
+ * above is cascaded, and so on up when that level laps too, just  *
+ * like the digits of an odometer. The caller makes sure nothing   *
+ * between the old and new time needed doing.                      *
+ *                                                                 *
+ *******************************************************************/
+static void AdvanceWheel(int64_t tick)
+{
+		wheel.current = tick;
+
+		if (tick & WHEEL_ROOT_MASK)
+				return;
+
+		for (int level = 0; level < WHEEL_LEVELS && !Cascade(level); ++level)
+				;
+}
+
+/*******************************************************************
+ * Function: GetNextTick                                           *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int64_t) The next millisecond we have to do something *
+ * at, or -1 if there aren't any timers.                           *
+ *                                                                 *
+ * Description: That's either the next occupied slot of the root   *
+ * wheel or the next time an occupied slot above it cascades. Only *
+ * the bitmaps are looked at, never the timers themselves.         *
+ *                                                                 *
+ *******************************************************************/
+static int64_t GetNextTick(void)
+{
+		if (!wheel.count)
+				return -1;
+
+		int idx = (int)(wheel.current & WHEEL_ROOT_MASK);
+		uint64_t any = 0;
+
+		// The rest of this lap of the root wheel.
+		for (int w = 0; w < WHEEL_ROOT_WORDS; ++w)
+		{
+				uint64_t bits = wheel.map[w];
+				any |= bits;
+
+				if (w < idx / 64)
+						continue;
+				if (w == idx / 64)
+						bits &= ~UINT64_C(0) << (idx % 64);
+				if (bits)
+						return wheel.current + w * 64 + LowestBit(bits) - idx;
+		}
+
+		// Anything left in the root wheel is from the next lap, which starts
+		// with a cascade anyway.
+		int64_t lap = wheel.current - idx + WHEEL_ROOT_SIZE;
+		if (any)
+				return lap;
+
+		int64_t next = -1;
+		for (int level = 0; level < WHEEL_LEVELS; ++level)
+		{
+				uint64_t bits = wheel.map[WHEEL_ROOT_WORDS + level];
+				if (!bits)
+						continue;
+
+				// The slot for the current time was cascaded when we got to it, so
+				// a timer in it is a whole lap of this level away.
+				int shift = LEVEL_SHIFT(level);
+				int cur = (int)((wheel.current >> shift) & WHEEL_LEVEL_MASK);
+				uint64_t rotated = cur ? (bits >> cur) | (bits << (64 - cur)) : bits;
+				rotated &= ~UINT64_C(1);
+
+				int distance = rotated ? LowestBit(rotated) : WHEEL_LEVEL_SIZE;
+				int64_t when = ((wheel.current >> shift) + distance) << shift;
+				if (next == -1 || when < next)
+						next = when;
+		}
+
+		return next;
+}
+
+/*******************************************************************
+ * Function: InitializeTimers                                      *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Sets up the calling thread's wheel, called by      *
+ * InitializeEventLoop.                                            *
+ *                                                                 *
+ *******************************************************************/
+void InitializeTimers(void)
+{
+		memset(&wheel, 0, sizeof(wheel));
+		wheel.current = GetMonotonicTime();
+}
+
+/*******************************************************************
+ * Function: InitializeTimer                                       *
+ *                                                                 *
+ * Arguments: evtimer_t*, TimerCallback, void*                     *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Sets up a timer which isn't pending. This must be  *
+ * called once before the timer is started.                        *
+ *                                                                 *
+ *******************************************************************/
+void InitializeTimer(evtimer_t *timer, TimerCallback callback, void *data)
+{
+		assert(timer && callback);
+		memset(timer, 0, sizeof(evtimer_t));
+		timer->callback = callback;
+		timer->data     = data;
+}
+
+/*******************************************************************
+ * Function: StartTimerAt                                          *
+ *                                                                 *
+ * Arguments: evtimer_t*, (int64_t) deadline                       *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Has the timer's callback called once the monotonic *
+ * clock reaches the deadline. A timer which is already pending is *
+ * moved to the new deadline.                                      *
+ *                                                                 *
+ *******************************************************************/
+void StartTimerAt(evtimer_t *timer, int64_t deadline)
+{
+		assert(timer && timer->callback);
+
+		if (timer->pprev)
+				UnlinkTimer(timer);
+
+		timer->deadline = deadline;
+		ScheduleTimer(timer);
+}
+
+/*******************************************************************
+ * Function: StartTimer                                            *
+ *                                                                 *
+ * Arguments: evtimer_t*, (int64_t) delay in milliseconds          *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+void StartTimer(evtimer_t *timer, int64_t delay)
+{
+		StartTimerAt(timer, GetMonotonicTime() + delay);
+}
+
+/*******************************************************************
+ * Function: StopTimer                                             *
+ *                                                                 *
+ * Arguments: evtimer_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Makes sure the timer's callback isn't called. It's *
+ * fine to stop a timer which isn't pending.                       *
+ *                                                                 *
+ *******************************************************************/
+void StopTimer(evtimer_t *timer)
+{
+		assert(timer);
+
+		if (timer->pprev)
+				UnlinkTimer(timer);
+}
+
+/*******************************************************************
+ * Function: IsTimerPending                                        *
+ *                                                                 *
+ * Arguments: (const evtimer_t*)                                   *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ *******************************************************************/
+int IsTimerPending(const evtimer_t *timer)
+{
+		return timer->pprev != NULL;
+}
+
+/*******************************************************************
+ * Function: GetTimerTimeout                                       *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) Milliseconds until the wheel needs to be looked  *
+ * at again, or -1 if there are no timers.                         *
+ *                                                                 *
+ * Description: Used by ProcessEvents to bound how long it sleeps  *
+ * in the kernel. This may be earlier than the next timer is due   *
+ * when timers have to be moved down the wheel first.              *
+ *                                                                 *
+ *******************************************************************/
+int GetTimerTimeout(void)
+{
+		int64_t next = GetNextTick();
+		if (next == -1)
+				return -1;
+
+		int64_t now = GetMonotonicTime();
+		if (next <= now)
+				return 0;
+
+		return next - now > INT_MAX ? INT_MAX : (int)(next - now);
+}
+
+/*******************************************************************
+ * Function: RunTimers                                             *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) The number of timers which were run.             *
+ *                                                                 *
+ * Description: Calls the callback of every timer which is due and *
+ * brings the wheel up to the current time. Empty stretches of the *
+ * wheel are skipped over in one go rather than a millisecond at a *
+ * time.                                                           *
+ *                                                                 *
+ *******************************************************************/
+int RunTimers(void)
+{
+		int64_t now = GetMonotonicTime();
+		int ran = 0;
+
+		while (wheel.current <= now)
+		{
+				int64_t next = GetNextTick();
+
+				// Nothing to do until after now, catch up and stop.
+				if (next == -1 || next > now)
+				{
+						AdvanceWheel(now + 1);
+						break;
+				}
+
+				if (next != wheel.current)
+				{
+						AdvanceWheel(next);
+						continue;
+				}
+
+				// Take the slot out of the wheel first so the callbacks can start
+				// and stop timers (including these ones) as they please.
+				evtimer_t *list;
+				DetachSlot((int)(wheel.current & WHEEL_ROOT_MASK), &list);
+				AdvanceWheel(wheel.current + 1);
+
+				evtimer_t *timer;
+				while ((timer = list))
+				{
+						UnlinkTimer(timer);
+						timer->callback(timer, timer->data);
+						ran++;
+				}
+		}
+
+		return ran;
+}
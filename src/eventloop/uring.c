@@ -0,0 +1,725 @@
+// syscall() and MAP_POPULATE aren't POSIX.
+#define _DEFAULT_SOURCE 1
+#include "eventloop/eventloop.h"
+
+// This file is only compiled in when io_uring was selected in eventloop.h
+#ifdef EVENTLOOP_URING
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "vector/vec.h"
+#include "metrics/metrics.h"
+#include "log/log.h"
+
+// io_uring lets us hand the kernel a whole batch of requests and wait for
+// their results with a single system call. Descriptors which are only
+// watched get a one-shot poll request for their events, and once it fires
+// we queue another. That keeps epoll's level triggered behaviour (anything
+// still ready is reported again on the next wait) which the handlers rely
+// on. Adding, changing and removing polls costs nothing until the next
+// wait, which submits all of them along with it.
+//
+// Sockets can go further and have the kernel do the reading and writing
+// (see BackendReceive and BackendSend). A receive is always waiting in
+// the kernel for the next data and every send goes straight in as a
+// sendmsg, so with epoll's wait, read and write per event we're left with
+// one io_uring_enter per batch, which submits the next receives and sends
+// and collects what the last ones did.
+//
+// The ring is set up with the raw system calls so we don't need liburing.
+// Kernels which won't give us a ring (too old, or io_uring is disabled,
+// eg. by a container's seccomp profile) get epoll instead.
+
+// How many requests can be queued before we have to hand them over.
+#define URING_ENTRIES 256
+
+// The user_data of requests whose results we don't care about.
+#define URING_IGNORE UINT64_MAX
+
+// A request's user_data holds a generation in the top 32 bits, what the
+// request was for in the next 4 and the descriptor in the rest.
+#define URING_POLL 0
+#define URING_RECV 1
+#define URING_SEND 2
+#define URING_FD_MASK 0x0FFFFFFF
+
+// What we need to remember about each descriptor, indexed by descriptor.
+// A completion carries the generation its request was queued with so
+// results from polls we've since replaced (or from a descriptor that was
+// closed and reused) are recognised and dropped.
+typedef struct
+{
+		uint32_t gen;   // Bumped whenever the descriptor's poll is replaced.
+		uint32_t iogen; // Bumped whenever the descriptor is added or removed.
+		int events;     // The EVENT_* flags we're watching for.
+		int received;   // What the last receive returned, bytes or -errno.
+		int sent;       // Likewise for the last send.
+		char watched;   // Whether the descriptor was added.
+		char armed;     // Whether it has a poll queued or in the kernel.
+		char receiving; // Whether it has a receive queued or in the kernel.
+		char sending;   // Likewise for a send.
+		char gotrecv;   // Whether `received' wasn't taken by BackendResult yet.
+		char gotsend;   // Likewise for `sent'.
+} uringsource_t;
+
+// The submission and completion rings the kernel shares with us.
+typedef struct
+{
+		int fd;
+		_Atomic unsigned *sqhead;  // Moved by the kernel as it takes requests.
+		_Atomic unsigned *sqtail;  // Moved by us as we queue them.
+		unsigned *sqarray;
+		unsigned sqmask;
+		unsigned sqentries;
+		unsigned tail;             // Our copy of `sqtail'.
+		struct io_uring_sqe *sqes;
+		_Atomic unsigned *cqhead;  // Moved by us as we take results.
+		_Atomic unsigned *cqtail;  // Moved by the kernel as it posts them.
+		unsigned cqmask;
+		struct io_uring_cqe *cqes;
+		void *sqmap, *cqmap;
+		size_t sqmapsize, cqmapsize, sqessize;
+} uring_t;
+
+static _Thread_local uring_t ring = { .fd = -1 };
+
+// Whether this thread got a ring, if not everything goes to epoll.c.
+static _Thread_local int usering;
+
+static _Thread_local vec_t(uringsource_t) sources;
+
+// Convert our EVENT_* flags into poll's flags, in the order the kernel
+// wants poll32_events in.
+static uint32_t ToPollEvents(int events)
+{
+		uint32_t ev = 0;
+		if (events & EVENT_READ)
+				ev |= POLLIN;
+		if (events & EVENT_WRITE)
+				ev |= POLLOUT;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		ev = ev << 16 | ev >> 16;
+#endif
+		return ev;
+}
+
+/*******************************************************************
+ * Function: SubmitQueued                                          *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Hands everything we queued to the kernel without   *
+ * waiting for anything, for when it can't wait until BackendWait. *
+ *                                                                 *
+ *******************************************************************/
+static int SubmitQueued(void)
+{
+		unsigned queued;
+		while ((queued = ring.tail - atomic_load_explicit(ring.sqhead, memory_order_acquire)))
+		{
+				AddMetric(threadmetrics, METRIC_SYSCALLS, 1);
+				if (syscall(__NR_io_uring_enter, ring.fd, queued, 0, 0, NULL, 0) == -1 && errno != EINTR)
+						return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: QueueRequest                                          *
+ *                                                                 *
+ * Arguments: (uint8_t) opcode, (int) fd, (uint64_t) user_data     *
+ *                                                                 *
+ * Returns: (struct io_uring_sqe*) The request to fill in, or NULL *
+ * if the ring is full and we couldn't make room.                  *
+ *                                                                 *
+ * Description: The request is only visible to the kernel once     *
+ * PublishRequests is called.                                      *
+ *                                                                 *
+ *******************************************************************/
+static struct io_uring_sqe *QueueRequest(uint8_t opcode, int fd, uint64_t data)
+{
+		if (ring.tail - atomic_load_explicit(ring.sqhead, memory_order_acquire) == ring.sqentries && !SubmitQueued())
+				return NULL;
+
+		unsigned idx = ring.tail & ring.sqmask;
+		struct io_uring_sqe *sqe = &ring.sqes[idx];
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		sqe->opcode = opcode;
+		sqe->fd = fd;
+		sqe->user_data = data;
+
+		ring.sqarray[idx] = idx;
+		ring.tail++;
+		return sqe;
+}
+
+static void PublishRequests(void)
+{
+		atomic_store_explicit(ring.sqtail, ring.tail, memory_order_release);
+}
+
+static uint64_t UserData(int fd, uint32_t gen, int kind)
+{
+		return (uint64_t)gen << 32 | (uint64_t)kind << 28 | ((uint32_t)fd & URING_FD_MASK);
+}
+
+/*******************************************************************
+ * Function: ArmSource                                             *
+ *                                                                 *
+ * Arguments: (int) fd, uringsource_t*                             *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Queues a one-shot poll for the descriptor's        *
+ * events. Errors and hangups are reported whatever we ask for.    *
+ *                                                                 *
+ *******************************************************************/
+static int ArmSource(int fd, uringsource_t *src)
+{
+		struct io_uring_sqe *sqe = QueueRequest(IORING_OP_POLL_ADD, fd, UserData(fd, src->gen, URING_POLL));
+		if (!sqe)
+				return 0;
+
+		sqe->poll32_events = ToPollEvents(src->events);
+		PublishRequests();
+		src->armed = 1;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: DisarmSource                                          *
+ *                                                                 *
+ * Arguments: (int) fd, uringsource_t*                             *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Queues the removal of the descriptor's poll. Its   *
+ * generation moves on so if it fires before the removal gets to   *
+ * it, the result is dropped.                                      *
+ *                                                                 *
+ *******************************************************************/
+static int DisarmSource(int fd, uringsource_t *src)
+{
+		if (src->armed)
+		{
+				struct io_uring_sqe *sqe = QueueRequest(IORING_OP_POLL_REMOVE, -1, URING_IGNORE);
+				if (!sqe)
+						return 0;
+
+				sqe->addr = UserData(fd, src->gen, URING_POLL);
+				PublishRequests();
+		}
+
+		src->gen++;
+		src->armed = 0;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: WaitForRequest                                        *
+ *                                                                 *
+ * Arguments: (uint64_t) the request's user_data                   *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Waits until the request's result has been posted.  *
+ * Nothing is taken off the completion ring, BackendWait still     *
+ * sees (and drops) the result.                                    *
+ *                                                                 *
+ *******************************************************************/
+static int WaitForRequest(uint64_t data)
+{
+		for (;;)
+		{
+				unsigned head = atomic_load_explicit(ring.cqhead, memory_order_relaxed);
+				unsigned tail = atomic_load_explicit(ring.cqtail, memory_order_acquire);
+				for (unsigned i = head; i != tail; ++i)
+				{
+						if (ring.cqes[i & ring.cqmask].user_data == data)
+								return 1;
+				}
+
+				// Wait for one more result than we've already looked at.
+				AddMetric(threadmetrics, METRIC_SYSCALLS, 1);
+				if (syscall(__NR_io_uring_enter, ring.fd, 0, tail - head + 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1 && errno != EINTR)
+						return 0;
+		}
+}
+
+/*******************************************************************
+ * Function: CancelIO                                              *
+ *                                                                 *
+ * Arguments: (int) fd, uringsource_t*                             *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Cancels the descriptor's receive and send and      *
+ * waits for the kernel to be done with them, so the buffers they  *
+ * were given can be freed as soon as we return.                   *
+ *                                                                 *
+ *******************************************************************/
+static int CancelIO(int fd, uringsource_t *src)
+{
+		uint64_t recv = UserData(fd, src->iogen, URING_RECV);
+		uint64_t send = UserData(fd, src->iogen, URING_SEND);
+
+		struct io_uring_sqe *sqe;
+		if (src->receiving)
+		{
+				if (!(sqe = QueueRequest(IORING_OP_ASYNC_CANCEL, -1, URING_IGNORE)))
+						return 0;
+				sqe->addr = recv;
+		}
+
+		if (src->sending)
+		{
+				if (!(sqe = QueueRequest(IORING_OP_ASYNC_CANCEL, -1, URING_IGNORE)))
+						return 0;
+				sqe->addr = send;
+		}
+
+		PublishRequests();
+		if (!SubmitQueued())
+				return 0;
+
+		// Whatever the cancel says (the request may have finished already,
+		// or be too far along to stop), every request gets exactly one result.
+		if ((src->receiving && !WaitForRequest(recv)) || (src->sending && !WaitForRequest(send)))
+				return 0;
+
+		src->receiving = src->sending = 0;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: SetupRing                                             *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Asks the kernel for a ring and maps it. Only one   *
+ * thread ever uses it, newer kernels can make use of that.        *
+ *                                                                 *
+ *******************************************************************/
+static int SetupRing(void)
+{
+		struct io_uring_params params;
+		memset(&params, 0, sizeof(params));
+#if defined(IORING_SETUP_SINGLE_ISSUER) && defined(IORING_SETUP_COOP_TASKRUN)
+		params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+#endif
+
+		ring.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+		if (ring.fd == -1 && errno == EINVAL && params.flags)
+		{
+				memset(&params, 0, sizeof(params));
+				ring.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+		}
+
+		if (ring.fd == -1)
+				return 0;
+
+		// We need the kernel to keep results it has no room for instead of
+		// dropping them, and to take a timeout when we wait (5.11).
+		if ((params.features & (IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)) != (IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG))
+		{
+				close(ring.fd);
+				ring.fd = -1;
+				errno = ENOSYS;
+				return 0;
+		}
+
+		ring.sqmapsize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		ring.cqmapsize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+		ring.sqessize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+		// Both rings usually live in the same mapping.
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+				if (ring.cqmapsize > ring.sqmapsize)
+						ring.sqmapsize = ring.cqmapsize;
+				ring.cqmapsize = 0;
+		}
+
+		ring.sqmap = mmap(NULL, ring.sqmapsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+		ring.cqmap = ring.cqmapsize ? mmap(NULL, ring.cqmapsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING) : ring.sqmap;
+		ring.sqes = mmap(NULL, ring.sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+
+		if (ring.sqmap == MAP_FAILED || ring.cqmap == MAP_FAILED || ring.sqes == MAP_FAILED)
+		{
+				int error = errno;
+				if (ring.sqmap != MAP_FAILED)
+						munmap(ring.sqmap, ring.sqmapsize);
+				if (ring.cqmapsize && ring.cqmap != MAP_FAILED)
+						munmap(ring.cqmap, ring.cqmapsize);
+				if (ring.sqes != MAP_FAILED)
+						munmap(ring.sqes, ring.sqessize);
+				close(ring.fd);
+				ring.fd = -1;
+				errno = error;
+				return 0;
+		}
+
+		char *sq = ring.sqmap, *cq = ring.cqmap;
+		ring.sqhead    = (_Atomic unsigned*)(sq + params.sq_off.head);
+		ring.sqtail    = (_Atomic unsigned*)(sq + params.sq_off.tail);
+		ring.sqmask    = *(unsigned*)(sq + params.sq_off.ring_mask);
+		ring.sqentries = *(unsigned*)(sq + params.sq_off.ring_entries);
+		ring.sqarray   = (unsigned*)(sq + params.sq_off.array);
+		ring.tail      = atomic_load_explicit(ring.sqtail, memory_order_relaxed);
+		ring.cqhead    = (_Atomic unsigned*)(cq + params.cq_off.head);
+		ring.cqtail    = (_Atomic unsigned*)(cq + params.cq_off.tail);
+		ring.cqmask    = *(unsigned*)(cq + params.cq_off.ring_mask);
+		ring.cqes      = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+		return 1;
+}
+
+int BackendInitialize(void)
+{
+		vec_init(&sources);
+
+		if (SetupRing())
+		{
+				usering = 1;
+				return 1;
+		}
+
+		LogInfo("io_uring isn't available: %s (%d), using epoll", strerror(errno), errno);
+		usering = 0;
+		return EpollInitialize();
+}
+
+int BackendDestroy(void)
+{
+		vec_deinit(&sources);
+
+		if (!usering)
+				return EpollDestroy();
+
+		munmap(ring.sqes, ring.sqessize);
+		if (ring.cqmapsize)
+				munmap(ring.cqmap, ring.cqmapsize);
+		munmap(ring.sqmap, ring.sqmapsize);
+		close(ring.fd);
+		ring.fd = -1;
+		usering = 0;
+		return 1;
+}
+
+int BackendAdd(int fd, int events)
+{
+		if (!usering)
+				return EpollAdd(fd, events);
+
+		// Grow the table so the descriptor has a slot.
+		if (fd >= sources.length)
+		{
+				int oldlength = sources.length;
+				if (vec_reserve(&sources, fd + 1))
+						return 0;
+
+				memset(sources.data + oldlength, 0, (fd + 1 - oldlength) * sizeof(uringsource_t));
+				sources.length = fd + 1;
+		}
+
+		uringsource_t *src = &sources.data[fd];
+		src->gen++;
+		src->iogen++;
+		src->events = events;
+		src->watched = 1;
+		src->gotrecv = src->gotsend = 0;
+
+		// A socket which has us do its reading and writing hears about
+		// everything through those, it doesn't need a poll.
+		if (events && !ArmSource(fd, src))
+		{
+				src->watched = 0;
+				return 0;
+		}
+
+		return 1;
+}
+
+int BackendModify(int fd, int oldevents, int events)
+{
+		if (!usering)
+				return EpollModify(fd, oldevents, events);
+
+		uringsource_t *src = &sources.data[fd];
+		src->events = events;
+
+		// The poll is queued again after it fires, with the new events.
+		if (!src->armed && oldevents)
+				return 1;
+
+		if (src->armed && !DisarmSource(fd, src))
+				return 0;
+
+		return !events || ArmSource(fd, src);
+}
+
+int BackendRemove(int fd, int events)
+{
+		if (!usering)
+				return EpollRemove(fd, events);
+
+		uringsource_t *src = &sources.data[fd];
+		src->watched = 0;
+		src->gotrecv = src->gotsend = 0;
+
+		// The descriptor is about to be closed, but the kernel holds on to
+		// it while it's polled. Hand the removal over now so a socket we
+		// close really is closed instead of lingering until the next wait.
+		// Buffers the kernel is still reading into or sending from are
+		// about to be freed too, so wait for it to let go of those.
+		int removed = DisarmSource(fd, src) && CancelIO(fd, src) && SubmitQueued();
+		src->iogen++;
+		return removed;
+}
+
+int BackendWait(int timeout)
+{
+		if (!usering)
+				return EpollWait(timeout);
+
+		struct __kernel_timespec ts = { timeout / 1000, (long long)(timeout % 1000) * 1000000 };
+		struct io_uring_getevents_arg arg;
+		memset(&arg, 0, sizeof(arg));
+		if (timeout != -1)
+				arg.ts = (uint64_t)(uintptr_t)&ts;
+
+		// Everything queued since the last wait goes in with it.
+		unsigned queued = ring.tail - atomic_load_explicit(ring.sqhead, memory_order_acquire);
+		unsigned head = atomic_load_explicit(ring.cqhead, memory_order_relaxed);
+		unsigned wait = timeout != 0 && head == atomic_load_explicit(ring.cqtail, memory_order_acquire);
+
+		if (syscall(__NR_io_uring_enter, ring.fd, queued, wait, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) == -1)
+		{
+				// Running out of time isn't an error, and when the kernel is
+				// too busy to take more requests we make room below.
+				if (errno != ETIME && errno != EBUSY && errno != EAGAIN)
+						return -1;
+		}
+
+		int count = 0;
+		unsigned tail = atomic_load_explicit(ring.cqtail, memory_order_acquire);
+		for (; head != tail; ++head)
+		{
+				const struct io_uring_cqe *cqe = &ring.cqes[head & ring.cqmask];
+				if (cqe->user_data == URING_IGNORE)
+						continue;
+
+				int fd = (int)(cqe->user_data & URING_FD_MASK);
+				int kind = (int)(cqe->user_data >> 28 & 0xF);
+				uint32_t gen = (uint32_t)(cqe->user_data >> 32);
+				uringsource_t *src = fd < sources.length ? &sources.data[fd] : NULL;
+
+				if (!src || !src->watched)
+						continue;
+
+				// A receive or send finished, the handler collects the result
+				// with BackendResult.
+				if (kind == URING_RECV || kind == URING_SEND)
+				{
+						// One from before the descriptor was removed.
+						if (src->iogen != gen)
+								continue;
+
+						if (kind == URING_RECV)
+						{
+								src->receiving = 0;
+								src->received = cqe->res;
+								src->gotrecv = 1;
+								QueueEvent(fd, EVENT_READ);
+						}
+						else
+						{
+								src->sending = 0;
+								src->sent = cqe->res;
+								src->gotsend = 1;
+								QueueEvent(fd, EVENT_WRITE);
+						}
+
+						count++;
+						continue;
+				}
+
+				// A poll we replaced or removed.
+				if (src->gen != gen)
+						continue;
+
+				src->armed = 0;
+				int flags = 0;
+
+				if (cqe->res < 0)
+						flags = EVENT_ERROR;
+				else
+				{
+						if (cqe->res & POLLIN)
+								flags |= EVENT_READ;
+						if (cqe->res & POLLOUT)
+								flags |= EVENT_WRITE;
+						// A hangup is reported as readable so the reader sees EOF and
+						// any data the remote end sent before it hung up.
+						if (cqe->res & POLLHUP)
+								flags |= EVENT_READ;
+						if (cqe->res & (POLLERR | POLLNVAL))
+								flags |= EVENT_ERROR;
+				}
+
+				QueueEvent(fd, flags);
+				count++;
+
+				// The kernel only sees this once the handlers have run, so it
+				// reports the descriptor again if they left anything behind.
+				if (cqe->res >= 0)
+						ArmSource(fd, src);
+		}
+
+		atomic_store_explicit(ring.cqhead, head, memory_order_release);
+		return count;
+}
+
+/*******************************************************************
+ * Function: BackendDoesIO                                         *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Whether BackendReceive and BackendSend work, which *
+ * they don't if we fell back to epoll.                            *
+ *                                                                 *
+ *******************************************************************/
+int BackendDoesIO(void)
+{
+		return usering;
+}
+
+/*******************************************************************
+ * Function: BackendReceive                                        *
+ *                                                                 *
+ * Arguments: (int) fd, void* buffer, (size_t) length              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Queues a recv into the buffer, which must stay put *
+ * until the result comes back as an EVENT_READ (or the descriptor *
+ * is removed). One receive at a time per descriptor.              *
+ *                                                                 *
+ *******************************************************************/
+int BackendReceive(int fd, void *buffer, size_t len)
+{
+		if (!usering)
+		{
+				errno = ENOSYS;
+				return 0;
+		}
+
+		uringsource_t *src = &sources.data[fd];
+		struct io_uring_sqe *sqe = QueueRequest(IORING_OP_RECV, fd, UserData(fd, src->iogen, URING_RECV));
+		if (!sqe)
+				return 0;
+
+		sqe->addr = (uint64_t)(uintptr_t)buffer;
+		sqe->len = len > UINT32_MAX ? UINT32_MAX : (uint32_t)len;
+		PublishRequests();
+		src->receiving = 1;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: BackendSend                                           *
+ *                                                                 *
+ * Arguments: (int) fd, (const struct msghdr*) what to send        *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Queues a sendmsg, the message and everything it    *
+ * points at must stay put until the result comes back as an       *
+ * EVENT_WRITE (or the descriptor is removed). One send at a time  *
+ * per descriptor.                                                 *
+ *                                                                 *
+ *******************************************************************/
+int BackendSend(int fd, const struct msghdr *msg)
+{
+		if (!usering)
+		{
+				errno = ENOSYS;
+				return 0;
+		}
+
+		uringsource_t *src = &sources.data[fd];
+		struct io_uring_sqe *sqe = QueueRequest(IORING_OP_SENDMSG, fd, UserData(fd, src->iogen, URING_SEND));
+		if (!sqe)
+				return 0;
+
+		// MSG_NOSIGNAL so a peer which has gone away doesn't get us killed with SIGPIPE.
+		sqe->addr = (uint64_t)(uintptr_t)msg;
+		sqe->len = 1;
+		sqe->msg_flags = MSG_NOSIGNAL;
+		PublishRequests();
+		src->sending = 1;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: BackendResult                                         *
+ *                                                                 *
+ * Arguments: (int) fd, (int) EVENT_READ or EVENT_WRITE, (size_t*) *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Takes the result of the descriptor's last receive  *
+ * (EVENT_READ) or send (EVENT_WRITE): the number of bytes, or -1  *
+ * with errno set. Returns false if it hasn't finished yet.        *
+ *                                                                 *
+ *******************************************************************/
+int BackendResult(int fd, int event, size_t *result)
+{
+		if (!usering || fd >= sources.length)
+				return 0;
+
+		uringsource_t *src = &sources.data[fd];
+		int res;
+		if (event == EVENT_READ && src->gotrecv)
+		{
+				src->gotrecv = 0;
+				res = src->received;
+		}
+		else if (event == EVENT_WRITE && src->gotsend)
+		{
+				src->gotsend = 0;
+				res = src->sent;
+		}
+		else
+				return 0;
+
+		if (res < 0)
+		{
+				errno = -res;
+				*result = (size_t)-1;
+		}
+		else
+				*result = (size_t)res;
+
+		return 1;
+}
+
+const char *BackendName(void)
+{
+		return usering ? "io_uring" : EpollName();
+}
+
+#endif // EVENTLOOP_URING
@@ -0,0 +1,253 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Include our hash table types and function declarations.
+#include "hash/hashtable.h"
+
+// The fewest slots a table has.
+#define HASHTABLE_MIN_SLOTS 16
+
+// Grow once the table is 3/4 full. Linear probing gets slow quickly past
+// that since the runs of full slots start joining up.
+#define HASHTABLE_FULL(count, slots) ((uint64_t)(count) * 4 >= (uint64_t)(slots) * 3)
+
+/*******************************************************************
+ * Function: AllocateSlots                                         *
+ *                                                                 *
+ * Arguments: hashtable_t*, (uint32_t) number of slots             *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Gives the table a new, empty array of slots and    *
+ * moves every item from the old one into it.                      *
+ *                                                                 *
+ *******************************************************************/
+static int AllocateSlots(hashtable_t *table, uint32_t nslots)
+{
+		hashslot_t *slots = calloc(nslots, sizeof(hashslot_t));
+		if (!slots)
+				return 0;
+
+		hashslot_t *old = table->slots;
+		uint32_t oldslots = old ? table->mask + 1 : 0;
+
+		table->slots = slots;
+		table->mask  = nslots - 1;
+
+		for (uint32_t i = 0; i < oldslots; ++i)
+		{
+				if (!old[i].item)
+						continue;
+
+				uint32_t j = old[i].hash & table->mask;
+				while (slots[j].item)
+						j = (j + 1) & table->mask;
+				slots[j] = old[i];
+		}
+
+		free(old);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: InitializeHashTable                                   *
+ *                                                                 *
+ * Arguments: hashtable_t*, (uint32_t) expected number of items    *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sets up an empty table with room for `expected'    *
+ * items before it needs to grow.                                  *
+ *                                                                 *
+ *******************************************************************/
+int InitializeHashTable(hashtable_t *table, uint32_t expected)
+{
+		assert(table);
+		memset(table, 0, sizeof(hashtable_t));
+
+		uint32_t nslots = HASHTABLE_MIN_SLOTS;
+		while (HASHTABLE_FULL(expected, nslots) && nslots < (1U << 31))
+				nslots <<= 1;
+
+		return AllocateSlots(table, nslots);
+}
+
+/*******************************************************************
+ * Function: DestroyHashTable                                      *
+ *                                                                 *
+ * Arguments: hashtable_t*                                         *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Frees the table, the items themselves belong to    *
+ * the caller and are left alone.                                  *
+ *                                                                 *
+ *******************************************************************/
+void DestroyHashTable(hashtable_t *table)
+{
+		assert(table);
+		free(table->slots);
+		memset(table, 0, sizeof(hashtable_t));
+}
+
+/*******************************************************************
+ * Function: ClearHashTable                                        *
+ *                                                                 *
+ * Arguments: hashtable_t*                                         *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+void ClearHashTable(hashtable_t *table)
+{
+		assert(table);
+		if (table->slots)
+				memset(table->slots, 0, (table->mask + 1) * sizeof(hashslot_t));
+		table->count = 0;
+}
+
+/*******************************************************************
+ * Function: FindHashItem                                          *
+ *                                                                 *
+ * Arguments: const hashtable_t*, (uint32_t) hash, HashMatch,      *
+ *            (const void*) key                                    *
+ *                                                                 *
+ * Returns: (void*) The item with the key or NULL if there isn't   *
+ * one.                                                            *
+ *                                                                 *
+ *******************************************************************/
+void *FindHashItem(const hashtable_t *table, uint32_t hash, HashMatch match, const void *key)
+{
+		assert(table && match);
+
+		if (!table->slots)
+				return NULL;
+
+		// Walk the run of full slots starting where the key belongs. The
+		// hash is compared first so match is almost only called on a hit.
+		for (uint32_t i = hash & table->mask; table->slots[i].item; i = (i + 1) & table->mask)
+		{
+				const hashslot_t *slot = &table->slots[i];
+				if (slot->hash == hash && match(slot->item, key))
+						return slot->item;
+		}
+
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: InsertHashItem                                        *
+ *                                                                 *
+ * Arguments: hashtable_t*, (uint32_t) hash, void* item            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Adds an item to the table. The caller makes sure   *
+ * there isn't already an item with the same key.                  *
+ *                                                                 *
+ *******************************************************************/
+int InsertHashItem(hashtable_t *table, uint32_t hash, void *item)
+{
+		assert(table && item);
+
+		if (!table->slots || HASHTABLE_FULL(table->count + 1, table->mask + 1))
+		{
+				uint32_t nslots = table->slots ? (table->mask + 1) * 2 : HASHTABLE_MIN_SLOTS;
+				if (!nslots || !AllocateSlots(table, nslots))
+				{
+						errno = ENOMEM;
+						return 0;
+				}
+		}
+
+		uint32_t i = hash & table->mask;
+		while (table->slots[i].item)
+				i = (i + 1) & table->mask;
+
+		table->slots[i].hash = hash;
+		table->slots[i].item = item;
+		table->count++;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: RemoveHashItem                                        *
+ *                                                                 *
+ * Arguments: hashtable_t*, (uint32_t) hash, HashMatch,            *
+ *            (const void*) key                                    *
+ *                                                                 *
+ * Returns: (void*) The item which was removed or NULL if there    *
+ * was no item with the key.                                       *
+ *                                                                 *
+ * Description: Takes the item out of the table and then moves     *
+ * any items after it which belong earlier back into the gap, so   *
+ * every item can still be reached from its home slot.             *
+ *                                                                 *
+ *******************************************************************/
+void *RemoveHashItem(hashtable_t *table, uint32_t hash, HashMatch match, const void *key)
+{
+		assert(table && match);
+
+		if (!table->slots)
+				return NULL;
+
+		uint32_t i = hash & table->mask;
+		for (; table->slots[i].item; i = (i + 1) & table->mask)
+				if (table->slots[i].hash == hash && match(table->slots[i].item, key))
+						break;
+
+		void *item = table->slots[i].item;
+		if (!item)
+				return NULL;
+
+		table->slots[i].item = NULL;
+		table->count--;
+
+		for (uint32_t j = (i + 1) & table->mask; table->slots[j].item; j = (j + 1) & table->mask)
+		{
+				// How far the item at j is from its home slot, and how far it
+				// would be if it moved into the gap. Only move it if that
+				// doesn't put it before its home.
+				uint32_t home = table->slots[j].hash & table->mask;
+				if (((j - home) & table->mask) >= ((j - i) & table->mask))
+				{
+						table->slots[i] = table->slots[j];
+						table->slots[j].item = NULL;
+						i = j;
+				}
+		}
+
+		return item;
+}
+
+/*******************************************************************
+ * Function: NextHashItem                                          *
+ *                                                                 *
+ * Arguments: const hashtable_t*, (uint32_t*) iterator             *
+ *                                                                 *
+ * Returns: (void*) The next item or NULL once every item has been *
+ * handed out.                                                     *
+ *                                                                 *
+ * Description: Walks every item in no particular order. Start     *
+ * with the iterator set to 0. The table must not be changed while *
+ * walking it since removing an item can move others around.       *
+ *                                                                 *
+ *******************************************************************/
+void *NextHashItem(const hashtable_t *table, uint32_t *iter)
+{
+		assert(table && iter);
+
+		if (!table->slots)
+				return NULL;
+
+		while (*iter <= table->mask)
+		{
+				void *item = table->slots[(*iter)++].item;
+				if (item)
+						return item;
+		}
+
+		return NULL;
+}
@@ -0,0 +1,379 @@
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include "sysconf.h"
+
+// Strings are folded 8 bytes at a time in a plain 64 bit word, and long
+// ones a vector at a time with whichever instructions CMake found (see
+// CheckSIMD). Without any it's words all the way.
+#if defined(HAVE_AVX2)
+# include <immintrin.h>
+# define CASEMAP_BLOCK 32
+#elif defined(HAVE_SSE2)
+# include <emmintrin.h>
+# define CASEMAP_BLOCK 16
+#elif defined(HAVE_NEON)
+# include <arm_neon.h>
+# define CASEMAP_BLOCK 16
+#endif
+
+// A byte repeated across a word, and the top bit of every byte.
+#define WORD_ONES  0x0101010101010101ULL
+#define WORD_HIGHS 0x8080808080808080ULL
+
+// Include our case mapping types and function declarations.
+#include "irc/casemap.h"
+
+// Every case map agrees on the bytes up to Z (only A-Z fold) and from `
+// onwards (nothing folds), these are shared between the tables below.
+#define IDENTITY_ROWS \
+		  0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15, \
+		 16,  17,  18,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31, \
+		' ', '!', '"', '#', '$', '%', '&', '\'', '(', ')', '*', '+', ',', '-', '.', '/', \
+		'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', ':', ';', '<', '=', '>', '?', \
+		'@', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', \
+		'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z'
+
+#define HIGH_ROWS \
+		'`', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', \
+		'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', '{', '|', '}', '~', 127, \
+		128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143, \
+		144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159, \
+		160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175, \
+		176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191, \
+		192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207, \
+		208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223, \
+		224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239, \
+		240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+
+// The tables each byte is folded through before comparing or hashing.
+// The only differences are in the 5 bytes after Z: [ \ ] ^ _
+// (rfc1459 treats ^ as the upper case ~, strict-rfc1459 doesn't).
+static const unsigned char casemaps[IRC_CASEMAPS][256] =
+{
+		[IRC_CASEMAP_RFC1459]        = { IDENTITY_ROWS, '{', '|', '}', '~', '_', HIGH_ROWS },
+		[IRC_CASEMAP_STRICT_RFC1459] = { IDENTITY_ROWS, '{', '|', '}', '^', '_', HIGH_ROWS },
+		[IRC_CASEMAP_ASCII]          = { IDENTITY_ROWS, '[', '\\', ']', '^', '_', HIGH_ROWS },
+};
+
+// Every table above folds a run of bytes starting at A by adding 32 to
+// them and leaves everything else alone, which is what lets them be done
+// a vector at a time. These are how long the runs are: A-^, A-] and A-Z.
+static const unsigned char foldspans[IRC_CASEMAPS] =
+{
+		[IRC_CASEMAP_RFC1459]        = 30,
+		[IRC_CASEMAP_STRICT_RFC1459] = 29,
+		[IRC_CASEMAP_ASCII]          = 26,
+};
+
+/*******************************************************************
+ * Function: GetIRCCaseMap                                         *
+ *                                                                 *
+ * Arguments: irccasemap_t                                         *
+ *                                                                 *
+ * Returns: (const unsigned char*) A 256 byte table which maps     *
+ * every byte to its lower case version under the rules given.     *
+ *                                                                 *
+ *******************************************************************/
+const unsigned char *GetIRCCaseMap(irccasemap_t casemap)
+{
+		assert(casemap < IRC_CASEMAPS);
+		return casemaps[casemap];
+}
+
+/*******************************************************************
+ * Function: ParseIRCCaseMap                                       *
+ *                                                                 *
+ * Arguments: strview_t name                                       *
+ *                                                                 *
+ * Returns: (irccasemap_t) The case mapping with the name which    *
+ * servers use in CASEMAPPING=, or rfc1459 if we don't know it.    *
+ *                                                                 *
+ *******************************************************************/
+irccasemap_t ParseIRCCaseMap(strview_t name)
+{
+		if (name.len == 5 && !strncasecmp(name.ptr, "ascii", 5))
+				return IRC_CASEMAP_ASCII;
+		if (name.len == 14 && !strncasecmp(name.ptr, "strict-rfc1459", 14))
+				return IRC_CASEMAP_STRICT_RFC1459;
+		return IRC_CASEMAP_RFC1459;
+}
+
+/*******************************************************************
+ * Function: GetFoldSpan                                           *
+ *                                                                 *
+ * Arguments: (const unsigned char*) case map                      *
+ *                                                                 *
+ * Returns: (int) How many bytes from A on the map folds, or 0 if  *
+ * it isn't one of ours and has to be looked up byte by byte.      *
+ *                                                                 *
+ *******************************************************************/
+static inline int GetFoldSpan(const unsigned char *map)
+{
+		for (int i = 0; i < IRC_CASEMAPS; ++i)
+				if (map == casemaps[i])
+						return foldspans[i];
+		return 0;
+}
+
+/*******************************************************************
+ * Function: FoldWord                                              *
+ *                                                                 *
+ * Arguments: (uint64_t) 8 bytes, (int) span of the case map       *
+ *                                                                 *
+ * Returns: (uint64_t) The bytes folded.                           *
+ *                                                                 *
+ * Description: Folds every byte of the word at once. With the top *
+ * bits cleared no byte can carry into the next, so adding 0x80-A  *
+ * sets the top bit of the bytes from A up and adding 0x80-A-span  *
+ * that of the bytes past the span. The bytes with the first but   *
+ * not the second (and which were below 0x80 to start with) get    *
+ * 0x20 added.                                                     *
+ *                                                                 *
+ *******************************************************************/
+static inline uint64_t FoldWord(uint64_t x, int span)
+{
+		uint64_t low = x & ~WORD_HIGHS;
+		uint64_t from = low + WORD_ONES * (0x80 - 'A');
+		uint64_t past = low + WORD_ONES * (0x80 - 'A' - span);
+		uint64_t in = from & ~past & ~x & WORD_HIGHS;
+		return x + (in >> 2);
+}
+
+static inline uint64_t LoadWord(const unsigned char *p)
+{
+		uint64_t word;
+		memcpy(&word, p, sizeof(word));
+		return word;
+}
+
+/*******************************************************************
+ * Function: LoadShort                                             *
+ *                                                                 *
+ * Arguments: (const unsigned char*) string, (size_t) length from  *
+ *            1 to 7                                               *
+ *                                                                 *
+ * Returns: (uint64_t) The bytes packed into a word.               *
+ *                                                                 *
+ * Description: Packs a short string into a word without reading   *
+ * past its end, with loads which overlap each other when it's     *
+ * shorter than they are. Strings of the same length always pack   *
+ * the same way, so packed strings can be compared and hashed.     *
+ *                                                                 *
+ *******************************************************************/
+static inline uint64_t LoadShort(const unsigned char *p, size_t len)
+{
+		if (len >= 4)
+		{
+				uint32_t lo, hi;
+				memcpy(&lo, p, sizeof(lo));
+				memcpy(&hi, p + len - 4, sizeof(hi));
+				return lo | (uint64_t)hi << 32;
+		}
+
+		return p[0] | (uint64_t)p[len / 2] << 8 | (uint64_t)p[len - 1] << 16;
+}
+
+#if defined(HAVE_AVX2)
+typedef __m256i foldvec_t;
+
+static inline foldvec_t FoldVector(foldvec_t v, int span)
+{
+		// Bytes in [A, A + span) are the ones below span once A is taken
+		// away, with anything below A wrapping round to the top.
+		__m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+		__m256i in = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(span - 1)), t);
+		return _mm256_add_epi8(v, _mm256_and_si256(in, _mm256_set1_epi8(0x20)));
+}
+
+# define LoadVector(p)      _mm256_loadu_si256((const __m256i*)(p))
+# define StoreVector(p, v)  _mm256_storeu_si256((__m256i*)(p), (v))
+# define VectorsEqual(a, b) (_mm256_movemask_epi8(_mm256_cmpeq_epi8((a), (b))) == -1)
+#elif defined(HAVE_SSE2)
+typedef __m128i foldvec_t;
+
+static inline foldvec_t FoldVector(foldvec_t v, int span)
+{
+		// Bytes in [A, A + span) are the ones below span once A is taken
+		// away, with anything below A wrapping round to the top.
+		__m128i t = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+		__m128i in = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(span - 1)), t);
+		return _mm_add_epi8(v, _mm_and_si128(in, _mm_set1_epi8(0x20)));
+}
+
+# define LoadVector(p)      _mm_loadu_si128((const __m128i*)(p))
+# define StoreVector(p, v)  _mm_storeu_si128((__m128i*)(p), (v))
+# define VectorsEqual(a, b) (_mm_movemask_epi8(_mm_cmpeq_epi8((a), (b))) == 0xFFFF)
+#elif defined(HAVE_NEON)
+typedef uint8x16_t foldvec_t;
+
+static inline foldvec_t FoldVector(foldvec_t v, int span)
+{
+		uint8x16_t in = vcltq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(span));
+		return vaddq_u8(v, vandq_u8(in, vdupq_n_u8(0x20)));
+}
+
+# define LoadVector(p)      vld1q_u8((const uint8_t*)(p))
+# define StoreVector(p, v)  vst1q_u8((uint8_t*)(p), (v))
+# define VectorsEqual(a, b) (vminvq_u8(vceqq_u8((a), (b))) == 0xFF)
+#endif
+
+/*******************************************************************
+ * Function: IRCFoldString                                         *
+ *                                                                 *
+ * Arguments: (const unsigned char*) case map, (char*) destination *
+ *            of at least length bytes, (const char*) string,      *
+ *            (size_t) length                                      *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Writes out the string with every byte folded       *
+ * through the case map, a block at a time. The destination may be *
+ * the string itself. The last block overlaps the one before it    *
+ * rather than going past the end, which is fine since folding     *
+ * what's already folded changes nothing.                          *
+ *                                                                 *
+ *******************************************************************/
+void IRCFoldString(const unsigned char *map, char *dst, const char *str, size_t len)
+{
+		assert(map && ((dst && str) || !len));
+
+		const unsigned char *src = (const unsigned char*)str;
+		unsigned char *out = (unsigned char*)dst;
+		int span = GetFoldSpan(map);
+
+		if (!span || len < 8)
+		{
+				for (size_t i = 0; i < len; ++i)
+						out[i] = map[src[i]];
+				return;
+		}
+
+#ifdef LoadVector
+		if (len >= CASEMAP_BLOCK)
+		{
+				for (size_t i = 0; i + CASEMAP_BLOCK < len; i += CASEMAP_BLOCK)
+						StoreVector(out + i, FoldVector(LoadVector(src + i), span));
+				StoreVector(out + len - CASEMAP_BLOCK, FoldVector(LoadVector(src + len - CASEMAP_BLOCK), span));
+				return;
+		}
+#endif
+
+		for (size_t i = 0; i + 8 < len; i += 8)
+		{
+				uint64_t word = FoldWord(LoadWord(src + i), span);
+				memcpy(out + i, &word, sizeof(word));
+		}
+
+		uint64_t word = FoldWord(LoadWord(src + len - 8), span);
+		memcpy(out + len - 8, &word, sizeof(word));
+}
+
+/*******************************************************************
+ * Function: IRCHashString                                         *
+ *                                                                 *
+ * Arguments: (const unsigned char*) case map, (const char*)       *
+ *            string, (size_t) length                              *
+ *                                                                 *
+ * Returns: (uint32_t) The hash of the folded string.              *
+ *                                                                 *
+ * Description: Folds the string 8 bytes at a time and mixes each  *
+ * word in with a multiply, so names which IRC considers equal     *
+ * always hash the same. The last word overlaps the one before it  *
+ * (and short strings are packed with LoadShort), the length goes  *
+ * into the hash as well so that can't make two names collide.     *
+ * Maps which aren't ours are the FNV-1a of the folded bytes.      *
+ *                                                                 *
+ *******************************************************************/
+uint32_t IRCHashString(const unsigned char *map, const char *str, size_t len)
+{
+		assert(map && (str || !len));
+
+		const unsigned char *p = (const unsigned char*)str;
+		int span = GetFoldSpan(map);
+
+		if (!span)
+		{
+				uint32_t hash = 2166136261U;
+				for (size_t i = 0; i < len; ++i)
+				{
+						hash ^= map[p[i]];
+						hash *= 16777619U;
+				}
+				return hash;
+		}
+
+		#define MIX(hash, word) ((hash) = ((hash) ^ (word)) * 0xFF51AFD7ED558CCDULL, (hash) ^= (hash) >> 32)
+
+		uint64_t hash = 0x9E3779B97F4A7C15ULL ^ len;
+		if (len >= 8)
+		{
+				for (size_t i = 0; i + 8 < len; i += 8)
+						MIX(hash, FoldWord(LoadWord(p + i), span));
+				MIX(hash, FoldWord(LoadWord(p + len - 8), span));
+		}
+		else if (len)
+				MIX(hash, FoldWord(LoadShort(p, len), span));
+
+		#undef MIX
+
+		// Finish off so every bit of the input reaches the bits we return.
+		hash ^= hash >> 33;
+		hash *= 0xC4CEB9FE1A85EC53ULL;
+		hash ^= hash >> 33;
+		return (uint32_t)hash;
+}
+
+/*******************************************************************
+ * Function: IRCStringEquals                                       *
+ *                                                                 *
+ * Arguments: (const unsigned char*) case map, (const char*) a,    *
+ *            (size_t) length of a, (const char*) b, (size_t)      *
+ *            length of b                                          *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ *******************************************************************/
+int IRCStringEquals(const unsigned char *map, const char *a, size_t alen, const char *b, size_t blen)
+{
+		assert(map);
+
+		if (alen != blen)
+				return 0;
+
+		const unsigned char *pa = (const unsigned char*)a, *pb = (const unsigned char*)b;
+		size_t len = alen;
+		int span = GetFoldSpan(map);
+
+		if (!span)
+		{
+				for (size_t i = 0; i < len; ++i)
+						if (map[pa[i]] != map[pb[i]])
+								return 0;
+				return 1;
+		}
+
+		// Like IRCHashString the last block (or word) overlaps the one
+		// before it, and strings under 8 bytes are packed into a word.
+#ifdef LoadVector
+		if (len >= CASEMAP_BLOCK)
+		{
+				for (size_t i = 0; i + CASEMAP_BLOCK < len; i += CASEMAP_BLOCK)
+						if (!VectorsEqual(FoldVector(LoadVector(pa + i), span), FoldVector(LoadVector(pb + i), span)))
+								return 0;
+
+				size_t last = len - CASEMAP_BLOCK;
+				return VectorsEqual(FoldVector(LoadVector(pa + last), span), FoldVector(LoadVector(pb + last), span));
+		}
+#endif
+
+		if (len >= 8)
+		{
+				for (size_t i = 0; i + 8 < len; i += 8)
+						if (FoldWord(LoadWord(pa + i), span) != FoldWord(LoadWord(pb + i), span))
+								return 0;
+				return FoldWord(LoadWord(pa + len - 8), span) == FoldWord(LoadWord(pb + len - 8), span);
+		}
+
+		return !len || FoldWord(LoadShort(pa, len), span) == FoldWord(LoadShort(pb, len), span);
+}
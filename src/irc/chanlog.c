@@ -0,0 +1,1197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "irc/casemap.h"
+#include "log/log.h"
+
+// Include our channel log types and function declarations.
+#include "irc/chanlog.h"
+
+// The most a record can be: the time, a space, a line and the \n.
+#define CHANLOG_RECORD_MAX (20 + 1 + RECVBUF_SIZE + 1)
+
+// What we look channels up by.
+typedef struct
+{
+		const unsigned char *map;
+		const char *name;
+		size_t len;
+} namekey_t;
+
+// What a reader saw of a channel when it started. Anything logged after
+// that is ignored so a reader never sees a record being written.
+typedef struct
+{
+		chanlogchannel_t *ch;
+		int count;        // How many index entries there were.
+		uint32_t segment; // The segment being written.
+		size_t length;    // How much of it was written.
+		chansearch_t *search; // Its search index, if we asked for it.
+} chanlogsnap_t;
+
+// The segment a reader has mapped.
+typedef struct
+{
+		const char *dir;
+		uint32_t segment;
+		const char *map;  // NULL until something is mapped.
+} chanlogview_t;
+
+static int MatchChannel(const void *item, const void *key)
+{
+		const chanlogchannel_t *ch = item;
+		const namekey_t *k = key;
+		return IRCStringEquals(k->map, ch->name, ch->namelen, k->name, k->len);
+}
+
+/*******************************************************************
+ * Function: GetWallTime                                           *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int64_t) Milliseconds since the epoch.                *
+ *                                                                 *
+ * Description: The logs outlive the process, so unlike the event  *
+ * loop's timers they go by the real time.                         *
+ *                                                                 *
+ *******************************************************************/
+static int64_t GetWallTime(void)
+{
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*******************************************************************
+ * Function: MakeDirectory                                         *
+ *                                                                 *
+ * Arguments: (const char*) path                                   *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ *******************************************************************/
+static int MakeDirectory(const char *path)
+{
+		if (mkdir(path, 0755) == -1 && errno != EEXIST)
+		{
+				LogError("Failed to create %s: %s (%d)", path, strerror(errno), errno);
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ChannelDirectory                                      *
+ *                                                                 *
+ * Arguments: chanlog_t*, strview_t name                           *
+ *                                                                 *
+ * Returns: (char*) The directory for the channel, or NULL if we   *
+ * ran out of memory. The caller has to free it.                   *
+ *                                                                 *
+ * Description: Channel names may have just about anything in      *
+ * them, including slashes. The name is case mapped (so #Foo and   *
+ * #foo share their logs) and anything unusual is %-escaped.       *
+ *                                                                 *
+ *******************************************************************/
+static char *ChannelDirectory(chanlog_t *log, strview_t name)
+{
+		static const char hex[] = "0123456789ABCDEF";
+		size_t dirlen = strlen(log->dir);
+
+		char *path = malloc(dirlen + 1 + name.len * 3 + 1);
+		if (!path)
+				return NULL;
+
+		memcpy(path, log->dir, dirlen);
+		char *p = path + dirlen;
+		*p++ = '/';
+
+		for (size_t i = 0; i < name.len; ++i)
+		{
+				unsigned char c = log->map[(unsigned char)name.ptr[i]];
+				if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (c && strchr("#&+!-_", c)) || (c == '.' && i))
+						*p++ = c;
+				else
+				{
+						*p++ = '%';
+						*p++ = hex[c >> 4];
+						*p++ = hex[c & 15];
+				}
+		}
+
+		*p = 0;
+		return path;
+}
+
+/*******************************************************************
+ * Function: MapSegment                                            *
+ *                                                                 *
+ * Arguments: (const char*) directory, (uint32_t) segment,         *
+ *            (int) whether we're going to write to it             *
+ *                                                                 *
+ * Returns: (char*) The mapped segment, or NULL on failure.        *
+ *                                                                 *
+ * Description: Maps a whole segment, creating it if we're going   *
+ * to write to it. The space is allocated now so running out of    *
+ * disk shows up here instead of as a SIGBUS in the middle of      *
+ * copying a line in.                                              *
+ *                                                                 *
+ *******************************************************************/
+static char *MapSegment(const char *dir, uint32_t segment, int writable)
+{
+		char path[PATH_MAX];
+		if ((size_t)snprintf(path, sizeof(path), "%s/%08u.log", dir, (unsigned)segment) >= sizeof(path))
+		{
+				errno = ENAMETOOLONG;
+				return NULL;
+		}
+
+		int fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+		if (fd == -1)
+				return NULL;
+
+		struct stat st;
+		if (fstat(fd, &st) == -1)
+				goto fail;
+
+		if (st.st_size < CHANLOG_SEGMENT_SIZE)
+		{
+				if (!writable)
+				{
+						errno = EINVAL;
+						goto fail;
+				}
+
+				// Not every file system can allocate space, a sparse file will do.
+				int err = posix_fallocate(fd, 0, CHANLOG_SEGMENT_SIZE);
+				if (err == EINVAL || err == EOPNOTSUPP)
+						err = ftruncate(fd, CHANLOG_SEGMENT_SIZE) == -1 ? errno : 0;
+				if (err)
+				{
+						errno = err;
+						goto fail;
+				}
+		}
+
+		void *map = mmap(NULL, CHANLOG_SEGMENT_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED)
+				goto fail;
+
+		close(fd);
+		return map;
+
+fail:
+		if (writable)
+				LogError("Failed to map %s: %s (%d)", path, strerror(errno), errno);
+		int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: LoadIndex                                             *
+ *                                                                 *
+ * Arguments: chanlogchannel_t*                                    *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Reads the channel's index file. An entry cut short *
+ * (we died while appending it) is dropped.                        *
+ *                                                                 *
+ *******************************************************************/
+static int LoadIndex(chanlogchannel_t *ch)
+{
+		struct stat st;
+		if (fstat(ch->indexfd, &st) == -1)
+				return 0;
+
+		size_t count = st.st_size / sizeof(chanlogindex_t);
+		if ((off_t)(count * sizeof(chanlogindex_t)) != st.st_size && ftruncate(ch->indexfd, count * sizeof(chanlogindex_t)) == -1)
+				return 0;
+
+		if (count && vec_reserve(&ch->index, count))
+				return 0;
+
+		size_t done = 0, want = count * sizeof(chanlogindex_t);
+		while (done < want)
+		{
+				ssize_t got = pread(ch->indexfd, (char*)ch->index.data + done, want - done, done);
+				if (got <= 0)
+				{
+						if (got == -1 && errno == EINTR)
+								continue;
+						return 0;
+				}
+				done += got;
+		}
+
+		ch->index.length = count;
+		ch->flushed = count;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: AddIndexEntry                                         *
+ *                                                                 *
+ * Arguments: chanlog_t*, chanlogchannel_t*, (int64_t) time,       *
+ *            (size_t) offset                                      *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Adds an entry for a record at the offset in the    *
+ * segment being written. It's written to disk with the next       *
+ * flush.                                                          *
+ *                                                                 *
+ *******************************************************************/
+static int AddIndexEntry(chanlog_t *log, chanlogchannel_t *ch, int64_t time, size_t offset)
+{
+		chanlogindex_t entry = { time, ch->segment, (uint32_t)offset };
+
+		pthread_rwlock_wrlock(&log->lock);
+		int ok = !vec_push(&ch->index, entry);
+		pthread_rwlock_unlock(&log->lock);
+
+		if (ok)
+				ch->indexed = offset;
+		return ok;
+}
+
+/*******************************************************************
+ * Function: SyncChannel                                           *
+ *                                                                 *
+ * Arguments: chanlogchannel_t*                                    *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Hands what was logged since the last time to the   *
+ * kernel and appends the new index entries to the index file.     *
+ * That's an msync and a write for however many lines came in.     *
+ *                                                                 *
+ *******************************************************************/
+static void SyncChannel(chanlogchannel_t *ch)
+{
+		size_t length = atomic_load_explicit(&ch->length, memory_order_relaxed);
+		if (length > ch->synced)
+		{
+				size_t page = (size_t)sysconf(_SC_PAGESIZE);
+				size_t start = ch->synced & ~(page - 1);
+				if (msync(ch->map + start, length - start, MS_ASYNC) == -1)
+						LogError("Failed to flush the log of %s: %s (%d)", ch->name, strerror(errno), errno);
+				ch->synced = length;
+		}
+
+		while (ch->flushed < ch->index.length)
+		{
+				ssize_t wrote = write(ch->indexfd, ch->index.data + ch->flushed, (ch->index.length - ch->flushed) * sizeof(chanlogindex_t));
+				if (wrote == -1 && errno == EINTR)
+						continue;
+
+				// write() only stops short of a whole entry when something is
+				// badly wrong, LoadIndex drops the piece next time.
+				if (wrote <= 0 || wrote % sizeof(chanlogindex_t))
+				{
+						LogError("Failed to write the index of %s: %s (%d)", ch->name, strerror(errno), errno);
+						break;
+				}
+				ch->flushed += wrote / sizeof(chanlogindex_t);
+		}
+}
+
+/*******************************************************************
+ * Function: FreeChannel                                           *
+ *                                                                 *
+ * Arguments: chanlogchannel_t*                                    *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void FreeChannel(chanlogchannel_t *ch)
+{
+		ReleaseSearchIndex(ch->search);
+		if (ch->map)
+				munmap(ch->map, CHANLOG_SEGMENT_SIZE);
+		if (ch->indexfd != -1)
+				close(ch->indexfd);
+
+		vec_deinit(&ch->index);
+		free(ch->dir);
+		free(ch->name);
+		free(ch);
+}
+
+/*******************************************************************
+ * Function: FindChannel                                           *
+ *                                                                 *
+ * Arguments: const chanlog_t*, strview_t name                     *
+ *                                                                 *
+ * Returns: (chanlogchannel_t*) The channel or NULL if it has no   *
+ * log open. Readers have to hold the lock.                        *
+ *                                                                 *
+ *******************************************************************/
+static chanlogchannel_t *FindChannel(const chanlog_t *log, strview_t name)
+{
+		namekey_t key = { log->map, name.ptr, name.len };
+		return FindHashItem(&log->channels, IRCHashString(log->map, name.ptr, name.len), MatchChannel, &key);
+}
+
+/*******************************************************************
+ * Function: NextRecord                                            *
+ *                                                                 *
+ * Arguments: (const char*) segment, (size_t*) position,           *
+ *            (size_t) end, (int64_t*) time, strview_t* line       *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Reads the record at `position' and moves past it.  *
+ * Returns false once there are no more before `end'.              *
+ *                                                                 *
+ *******************************************************************/
+static int NextRecord(const char *map, size_t *pos, size_t end, int64_t *time, strview_t *line)
+{
+		while (*pos < end && map[*pos])
+		{
+				const char *start = map + *pos;
+				const char *nl = memchr(start, '\n', end - *pos);
+				if (!nl)
+						return 0;
+
+				*pos = nl - map + 1;
+
+				int64_t t = 0;
+				const char *p = start;
+				while (p < nl && *p >= '0' && *p <= '9')
+						t = t * 10 + (*p++ - '0');
+
+				// Someone has been editing the logs, skip whatever this is.
+				if (p == start || p == nl || *p != ' ')
+						continue;
+
+				*time = t;
+				line->ptr = p + 1;
+				line->len = nl - p - 1;
+				return 1;
+		}
+
+		return 0;
+}
+
+/*******************************************************************
+ * Function: IndexRecords                                          *
+ *                                                                 *
+ * Arguments: chansearch_t*, (const char*) segment, (size_t) end   *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Adds every record of the segment up to `end' to    *
+ * the search index.                                               *
+ *                                                                 *
+ *******************************************************************/
+static int IndexRecords(chansearch_t *search, const char *map, size_t end)
+{
+		size_t pos = 0, start = 0;
+		int64_t time;
+		strview_t line;
+		int ok = 1;
+
+		while (NextRecord(map, &pos, end, &time, &line))
+		{
+				if (!AddSearchRecord(search, (uint32_t)start, line))
+						ok = 0;
+				start = pos;
+		}
+
+		return ok;
+}
+
+/*******************************************************************
+ * Function: SearchIndexPath                                       *
+ *                                                                 *
+ * Arguments: (char*) buffer, (size_t) size, (const char*)         *
+ *            directory, (uint32_t) segment                        *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ *******************************************************************/
+static int SearchIndexPath(char *path, size_t size, const char *dir, uint32_t segment)
+{
+		if ((size_t)snprintf(path, size, "%s/%08u.idx", dir, (unsigned)segment) >= size)
+		{
+				errno = ENAMETOOLONG;
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: OpenChannel                                           *
+ *                                                                 *
+ * Arguments: chanlog_t*, strview_t name                           *
+ *                                                                 *
+ * Returns: (chanlogchannel_t*) The channel or NULL on failure.    *
+ *                                                                 *
+ * Description: Opens (or starts) the channel's log and finds      *
+ * where we left off: right after the last record in the newest    *
+ * segment.                                                        *
+ *                                                                 *
+ *******************************************************************/
+static chanlogchannel_t *OpenChannel(chanlog_t *log, strview_t name)
+{
+		chanlogchannel_t *ch = calloc(1, sizeof(chanlogchannel_t));
+		if (!ch)
+				return NULL;
+
+		ch->indexfd = -1;
+		vec_init(&ch->index);
+
+		ch->name = strndup(name.ptr, name.len);
+		ch->namelen = name.len;
+		ch->hash = IRCHashString(log->map, name.ptr, name.len);
+		ch->dir = ChannelDirectory(log, name);
+		if (!ch->name || !ch->dir || !MakeDirectory(ch->dir))
+				goto fail;
+
+		char path[PATH_MAX];
+		if ((size_t)snprintf(path, sizeof(path), "%s/index", ch->dir) >= sizeof(path))
+		{
+				errno = ENAMETOOLONG;
+				goto fail;
+		}
+
+		ch->indexfd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+		if (ch->indexfd == -1 || !LoadIndex(ch))
+				goto fail;
+
+		const chanlogindex_t *last = ch->index.length ? &vec_last(&ch->index) : NULL;
+		ch->segment = last ? last->segment : 0;
+		ch->map = MapSegment(ch->dir, ch->segment, 1);
+		if (!ch->map)
+				goto fail;
+
+		// The index lags behind the records by up to a flush, carry on
+		// from wherever the last one we know of ends.
+		size_t start = last ? last->offset : 0;
+		const char *end = memchr(ch->map + start, 0, CHANLOG_SEGMENT_SIZE - start);
+		size_t length = end ? (size_t)(end - ch->map) : CHANLOG_SEGMENT_SIZE;
+		atomic_init(&ch->length, length);
+		ch->synced = length;
+		ch->indexed = start;
+
+		// The segment being written is indexed in memory, which has to
+		// be built again from what's in it.
+		ch->search = CreateSearchIndex();
+		if (!ch->search)
+				goto fail;
+		if (!IndexRecords(ch->search, ch->map, length))
+				LogError("Failed to index some of the log of %.*s", (int)name.len, name.ptr);
+
+		// Readers start at an index entry, so there has to be one.
+		if (!last && !AddIndexEntry(log, ch, 0, 0))
+				goto fail;
+
+		pthread_rwlock_wrlock(&log->lock);
+		int inserted = InsertHashItem(&log->channels, ch->hash, ch);
+		pthread_rwlock_unlock(&log->lock);
+
+		if (inserted)
+				return ch;
+
+fail:
+		LogError("Failed to open the log of %.*s: %s (%d)", (int)name.len, name.ptr, strerror(errno), errno);
+		FreeChannel(ch);
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: RotateSegment                                         *
+ *                                                                 *
+ * Arguments: chanlog_t*, chanlogchannel_t*, (int64_t) time        *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Flushes the full segment, writes out its search    *
+ * index and starts the next one. The index is written first so    *
+ * anyone who sees the new segment finds the old one's index.      *
+ *                                                                 *
+ *******************************************************************/
+static int RotateSegment(chanlog_t *log, chanlogchannel_t *ch, int64_t time)
+{
+		SyncChannel(ch);
+
+		// If this fails searches build the index from the segment instead.
+		char path[PATH_MAX];
+		if (SearchIndexPath(path, sizeof(path), ch->dir, ch->segment))
+				WriteSearchIndex(ch->search, path);
+
+		chansearch_t *search = CreateSearchIndex();
+		char *map = search ? MapSegment(ch->dir, ch->segment + 1, 1) : NULL;
+		if (!map)
+		{
+				ReleaseSearchIndex(search);
+				return 0;
+		}
+
+		pthread_rwlock_wrlock(&log->lock);
+		int ok = !vec_reserve(&ch->index, ch->index.length + 1);
+		chansearch_t *old = ch->search;
+		if (ok)
+		{
+				chanlogindex_t entry = { time, ch->segment + 1, 0 };
+				ch->index.data[ch->index.length++] = entry;
+				ch->segment++;
+				ch->search = search;
+				atomic_store_explicit(&ch->length, 0, memory_order_relaxed);
+		}
+		pthread_rwlock_unlock(&log->lock);
+
+		if (!ok)
+		{
+				munmap(map, CHANLOG_SEGMENT_SIZE);
+				ReleaseSearchIndex(search);
+				return 0;
+		}
+
+		// Searches still going through it hold their own references.
+		ReleaseSearchIndex(old);
+
+		munmap(ch->map, CHANLOG_SEGMENT_SIZE);
+		ch->map = map;
+		ch->synced = 0;
+		ch->indexed = 0;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: FlushTimerHandler                                     *
+ *                                                                 *
+ * Arguments: evtimer_t*, void* (the chanlog_t)                    *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void FlushTimerHandler(evtimer_t *timer, void *data)
+{
+		FlushChannelLog(data);
+}
+
+/*******************************************************************
+ * Function: InitializeChannelLog                                  *
+ *                                                                 *
+ * Arguments: chanlog_t*, (const char*) directory,                 *
+ *            (const char*) network                                *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sets up logging to a directory for the network in  *
+ * `dir', creating them if they don't exist. Channels are opened   *
+ * as they're logged to. This has to be called on the event loop   *
+ * thread which writes the log.                                    *
+ *                                                                 *
+ *******************************************************************/
+int InitializeChannelLog(chanlog_t *log, const char *dir, const char *network)
+{
+		assert(log && dir && network);
+		memset(log, 0, sizeof(chanlog_t));
+
+		if (!MakeDirectory(dir))
+				return 0;
+
+		// The network is a hostname (or address) but make sure of it.
+		size_t len = strlen(dir) + 1 + strlen(network) + 1;
+		log->dir = malloc(len);
+		if (!log->dir)
+				return 0;
+
+		snprintf(log->dir, len, "%s/%s", dir, network);
+		for (char *p = log->dir + strlen(dir) + 1; *p; ++p)
+				if (*p == '/')
+						*p = '_';
+
+		// The server can change how it compares names once we're connected,
+		// but the files are already named by now. RFC 1459 it is.
+		log->map = GetIRCCaseMap(IRC_CASEMAP_RFC1459);
+
+		if (!MakeDirectory(log->dir) || !InitializeHashTable(&log->channels, 16))
+		{
+				free(log->dir);
+				return 0;
+		}
+
+		pthread_rwlock_init(&log->lock, NULL);
+		vec_init(&log->dirty);
+		InitializeTimer(&log->timer, FlushTimerHandler, log);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: CloseChannelLog                                       *
+ *                                                                 *
+ * Arguments: chanlog_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Flushes everything and stops the flush timer, the  *
+ * log can't be written to after this but it can still be read.    *
+ * Has to be called on the event loop thread which wrote the log.  *
+ *                                                                 *
+ *******************************************************************/
+void CloseChannelLog(chanlog_t *log)
+{
+		assert(log);
+
+		StopTimer(&log->timer);
+		FlushChannelLog(log);
+}
+
+/*******************************************************************
+ * Function: DestroyChannelLog                                     *
+ *                                                                 *
+ * Arguments: chanlog_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Frees everything. The log has to have been closed  *
+ * and nothing may be reading it any more.                         *
+ *                                                                 *
+ *******************************************************************/
+void DestroyChannelLog(chanlog_t *log)
+{
+		assert(log && !IsTimerPending(&log->timer));
+
+		uint32_t iter = 0;
+		chanlogchannel_t *ch;
+		while ((ch = NextHashItem(&log->channels, &iter)))
+				FreeChannel(ch);
+
+		DestroyHashTable(&log->channels);
+		pthread_rwlock_destroy(&log->lock);
+		vec_deinit(&log->dirty);
+		free(log->dir);
+		log->dir = NULL;
+}
+
+/*******************************************************************
+ * Function: AppendChannelLog                                      *
+ *                                                                 *
+ * Arguments: chanlog_t*, strview_t channel, strview_t line        *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Logs a line (without its \r\n) to the channel. It  *
+ * reaches the disk with the next flush, which is at most          *
+ * CHANLOG_FLUSH_INTERVAL away. Must be called on the event loop   *
+ * thread which writes the log.                                    *
+ *                                                                 *
+ *******************************************************************/
+int AppendChannelLog(chanlog_t *log, strview_t channel, strview_t line)
+{
+		assert(log && log->dir);
+
+		// A NUL would look like the end of the segment next time we open it.
+		if (!channel.len || (line.len && memchr(line.ptr, 0, line.len)))
+		{
+				errno = EINVAL;
+				return 0;
+		}
+
+		chanlogchannel_t *ch = FindChannel(log, channel);
+		if (!ch && !(ch = OpenChannel(log, channel)))
+				return 0;
+
+		int64_t now = GetWallTime();
+		char stamp[24];
+		int stamplen = snprintf(stamp, sizeof(stamp), "%lld ", (long long)now);
+		size_t need = stamplen + line.len + 1;
+		if (need > CHANLOG_RECORD_MAX)
+		{
+				errno = E2BIG;
+				return 0;
+		}
+
+		size_t length = atomic_load_explicit(&ch->length, memory_order_relaxed);
+		if (length + need > CHANLOG_SEGMENT_SIZE)
+		{
+				if (!RotateSegment(log, ch, now))
+						return 0;
+				length = 0;
+		}
+		else if (length - ch->indexed >= CHANLOG_INDEX_STRIDE && !AddIndexEntry(log, ch, now, length))
+				return 0;
+
+		char *p = ch->map + length;
+		memcpy(p, stamp, stamplen);
+		memcpy(p + stamplen, line.ptr, line.len);
+		p[stamplen + line.len] = '\n';
+
+		// Readers only look as far as this, so the record is complete by
+		// the time they can see it.
+		atomic_store_explicit(&ch->length, length + need, memory_order_release);
+
+		if (!AddSearchRecord(ch->search, (uint32_t)length, line))
+				LogError("Failed to index a line of %s: %s (%d)", ch->name, strerror(errno), errno);
+
+		if (!ch->dirty)
+		{
+				if (vec_push(&log->dirty, ch))
+				{
+						SyncChannel(ch);
+						return 1;
+				}
+				ch->dirty = 1;
+		}
+
+		if (!IsTimerPending(&log->timer))
+				StartTimer(&log->timer, CHANLOG_FLUSH_INTERVAL);
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: FlushChannelLog                                       *
+ *                                                                 *
+ * Arguments: chanlog_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Flushes every channel logged to since the last     *
+ * time. Must be called on the event loop thread which writes the  *
+ * log.                                                            *
+ *                                                                 *
+ *******************************************************************/
+void FlushChannelLog(chanlog_t *log)
+{
+		assert(log);
+
+		chanlogchannel_t *ch;
+		int i;
+		vec_foreach(&log->dirty, ch, i)
+		{
+				SyncChannel(ch);
+				ch->dirty = 0;
+		}
+
+		vec_clear(&log->dirty);
+}
+
+/*******************************************************************
+ * Function: TakeSnapshot                                          *
+ *                                                                 *
+ * Arguments: chanlog_t*, strview_t channel, chanlogsnap_t*,       *
+ *            (int) whether to hold on to the search index         *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Notes how much of the channel's log there is right *
+ * now. Returns false if the channel has no log open. If asked the *
+ * snapshot holds a reference to the index of the segment being    *
+ * written, which has to be released.                              *
+ *                                                                 *
+ *******************************************************************/
+static int TakeSnapshot(chanlog_t *log, strview_t channel, chanlogsnap_t *snap, int search)
+{
+		pthread_rwlock_rdlock(&log->lock);
+		snap->ch = FindChannel(log, channel);
+		snap->search = NULL;
+		if (snap->ch)
+		{
+				if (search)
+						snap->search = AcquireSearchIndex(snap->ch->search);
+				snap->count = snap->ch->index.length;
+				snap->segment = snap->ch->segment;
+				snap->length = atomic_load_explicit(&snap->ch->length, memory_order_acquire);
+		}
+		pthread_rwlock_unlock(&log->lock);
+
+		if (!snap->ch)
+				errno = ENOENT;
+		return snap->ch != NULL;
+}
+
+/*******************************************************************
+ * Function: GetChunk                                              *
+ *                                                                 *
+ * Arguments: chanlog_t*, const chanlogsnap_t*, (int) entry,       *
+ *            chanlogindex_t*, (size_t*) end                       *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Finds the records between an index entry and the   *
+ * next one: they're in `start->segment' from `start->offset' to   *
+ * `end', or to the first zero if that comes first.                *
+ *                                                                 *
+ *******************************************************************/
+static void GetChunk(chanlog_t *log, const chanlogsnap_t *snap, int i, chanlogindex_t *start, size_t *end)
+{
+		pthread_rwlock_rdlock(&log->lock);
+		*start = snap->ch->index.data[i];
+		chanlogindex_t next = i + 1 < snap->count ? snap->ch->index.data[i + 1] : *start;
+		pthread_rwlock_unlock(&log->lock);
+
+		if (i + 1 < snap->count && next.segment == start->segment)
+				*end = next.offset;
+		else if (start->segment == snap->segment)
+				*end = snap->length;
+		else
+				*end = CHANLOG_SEGMENT_SIZE;
+}
+
+/*******************************************************************
+ * Function: ViewSegment                                           *
+ *                                                                 *
+ * Arguments: chanlogview_t*, (uint32_t) segment                   *
+ *                                                                 *
+ * Returns: (const char*) The segment, NULL if it can't be mapped. *
+ *                                                                 *
+ * Description: Maps a segment for reading, keeping the last one   *
+ * mapped since consecutive chunks are mostly in the same one.     *
+ *                                                                 *
+ *******************************************************************/
+static const char *ViewSegment(chanlogview_t *view, uint32_t segment)
+{
+		if (view->map && view->segment == segment)
+				return view->map;
+
+		if (view->map)
+				munmap((void*)view->map, CHANLOG_SEGMENT_SIZE);
+
+		view->segment = segment;
+		view->map = MapSegment(view->dir, segment, 0);
+		return view->map;
+}
+
+/*******************************************************************
+ * Function: ReadChannelLog                                        *
+ *                                                                 *
+ * Arguments: chanlog_t*, strview_t channel, (int64_t) since,      *
+ *            ChanLogCallback, void*                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Calls the callback for every record logged to the  *
+ * channel from `since' (milliseconds since the epoch) on, oldest  *
+ * first. The index takes us straight to the stride they start in. *
+ * Can be called from any thread. Returns false if the channel has *
+ * no log or a segment couldn't be read.                           *
+ *                                                                 *
+ *******************************************************************/
+int ReadChannelLog(chanlog_t *log, strview_t channel, int64_t since, ChanLogCallback callback, void *data)
+{
+		assert(log && callback);
+
+		chanlogsnap_t snap;
+		if (!TakeSnapshot(log, channel, &snap, 0))
+				return 0;
+
+		// Find the first entry at or after `since', the records before it
+		// which are recent enough are in the stride before.
+		pthread_rwlock_rdlock(&log->lock);
+		int lo = 0, hi = snap.count;
+		while (lo < hi)
+		{
+				int mid = lo + (hi - lo) / 2;
+				if (snap.ch->index.data[mid].time < since)
+						lo = mid + 1;
+				else
+						hi = mid;
+		}
+		pthread_rwlock_unlock(&log->lock);
+
+		chanlogview_t view = { snap.ch->dir, 0, NULL };
+		int ok = 1, more = 1;
+
+		for (int i = lo ? lo - 1 : 0; more && i < snap.count; ++i)
+		{
+				chanlogindex_t start;
+				size_t end;
+				GetChunk(log, &snap, i, &start, &end);
+
+				const char *map = ViewSegment(&view, start.segment);
+				if (!map)
+				{
+						ok = 0;
+						break;
+				}
+
+				size_t pos = start.offset;
+				int64_t time;
+				strview_t line;
+				while (more && NextRecord(map, &pos, end, &time, &line))
+						if (time >= since)
+								more = callback(time, line, data);
+		}
+
+		if (view.map)
+				munmap((void*)view.map, CHANLOG_SEGMENT_SIZE);
+		return ok;
+}
+
+/*******************************************************************
+ * Function: ReadChannelLogBackwards                               *
+ *                                                                 *
+ * Arguments: chanlog_t*, strview_t channel, ChanLogCallback,      *
+ *            void*                                                *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Calls the callback for every record logged to the  *
+ * channel, newest first, until it returns 0. Records are read a   *
+ * stride at a time so only what the callback asks for is read.    *
+ * Can be called from any thread. Returns false if the channel has *
+ * no log or a segment couldn't be read.                           *
+ *                                                                 *
+ *******************************************************************/
+int ReadChannelLogBackwards(chanlog_t *log, strview_t channel, ChanLogCallback callback, void *data)
+{
+		assert(log && callback);
+
+		chanlogsnap_t snap;
+		if (!TakeSnapshot(log, channel, &snap, 0))
+				return 0;
+
+		chanlogview_t view = { snap.ch->dir, 0, NULL };
+		vec_t(uint32_t) records;
+		vec_init(&records);
+		int ok = 1, more = 1;
+
+		for (int i = snap.count - 1; more && i >= 0; --i)
+		{
+				chanlogindex_t start;
+				size_t end;
+				GetChunk(log, &snap, i, &start, &end);
+
+				const char *map = ViewSegment(&view, start.segment);
+				if (!map)
+				{
+						ok = 0;
+						break;
+				}
+
+				// Records can only be found going forward, so note where the
+				// stride's start and then go through them the other way.
+				vec_clear(&records);
+				size_t pos = start.offset, prev = pos;
+				int64_t time;
+				strview_t line;
+				while (NextRecord(map, &pos, end, &time, &line))
+				{
+						if (vec_push(&records, (uint32_t)prev))
+						{
+								ok = more = 0;
+								break;
+						}
+						prev = pos;
+				}
+
+				for (int r = records.length - 1; more && r >= 0; --r)
+				{
+						pos = records.data[r];
+						if (NextRecord(map, &pos, end, &time, &line))
+								more = callback(time, line, data);
+				}
+		}
+
+		vec_deinit(&records);
+		if (view.map)
+				munmap((void*)view.map, CHANLOG_SEGMENT_SIZE);
+		return ok;
+}
+
+/*******************************************************************
+ * Function: LoadSegmentIndex                                      *
+ *                                                                 *
+ * Arguments: chanlogchannel_t*, (uint32_t) segment,               *
+ *            chanlogview_t*, chansearchfile_t*, chansearch_t**    *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Opens the search index of a full segment. Segments *
+ * logged before we had indexes (or whose index couldn't be        *
+ * written) are indexed now, and the index is kept for next time.  *
+ * If it can't be kept (eg, the disk is full) the index we built   *
+ * is handed back in `temp' instead, to be released by the caller. *
+ *                                                                 *
+ *******************************************************************/
+static int LoadSegmentIndex(chanlogchannel_t *ch, uint32_t segment, chanlogview_t *view, chansearchfile_t *file, chansearch_t **temp)
+{
+		*temp = NULL;
+
+		char path[PATH_MAX];
+		if (!SearchIndexPath(path, sizeof(path), ch->dir, segment))
+				return 0;
+
+		if (OpenSearchFile(file, path))
+				return 1;
+
+		const char *map = ViewSegment(view, segment);
+		chansearch_t *search = map ? CreateSearchIndex() : NULL;
+		if (!search)
+				return 0;
+
+		if (!IndexRecords(search, map, CHANLOG_SEGMENT_SIZE))
+		{
+				ReleaseSearchIndex(search);
+				return 0;
+		}
+
+		if (WriteSearchIndex(search, path) && OpenSearchFile(file, path))
+		{
+				ReleaseSearchIndex(search);
+				return 1;
+		}
+
+		*temp = search;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ContainsOffset                                        *
+ *                                                                 *
+ * Arguments: const chansearchpostings_t*, (uint32_t) offset       *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ *******************************************************************/
+static int ContainsOffset(const chansearchpostings_t *list, uint32_t offset)
+{
+		int lo = 0, hi = list->length;
+		while (lo < hi)
+		{
+				int mid = lo + (hi - lo) / 2;
+				if (list->data[mid] < offset)
+						lo = mid + 1;
+				else
+						hi = mid;
+		}
+
+		return lo < list->length && list->data[lo] == offset;
+}
+
+/*******************************************************************
+ * Function: SearchChannelLog                                      *
+ *                                                                 *
+ * Arguments: chanlog_t*, strview_t channel, strview_t query,      *
+ *            ChanLogCallback, void*                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Calls the callback for every record said in the    *
+ * channel with all the words of the query in it, newest first,    *
+ * until it returns 0. Every segment costs a lookup per word in    *
+ * its index and then only the matching records are read. Can be   *
+ * called from any thread, appending to the log carries on         *
+ * meanwhile. Returns false if the query has no words, the channel *
+ * has no log or something couldn't be read.                       *
+ *                                                                 *
+ *******************************************************************/
+int SearchChannelLog(chanlog_t *log, strview_t channel, strview_t query, ChanLogCallback callback, void *data)
+{
+		assert(log && callback);
+
+		char tokens[CHANLOG_QUERY_MAX][CHANSEARCH_TOKEN_MAX];
+		size_t lens[CHANLOG_QUERY_MAX];
+		int ntokens = 0;
+
+		while (ntokens < CHANLOG_QUERY_MAX && NextSearchToken(&query, tokens[ntokens], &lens[ntokens]))
+		{
+				int dup = 0;
+				for (int t = 0; t < ntokens && !dup; ++t)
+						dup = lens[t] == lens[ntokens] && !memcmp(tokens[t], tokens[ntokens], lens[t]);
+				if (!dup)
+						ntokens++;
+		}
+
+		if (!ntokens)
+		{
+				errno = EINVAL;
+				return 0;
+		}
+
+		chanlogsnap_t snap;
+		if (!TakeSnapshot(log, channel, &snap, 1))
+				return 0;
+
+		chansearchpostings_t lists[CHANLOG_QUERY_MAX];
+		for (int t = 0; t < ntokens; ++t)
+				vec_init(&lists[t]);
+
+		chanlogview_t view = { snap.ch->dir, 0, NULL };
+		int ok = 1, more = 1;
+
+		for (int64_t segment = snap.segment; ok && more && segment >= 0; --segment)
+		{
+				chansearchfile_t file;
+				chansearch_t *temp = NULL;
+				int current = segment == snap.segment;
+
+				if (!current && !LoadSegmentIndex(snap.ch, (uint32_t)segment, &view, &file, &temp))
+				{
+						// Nothing was ever logged there, eg. it was deleted by hand.
+						if (errno == ENOENT)
+								continue;
+						ok = 0;
+						break;
+				}
+
+				// Start with the word in the fewest records, most of them only
+				// need a binary search of the other lists to rule out.
+				int rarest = 0;
+				for (int t = 0; ok && t < ntokens; ++t)
+				{
+						vec_clear(&lists[t]);
+						if (current || temp)
+								ok = GetSearchPostings(current ? snap.search : temp, tokens[t], lens[t], &lists[t]);
+						else
+								ok = GetSearchFilePostings(&file, tokens[t], lens[t], &lists[t]);
+						if (lists[t].length < lists[rarest].length)
+								rarest = t;
+				}
+
+				if (temp)
+						ReleaseSearchIndex(temp);
+				else if (!current)
+						CloseSearchFile(&file);
+
+				const char *map = ok && lists[rarest].length ? ViewSegment(&view, (uint32_t)segment) : NULL;
+				if (ok && lists[rarest].length && !map)
+						ok = 0;
+
+				size_t end = current ? snap.length : CHANLOG_SEGMENT_SIZE;
+				for (int r = lists[rarest].length - 1; ok && more && r >= 0; --r)
+				{
+						uint32_t offset = lists[rarest].data[r];
+
+						// Indexed after we took the snapshot.
+						if (offset >= end)
+								continue;
+
+						int all = 1;
+						for (int t = 0; all && t < ntokens; ++t)
+								all = t == rarest || ContainsOffset(&lists[t], offset);
+						if (!all)
+								continue;
+
+						size_t pos = offset;
+						int64_t time;
+						strview_t line;
+						if (NextRecord(map, &pos, end, &time, &line))
+								more = callback(time, line, data);
+				}
+		}
+
+		for (int t = 0; t < ntokens; ++t)
+				vec_deinit(&lists[t]);
+		if (view.map)
+				munmap((void*)view.map, CHANLOG_SEGMENT_SIZE);
+		ReleaseSearchIndex(snap.search);
+		return ok;
+}
@@ -0,0 +1,640 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "irc/parser.h"
+#include "log/log.h"
+
+// Include our search index types and function declarations.
+#include "irc/chansearch.h"
+
+// What an index file starts with, and the version of its layout.
+#define CHANSEARCH_MAGIC   "PNSX"
+#define CHANSEARCH_VERSION 1
+
+// How big the blocks the terms and lists are carved out of are.
+#define CHANSEARCH_ARENA_SIZE (256 << 10)
+
+// The start of an index file: the header, then `nterms' entries sorted
+// by word and then the lists they point at.
+typedef struct
+{
+		char magic[4];
+		uint32_t version;
+		uint32_t nterms;
+		uint32_t reserved;
+} chansearchheader_t;
+
+struct chansearchentry_s
+{
+		char token[CHANSEARCH_TOKEN_MAX]; // Padded with zeroes.
+		uint32_t count;  // How many postings there are.
+		uint32_t bytes;  // How long the list is.
+		uint64_t offset; // Where in the file the list starts.
+};
+
+// What we look terms up by.
+typedef struct
+{
+		const char *token;
+		size_t len;
+} termkey_t;
+
+static int MatchTerm(const void *item, const void *key)
+{
+		const chansearchterm_t *term = item;
+		const termkey_t *k = key;
+		return term->len == k->len && !memcmp(term->token, k->token, k->len);
+}
+
+/*******************************************************************
+ * Function: HashToken                                             *
+ *                                                                 *
+ * Arguments: (const char*) token, (size_t) length                 *
+ *                                                                 *
+ * Returns: (uint32_t) FNV-1a of the token.                        *
+ *                                                                 *
+ *******************************************************************/
+static uint32_t HashToken(const char *token, size_t len)
+{
+		uint32_t hash = 2166136261U;
+		for (size_t i = 0; i < len; ++i)
+				hash = (hash ^ (unsigned char)token[i]) * 16777619U;
+		return hash;
+}
+
+/*******************************************************************
+ * Function: IsTokenByte                                           *
+ *                                                                 *
+ * Arguments: (unsigned char)                                      *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ *******************************************************************/
+static inline int IsTokenByte(unsigned char c)
+{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+/*******************************************************************
+ * Function: NextSearchToken                                       *
+ *                                                                 *
+ * Arguments: strview_t* text, (char*) token, (size_t*) length     *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Finds the next word in the text and moves past it. *
+ * The word is folded and cut down the same way as the index does, *
+ * into `token' (which needs room for CHANSEARCH_TOKEN_MAX bytes,  *
+ * the rest are set to zero). Returns false once there are none.   *
+ *                                                                 *
+ *******************************************************************/
+int NextSearchToken(strview_t *text, char *token, size_t *len)
+{
+		const unsigned char *p = (const unsigned char*)text->ptr;
+		const unsigned char *end = p + text->len;
+
+		while (p < end)
+		{
+				while (p < end && !IsTokenByte(*p))
+						p++;
+
+				size_t n = 0;
+				memset(token, 0, CHANSEARCH_TOKEN_MAX);
+				for (; p < end && IsTokenByte(*p); ++p)
+						if (n < CHANSEARCH_TOKEN_MAX)
+								token[n++] = *p >= 'A' && *p <= 'Z' ? *p + ('a' - 'A') : *p;
+
+				if (n >= CHANSEARCH_TOKEN_MIN)
+				{
+						text->len -= (const char*)p - text->ptr;
+						text->ptr = (const char*)p;
+						*len = n;
+						return 1;
+				}
+		}
+
+		text->ptr += text->len;
+		text->len = 0;
+		return 0;
+}
+
+/*******************************************************************
+ * Function: CreateSearchIndex                                     *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (chansearch_t*) An empty index or NULL if we ran out   *
+ * of memory. The caller holds the only reference to it.           *
+ *                                                                 *
+ *******************************************************************/
+chansearch_t *CreateSearchIndex(void)
+{
+		chansearch_t *search = calloc(1, sizeof(chansearch_t));
+		if (!search)
+				return NULL;
+
+		if (!InitializeHashTable(&search->terms, 1024))
+		{
+				free(search);
+				return NULL;
+		}
+
+		atomic_init(&search->refs, 1);
+		pthread_rwlock_init(&search->lock, NULL);
+		InitializeArena(&search->arena, CHANSEARCH_ARENA_SIZE);
+		return search;
+}
+
+/*******************************************************************
+ * Function: AcquireSearchIndex                                    *
+ *                                                                 *
+ * Arguments: chansearch_t*                                        *
+ *                                                                 *
+ * Returns: (chansearch_t*) The same index.                        *
+ *                                                                 *
+ * Description: Takes another reference, the index is only freed   *
+ * once every one of them has been released.                       *
+ *                                                                 *
+ *******************************************************************/
+chansearch_t *AcquireSearchIndex(chansearch_t *search)
+{
+		if (search)
+				atomic_fetch_add_explicit(&search->refs, 1, memory_order_relaxed);
+		return search;
+}
+
+/*******************************************************************
+ * Function: ReleaseSearchIndex                                    *
+ *                                                                 *
+ * Arguments: chansearch_t*                                        *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Drops a reference, freeing the index if it was the *
+ * last one. Can be called from any thread.                        *
+ *                                                                 *
+ *******************************************************************/
+void ReleaseSearchIndex(chansearch_t *search)
+{
+		if (!search || atomic_fetch_sub_explicit(&search->refs, 1, memory_order_acq_rel) != 1)
+				return;
+
+		DestroyHashTable(&search->terms);
+		DestroyArena(&search->arena);
+		pthread_rwlock_destroy(&search->lock);
+		free(search);
+}
+
+/*******************************************************************
+ * Function: NewBlock                                              *
+ *                                                                 *
+ * Arguments: chansearch_t*                                        *
+ *                                                                 *
+ * Returns: (chansearchblock_t*) An empty block, NULL if we ran    *
+ * out of memory.                                                  *
+ *                                                                 *
+ *******************************************************************/
+static chansearchblock_t *NewBlock(chansearch_t *search)
+{
+		chansearchblock_t *block = ArenaAlloc(&search->arena, sizeof(chansearchblock_t));
+		if (block)
+				block->next = NULL;
+		return block;
+}
+
+/*******************************************************************
+ * Function: AddPosting                                            *
+ *                                                                 *
+ * Arguments: chansearch_t*, chansearchterm_t*, (uint32_t) offset  *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Appends the offset to the term's list as the       *
+ * difference to the last one. The new bytes are only published    *
+ * once they (and the block they went in) are all written.         *
+ *                                                                 *
+ *******************************************************************/
+static int AddPosting(chansearch_t *search, chansearchterm_t *term, uint32_t offset)
+{
+		// A word said twice in a line is found just the same.
+		if (term->count && term->last == offset)
+				return 1;
+
+		unsigned char varint[5];
+		size_t n = 0;
+		uint32_t delta = offset - (term->count ? term->last : 0);
+		do
+		{
+				varint[n] = delta & 0x7F;
+				delta >>= 7;
+				if (delta)
+						varint[n] |= 0x80;
+				n++;
+		} while (delta);
+
+		size_t bytes = atomic_load_explicit(&term->bytes, memory_order_relaxed);
+		size_t used = bytes % CHANSEARCH_BLOCK_SIZE;
+		if (bytes && !used)
+				used = CHANSEARCH_BLOCK_SIZE;
+
+		chansearchblock_t *next = NULL;
+		if (used + n > CHANSEARCH_BLOCK_SIZE && !(next = NewBlock(search)))
+				return 0;
+
+		for (size_t i = 0; i < n; ++i)
+		{
+				if (used == CHANSEARCH_BLOCK_SIZE)
+				{
+						term->tail->next = next;
+						term->tail = next;
+						used = 0;
+				}
+				term->tail->data[used++] = varint[i];
+		}
+
+		atomic_store_explicit(&term->bytes, bytes + n, memory_order_release);
+		term->last = offset;
+		term->count++;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: AddSearchRecord                                       *
+ *                                                                 *
+ * Arguments: chansearch_t*, (uint32_t) offset, strview_t line     *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Indexes the words of the line logged at `offset'.  *
+ * Only what people say is indexed (PRIVMSG, NOTICE and TOPIC).    *
+ * Offsets have to be added in order. Only one thread may add to   *
+ * an index, any number can read it meanwhile. Returns false if we *
+ * ran out of memory, some of the words may be missing then.       *
+ *                                                                 *
+ *******************************************************************/
+int AddSearchRecord(chansearch_t *search, uint32_t offset, strview_t line)
+{
+		assert(search);
+
+		ircmsg_t msg;
+		if (!ParseIRCMessage(line, &msg) || msg.nparams < 2)
+				return 1;
+
+		if (!IRCSpanEquals(&msg, msg.command, "PRIVMSG") && !IRCSpanEquals(&msg, msg.command, "NOTICE") && !IRCSpanEquals(&msg, msg.command, "TOPIC"))
+				return 1;
+
+		strview_t text = IRCSpan(&msg, msg.params[msg.nparams - 1]);
+		char token[CHANSEARCH_TOKEN_MAX];
+		size_t len;
+		int ok = 1;
+
+		while (NextSearchToken(&text, token, &len))
+		{
+				termkey_t key = { token, len };
+				uint32_t hash = HashToken(token, len);
+
+				// We're the only one changing the table, no need to lock to read it.
+				chansearchterm_t *term = FindHashItem(&search->terms, hash, MatchTerm, &key);
+				if (!term)
+				{
+						term = ArenaAlloc(&search->arena, sizeof(chansearchterm_t));
+						chansearchblock_t *head = NewBlock(search);
+						if (!term || !head)
+						{
+								ok = 0;
+								continue;
+						}
+
+						memcpy(term->token, token, CHANSEARCH_TOKEN_MAX);
+						term->len = len;
+						term->hash = hash;
+						term->count = 0;
+						term->last = 0;
+						term->head = term->tail = head;
+						atomic_init(&term->bytes, 0);
+
+						// Readers can't find it until it's in the table, so fill in
+						// the first posting beforehand.
+						AddPosting(search, term, offset);
+
+						pthread_rwlock_wrlock(&search->lock);
+						int inserted = InsertHashItem(&search->terms, hash, term);
+						pthread_rwlock_unlock(&search->lock);
+
+						if (!inserted)
+								ok = 0;
+						continue;
+				}
+
+				if (!AddPosting(search, term, offset))
+						ok = 0;
+		}
+
+		return ok;
+}
+
+/*******************************************************************
+ * Function: GetSearchPostings                                     *
+ *                                                                 *
+ * Arguments: chansearch_t*, (const char*) token, (size_t) length, *
+ *            chansearchpostings_t*                                *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Appends the offsets of every record with the word  *
+ * to `out', oldest first. The token has to come from              *
+ * NextSearchToken. Can be called from any thread, the lock is     *
+ * only held to find the word. Returns false if we ran out of      *
+ * memory.                                                         *
+ *                                                                 *
+ *******************************************************************/
+int GetSearchPostings(chansearch_t *search, const char *token, size_t len, chansearchpostings_t *out)
+{
+		assert(search && token && out);
+
+		termkey_t key = { token, len };
+		const chansearchblock_t *block = NULL;
+		size_t bytes = 0;
+
+		pthread_rwlock_rdlock(&search->lock);
+		const chansearchterm_t *term = FindHashItem(&search->terms, HashToken(token, len), MatchTerm, &key);
+		if (term)
+		{
+				block = term->head;
+				bytes = atomic_load_explicit(&term->bytes, memory_order_acquire);
+		}
+		pthread_rwlock_unlock(&search->lock);
+
+		uint32_t offset = 0, delta = 0;
+		int shift = 0;
+		for (size_t i = 0; i < bytes; ++i)
+		{
+				if (i && !(i % CHANSEARCH_BLOCK_SIZE))
+						block = block->next;
+
+				unsigned char b = block->data[i % CHANSEARCH_BLOCK_SIZE];
+				delta |= (uint32_t)(b & 0x7F) << shift;
+				if (b & 0x80)
+				{
+						shift += 7;
+						continue;
+				}
+
+				offset += delta;
+				if (vec_push(out, offset))
+						return 0;
+				delta = 0;
+				shift = 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: CompareTerms                                          *
+ *                                                                 *
+ * Arguments: (const void*), (const void*)                         *
+ *                                                                 *
+ * Returns: (int) less than, equal to or greater than zero         *
+ *                                                                 *
+ * Description: qsort comparator for the terms of an index file.   *
+ *                                                                 *
+ *******************************************************************/
+static int CompareTerms(const void *a, const void *b)
+{
+		const chansearchterm_t *x = *(const chansearchterm_t *const*)a;
+		const chansearchterm_t *y = *(const chansearchterm_t *const*)b;
+		return memcmp(x->token, y->token, CHANSEARCH_TOKEN_MAX);
+}
+
+/*******************************************************************
+ * Function: WriteSearchIndex                                      *
+ *                                                                 *
+ * Arguments: chansearch_t*, (const char*) path                    *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Writes the index out for OpenSearchFile. It's      *
+ * written next to `path' and renamed into place, so nobody ever   *
+ * opens half of one. Nothing may be adding to the index.          *
+ *                                                                 *
+ *******************************************************************/
+int WriteSearchIndex(chansearch_t *search, const char *path)
+{
+		assert(search && path);
+
+		char tmp[PATH_MAX];
+		if ((size_t)snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= sizeof(tmp))
+		{
+				errno = ENAMETOOLONG;
+				return 0;
+		}
+
+		size_t nterms = search->terms.count;
+		chansearchterm_t **terms = malloc((nterms ? nterms : 1) * sizeof(chansearchterm_t*));
+		if (!terms)
+				return 0;
+
+		uint32_t iter = 0;
+		size_t n = 0;
+		chansearchterm_t *term;
+		while ((term = NextHashItem(&search->terms, &iter)) && n < nterms)
+				terms[n++] = term;
+		qsort(terms, n, sizeof(chansearchterm_t*), CompareTerms);
+
+		// mkstemp makes it private, it's as readable as the logs though.
+		int fd = mkstemp(tmp);
+		if (fd != -1)
+				fchmod(fd, 0644);
+
+		FILE *f = fd == -1 ? NULL : fdopen(fd, "wb");
+		if (!f)
+		{
+				if (fd != -1)
+						close(fd);
+				free(terms);
+				return 0;
+		}
+
+		chansearchheader_t header = { { 'P', 'N', 'S', 'X' }, CHANSEARCH_VERSION, (uint32_t)n, 0 };
+		int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+		uint64_t offset = sizeof(chansearchheader_t) + n * sizeof(struct chansearchentry_s);
+		for (size_t i = 0; ok && i < n; ++i)
+		{
+				struct chansearchentry_s entry;
+				memcpy(entry.token, terms[i]->token, CHANSEARCH_TOKEN_MAX);
+				entry.count = terms[i]->count;
+				entry.bytes = (uint32_t)atomic_load_explicit(&terms[i]->bytes, memory_order_relaxed);
+				entry.offset = offset;
+				offset += entry.bytes;
+				ok = fwrite(&entry, sizeof(entry), 1, f) == 1;
+		}
+
+		for (size_t i = 0; ok && i < n; ++i)
+		{
+				size_t bytes = atomic_load_explicit(&terms[i]->bytes, memory_order_relaxed);
+				for (const chansearchblock_t *block = terms[i]->head; ok && bytes; block = block->next)
+				{
+						size_t len = bytes < CHANSEARCH_BLOCK_SIZE ? bytes : CHANSEARCH_BLOCK_SIZE;
+						ok = fwrite(block->data, 1, len, f) == len;
+						bytes -= len;
+				}
+		}
+
+		free(terms);
+		if (fclose(f) || !ok || rename(tmp, path) == -1)
+		{
+				LogError("Failed to write %s: %s (%d)", path, strerror(errno), errno);
+				unlink(tmp);
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: OpenSearchFile                                        *
+ *                                                                 *
+ * Arguments: chansearchfile_t*, (const char*) path                *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Maps an index written by WriteSearchIndex. Returns *
+ * false with errno set to ENOENT if there is none, or EINVAL if   *
+ * it isn't one we can read.                                       *
+ *                                                                 *
+ *******************************************************************/
+int OpenSearchFile(chansearchfile_t *file, const char *path)
+{
+		assert(file && path);
+		memset(file, 0, sizeof(chansearchfile_t));
+
+		int fd = open(path, O_RDONLY);
+		if (fd == -1)
+				return 0;
+
+		struct stat st;
+		if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(chansearchheader_t))
+		{
+				close(fd);
+				errno = EINVAL;
+				return 0;
+		}
+
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED)
+				return 0;
+
+		const chansearchheader_t *header = map;
+		if (memcmp(header->magic, CHANSEARCH_MAGIC, 4) || header->version != CHANSEARCH_VERSION ||
+			header->nterms > (st.st_size - sizeof(chansearchheader_t)) / sizeof(struct chansearchentry_s))
+		{
+				munmap(map, st.st_size);
+				errno = EINVAL;
+				return 0;
+		}
+
+		file->map = map;
+		file->size = st.st_size;
+		file->nterms = header->nterms;
+		file->terms = (const struct chansearchentry_s*)(file->map + sizeof(chansearchheader_t));
+		return 1;
+}
+
+/*******************************************************************
+ * Function: CloseSearchFile                                       *
+ *                                                                 *
+ * Arguments: chansearchfile_t*                                    *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+void CloseSearchFile(chansearchfile_t *file)
+{
+		if (file->map)
+				munmap((void*)file->map, file->size);
+		memset(file, 0, sizeof(chansearchfile_t));
+}
+
+/*******************************************************************
+ * Function: GetSearchFilePostings                                 *
+ *                                                                 *
+ * Arguments: const chansearchfile_t*, (const char*) token,        *
+ *            (size_t) length, chansearchpostings_t*               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Like GetSearchPostings, for an index file. The     *
+ * word is found with a binary search. Returns false if we ran out *
+ * of memory or the file is damaged.                               *
+ *                                                                 *
+ *******************************************************************/
+int GetSearchFilePostings(const chansearchfile_t *file, const char *token, size_t len, chansearchpostings_t *out)
+{
+		assert(file && token && out);
+
+		char key[CHANSEARCH_TOKEN_MAX] = { 0 };
+		memcpy(key, token, len < sizeof(key) ? len : sizeof(key));
+
+		uint32_t lo = 0, hi = file->nterms;
+		while (lo < hi)
+		{
+				uint32_t mid = lo + (hi - lo) / 2;
+				int cmp = memcmp(key, file->terms[mid].token, sizeof(key));
+				if (!cmp)
+				{
+						lo = mid;
+						break;
+				}
+
+				if (cmp > 0)
+						lo = mid + 1;
+				else
+						hi = mid;
+		}
+
+		if (lo >= file->nterms || memcmp(key, file->terms[lo].token, sizeof(key)))
+				return 1;
+
+		const struct chansearchentry_s *entry = &file->terms[lo];
+		if (entry->offset > file->size || entry->bytes > file->size - entry->offset)
+		{
+				errno = EINVAL;
+				return 0;
+		}
+
+		const unsigned char *p = (const unsigned char*)file->map + entry->offset;
+		uint32_t offset = 0, delta = 0;
+		int shift = 0;
+		for (uint32_t i = 0; i < entry->bytes; ++i)
+		{
+				delta |= (uint32_t)(p[i] & 0x7F) << shift;
+				if (p[i] & 0x80)
+				{
+						// Five bytes is all a 32 bit offset ever needs.
+						if ((shift += 7) > 28)
+						{
+								errno = EINVAL;
+								return 0;
+						}
+						continue;
+				}
+
+				offset += delta;
+				if (vec_push(out, offset))
+						return 0;
+				delta = 0;
+				shift = 0;
+		}
+
+		return 1;
+}
@@ -0,0 +1,611 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// Include our mask set types and function declarations.
+#include "irc/hostmask.h"
+
+// What trie edges are looked up by.
+typedef struct
+{
+		const ircmasknode_t *parent;
+		unsigned char byte;
+} edgekey_t;
+
+// What masks without wildcards are looked up by.
+typedef struct
+{
+		const unsigned char *map;
+		strview_t str;
+} exactkey_t;
+
+static int MatchEdge(const void *item, const void *key)
+{
+		const ircmasknode_t *node = item;
+		const edgekey_t *k = key;
+		return node->parent == k->parent && node->byte == k->byte;
+}
+
+static int MatchExact(const void *item, const void *key)
+{
+		const ircmask_t *mask = item;
+		const exactkey_t *k = key;
+		return IRCStringEquals(k->map, mask->mask, mask->len, k->str.ptr, k->str.len);
+}
+
+static inline uint32_t EdgeHash(const ircmasknode_t *parent, unsigned char byte)
+{
+		return HashPointers(parent, (const void*)(uintptr_t)(byte + 1));
+}
+
+static inline int IsWildcard(char c)
+{
+		return c == '*' || c == '?';
+}
+
+// Where in the set a mask goes, see hostmask.h.
+typedef enum
+{
+		MASK_EXACT,
+		MASK_SUFFIX,
+		MASK_PREFIX,
+		MASK_OTHER
+} maskkind_t;
+
+/*******************************************************************
+ * Function: ClassifyMask                                          *
+ *                                                                 *
+ * Arguments: (const char*) mask, (size_t) length, (size_t*) set   *
+ *            to how long the literal it's kept under is           *
+ *                                                                 *
+ * Returns: (maskkind_t) Which part of the set the mask belongs in *
+ *                                                                 *
+ * Description: Measures the literal text at both ends of the mask *
+ * and picks the longer one, it rules out more hostmasks.          *
+ *                                                                 *
+ *******************************************************************/
+static maskkind_t ClassifyMask(const char *mask, size_t len, size_t *literal)
+{
+		size_t prefix = 0, suffix = 0;
+		while (prefix < len && !IsWildcard(mask[prefix]))
+				prefix++;
+
+		if (prefix == len)
+		{
+				*literal = len;
+				return MASK_EXACT;
+		}
+
+		while (suffix < len && !IsWildcard(mask[len - 1 - suffix]))
+				suffix++;
+
+		*literal = suffix >= prefix ? suffix : prefix;
+		if (!*literal)
+				return MASK_OTHER;
+		return suffix >= prefix ? MASK_SUFFIX : MASK_PREFIX;
+}
+
+// How long a hostmask can be for the masks with wildcards at both ends
+// to be ruled out by their literal first, longer ones are matched in full.
+#define HOSTMASK_FOLD_MAX 512
+
+/*******************************************************************
+ * Function: FindLongestLiteral                                    *
+ *                                                                 *
+ * Arguments: ircmask_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Finds the longest run of text between wildcards in *
+ * the mask, which any hostmask it matches has to contain.         *
+ *                                                                 *
+ *******************************************************************/
+static void FindLongestLiteral(ircmask_t *mask)
+{
+		size_t start = 0, best = 0, bestlen = 0;
+		for (size_t i = 0; i <= mask->len; ++i)
+		{
+				if (i < mask->len && !IsWildcard(mask->mask[i]))
+						continue;
+
+				if (i - start > bestlen)
+				{
+						best = start;
+						bestlen = i - start;
+				}
+				start = i + 1;
+		}
+
+		// Literals which don't fit are left out, the mask is still
+		// matched in full.
+		mask->literal = best <= UINT16_MAX - bestlen ? best : 0;
+		mask->literallen = best <= UINT16_MAX - bestlen ? bestlen : 0;
+}
+
+/*******************************************************************
+ * Function: HasLiteral                                            *
+ *                                                                 *
+ * Arguments: (const char*) folded hostmask, (size_t) length,      *
+ *            const ircmask_t*                                     *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Whether the mask's longest literal turns up in the *
+ * hostmask, if it doesn't the mask can't match.                   *
+ *                                                                 *
+ *******************************************************************/
+static int HasLiteral(const char *str, size_t len, const ircmask_t *mask)
+{
+		const char *lit = mask->mask + mask->literal;
+		size_t litlen = mask->literallen;
+		if (!litlen)
+				return 1;
+		if (len < litlen)
+				return 0;
+
+		const char *p = str, *last = str + len - litlen;
+		while (p <= last && (p = memchr(p, lit[0], last - p + 1)))
+		{
+				if (!memcmp(p + 1, lit + 1, litlen - 1))
+						return 1;
+				p++;
+		}
+
+		return 0;
+}
+
+/*******************************************************************
+ * Function: IRCMaskMatches                                        *
+ *                                                                 *
+ * Arguments: (const unsigned char*) case map, strview_t mask,     *
+ *            strview_t string                                     *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Matches one mask against the string. Rather than   *
+ * recursing at every `*' only the last one is remembered: when    *
+ * what follows it stops matching, it's made to swallow one more   *
+ * byte and matching carries on from there. Earlier stars never    *
+ * need to be revisited, since the later one can swallow whatever  *
+ * they would have.                                                *
+ *                                                                 *
+ *******************************************************************/
+int IRCMaskMatches(const unsigned char *map, strview_t mask, strview_t str)
+{
+		assert(map && (mask.ptr || !mask.len) && (str.ptr || !str.len));
+
+		const unsigned char *m = (const unsigned char*)mask.ptr;
+		const unsigned char *s = (const unsigned char*)str.ptr;
+		size_t mi = 0, si = 0, star = SIZE_MAX, mark = 0;
+
+		while (si < str.len)
+		{
+				if (mi < mask.len && m[mi] == '*')
+				{
+						star = ++mi;
+						mark = si;
+				}
+				else if (mi < mask.len && (m[mi] == '?' || map[m[mi]] == map[s[si]]))
+				{
+						mi++;
+						si++;
+				}
+				else if (star != SIZE_MAX)
+				{
+						mi = star;
+						si = ++mark;
+				}
+				else
+						return 0;
+		}
+
+		while (mi < mask.len && m[mi] == '*')
+				mi++;
+
+		return mi == mask.len;
+}
+
+/*******************************************************************
+ * Function: InitializeIRCMaskSet                                  *
+ *                                                                 *
+ * Arguments: ircmaskset_t*, (const unsigned char*) case map       *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sets up an empty set which compares bytes with the *
+ * case map given. The masks are folded with it when they're       *
+ * added, so a set has to be filled again to change it.            *
+ *                                                                 *
+ *******************************************************************/
+int InitializeIRCMaskSet(ircmaskset_t *set, const unsigned char *map)
+{
+		assert(set && map);
+
+		memset(set, 0, sizeof(*set));
+		set->map = map;
+		vec_init(&set->suffixes.masks);
+		vec_init(&set->prefixes.masks);
+		vec_init(&set->others);
+
+		if (!InitializeHashTable(&set->exact, 0) || !InitializeHashTable(&set->edges, 0) ||
+			!InitializePool(&set->nodepool, sizeof(ircmasknode_t), 0, 0))
+		{
+				DestroyHashTable(&set->exact);
+				DestroyHashTable(&set->edges);
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: DestroyIRCMaskSet                                     *
+ *                                                                 *
+ * Arguments: ircmaskset_t*                                        *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Frees every mask and node in the set. The data the *
+ * masks were added with belongs to the caller.                    *
+ *                                                                 *
+ *******************************************************************/
+void DestroyIRCMaskSet(ircmaskset_t *set)
+{
+		assert(set);
+
+		uint32_t iter = 0;
+		ircmask_t *mask;
+		while ((mask = NextHashItem(&set->exact, &iter)))
+				free(mask);
+
+		iter = 0;
+		ircmasknode_t *node;
+		while ((node = NextHashItem(&set->edges, &iter)))
+		{
+				for (int i = 0; i < node->masks.length; ++i)
+						free(node->masks.data[i]);
+				vec_deinit(&node->masks);
+				PoolFree(&set->nodepool, node);
+		}
+
+		for (int i = 0; i < set->others.length; ++i)
+				free(set->others.data[i]);
+
+		vec_deinit(&set->suffixes.masks);
+		vec_deinit(&set->prefixes.masks);
+		vec_deinit(&set->others);
+		DestroyHashTable(&set->exact);
+		DestroyHashTable(&set->edges);
+		DestroyPool(&set->nodepool);
+		set->count = 0;
+}
+
+/*******************************************************************
+ * Function: FindMaskNode                                          *
+ *                                                                 *
+ * Arguments: ircmaskset_t*, (maskkind_t) which trie, (const       *
+ *            char*) folded mask, (size_t) length, (size_t)        *
+ *            literal length, (int) whether to create what's       *
+ *            missing                                              *
+ *                                                                 *
+ * Returns: (ircmasknode_t*) The node the mask is kept at, or NULL *
+ * if it isn't there (or couldn't be created).                     *
+ *                                                                 *
+ * Description: Follows the mask's literal down its trie,          *
+ * backwards from the end for endings.                             *
+ *                                                                 *
+ *******************************************************************/
+static ircmasknode_t *FindMaskNode(ircmaskset_t *set, maskkind_t kind, const char *mask, size_t len, size_t literal, int create)
+{
+		ircmasknode_t *node = kind == MASK_SUFFIX ? &set->suffixes : &set->prefixes;
+
+		for (size_t i = 0; i < literal; ++i)
+		{
+				unsigned char byte = kind == MASK_SUFFIX ? mask[len - 1 - i] : mask[i];
+				edgekey_t key = { node, byte };
+				uint32_t hash = EdgeHash(node, byte);
+
+				ircmasknode_t *child = FindHashItem(&set->edges, hash, MatchEdge, &key);
+				if (!child)
+				{
+						if (!create || !(child = PoolAlloc(&set->nodepool)))
+								return NULL;
+
+						child->parent = node;
+						child->byte = byte;
+						child->children = 0;
+						vec_init(&child->masks);
+
+						if (!InsertHashItem(&set->edges, hash, child))
+						{
+								PoolFree(&set->nodepool, child);
+								return NULL;
+						}
+						node->children++;
+				}
+
+				node = child;
+		}
+
+		return node;
+}
+
+/*******************************************************************
+ * Function: PruneMaskNode                                         *
+ *                                                                 *
+ * Arguments: ircmaskset_t*, ircmasknode_t*                        *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Takes nodes which no longer lead to any mask out   *
+ * of their trie, from the node given up towards the root.         *
+ *                                                                 *
+ *******************************************************************/
+static void PruneMaskNode(ircmaskset_t *set, ircmasknode_t *node)
+{
+		while (node->parent && !node->children && !node->masks.length)
+		{
+				ircmasknode_t *parent = node->parent;
+				edgekey_t key = { parent, node->byte };
+				RemoveHashItem(&set->edges, EdgeHash(parent, node->byte), MatchEdge, &key);
+				parent->children--;
+
+				vec_deinit(&node->masks);
+				PoolFree(&set->nodepool, node);
+				node = parent;
+		}
+}
+
+/*******************************************************************
+ * Function: FindMask                                              *
+ *                                                                 *
+ * Arguments: ircmaskset_t*, (const char*) folded mask, (size_t)   *
+ *            length, (ircmasknode_t**) set to the node holding    *
+ *            the mask, (int*) set to where it is in the node (or  *
+ *            in `others')                                         *
+ *                                                                 *
+ * Returns: (ircmask_t*) The mask in the set, NULL if it isn't in  *
+ * it.                                                             *
+ *                                                                 *
+ * Description: Looks the mask up wherever ClassifyMask says it    *
+ * would have been put. Masks are compared exactly once they're    *
+ * folded, `?' and `*' only ever match themselves here.            *
+ *                                                                 *
+ *******************************************************************/
+static ircmask_t *FindMask(ircmaskset_t *set, const char *folded, size_t len, ircmasknode_t **nodep, int *idx)
+{
+		size_t literal;
+		maskkind_t kind = ClassifyMask(folded, len, &literal);
+		ircmasklist_t *masks = &set->others;
+
+		*nodep = NULL;
+		if (kind == MASK_EXACT)
+		{
+				exactkey_t key = { set->map, { folded, len } };
+				return FindHashItem(&set->exact, IRCHashString(set->map, folded, len), MatchExact, &key);
+		}
+		else if (kind != MASK_OTHER)
+		{
+				*nodep = FindMaskNode(set, kind, folded, len, literal, 0);
+				if (!*nodep)
+						return NULL;
+				masks = &(*nodep)->masks;
+		}
+
+		for (int i = 0; i < masks->length; ++i)
+		{
+				ircmask_t *mask = masks->data[i];
+				if (mask->len == len && !memcmp(mask->mask, folded, len))
+				{
+						*idx = i;
+						return mask;
+				}
+		}
+
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: AddIRCMask                                            *
+ *                                                                 *
+ * Arguments: ircmaskset_t*, strview_t mask, (void*) data          *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Adds a mask to the set, MatchIRCMaskSet hands back *
+ * the data with it when it matches. Adding a mask which is        *
+ * already in the set (under the case map) replaces its data.      *
+ *                                                                 *
+ *******************************************************************/
+int AddIRCMask(ircmaskset_t *set, strview_t mask, void *data)
+{
+		assert(set);
+
+		if (!mask.len)
+		{
+				errno = EINVAL;
+				return 0;
+		}
+
+		ircmask_t *m = malloc(sizeof(ircmask_t) + mask.len + 1);
+		if (!m)
+				return 0;
+
+		IRCFoldString(set->map, m->mask, mask.ptr, mask.len);
+		m->mask[mask.len] = 0;
+		m->len = mask.len;
+		m->data = data;
+		m->node = NULL;
+		m->hash = 0;
+		m->literal = 0;
+		m->literallen = 0;
+
+		ircmasknode_t *node;
+		int idx;
+		ircmask_t *old = FindMask(set, m->mask, m->len, &node, &idx);
+		if (old)
+		{
+				old->data = data;
+				free(m);
+				return 1;
+		}
+
+		size_t literal;
+		maskkind_t kind = ClassifyMask(m->mask, m->len, &literal);
+		int failed;
+		switch (kind)
+		{
+				case MASK_EXACT:
+						m->hash = IRCHashString(set->map, m->mask, m->len);
+						failed = !InsertHashItem(&set->exact, m->hash, m);
+						break;
+				case MASK_OTHER:
+						FindLongestLiteral(m);
+						failed = vec_push(&set->others, m);
+						break;
+				default:
+						node = FindMaskNode(set, kind, m->mask, m->len, literal, 1);
+						failed = !node || vec_push(&node->masks, m);
+						if (failed && node)
+								PruneMaskNode(set, node);
+						m->node = node;
+						break;
+		}
+
+		if (failed)
+		{
+				free(m);
+				errno = ENOMEM;
+				return 0;
+		}
+
+		set->count++;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: RemoveIRCMask                                         *
+ *                                                                 *
+ * Arguments: ircmaskset_t*, strview_t mask                        *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Takes the mask out of the set (as it was added, or *
+ * anything equal to it under the case map). Returns false if it   *
+ * wasn't in the set.                                              *
+ *                                                                 *
+ *******************************************************************/
+int RemoveIRCMask(ircmaskset_t *set, strview_t mask)
+{
+		assert(set);
+
+		char stackbuf[512];
+		char *folded = mask.len <= sizeof(stackbuf) ? stackbuf : malloc(mask.len);
+		if (!folded)
+				return 0;
+		IRCFoldString(set->map, folded, mask.ptr, mask.len);
+
+		ircmasknode_t *node;
+		int idx = 0;
+		ircmask_t *m = mask.len ? FindMask(set, folded, mask.len, &node, &idx) : NULL;
+
+		size_t literal;
+		if (m && ClassifyMask(folded, mask.len, &literal) == MASK_EXACT)
+		{
+				exactkey_t key = { set->map, { folded, mask.len } };
+				RemoveHashItem(&set->exact, m->hash, MatchExact, &key);
+		}
+		else if (m && node)
+		{
+				vec_splice(&node->masks, idx, 1);
+				PruneMaskNode(set, node);
+		}
+		else if (m)
+				vec_splice(&set->others, idx, 1);
+
+		if (folded != stackbuf)
+				free(folded);
+
+		if (!m)
+				return 0;
+
+		free(m);
+		set->count--;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: MatchIRCMaskSet                                       *
+ *                                                                 *
+ * Arguments: const ircmaskset_t*, strview_t nick!user@host        *
+ *                                                                 *
+ * Returns: (ircmask_t*) A mask in the set which matches, or NULL  *
+ * if none do.                                                     *
+ *                                                                 *
+ * Description: Looks for any mask matching the hostmask: the hash *
+ * table first, then the masks whose literal ending the hostmask   *
+ * ends with, then those whose literal beginning it starts with,   *
+ * and finally the few with neither, once their literal shows up.  *
+ * Never changes the set, so it's safe from many threads at once   *
+ * while nothing else does.                                        *
+ *                                                                 *
+ *******************************************************************/
+ircmask_t *MatchIRCMaskSet(const ircmaskset_t *set, strview_t hostmask)
+{
+		assert(set && (hostmask.ptr || !hostmask.len));
+
+		if (!set->count)
+				return NULL;
+
+		const unsigned char *map = set->map;
+		const unsigned char *s = (const unsigned char*)hostmask.ptr;
+
+		if (set->exact.count)
+		{
+				exactkey_t key = { map, hostmask };
+				ircmask_t *mask = FindHashItem(&set->exact, IRCHashString(map, hostmask.ptr, hostmask.len), MatchExact, &key);
+				if (mask)
+						return mask;
+		}
+
+		for (int pass = 0; pass < 2; ++pass)
+		{
+				const ircmasknode_t *node = pass ? &set->prefixes : &set->suffixes;
+
+				for (size_t i = 0; i < hostmask.len && node->children; ++i)
+				{
+						unsigned char byte = map[pass ? s[i] : s[hostmask.len - 1 - i]];
+						edgekey_t key = { node, byte };
+						node = FindHashItem(&set->edges, EdgeHash(node, byte), MatchEdge, &key);
+						if (!node)
+								break;
+
+						for (int j = 0; j < node->masks.length; ++j)
+						{
+								ircmask_t *mask = node->masks.data[j];
+								if (IRCMaskMatches(map, (strview_t){ mask->mask, mask->len }, hostmask))
+										return mask;
+						}
+				}
+		}
+
+		// The hostmask is folded once so any literal can just be
+		// searched for.
+		char folded[HOSTMASK_FOLD_MAX];
+		int prefilter = set->others.length && hostmask.len <= sizeof(folded);
+		if (prefilter)
+				IRCFoldString(map, folded, hostmask.ptr, hostmask.len);
+
+		for (int i = 0; i < set->others.length; ++i)
+		{
+				ircmask_t *mask = set->others.data[i];
+				if (prefilter && !HasLiteral(folded, hostmask.len, mask))
+						continue;
+				if (IRCMaskMatches(map, (strview_t){ mask->mask, mask->len }, hostmask))
+						return mask;
+		}
+
+		return NULL;
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include "metrics/metrics.h"
+
+// Include our job types and function declarations.
+#include "irc/job.h"
+
+// A reply on its way from a worker back to the connection's event loop.
+typedef struct
+{
+		uint64_t sockid;
+		floodlane_t lane;
+		size_t len;
+		char data[];
+} ircreply_t;
+
+/*******************************************************************
+ * Function: RunIRCJob                                             *
+ *                                                                 *
+ * Arguments: workjob_t* (the ircjob_t)                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called on a worker thread to run the handler, the  *
+ * time it takes goes into the worker's metrics.                   *
+ *                                                                 *
+ *******************************************************************/
+static void RunIRCJob(workjob_t *work)
+{
+		ircjob_t *job = (ircjob_t*)work;
+
+		uint64_t start = GetMetricsClock();
+		job->handler(job);
+		RecordMetric(threadmetrics, HISTOGRAM_HANDLER, GetMetricsClock() - start);
+		AddMetric(threadmetrics, METRIC_JOBS, 1);
+
+		free(job);
+}
+
+/*******************************************************************
+ * Function: SubmitIRCMessage                                      *
+ *                                                                 *
+ * Arguments: socket_t*, strview_t line, const ircmsg_t*,          *
+ *            IRCJobHandler, void*                                 *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Has a worker call the handler with a copy of the   *
+ * message, which must have been parsed from `line'. The pointer   *
+ * ends up in the job's `data' for the handler. Must be called     *
+ * from the event loop the socket belongs to. Messages may be      *
+ * handled in any order (and at the same time) so a slow one       *
+ * doesn't hold the rest up. Returns false if we ran out of memory *
+ * or the workers are too far behind, and the message is dropped.  *
+ *                                                                 *
+ *******************************************************************/
+int SubmitIRCMessage(socket_t *sock, strview_t line, const ircmsg_t *msg, IRCJobHandler handler, void *data)
+{
+		assert(sock && msg && handler && msg->line == line.ptr);
+
+		shard_t *shard = GetCurrentShard();
+		assert(shard);
+
+		// The job outlives the batch of events (a worker runs it whenever
+		// it gets to it) so it can't come from the event arena, this is
+		// where the line is copied out of it.
+		ircjob_t *job = malloc(sizeof(ircjob_t) + line.len);
+		if (!job)
+				return 0;
+
+		job->work.run = RunIRCJob;
+		job->handler  = handler;
+		job->shard    = shard;
+		job->sockid   = sock->id;
+		job->owner    = sock->data;
+		job->data     = data;
+		job->len      = line.len;
+		memcpy(job->line, line.ptr, line.len);
+
+		// The spans are offsets so they work just as well in our copy.
+		job->msg = *msg;
+		job->msg.line = job->line;
+
+		if (!SubmitWork(&job->work, (uint32_t)sock->id))
+		{
+				AddMetric(threadmetrics, METRIC_JOBS_DROPPED, 1);
+				free(job);
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: DeliverReply                                          *
+ *                                                                 *
+ * Arguments: shard_t*, void* (the ircreply_t)                     *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called on the connection's event loop to queue a   *
+ * worker's reply, if the connection is still there.               *
+ *                                                                 *
+ *******************************************************************/
+static void DeliverReply(shard_t *shard, void *data)
+{
+		ircreply_t *reply = data;
+
+		socket_t *sock = FindSocket(reply->sockid);
+		if (sock && sock->state == SOCKET_CONNECTED)
+				QueueSocketMessage(sock, reply->lane, reply->data, reply->len);
+
+		free(reply);
+}
+
+/*******************************************************************
+ * Function: ReplyToIRCJob                                         *
+ *                                                                 *
+ * Arguments: const ircjob_t*, floodlane_t, (const void*) message, *
+ *            (size_t) length                                      *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sends a line (including its \r\n) to the server    *
+ * the job's message came from. Called from the job's handler, the *
+ * message is copied and queued by the connection's event loop on  *
+ * the flood control lane given.                                   *
+ *                                                                 *
+ *******************************************************************/
+int ReplyToIRCJob(const ircjob_t *job, floodlane_t lane, const void *message, size_t len)
+{
+		assert(job && message);
+
+		ircreply_t *reply = malloc(sizeof(ircreply_t) + len);
+		if (!reply)
+				return 0;
+
+		reply->sockid = job->sockid;
+		reply->lane   = lane;
+		reply->len    = len;
+		memcpy(reply->data, message, len);
+
+		if (!SendToShard(job->shard, DeliverReply, reply, free))
+		{
+				free(reply);
+				return 0;
+		}
+
+		return 1;
+}
@@ -0,0 +1,152 @@
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+
+// Include our parser types and function declarations.
+#include "irc/parser.h"
+
+/*******************************************************************
+ * Function: MakeSpan                                              *
+ *                                                                 *
+ * Arguments: (const char*) line, (const char*) start, end         *
+ *                                                                 *
+ * Returns: (ircspan_t) The span from start up to (not including)  *
+ * end.                                                            *
+ *                                                                 *
+ *******************************************************************/
+static inline ircspan_t MakeSpan(const char *line, const char *start, const char *end)
+{
+		ircspan_t span = { (uint16_t)(start - line), (uint16_t)(end - start) };
+		return span;
+}
+
+/*******************************************************************
+ * Function: SkipSpaces                                            *
+ *                                                                 *
+ * Arguments: (const char*) position, (const char*) end of line    *
+ *                                                                 *
+ * Returns: (const char*) The first character which isn't a space. *
+ *                                                                 *
+ * Description: RFC 1459 says words are separated by one space but *
+ * plenty of servers send more than one so we allow for that.      *
+ *                                                                 *
+ *******************************************************************/
+static inline const char *SkipSpaces(const char *p, const char *end)
+{
+		while (p < end && *p == ' ')
+				p++;
+		return p;
+}
+
+/*******************************************************************
+ * Function: NextWord                                              *
+ *                                                                 *
+ * Arguments: (const char*) position, (const char*) end of line    *
+ *                                                                 *
+ * Returns: (const char*) The space after the word, or the end.    *
+ *                                                                 *
+ *******************************************************************/
+static inline const char *NextWord(const char *p, const char *end)
+{
+		const char *space = memchr(p, ' ', end - p);
+		return space ? space : end;
+}
+
+/*******************************************************************
+ * Function: ParseIRCMessage                                       *
+ *                                                                 *
+ * Arguments: strview_t line, ircmsg_t*                            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Splits an IRC line (without its \r\n) into its     *
+ * tags, prefix, command and parameters. Nothing is allocated or   *
+ * copied: the message just records where each piece is in the     *
+ * line. Returns false if the line isn't a valid IRC message.      *
+ *                                                                 *
+ *******************************************************************/
+int ParseIRCMessage(strview_t line, ircmsg_t *msg)
+{
+		assert(msg);
+
+		// Our spans can't point past 64KiB, no IRC line is anywhere near that.
+		if (!line.ptr || !line.len || line.len > UINT16_MAX)
+				return 0;
+
+		const char *p   = line.ptr;
+		const char *end = line.ptr + line.len;
+		const char *word;
+
+		msg->line    = line.ptr;
+		msg->tags    = MakeSpan(line.ptr, p, p);
+		msg->prefix  = MakeSpan(line.ptr, p, p);
+		msg->numeric = 0;
+		msg->nparams = 0;
+
+		// @tags
+		if (*p == '@')
+		{
+				word = NextWord(++p, end);
+				msg->tags = MakeSpan(line.ptr, p, word);
+				p = SkipSpaces(word, end);
+		}
+
+		// :prefix
+		if (p < end && *p == ':')
+		{
+				word = NextWord(++p, end);
+				msg->prefix = MakeSpan(line.ptr, p, word);
+				p = SkipSpaces(word, end);
+		}
+
+		// COMMAND
+		if (p == end)
+				return 0;
+
+		word = NextWord(p, end);
+		msg->command = MakeSpan(line.ptr, p, word);
+
+		// Numerics are always exactly 3 digits.
+		if (word - p == 3 && (unsigned)(p[0] - '0') < 10 && (unsigned)(p[1] - '0') < 10 && (unsigned)(p[2] - '0') < 10)
+				msg->numeric = (p[0] - '0') * 100 + (p[1] - '0') * 10 + (p[2] - '0');
+
+		p = SkipSpaces(word, end);
+
+		// Parameters
+		while (p < end)
+		{
+				// A parameter starting with ':' is the rest of the line, spaces
+				// and all. The 15th parameter is the rest of the line even
+				// without it since there can't be any more after it.
+				if (*p == ':' || msg->nparams == IRC_MAX_PARAMS - 1)
+				{
+						if (*p == ':')
+								p++;
+						msg->params[msg->nparams++] = MakeSpan(line.ptr, p, end);
+						break;
+				}
+
+				word = NextWord(p, end);
+				msg->params[msg->nparams++] = MakeSpan(line.ptr, p, word);
+				p = SkipSpaces(word, end);
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: IRCSpanEquals                                         *
+ *                                                                 *
+ * Arguments: const ircmsg_t*, ircspan_t, (const char*) string     *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Compares a piece of the message against a string,  *
+ * ignoring case since IRC commands are case-insensitive.          *
+ *                                                                 *
+ *******************************************************************/
+int IRCSpanEquals(const ircmsg_t *msg, ircspan_t span, const char *str)
+{
+		size_t len = strlen(str);
+		return span.len == len && !strncasecmp(msg->line + span.off, str, len);
+}
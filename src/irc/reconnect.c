@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include "eventloop/eventloop.h"
+
+// Include our reconnect types and function declarations.
+#include "irc/reconnect.h"
+
+/*******************************************************************
+ * Function: NextRandom                                            *
+ *                                                                 *
+ * Arguments: ircreconnect_t*                                      *
+ *                                                                 *
+ * Returns: (uint32_t) A pseudo random number.                     *
+ *                                                                 *
+ * Description: xorshift, it only has to spread reconnects out.    *
+ *                                                                 *
+ *******************************************************************/
+static uint32_t NextRandom(ircreconnect_t *r)
+{
+		r->seed ^= r->seed << 13;
+		r->seed ^= r->seed >> 17;
+		r->seed ^= r->seed << 5;
+		return r->seed;
+}
+
+/*******************************************************************
+ * Function: ForgetChannels                                        *
+ *                                                                 *
+ * Arguments: ircreconnect_t*                                      *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void ForgetChannels(ircreconnect_t *r)
+{
+		char *name;
+		int i;
+		vec_foreach(&r->channels, name, i)
+				free(name);
+
+		vec_clear(&r->channels);
+}
+
+/*******************************************************************
+ * Function: ReconnectTimerHandler                                 *
+ *                                                                 *
+ * Arguments: evtimer_t*, void* (the ircreconnect_t)               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called once we've waited long enough, starts       *
+ * connecting again. If that fails straight away we wait longer.   *
+ * Failures later on are reported to the socket's OnError as usual *
+ * and its owner calls ScheduleReconnect again.                    *
+ *                                                                 *
+ *******************************************************************/
+static void ReconnectTimerHandler(evtimer_t *timer, void *data)
+{
+		ircreconnect_t *r = data;
+
+		if (!ConnectSocket(r->sock))
+				ScheduleReconnect(r, NULL);
+}
+
+/*******************************************************************
+ * Function: InitializeReconnect                                   *
+ *                                                                 *
+ * Arguments: ircreconnect_t*, socket_t*                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Sets up reconnecting for the socket. This has to   *
+ * be called on the event loop thread the socket belongs to.       *
+ *                                                                 *
+ *******************************************************************/
+void InitializeReconnect(ircreconnect_t *r, socket_t *sock)
+{
+		assert(r && sock);
+		memset(r, 0, sizeof(ircreconnect_t));
+
+		r->sock = sock;
+		r->registered = -1;
+		vec_init(&r->channels);
+		InitializeTimer(&r->timer, ReconnectTimerHandler, r);
+
+		// Bots started together (or on the same host) mustn't pick the same
+		// delays, that's the stampede the jitter is there to prevent.
+		r->seed = ((uint32_t)getpid() * 2654435761U) ^ (uint32_t)GetMonotonicTime() ^ ((uint32_t)sock->id << 16);
+		if (!r->seed)
+				r->seed = 1;
+}
+
+/*******************************************************************
+ * Function: DestroyReconnect                                      *
+ *                                                                 *
+ * Arguments: ircreconnect_t*                                      *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Stops any pending reconnect. The socket itself is  *
+ * left alone.                                                     *
+ *                                                                 *
+ *******************************************************************/
+void DestroyReconnect(ircreconnect_t *r)
+{
+		assert(r);
+
+		StopTimer(&r->timer);
+		ForgetChannels(r);
+		vec_deinit(&r->channels);
+}
+
+/*******************************************************************
+ * Function: AddReconnectChannel                                   *
+ *                                                                 *
+ * Arguments: ircreconnect_t*, (const char*) channel name          *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Adds a channel to join once the server lets us in, *
+ * eg. the channels we were told to join on the command line.      *
+ *                                                                 *
+ *******************************************************************/
+int AddReconnectChannel(ircreconnect_t *r, const char *name)
+{
+		assert(r && name);
+
+		char *copy = strdup(name);
+		if (!copy || vec_push(&r->channels, copy))
+		{
+				free(copy);
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ScheduleReconnect                                     *
+ *                                                                 *
+ * Arguments: ircreconnect_t*, (const ircstate_t*) or NULL         *
+ *                                                                 *
+ * Returns: (int64_t) How long (in milliseconds) until we try.     *
+ *                                                                 *
+ * Description: Called once the connection is lost (or failed),    *
+ * closes the socket and has it connect again after a delay. The   *
+ * delay starts at RECONNECT_MIN_DELAY and doubles with every      *
+ * failure up to RECONNECT_MAX_DELAY, we then wait anywhere from   *
+ * half of it to all of it ("equal jitter"). The channels we're in *
+ * according to the state are remembered so FinishReconnect can    *
+ * join them again. Without a state, or if the server never told   *
+ * us about them this time, the channels from before are kept.     *
+ *                                                                 *
+ *******************************************************************/
+int64_t ScheduleReconnect(ircreconnect_t *r, const ircstate_t *st)
+{
+		assert(r);
+
+		int64_t now = GetMonotonicTime();
+		int stable = r->registered != -1 && now - r->registered >= RECONNECT_STABLE_TIME;
+
+		// A connection which stayed up a while worked, however it ended.
+		if (stable)
+				r->failures = 0;
+
+		// If we're in no channels right after getting back in the JOINs
+		// probably just didn't make it, try them again next time.
+		if (st && st->self && (st->self->channels.length || stable))
+		{
+				ForgetChannels(r);
+
+				for (int i = 0; i < st->self->channels.length; ++i)
+				{
+						char *name = strdup(st->self->channels.data[i]->channel->name);
+						if (name && vec_push(&r->channels, name))
+								free(name);
+				}
+		}
+
+		r->registered = -1;
+		CloseSocket(r->sock);
+
+		int64_t delay = RECONNECT_MIN_DELAY;
+		for (int i = 0; i < r->failures && delay < RECONNECT_MAX_DELAY; ++i)
+				delay *= 2;
+		if (delay > RECONNECT_MAX_DELAY)
+				delay = RECONNECT_MAX_DELAY;
+
+		delay = delay / 2 + NextRandom(r) % (delay / 2 + 1);
+		r->failures++;
+
+		StartTimer(&r->timer, delay);
+		return delay;
+}
+
+/*******************************************************************
+ * Function: FinishReconnect                                       *
+ *                                                                 *
+ * Arguments: ircreconnect_t*                                      *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Called once the server has let us in (RPL_WELCOME) *
+ * to join the channels we were in before we lost the connection.  *
+ *                                                                 *
+ *******************************************************************/
+int FinishReconnect(ircreconnect_t *r)
+{
+		assert(r);
+
+		r->registered = GetMonotonicTime();
+		return QueueJoinLines(r->sock, r->channels.data, r->channels.length);
+}
+
+/*******************************************************************
+ * Function: QueueJoinLines                                        *
+ *                                                                 *
+ * Arguments: socket_t*, (char *const*) channels, (int) count      *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Queues JOINs for the channels, as many to a line   *
+ * as fit in IRC_LINE_MAX (eg, "JOIN #a,#b,#c"). The flood         *
+ * limits charge per line so this gets us back in our channels     *
+ * sooner and leaves more of the server's budget for everything    *
+ * else.                                                           *
+ *                                                                 *
+ *******************************************************************/
+int QueueJoinLines(socket_t *sock, char *const *channels, int count)
+{
+		assert(sock && (channels || !count));
+
+		static const char join[] = "JOIN ";
+		char line[IRC_LINE_MAX];
+		size_t len = 0;
+
+		for (int i = 0; i <= count; ++i)
+		{
+				size_t namelen = i < count ? strlen(channels[i]) : 0;
+
+				// Send what we have once the next name won't fit (or there are no more).
+				if (len && (i == count || len + 1 + namelen + 2 > sizeof(line)))
+				{
+						line[len++] = '\r';
+						line[len++] = '\n';
+						if (!QueueSocketMessage(sock, FLOOD_LANE_BULK, line, len))
+								return 0;
+						len = 0;
+				}
+
+				// A name too long for a line of its own can't be joined anyway.
+				if (i == count || !namelen || sizeof(join) - 1 + namelen + 2 > sizeof(line))
+						continue;
+
+				if (len)
+						line[len++] = ',';
+				else
+				{
+						memcpy(line, join, sizeof(join) - 1);
+						len = sizeof(join) - 1;
+				}
+
+				memcpy(line + len, channels[i], namelen);
+				len += namelen;
+		}
+
+		return 1;
+}
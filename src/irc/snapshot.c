@@ -0,0 +1,518 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "eventloop/eventloop.h"
+#include "thread/workers.h"
+#include "log/log.h"
+
+// Include our snapshot types and function declarations.
+#include "irc/snapshot.h"
+
+// What a snapshot file starts with, and the version of its layout.
+#define SNAPSHOT_MAGIC   "PNSS"
+#define SNAPSHOT_VERSION 1
+
+// A user index meaning nobody.
+#define SNAPSHOT_NONE UINT32_MAX
+
+// The start of a snapshot file: the header, the users, the channels, the
+// memberships (grouped by channel) and then the names.
+typedef struct
+{
+		char magic[4];
+		uint32_t version;
+		uint32_t casemap;   // The irccasemap_t the server uses.
+		uint32_t self;      // Which user is us.
+		uint32_t nusers;
+		uint32_t nchannels;
+		uint32_t nmembers;
+		uint32_t reserved;
+		uint64_t size;      // How long the whole file is.
+} snapshotheader_t;
+
+// Where a name is in the file.
+typedef struct
+{
+		uint32_t offset;
+		uint32_t len;
+} snapshotname_t;
+
+typedef struct
+{
+		snapshotname_t name;
+		uint32_t first;     // The channel's first membership.
+		uint32_t count;     // How many memberships it has.
+} snapshotchannel_t;
+
+typedef struct
+{
+		uint32_t user;      // Which user is in the channel.
+		uint32_t modes;     // IRC_MEMBER_* flags.
+} snapshotmember_t;
+
+// A snapshot on its way to a worker to be written.
+typedef struct
+{
+		workjob_t work;     // Must be first, the workers only know about this.
+		ircsnapshot_t *snap;
+		uint64_t taken;     // Which snapshot this is.
+		size_t len;
+		char data[];
+} snapshotjob_t;
+
+static int ComparePointers(const void *a, const void *b)
+{
+		uintptr_t x = (uintptr_t)*(void *const *)a, y = (uintptr_t)*(void *const *)b;
+		return x < y ? -1 : x > y;
+}
+
+/*******************************************************************
+ * Function: UserIndex                                             *
+ *                                                                 *
+ * Arguments: (ircuser_t *const*) users sorted by address,         *
+ *            (uint32_t) count, const ircuser_t*                   *
+ *                                                                 *
+ * Returns: (uint32_t) Where the user is, SNAPSHOT_NONE if they    *
+ * aren't there.                                                   *
+ *                                                                 *
+ *******************************************************************/
+static uint32_t UserIndex(ircuser_t *const *users, uint32_t count, const ircuser_t *user)
+{
+		ircuser_t *const *found = user ? bsearch(&user, users, count, sizeof(ircuser_t*), ComparePointers) : NULL;
+		return found ? (uint32_t)(found - users) : SNAPSHOT_NONE;
+}
+
+/*******************************************************************
+ * Function: PackSnapshot                                          *
+ *                                                                 *
+ * Arguments: const ircstate_t*                                    *
+ *                                                                 *
+ * Returns: (snapshotjob_t*) The state packed into a snapshot, or  *
+ * NULL if we ran out of memory.                                   *
+ *                                                                 *
+ * Description: The users are written in order of their address so *
+ * each membership can find its user with a binary search instead  *
+ * of needing a table of its own.                                  *
+ *                                                                 *
+ *******************************************************************/
+static snapshotjob_t *PackSnapshot(const ircstate_t *st)
+{
+		uint32_t nusers = st->users.count, nchannels = st->channels.count, nmembers = st->members.count;
+		ircuser_t **users = malloc((nusers ? nusers : 1) * sizeof(ircuser_t*));
+		if (!users)
+				return NULL;
+
+		size_t strings = 0;
+		uint32_t iter = 0, n = 0;
+		ircuser_t *user;
+		while ((user = NextHashItem(&st->users, &iter)) && n < nusers)
+		{
+				users[n++] = user;
+				strings += user->nicklen;
+		}
+		qsort(users, n, sizeof(ircuser_t*), ComparePointers);
+
+		iter = 0;
+		ircchannel_t *channel;
+		while ((channel = NextHashItem(&st->channels, &iter)))
+				strings += channel->namelen;
+
+		size_t tables = sizeof(snapshotheader_t) + nusers * sizeof(snapshotname_t) +
+			nchannels * sizeof(snapshotchannel_t) + nmembers * sizeof(snapshotmember_t);
+
+		// Names are found by 32 bit offsets.
+		if (tables + strings > UINT32_MAX)
+		{
+				free(users);
+				errno = EFBIG;
+				return NULL;
+		}
+
+		snapshotjob_t *job = malloc(sizeof(snapshotjob_t) + tables + strings);
+		if (!job)
+		{
+				free(users);
+				return NULL;
+		}
+
+		job->len = tables + strings;
+		snapshotheader_t *header = (snapshotheader_t*)job->data;
+		snapshotname_t *names = (snapshotname_t*)(header + 1);
+		snapshotchannel_t *channels = (snapshotchannel_t*)(names + nusers);
+		snapshotmember_t *members = (snapshotmember_t*)(channels + nchannels);
+		uint32_t offset = tables;
+
+		*header = (snapshotheader_t){ { 'P', 'N', 'S', 'S' }, SNAPSHOT_VERSION, st->casemap,
+			UserIndex(users, n, st->self), n, nchannels, nmembers, 0, job->len };
+
+		for (uint32_t i = 0; i < n; ++i)
+		{
+				names[i] = (snapshotname_t){ offset, (uint32_t)users[i]->nicklen };
+				memcpy(job->data + offset, users[i]->nick, users[i]->nicklen);
+				offset += users[i]->nicklen;
+		}
+
+		iter = 0;
+		uint32_t c = 0, m = 0;
+		while ((channel = NextHashItem(&st->channels, &iter)) && c < nchannels)
+		{
+				channels[c] = (snapshotchannel_t){ { offset, (uint32_t)channel->namelen }, m, 0 };
+				memcpy(job->data + offset, channel->name, channel->namelen);
+				offset += channel->namelen;
+
+				for (int i = 0; i < channel->members.length && m < nmembers; ++i)
+				{
+						const ircmember_t *member = channel->members.data[i];
+						members[m++] = (snapshotmember_t){ UserIndex(users, n, member->user), (uint32_t)member->modes };
+						channels[c].count++;
+				}
+				c++;
+		}
+
+		free(users);
+		return job;
+}
+
+/*******************************************************************
+ * Function: WriteSnapshot                                         *
+ *                                                                 *
+ * Arguments: ircsnapshot_t*, (uint64_t) which snapshot,           *
+ *            (const char*) data, (size_t) length                  *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Writes the snapshot next to the file and renames   *
+ * it over it, unless a newer one got there first (eg, the one     *
+ * taken while shutting down overtook a worker).                   *
+ *                                                                 *
+ *******************************************************************/
+static int WriteSnapshot(ircsnapshot_t *snap, uint64_t taken, const char *data, size_t len)
+{
+		char tmp[PATH_MAX];
+		if ((size_t)snprintf(tmp, sizeof(tmp), "%s.XXXXXX", snap->path) >= sizeof(tmp))
+		{
+				errno = ENAMETOOLONG;
+				return 0;
+		}
+
+		pthread_mutex_lock(&snap->lock);
+		if (taken <= snap->written)
+		{
+				pthread_mutex_unlock(&snap->lock);
+				return 1;
+		}
+
+		int fd = mkstemp(tmp);
+		int ok = fd != -1;
+		for (size_t done = 0; ok && done < len; )
+		{
+				ssize_t wrote = write(fd, data + done, len - done);
+				if (wrote == -1 && errno == EINTR)
+						continue;
+				ok = wrote > 0;
+				done += ok ? (size_t)wrote : 0;
+		}
+
+		// Without the fsync the rename can reach the disk before the data.
+		ok = ok && !fsync(fd);
+		if (fd != -1 && close(fd) == -1)
+				ok = 0;
+
+		if (!ok || rename(tmp, snap->path) == -1)
+		{
+				LogError("Failed to write %s: %s (%d)", snap->path, strerror(errno), errno);
+				if (fd != -1)
+						unlink(tmp);
+				pthread_mutex_unlock(&snap->lock);
+				return 0;
+		}
+
+		snap->written = taken;
+		pthread_mutex_unlock(&snap->lock);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: RunSnapshotJob                                        *
+ *                                                                 *
+ * Arguments: workjob_t* (the snapshotjob_t)                       *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void RunSnapshotJob(workjob_t *work)
+{
+		snapshotjob_t *job = (snapshotjob_t*)work;
+		WriteSnapshot(job->snap, job->taken, job->data, job->len);
+		free(job);
+}
+
+/*******************************************************************
+ * Function: SnapshotTimerHandler                                  *
+ *                                                                 *
+ * Arguments: evtimer_t*, void* (the ircsnapshot_t)                *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void SnapshotTimerHandler(evtimer_t *timer, void *data)
+{
+		SaveSnapshot(data, 0);
+		StartTimer(timer, SNAPSHOT_INTERVAL);
+}
+
+/*******************************************************************
+ * Function: InitializeSnapshot                                    *
+ *                                                                 *
+ * Arguments: ircsnapshot_t*, (const char*) directory,             *
+ *            (const char*) network, ircstate_t*                   *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sets up taking snapshots of the network's state to *
+ * `dir', creating it if it doesn't exist. This has to be called   *
+ * on the event loop thread the state belongs to.                  *
+ *                                                                 *
+ *******************************************************************/
+int InitializeSnapshot(ircsnapshot_t *snap, const char *dir, const char *network, ircstate_t *st)
+{
+		assert(snap && dir && network && st);
+		memset(snap, 0, sizeof(ircsnapshot_t));
+
+		if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+		{
+				LogError("Failed to create %s: %s (%d)", dir, strerror(errno), errno);
+				return 0;
+		}
+
+		// The network is a hostname (or address) but make sure of it.
+		size_t len = strlen(dir) + 1 + strlen(network) + sizeof(".state");
+		snap->path = malloc(len);
+		if (!snap->path)
+				return 0;
+
+		snprintf(snap->path, len, "%s/%s.state", dir, network);
+		for (char *p = snap->path + strlen(dir) + 1; *p; ++p)
+				if (*p == '/')
+						*p = '_';
+
+		snap->state = st;
+		snap->changes = st->changes;
+		pthread_mutex_init(&snap->lock, NULL);
+		InitializeTimer(&snap->timer, SnapshotTimerHandler, snap);
+		StartTimer(&snap->timer, SNAPSHOT_INTERVAL);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: LoadSnapshot                                          *
+ *                                                                 *
+ * Arguments: ircsnapshot_t*, ircreconnect_t*                      *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Fills the (empty) state in from the last snapshot  *
+ * and has the channels we were in joined once the server lets us  *
+ * in. Returns false with errno set to ENOENT if there is none, or  *
+ * EINVAL if it isn't one we can read.                             *
+ *                                                                 *
+ *******************************************************************/
+int LoadSnapshot(ircsnapshot_t *snap, ircreconnect_t *r)
+{
+		assert(snap && r);
+		ircstate_t *st = snap->state;
+		int64_t start = GetMonotonicTime();
+
+		int fd = open(snap->path, O_RDONLY);
+		if (fd == -1)
+				return 0;
+
+		struct stat sb;
+		if (fstat(fd, &sb) == -1 || (size_t)sb.st_size < sizeof(snapshotheader_t))
+		{
+				close(fd);
+				errno = EINVAL;
+				return 0;
+		}
+
+		const char *map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED)
+				return 0;
+
+		// Check everything points inside the file before using any of it.
+		const snapshotheader_t *header = (const snapshotheader_t*)map;
+		uint64_t size = sb.st_size;
+		uint64_t tables = sizeof(snapshotheader_t) + (uint64_t)header->nusers * sizeof(snapshotname_t) +
+			(uint64_t)header->nchannels * sizeof(snapshotchannel_t) + (uint64_t)header->nmembers * sizeof(snapshotmember_t);
+		const snapshotname_t *users = (const snapshotname_t*)(header + 1);
+		const snapshotchannel_t *channels = (const snapshotchannel_t*)(users + header->nusers);
+		const snapshotmember_t *members = (const snapshotmember_t*)(channels + header->nchannels);
+
+		int ok = !memcmp(header->magic, SNAPSHOT_MAGIC, 4) && header->version == SNAPSHOT_VERSION &&
+			header->size == size && tables <= size && header->casemap < IRC_CASEMAPS;
+
+		for (uint32_t i = 0; ok && i < header->nusers; ++i)
+				ok = users[i].offset >= tables && users[i].offset <= size && users[i].len <= size - users[i].offset;
+
+		for (uint32_t i = 0; ok && i < header->nchannels; ++i)
+				ok = channels[i].name.offset >= tables && channels[i].name.offset <= size &&
+					channels[i].name.len <= size - channels[i].name.offset &&
+					channels[i].first <= header->nmembers && channels[i].count <= header->nmembers - channels[i].first;
+
+		for (uint32_t i = 0; ok && i < header->nmembers; ++i)
+				ok = members[i].user < header->nusers;
+
+		if (!ok)
+		{
+				LogWarning("Ignoring %s, it isn't a snapshot we can read", snap->path);
+				munmap((void*)map, sb.st_size);
+				errno = EINVAL;
+				return 0;
+		}
+
+		SetIRCCaseMap(st, header->casemap);
+
+		int restored = 0;
+		for (uint32_t i = 0; i < header->nchannels; ++i)
+		{
+				const snapshotchannel_t *ch = &channels[i];
+				strview_t name = { map + ch->name.offset, ch->name.len };
+				int ours = 0;
+
+				for (uint32_t j = ch->first; j < ch->first + ch->count; ++j)
+				{
+						const snapshotname_t *nick = &users[members[j].user];
+						ircmember_t *member = nick->len ? JoinIRCChannel(st, (strview_t){ map + nick->offset, nick->len }, name) : NULL;
+						if (!member)
+								continue;
+
+						member->modes = members[j].modes;
+						member->channel->stale = 1;
+						ours |= members[j].user == header->self;
+				}
+
+				if (!ours || !name.len)
+						continue;
+
+				// It may have been given on the command line too.
+				int known = 0;
+				for (int k = 0; k < r->channels.length && !known; ++k)
+						known = IRCStringEquals(st->map, r->channels.data[k], strlen(r->channels.data[k]), name.ptr, name.len);
+
+				char *copy = known ? NULL : strndup(name.ptr, name.len);
+				if (copy && AddReconnectChannel(r, copy))
+						restored++;
+				free(copy);
+		}
+
+		munmap((void*)map, sb.st_size);
+
+		// What we have now is what's on disk already.
+		snap->changes = st->changes;
+
+		LogInfo("Restored %u users in %u channels from %s in %lld ms, rejoining %d channels",
+			st->users.count, st->channels.count, snap->path, (long long)(GetMonotonicTime() - start), restored);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: SaveSnapshot                                          *
+ *                                                                 *
+ * Arguments: ircsnapshot_t*, (int) whether to wait for it         *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Takes a snapshot if anything changed since the     *
+ * last one. It's written by a worker unless we're told to wait,   *
+ * in which case it's written before we return. Nothing is taken   *
+ * while we aren't connected: the state is empty then and the old  *
+ * snapshot is a better guess of where we'll be once we're back.   *
+ * Must be called on the event loop thread the state belongs to.   *
+ *                                                                 *
+ *******************************************************************/
+int SaveSnapshot(ircsnapshot_t *snap, int wait)
+{
+		assert(snap && snap->path);
+		ircstate_t *st = snap->state;
+
+		if (st->changes == snap->changes || !st->self)
+				return 1;
+
+		snapshotjob_t *job = PackSnapshot(st);
+		if (!job)
+		{
+				LogError("Failed to take a snapshot for %s: %s (%d)", snap->path, strerror(errno), errno);
+				return 0;
+		}
+
+		job->work.run = RunSnapshotJob;
+		job->snap = snap;
+		job->taken = ++snap->taken;
+
+		if (wait)
+		{
+				int ok = WriteSnapshot(snap, job->taken, job->data, job->len);
+				free(job);
+				if (ok)
+						snap->changes = st->changes;
+				return ok;
+		}
+
+		// If the workers are too busy we'll try again next time.
+		if (!SubmitWork(&job->work, (uint32_t)(uintptr_t)snap))
+		{
+				free(job);
+				return 0;
+		}
+
+		snap->changes = st->changes;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: CloseSnapshot                                         *
+ *                                                                 *
+ * Arguments: ircsnapshot_t*                                       *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Takes a last snapshot (if anything changed) and    *
+ * stops taking them. Has to be called on the event loop thread    *
+ * the state belongs to, before the state is destroyed.            *
+ *                                                                 *
+ *******************************************************************/
+void CloseSnapshot(ircsnapshot_t *snap)
+{
+		assert(snap);
+
+		StopTimer(&snap->timer);
+		SaveSnapshot(snap, 1);
+}
+
+/*******************************************************************
+ * Function: DestroySnapshot                                       *
+ *                                                                 *
+ * Arguments: ircsnapshot_t*                                       *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Frees everything. The snapshots have to have been  *
+ * closed and the workers stopped so none is still being written.  *
+ *                                                                 *
+ *******************************************************************/
+void DestroySnapshot(ircsnapshot_t *snap)
+{
+		assert(snap && !IsTimerPending(&snap->timer));
+
+		pthread_mutex_destroy(&snap->lock);
+		free(snap->path);
+		snap->path = NULL;
+}
@@ -0,0 +1,877 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Include our network state types and function declarations.
+#include "irc/state.h"
+#include "eventloop/eventloop.h"
+
+// What we look users and channels up by.
+typedef struct
+{
+		const unsigned char *map;
+		const char *name;
+		size_t len;
+} namekey_t;
+
+// What we look memberships up by.
+typedef struct
+{
+		const ircuser_t *user;
+		const ircchannel_t *channel;
+} memberkey_t;
+
+static int MatchUser(const void *item, const void *key)
+{
+		const ircuser_t *user = item;
+		const namekey_t *k = key;
+		return IRCStringEquals(k->map, user->nick, user->nicklen, k->name, k->len);
+}
+
+static int MatchChannel(const void *item, const void *key)
+{
+		const ircchannel_t *channel = item;
+		const namekey_t *k = key;
+		return IRCStringEquals(k->map, channel->name, channel->namelen, k->name, k->len);
+}
+
+static int MatchMember(const void *item, const void *key)
+{
+		const ircmember_t *member = item;
+		const memberkey_t *k = key;
+		return member->user == k->user && member->channel == k->channel;
+}
+
+// Channel names start with one of these, anything else is a nick.
+static inline int IsChannelName(strview_t name)
+{
+		return name.len && memchr("#&+!", name.ptr[0], 4);
+}
+
+/*******************************************************************
+ * Function: InitializeIRCState                                    *
+ *                                                                 *
+ * Arguments: ircstate_t*                                          *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sets up empty tables using the RFC 1459 case map   *
+ * until the server tells us otherwise.                            *
+ *                                                                 *
+ *******************************************************************/
+int InitializeIRCState(ircstate_t *st)
+{
+		assert(st);
+		memset(st, 0, sizeof(ircstate_t));
+
+		st->casemap = IRC_CASEMAP_RFC1459;
+		st->map = GetIRCCaseMap(st->casemap);
+
+		if (!InitializeHashTable(&st->users, 0) ||
+			!InitializeHashTable(&st->channels, 0) ||
+			!InitializeHashTable(&st->members, 0) ||
+			!InitializePool(&st->userpool, sizeof(ircuser_t), 0, 0) ||
+			!InitializePool(&st->channelpool, sizeof(ircchannel_t), 0, 0) ||
+			!InitializePool(&st->memberpool, sizeof(ircmember_t), 0, 0))
+		{
+				DestroyIRCState(st);
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ClearIRCState                                         *
+ *                                                                 *
+ * Arguments: ircstate_t*                                          *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Forgets every user and channel, eg. because we     *
+ * lost the connection and the server will tell us everything      *
+ * again once we're back. The tables are kept for next time.       *
+ *                                                                 *
+ *******************************************************************/
+void ClearIRCState(ircstate_t *st)
+{
+		assert(st);
+
+		uint32_t iter = 0;
+		ircuser_t *user;
+		while ((user = NextHashItem(&st->users, &iter)))
+		{
+				free(user->nick);
+				vec_sbo_deinit(&user->channels);
+				PoolFree(&st->userpool, user);
+		}
+
+		iter = 0;
+		ircchannel_t *channel;
+		while ((channel = NextHashItem(&st->channels, &iter)))
+		{
+				free(channel->name);
+				vec_deinit(&channel->members);
+				PoolFree(&st->channelpool, channel);
+		}
+
+		iter = 0;
+		ircmember_t *member;
+		while ((member = NextHashItem(&st->members, &iter)))
+				PoolFree(&st->memberpool, member);
+
+		ClearHashTable(&st->users);
+		ClearHashTable(&st->channels);
+		ClearHashTable(&st->members);
+		st->self = NULL;
+		st->changes++;
+
+		// The next server may compare names differently.
+		st->casemap = IRC_CASEMAP_RFC1459;
+		st->map = GetIRCCaseMap(st->casemap);
+}
+
+/*******************************************************************
+ * Function: DestroyIRCState                                       *
+ *                                                                 *
+ * Arguments: ircstate_t*                                          *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+void DestroyIRCState(ircstate_t *st)
+{
+		assert(st);
+
+		ClearIRCState(st);
+
+		DestroyHashTable(&st->users);
+		DestroyHashTable(&st->channels);
+		DestroyHashTable(&st->members);
+		DestroyPool(&st->userpool);
+		DestroyPool(&st->channelpool);
+		DestroyPool(&st->memberpool);
+}
+
+/*******************************************************************
+ * Function: SetIRCCaseMap                                         *
+ *                                                                 *
+ * Arguments: ircstate_t*, irccasemap_t                            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Switches to the case map the server said it uses.  *
+ * This normally happens before we've joined anything but if we    *
+ * already know some names they're hashed again with the new map.  *
+ * Must be called from the event loop which owns the state.        *
+ *                                                                 *
+ *******************************************************************/
+int SetIRCCaseMap(ircstate_t *st, irccasemap_t casemap)
+{
+		assert(st);
+
+		if (casemap == st->casemap)
+				return 1;
+
+		// We can't insert while walking the table so take everything out
+		// first. Memberships are keyed by pointers so they're unaffected.
+		// The list is gone with the rest of the batch's scratch memory.
+		arena_t *arena = GetEventArena();
+		vec_t(void*) items;
+		vec_init(&items);
+
+		uint32_t iter = 0;
+		void *item;
+		while ((item = NextHashItem(&st->users, &iter)))
+				if (vec_arena_push(&items, arena, item))
+						return 0;
+
+		int nusers = items.length;
+
+		iter = 0;
+		while ((item = NextHashItem(&st->channels, &iter)))
+				if (vec_arena_push(&items, arena, item))
+						return 0;
+
+		// Only switch once nothing can fail, until then the tables are
+		// still hashed with the old map and have to be looked up with it.
+		st->casemap = casemap;
+		st->map = GetIRCCaseMap(casemap);
+		st->changes++;
+
+		ClearHashTable(&st->users);
+		ClearHashTable(&st->channels);
+
+		for (int i = 0; i < items.length; ++i)
+		{
+				if (i < nusers)
+				{
+						ircuser_t *user = items.data[i];
+						user->hash = IRCHashString(st->map, user->nick, user->nicklen);
+						InsertHashItem(&st->users, user->hash, user);
+				}
+				else
+				{
+						ircchannel_t *channel = items.data[i];
+						channel->hash = IRCHashString(st->map, channel->name, channel->namelen);
+						InsertHashItem(&st->channels, channel->hash, channel);
+				}
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: FindIRCUser                                           *
+ *                                                                 *
+ * Arguments: const ircstate_t*, strview_t nick                    *
+ *                                                                 *
+ * Returns: (ircuser_t*) The user or NULL if we don't know them.   *
+ *                                                                 *
+ *******************************************************************/
+ircuser_t *FindIRCUser(const ircstate_t *st, strview_t nick)
+{
+		assert(st);
+		namekey_t key = { st->map, nick.ptr, nick.len };
+		return FindHashItem(&st->users, IRCHashString(st->map, nick.ptr, nick.len), MatchUser, &key);
+}
+
+/*******************************************************************
+ * Function: FindIRCChannel                                        *
+ *                                                                 *
+ * Arguments: const ircstate_t*, strview_t name                    *
+ *                                                                 *
+ * Returns: (ircchannel_t*) The channel or NULL if we're not in    *
+ * it.                                                             *
+ *                                                                 *
+ *******************************************************************/
+ircchannel_t *FindIRCChannel(const ircstate_t *st, strview_t name)
+{
+		assert(st);
+		namekey_t key = { st->map, name.ptr, name.len };
+		return FindHashItem(&st->channels, IRCHashString(st->map, name.ptr, name.len), MatchChannel, &key);
+}
+
+/*******************************************************************
+ * Function: FindIRCMember                                         *
+ *                                                                 *
+ * Arguments: const ircstate_t*, const ircuser_t*,                 *
+ *            const ircchannel_t*                                  *
+ *                                                                 *
+ * Returns: (ircmember_t*) The user's membership of the channel or *
+ * NULL if they're not in it.                                      *
+ *                                                                 *
+ *******************************************************************/
+ircmember_t *FindIRCMember(const ircstate_t *st, const ircuser_t *user, const ircchannel_t *channel)
+{
+		assert(st && user && channel);
+		memberkey_t key = { user, channel };
+		return FindHashItem(&st->members, HashPointers(user, channel), MatchMember, &key);
+}
+
+/*******************************************************************
+ * Function: GetUser                                               *
+ *                                                                 *
+ * Arguments: ircstate_t*, strview_t nick                          *
+ *                                                                 *
+ * Returns: (ircuser_t*) The user with the nick, who is created if *
+ * we didn't know them, or NULL if we ran out of memory.           *
+ *                                                                 *
+ *******************************************************************/
+static ircuser_t *GetUser(ircstate_t *st, strview_t nick)
+{
+		ircuser_t *user = FindIRCUser(st, nick);
+		if (user)
+				return user;
+
+		// PoolCalloc leaves the small buffer vector ready to use.
+		user = PoolCalloc(&st->userpool);
+		if (!user)
+				return NULL;
+
+		user->nick = strndup(nick.ptr, nick.len);
+		user->nicklen = nick.len;
+		user->hash = IRCHashString(st->map, nick.ptr, nick.len);
+
+		if (!user->nick || !InsertHashItem(&st->users, user->hash, user))
+		{
+				free(user->nick);
+				PoolFree(&st->userpool, user);
+				return NULL;
+		}
+
+		return user;
+}
+
+/*******************************************************************
+ * Function: FreeUser                                              *
+ *                                                                 *
+ * Arguments: ircstate_t*, ircuser_t*                              *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void FreeUser(ircstate_t *st, ircuser_t *user)
+{
+		assert(!user->channels.length);
+
+		namekey_t key = { st->map, user->nick, user->nicklen };
+		RemoveHashItem(&st->users, user->hash, MatchUser, &key);
+
+		if (st->self == user)
+				st->self = NULL;
+
+		free(user->nick);
+		vec_sbo_deinit(&user->channels);
+		PoolFree(&st->userpool, user);
+}
+
+/*******************************************************************
+ * Function: GetChannel                                            *
+ *                                                                 *
+ * Arguments: ircstate_t*, strview_t name                          *
+ *                                                                 *
+ * Returns: (ircchannel_t*) The channel with the name, which is    *
+ * created if it didn't exist, or NULL if we ran out of memory.    *
+ *                                                                 *
+ *******************************************************************/
+static ircchannel_t *GetChannel(ircstate_t *st, strview_t name)
+{
+		ircchannel_t *channel = FindIRCChannel(st, name);
+		if (channel)
+				return channel;
+
+		channel = PoolCalloc(&st->channelpool);
+		if (!channel)
+				return NULL;
+
+		channel->name = strndup(name.ptr, name.len);
+		channel->namelen = name.len;
+		channel->hash = IRCHashString(st->map, name.ptr, name.len);
+
+		if (!channel->name || !InsertHashItem(&st->channels, channel->hash, channel))
+		{
+				free(channel->name);
+				PoolFree(&st->channelpool, channel);
+				return NULL;
+		}
+
+		return channel;
+}
+
+/*******************************************************************
+ * Function: FreeChannel                                           *
+ *                                                                 *
+ * Arguments: ircstate_t*, ircchannel_t*                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void FreeChannel(ircstate_t *st, ircchannel_t *channel)
+{
+		assert(!channel->members.length);
+
+		namekey_t key = { st->map, channel->name, channel->namelen };
+		RemoveHashItem(&st->channels, channel->hash, MatchChannel, &key);
+
+		free(channel->name);
+		vec_deinit(&channel->members);
+		PoolFree(&st->channelpool, channel);
+}
+
+/*******************************************************************
+ * Function: RemoveMember                                          *
+ *                                                                 *
+ * Arguments: ircstate_t*, ircmember_t*                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Takes a user out of a channel. Both lists fill the *
+ * gap with their last entry so this doesn't depend on how big the *
+ * channel is or how many channels the user is in. Users we no     *
+ * longer share a channel with are forgotten, as are channels with *
+ * nobody left in them.                                            *
+ *                                                                 *
+ *******************************************************************/
+static void RemoveMember(ircstate_t *st, ircmember_t *member)
+{
+		ircuser_t *user = member->user;
+		ircchannel_t *channel = member->channel;
+
+		memberkey_t key = { user, channel };
+		RemoveHashItem(&st->members, HashPointers(user, channel), MatchMember, &key);
+		st->changes++;
+
+		ircmember_t *last = vec_pop(&user->channels);
+		if (last != member)
+		{
+				user->channels.data[member->useridx] = last;
+				last->useridx = member->useridx;
+		}
+
+		last = vec_pop(&channel->members);
+		if (last != member)
+		{
+				channel->members.data[member->chanidx] = last;
+				last->chanidx = member->chanidx;
+		}
+
+		PoolFree(&st->memberpool, member);
+
+		if (!user->channels.length && user != st->self)
+				FreeUser(st, user);
+
+		if (!channel->members.length)
+				FreeChannel(st, channel);
+}
+
+/*******************************************************************
+ * Function: JoinIRCChannel                                        *
+ *                                                                 *
+ * Arguments: ircstate_t*, strview_t nick, strview_t channel name  *
+ *                                                                 *
+ * Returns: (ircmember_t*) The user's membership of the channel or *
+ * NULL if we ran out of memory.                                   *
+ *                                                                 *
+ * Description: Records that a user is in a channel, creating the  *
+ * user and the channel if we didn't know them yet. Joining a      *
+ * channel the user is already in just returns their membership.   *
+ *                                                                 *
+ *******************************************************************/
+ircmember_t *JoinIRCChannel(ircstate_t *st, strview_t nick, strview_t name)
+{
+		assert(st);
+
+		ircuser_t *user = GetUser(st, nick);
+		if (!user)
+				return NULL;
+
+		ircchannel_t *channel = GetChannel(st, name);
+		if (!channel)
+				goto fail;
+
+		ircmember_t *member = FindIRCMember(st, user, channel);
+		if (member)
+				return member;
+
+		member = PoolCalloc(&st->memberpool);
+		if (!member)
+				goto fail;
+
+		member->user    = user;
+		member->channel = channel;
+		member->useridx = user->channels.length;
+		member->chanidx = channel->members.length;
+
+		if (vec_sbo_push(&user->channels, member))
+				goto failmember;
+
+		if (vec_push(&channel->members, member))
+		{
+				user->channels.length--;
+				goto failmember;
+		}
+
+		if (!InsertHashItem(&st->members, HashPointers(user, channel), member))
+		{
+				user->channels.length--;
+				channel->members.length--;
+				goto failmember;
+		}
+
+		st->changes++;
+		return member;
+
+failmember:
+		PoolFree(&st->memberpool, member);
+fail:
+		// Don't leave behind a user or channel nobody is in.
+		if (channel && !channel->members.length)
+				FreeChannel(st, channel);
+		if (!user->channels.length && user != st->self)
+				FreeUser(st, user);
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: PartIRCChannel                                        *
+ *                                                                 *
+ * Arguments: ircstate_t*, strview_t nick, strview_t channel name  *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Records that a user left (or was kicked from) a    *
+ * channel. Returns false if they weren't in it.                   *
+ *                                                                 *
+ *******************************************************************/
+int PartIRCChannel(ircstate_t *st, strview_t nick, strview_t name)
+{
+		assert(st);
+
+		ircuser_t *user = FindIRCUser(st, nick);
+		ircchannel_t *channel = FindIRCChannel(st, name);
+		if (!user || !channel)
+				return 0;
+
+		ircmember_t *member = FindIRCMember(st, user, channel);
+		if (!member)
+				return 0;
+
+		RemoveMember(st, member);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: QuitIRCUser                                           *
+ *                                                                 *
+ * Arguments: ircstate_t*, strview_t nick                          *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Takes a user who quit out of every channel. Each   *
+ * channel costs the same no matter how big it is, a user in 200   *
+ * channels is 200 quick removals rather than 200 searches.        *
+ *                                                                 *
+ *******************************************************************/
+int QuitIRCUser(ircstate_t *st, strview_t nick)
+{
+		assert(st);
+
+		ircuser_t *user = FindIRCUser(st, nick);
+		if (!user)
+				return 0;
+
+		// The last removal frees the user (unless it's us) so don't look
+		// at them again after it.
+		int remaining = user->channels.length;
+		while (remaining--)
+				RemoveMember(st, vec_last(&user->channels));
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: RenameIRCUser                                         *
+ *                                                                 *
+ * Arguments: ircstate_t*, strview_t old nick, strview_t new nick  *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Changes a user's nick. Only the user table has to  *
+ * change, every channel they're in points at the same user.       *
+ *                                                                 *
+ *******************************************************************/
+int RenameIRCUser(ircstate_t *st, strview_t oldnick, strview_t newnick)
+{
+		assert(st);
+
+		ircuser_t *user = FindIRCUser(st, oldnick);
+		if (!user)
+				return 0;
+
+		// If we still think someone else has the new nick we missed them
+		// leaving, forget them so the names don't clash.
+		ircuser_t *other = FindIRCUser(st, newnick);
+		if (other && other != user)
+		{
+				if (other == st->self)
+						return 0;
+				QuitIRCUser(st, newnick);
+		}
+
+		char *nick = strndup(newnick.ptr, newnick.len);
+		if (!nick)
+				return 0;
+
+		namekey_t key = { st->map, user->nick, user->nicklen };
+		RemoveHashItem(&st->users, user->hash, MatchUser, &key);
+
+		free(user->nick);
+		user->nick = nick;
+		user->nicklen = newnick.len;
+		user->hash = IRCHashString(st->map, nick, newnick.len);
+
+		// We just removed an item so there's always room to put it back.
+		InsertHashItem(&st->users, user->hash, user);
+		st->changes++;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ForgetIRCChannel                                      *
+ *                                                                 *
+ * Arguments: ircstate_t*, ircchannel_t*                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Throws away everything we know about a channel,    *
+ * eg. once we left it and can't see who's in it anymore.          *
+ *                                                                 *
+ *******************************************************************/
+void ForgetIRCChannel(ircstate_t *st, ircchannel_t *channel)
+{
+		assert(st && channel);
+
+		// The last removal frees the channel.
+		int remaining = channel->members.length;
+		while (remaining--)
+				RemoveMember(st, vec_last(&channel->members));
+}
+
+/*******************************************************************
+ * Function: PrefixNick                                            *
+ *                                                                 *
+ * Arguments: strview_t prefix (or NAMES entry)                    *
+ *                                                                 *
+ * Returns: (strview_t) The nick in nick!user@host.                *
+ *                                                                 *
+ *******************************************************************/
+static strview_t PrefixNick(strview_t prefix)
+{
+		const char *bang = memchr(prefix.ptr, '!', prefix.len);
+		if (!bang)
+				bang = memchr(prefix.ptr, '@', prefix.len);
+		if (bang)
+				prefix.len = bang - prefix.ptr;
+		return prefix;
+}
+
+/*******************************************************************
+ * Function: NextListItem                                          *
+ *                                                                 *
+ * Arguments: strview_t* list, char separator, strview_t* item     *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Takes the next non-empty item off the front of a   *
+ * list like "#a,#b" or "@nick +nick nick".                        *
+ *                                                                 *
+ *******************************************************************/
+static int NextListItem(strview_t *list, char sep, strview_t *item)
+{
+		while (list->len && list->ptr[0] == sep)
+		{
+				list->ptr++;
+				list->len--;
+		}
+
+		if (!list->len)
+				return 0;
+
+		const char *end = memchr(list->ptr, sep, list->len);
+		item->ptr = list->ptr;
+		item->len = end ? (size_t)(end - list->ptr) : list->len;
+
+		list->ptr += item->len;
+		list->len -= item->len;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: MemberModeFlag                                        *
+ *                                                                 *
+ * Arguments: (char) mode letter or prefix symbol                  *
+ *                                                                 *
+ * Returns: (int) The IRC_MEMBER_* flag or 0 if it isn't one.      *
+ *                                                                 *
+ *******************************************************************/
+static int MemberModeFlag(char c)
+{
+		switch (c)
+		{
+				case 'v': case '+': return IRC_MEMBER_VOICE;
+				case 'h': case '%': return IRC_MEMBER_HALFOP;
+				case 'o': case '@': return IRC_MEMBER_OP;
+				case 'a': case '&': return IRC_MEMBER_ADMIN;
+				case 'q': case '~': return IRC_MEMBER_OWNER;
+				default:            return 0;
+		}
+}
+
+/*******************************************************************
+ * Function: UpdateChannelModes                                    *
+ *                                                                 *
+ * Arguments: ircstate_t*, const ircmsg_t* (a channel MODE)        *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Picks the member modes (+o, +v, ...) out of a      *
+ * MODE change. We don't know every server's list of modes which   *
+ * take a parameter so we assume the usual ones: the member modes  *
+ * and b, e, I and k always take one, l only when it's being set.  *
+ *                                                                 *
+ *******************************************************************/
+static void UpdateChannelModes(ircstate_t *st, const ircmsg_t *msg)
+{
+		ircchannel_t *channel = FindIRCChannel(st, IRCSpan(msg, msg->params[0]));
+		if (!channel || msg->nparams < 2)
+				return;
+
+		strview_t modes = IRCSpan(msg, msg->params[1]);
+		int arg = 2;
+		int adding = 1;
+
+		for (size_t i = 0; i < modes.len; ++i)
+		{
+				char c = modes.ptr[i];
+				if (c == '+' || c == '-')
+				{
+						adding = c == '+';
+						continue;
+				}
+
+				int flag = MemberModeFlag(c);
+				if (!flag)
+				{
+						if (memchr("beIk", c, 4) || (c == 'l' && adding))
+								arg++;
+						continue;
+				}
+
+				if (arg >= msg->nparams)
+						return;
+
+				ircuser_t *user = FindIRCUser(st, IRCSpan(msg, msg->params[arg++]));
+				ircmember_t *member = user ? FindIRCMember(st, user, channel) : NULL;
+				if (!member)
+						continue;
+
+				if (adding)
+						member->modes |= flag;
+				else
+						member->modes &= ~flag;
+				st->changes++;
+		}
+}
+
+/*******************************************************************
+ * Function: UpdateIRCState                                        *
+ *                                                                 *
+ * Arguments: ircstate_t*, const ircmsg_t*                         *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Keeps our picture of the network up to date. Feed  *
+ * it every message the server sends, it picks out the ones which  *
+ * change who is where (JOIN, PART, KICK, QUIT, NICK, MODE and     *
+ * NAMES replies) and ignores the rest.                            *
+ *                                                                 *
+ *******************************************************************/
+void UpdateIRCState(ircstate_t *st, const ircmsg_t *msg)
+{
+		assert(st && msg);
+
+		strview_t nick = PrefixNick(IRCSpan(msg, msg->prefix));
+		strview_t list, item;
+		ircchannel_t *channel;
+
+		switch (msg->numeric)
+		{
+				case 1: // RPL_WELCOME, the first parameter is our nick.
+						if (msg->nparams)
+								st->self = GetUser(st, IRCSpan(msg, msg->params[0]));
+						st->changes++;
+						return;
+
+				case 5: // RPL_ISUPPORT, the tokens are between our nick and the trailing text.
+						for (int i = 1; i < msg->nparams - 1; ++i)
+						{
+								strview_t token = IRCSpan(msg, msg->params[i]);
+								if (token.len > 12 && !memcmp(token.ptr, "CASEMAPPING=", 12))
+								{
+										strview_t name = { token.ptr + 12, token.len - 12 };
+										SetIRCCaseMap(st, ParseIRCCaseMap(name));
+								}
+						}
+						return;
+
+				case 353: // RPL_NAMREPLY: us, channel type, channel, names.
+						if (msg->nparams < 4)
+								return;
+
+						list = IRCSpan(msg, msg->params[3]);
+						while (NextListItem(&list, ' ', &item))
+						{
+								// Servers with multi-prefix send every prefix the user has.
+								int modes = 0, flag;
+								while (item.len && (flag = MemberModeFlag(item.ptr[0])) && !memchr("vhoaq", item.ptr[0], 5))
+								{
+										modes |= flag;
+										item.ptr++;
+										item.len--;
+								}
+
+								ircmember_t *member = item.len ? JoinIRCChannel(st, PrefixNick(item), IRCSpan(msg, msg->params[2])) : NULL;
+								if (member)
+										member->modes = modes;
+						}
+						return;
+
+				case 403: // ERR_NOSUCHCHANNEL
+				case 405: // ERR_TOOMANYCHANNELS
+				case 471: // ERR_CHANNELISFULL
+				case 473: // ERR_INVITEONLYCHAN
+				case 474: // ERR_BANNEDFROMCHAN
+				case 475: // ERR_BADCHANNELKEY
+				case 477: // ERR_NEEDREGGEDNICK
+						// We couldn't get back into a channel from the snapshot,
+						// what it says about it won't be corrected any more.
+						if (msg->nparams >= 2 && (channel = FindIRCChannel(st, IRCSpan(msg, msg->params[1]))) && channel->stale)
+								ForgetIRCChannel(st, channel);
+						return;
+
+				case 0:
+						break;
+
+				default:
+						return;
+		}
+
+		if (!msg->prefix.len)
+				return;
+
+		if (IRCSpanEquals(msg, msg->command, "JOIN") && msg->nparams)
+		{
+				list = IRCSpan(msg, msg->params[0]);
+				int self = st->self && FindIRCUser(st, nick) == st->self;
+				while (NextListItem(&list, ',', &item))
+				{
+						// The server sends everyone who is in a channel we join,
+						// drop whoever the snapshot thought was in it.
+						if (self && (channel = FindIRCChannel(st, item)) && channel->stale)
+								ForgetIRCChannel(st, channel);
+						JoinIRCChannel(st, nick, item);
+				}
+		}
+		else if (IRCSpanEquals(msg, msg->command, "PART") && msg->nparams)
+		{
+				list = IRCSpan(msg, msg->params[0]);
+				while (NextListItem(&list, ',', &item))
+				{
+						// Once we leave we can't see the channel anymore.
+						channel = FindIRCChannel(st, item);
+						if (channel && st->self && FindIRCUser(st, nick) == st->self)
+								ForgetIRCChannel(st, channel);
+						else
+								PartIRCChannel(st, nick, item);
+				}
+		}
+		else if (IRCSpanEquals(msg, msg->command, "KICK") && msg->nparams >= 2)
+		{
+				strview_t name = IRCSpan(msg, msg->params[0]);
+				strview_t victim = IRCSpan(msg, msg->params[1]);
+				channel = FindIRCChannel(st, name);
+
+				if (channel && st->self && FindIRCUser(st, victim) == st->self)
+						ForgetIRCChannel(st, channel);
+				else
+						PartIRCChannel(st, victim, name);
+		}
+		else if (IRCSpanEquals(msg, msg->command, "QUIT"))
+				QuitIRCUser(st, nick);
+		else if (IRCSpanEquals(msg, msg->command, "NICK") && msg->nparams)
+				RenameIRCUser(st, nick, IRCSpan(msg, msg->params[0]));
+		else if (IRCSpanEquals(msg, msg->command, "MODE") && msg->nparams && IsChannelName(IRCSpan(msg, msg->params[0])))
+				UpdateChannelModes(st, msg);
+}
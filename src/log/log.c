@@ -0,0 +1,643 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include "vector/vec.h"
+#include "memory/pool.h" // for POOL_CACHELINE
+
+// Include our logging types and function declarations.
+#include "log/log.h"
+
+// How many call sites each thread keeps count of for LOG_BURST.
+#define LOG_SITES_BITS 8
+#define LOG_SITES (1 << LOG_SITES_BITS)
+
+// How much the writer formats before writing it out.
+#define LOG_WRITE_BUFFER 65536
+
+// How long (in milliseconds) the writer sleeps when nobody wakes it.
+#define LOG_IDLE_TIMEOUT 1000
+
+// A message waiting for the writer.
+typedef struct
+{
+		struct timespec time;
+		loglevel_t level;
+		const char *file;       // __FILE__ of the call site, so it lives forever.
+		int line;
+		unsigned int suppressed; // Messages from the call site suppressed before this one.
+		char text[LOG_MESSAGE_MAX];
+} logrecord_t;
+
+// The ring of one thread. Only the thread pushes (moves `tail') and only
+// the writer pops (moves `head'), so each index has a single writer and
+// needs no read-modify-write.
+typedef struct
+{
+		logrecord_t records[LOG_RING_SIZE];
+		char name[16];            // The thread's name, from SetLogThreadName.
+		atomic_uint dropped;      // Messages which didn't fit since the writer last looked.
+		atomic_int closed;        // The thread exited, free the ring once it's empty.
+
+		_Alignas(POOL_CACHELINE) atomic_size_t tail;
+		_Alignas(POOL_CACHELINE) atomic_size_t head;
+} logring_t;
+
+// How often a call site logged in the current second.
+typedef struct
+{
+		const char *fmt;
+		time_t second;
+		unsigned int count;
+		unsigned int suppressed;
+} logsite_t;
+
+_Atomic int loglevel = LOGLEVEL_INFO;
+
+static const char *levelnames[LOGLEVELS] = { "debug", "info", "warning", "error" };
+
+// Every thread's ring, guarded by `ringlock'.
+static pthread_mutex_t ringlock = PTHREAD_MUTEX_INITIALIZER;
+static vec_t(logring_t*) rings;
+static pthread_key_t ringkey;
+static pthread_once_t ringkeyonce = PTHREAD_ONCE_INIT;
+static int keyerror;
+
+// The writer, `sleeping' is set while it waits on `wakepipe' for something
+// to do so the threads logging only write to the pipe when they have to.
+static pthread_t writer;
+static int wakepipe[2] = { -1, -1 };
+static atomic_int running;
+static atomic_int stopping;
+static atomic_int sleeping;
+
+// Bumped by StopLogging so threads know their ring is gone.
+static atomic_uint generation;
+
+static _Thread_local logring_t *threadring;
+static _Thread_local unsigned int threadgeneration;
+static _Thread_local char threadname[16] = "thread";
+static _Thread_local logsite_t sites[LOG_SITES];
+
+/*******************************************************************
+ * Function: FormatRecord                                          *
+ *                                                                 *
+ * Arguments: (char*) buffer, (size_t) its size, logrecord_t*,     *
+ * (const char*) the name of the thread which logged it            *
+ *                                                                 *
+ * Returns: (size_t) How many bytes were written, the line is cut  *
+ * short (but still ends in a newline) if the buffer is too small. *
+ *                                                                 *
+ * Description: Writes the message out as one line of key=value    *
+ * pairs. The text is quoted, with anything that would break the   *
+ * line up escaped since it can come straight from the network.    *
+ *                                                                 *
+ *******************************************************************/
+static size_t FormatRecord(char *buf, size_t size, const logrecord_t *rec, const char *thread)
+{
+		assert(size > 1);
+
+		struct tm tm;
+		gmtime_r(&rec->time.tv_sec, &tm);
+
+		const char *file = strrchr(rec->file, '/');
+		file = file ? file + 1 : rec->file;
+
+		int n = snprintf(buf, size, "time=%04d-%02d-%02dT%02d:%02d:%02d.%06ldZ level=%s thread=%s at=%s:%d msg=\"",
+		                 tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+		                 rec->time.tv_nsec / 1000, levelnames[rec->level], thread, file, rec->line);
+		size_t len = n < 0 ? 0 : (size_t)n >= size - 1 ? size - 2 : (size_t)n;
+
+		// Leave room for the escapes, the closing quote and the newline.
+		for (const char *p = rec->text; *p && len + 5 < size; ++p)
+		{
+				unsigned char c = *p;
+				if (c == '"' || c == '\\')
+				{
+						buf[len++] = '\\';
+						buf[len++] = c;
+				}
+				else if (c == '\n' || c == '\r' || c == '\t')
+				{
+						buf[len++] = '\\';
+						buf[len++] = c == '\n' ? 'n' : c == '\r' ? 'r' : 't';
+				}
+				else
+						buf[len++] = c < 0x20 || c == 0x7f ? '?' : c;
+		}
+
+		if (len + 2 < size)
+				buf[len++] = '"';
+
+		if (rec->suppressed)
+		{
+				n = snprintf(buf + len, size - len, " suppressed=%u", rec->suppressed);
+				len += n < 0 || (size_t)n >= size - len ? 0 : (size_t)n;
+		}
+
+		buf[len < size - 1 ? len++ : size - 2] = '\n';
+		return len < size ? len : size - 1;
+}
+
+/*******************************************************************
+ * Function: WriteAll                                              *
+ *                                                                 *
+ * Arguments: (const char*) buffer, (size_t) length                *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Writes everything to stderr, carrying on after     *
+ * short writes. There's nowhere to report it failing so it gives  *
+ * up quietly.                                                     *
+ *                                                                 *
+ *******************************************************************/
+static void WriteAll(const char *buf, size_t len)
+{
+		while (len)
+		{
+				ssize_t written = write(STDERR_FILENO, buf, len);
+				if (written == -1 && errno == EINTR)
+						continue;
+				if (written <= 0)
+						return;
+
+				buf += written;
+				len -= written;
+		}
+}
+
+/*******************************************************************
+ * Function: DestroyRing                                           *
+ *                                                                 *
+ * Arguments: (void*) logring_t* of the thread exiting             *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called when a thread with a ring exits. The ring   *
+ * may still have messages in it so it's only marked, the writer   *
+ * frees it once it's been emptied.                                *
+ *                                                                 *
+ *******************************************************************/
+static void DestroyRing(void *arg)
+{
+		logring_t *ring = arg;
+
+		// StopLogging already freed it.
+		if (threadgeneration != atomic_load_explicit(&generation, memory_order_acquire))
+				return;
+
+		atomic_store_explicit(&ring->closed, 1, memory_order_release);
+}
+
+/*******************************************************************
+ * Function: CreateRingKey                                         *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Creates the key which tells us when a thread with  *
+ * a ring exits, once however often logging is started.            *
+ *                                                                 *
+ *******************************************************************/
+static void CreateRingKey(void)
+{
+		keyerror = pthread_key_create(&ringkey, DestroyRing);
+}
+
+/*******************************************************************
+ * Function: GetRing                                               *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (logring_t*) The calling thread's ring or NULL if it   *
+ * can't have one.                                                 *
+ *                                                                 *
+ * Description: Hands back the thread's ring, creating it the      *
+ * first time the thread logs. Only then does logging take the     *
+ * lock.                                                           *
+ *                                                                 *
+ *******************************************************************/
+static logring_t *GetRing(void)
+{
+		unsigned int gen = atomic_load_explicit(&generation, memory_order_acquire);
+		if (threadring && threadgeneration == gen)
+				return threadring;
+
+		logring_t *ring = aligned_alloc(POOL_CACHELINE, sizeof(logring_t));
+		if (!ring)
+				return NULL;
+
+		memcpy(ring->name, threadname, sizeof(ring->name));
+		atomic_init(&ring->dropped, 0);
+		atomic_init(&ring->closed, 0);
+		atomic_init(&ring->tail, 0);
+		atomic_init(&ring->head, 0);
+
+		pthread_mutex_lock(&ringlock);
+		int failed = vec_push(&rings, ring);
+		pthread_mutex_unlock(&ringlock);
+
+		if (failed)
+		{
+				free(ring);
+				return NULL;
+		}
+
+		pthread_setspecific(ringkey, ring);
+		threadring = ring;
+		threadgeneration = gen;
+		return ring;
+}
+
+/*******************************************************************
+ * Function: AllowMessage                                          *
+ *                                                                 *
+ * Arguments: (const char*) format of the call site, (time_t) now, *
+ * (unsigned int*) set to how many messages were suppressed before *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Counts a message against its call site's LOG_BURST *
+ * for this second. Call sites are told apart by their format      *
+ * string, and counted per thread so nothing is shared. Two sites  *
+ * landing in the same slot take turns and may lose their counts,  *
+ * which only means a few more messages get through.               *
+ *                                                                 *
+ *******************************************************************/
+static int AllowMessage(const char *fmt, time_t now, unsigned int *suppressed)
+{
+		// Format strings sit next to each other, mix the bits up so they
+		// don't all land in neighbouring slots.
+		uint32_t hash = (uint32_t)((uintptr_t)fmt >> 3) * 2654435761U;
+		logsite_t *site = &sites[hash >> (32 - LOG_SITES_BITS)];
+		*suppressed = 0;
+
+		// Don't take the slot away from a site which is being held back,
+		// the one that's flooding is the one to keep count of.
+		if (site->fmt != fmt && site->second == now && site->count >= LOG_BURST)
+				return 1;
+
+		if (site->fmt != fmt || site->second != now)
+		{
+				if (site->fmt == fmt)
+						*suppressed = site->suppressed;
+
+				site->fmt = fmt;
+				site->second = now;
+				site->count = 0;
+				site->suppressed = 0;
+		}
+
+		if (site->count >= LOG_BURST)
+		{
+				site->suppressed++;
+				return 0;
+		}
+
+		site->count++;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: WriteLog                                              *
+ *                                                                 *
+ * Arguments: (loglevel_t) level, (const char*) file, (int) line,  *
+ * (const char*) printf style format, ... its arguments            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Logs a message, use the Log macros instead so the  *
+ * level is checked first and the call site filled in. Never waits *
+ * for the writer: when the ring is full the message is dropped.   *
+ *                                                                 *
+ *******************************************************************/
+void WriteLog(loglevel_t level, const char *file, int line, const char *fmt, ...)
+{
+		assert(level >= 0 && level < LOGLEVELS && file && fmt);
+
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+
+		unsigned int suppressed;
+		if (!AllowMessage(fmt, now.tv_sec, &suppressed))
+				return;
+
+		logring_t *ring = atomic_load_explicit(&running, memory_order_acquire) ? GetRing() : NULL;
+		va_list args;
+
+		// Nobody to hand it to, write it out ourselves.
+		if (!ring)
+		{
+				logrecord_t rec = { now, level, file, line, suppressed, "" };
+				char buf[LOG_MESSAGE_MAX * 2 + 128];
+
+				va_start(args, fmt);
+				vsnprintf(rec.text, sizeof(rec.text), fmt, args);
+				va_end(args);
+
+				WriteAll(buf, FormatRecord(buf, sizeof(buf), &rec, threadname));
+				return;
+		}
+
+		size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) >= LOG_RING_SIZE)
+		{
+				atomic_fetch_add_explicit(&ring->dropped, 1 + suppressed, memory_order_relaxed);
+				return;
+		}
+
+		logrecord_t *rec = &ring->records[tail % LOG_RING_SIZE];
+		rec->time = now;
+		rec->level = level;
+		rec->file = file;
+		rec->line = line;
+		rec->suppressed = suppressed;
+
+		va_start(args, fmt);
+		vsnprintf(rec->text, sizeof(rec->text), fmt, args);
+		va_end(args);
+
+		atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+		// Pairs with the fence in LogThread: either it sees the message
+		// when it looks once more before sleeping, or we see it sleeping.
+		atomic_thread_fence(memory_order_seq_cst);
+		if (atomic_load_explicit(&sleeping, memory_order_relaxed) && atomic_exchange(&sleeping, 0))
+		{
+				char c = 0;
+				ssize_t written = write(wakepipe[1], &c, 1);
+				(void)written;
+		}
+}
+
+/*******************************************************************
+ * Function: DrainRings                                            *
+ *                                                                 *
+ * Arguments: (char*) buffer of LOG_WRITE_BUFFER bytes             *
+ *                                                                 *
+ * Returns: (size_t) How many messages were written.               *
+ *                                                                 *
+ * Description: Writes out everything waiting in every ring and    *
+ * frees the rings of threads which have exited. The lock is only  *
+ * held while formatting, so a thread logging for the first time   *
+ * never waits on stderr.                                          *
+ *                                                                 *
+ *******************************************************************/
+static size_t DrainRings(char *buf)
+{
+		size_t total = 0, len = 0;
+
+		pthread_mutex_lock(&ringlock);
+		for (int i = 0; i < rings.length; ++i)
+		{
+				logring_t *ring = rings.data[i];
+
+				// Read before emptying the ring: a thread that exited can't
+				// have pushed anything after saying so.
+				int closed = atomic_load_explicit(&ring->closed, memory_order_acquire);
+				size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+				size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+				for (; head != tail; ++head, ++total)
+				{
+						if (LOG_WRITE_BUFFER - len < LOG_MESSAGE_MAX * 2 + 128)
+						{
+								pthread_mutex_unlock(&ringlock);
+								WriteAll(buf, len);
+								len = 0;
+								pthread_mutex_lock(&ringlock);
+						}
+
+						len += FormatRecord(buf + len, LOG_WRITE_BUFFER - len, &ring->records[head % LOG_RING_SIZE], ring->name);
+
+						// Let the thread reuse the slot.
+						atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+				}
+
+				unsigned int dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+				if (dropped)
+				{
+						logrecord_t rec = { { 0, 0 }, LOGLEVEL_WARNING, __FILE__, __LINE__, 0, "" };
+						clock_gettime(CLOCK_REALTIME, &rec.time);
+						snprintf(rec.text, sizeof(rec.text), "Dropped %u messages, the log couldn't keep up", dropped);
+						len += FormatRecord(buf + len, LOG_WRITE_BUFFER - len, &rec, ring->name);
+						total++;
+				}
+
+				if (closed)
+				{
+						free(ring);
+						rings.data[i--] = rings.data[rings.length - 1];
+						vec_truncate(&rings, rings.length - 1);
+				}
+		}
+		pthread_mutex_unlock(&ringlock);
+
+		if (len)
+				WriteAll(buf, len);
+		return total;
+}
+
+/*******************************************************************
+ * Function: LogThread                                             *
+ *                                                                 *
+ * Arguments: (void*) unused                                       *
+ *                                                                 *
+ * Returns: (void*) NULL                                           *
+ *                                                                 *
+ * Description: The writer. Drains the rings until there's nothing *
+ * left, then sleeps until a thread logs something (or a second    *
+ * passes, to pick up after threads which exited). Once it's told  *
+ * to stop it empties the rings one last time.                     *
+ *                                                                 *
+ *******************************************************************/
+static void *LogThread(void *arg)
+{
+		static char buf[LOG_WRITE_BUFFER];
+
+		for (;;)
+		{
+				if (DrainRings(buf))
+						continue;
+
+				if (atomic_load(&stopping))
+						break;
+
+				atomic_store(&sleeping, 1);
+				atomic_thread_fence(memory_order_seq_cst);
+				if (DrainRings(buf))
+				{
+						atomic_store(&sleeping, 0);
+						continue;
+				}
+
+				struct pollfd pfd = { wakepipe[0], POLLIN, 0 };
+				if (poll(&pfd, 1, LOG_IDLE_TIMEOUT) > 0)
+				{
+						char junk[64];
+						while (read(wakepipe[0], junk, sizeof(junk)) > 0)
+								;
+				}
+				atomic_store(&sleeping, 0);
+		}
+
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: StartLogging                                          *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Starts the writer thread, from then on messages go *
+ * through the rings.                                              *
+ *                                                                 *
+ *******************************************************************/
+int StartLogging(void)
+{
+		assert(!atomic_load(&running));
+
+		pthread_once(&ringkeyonce, CreateRingKey);
+		if (keyerror)
+		{
+				fprintf(stderr, "Failed to start logging: %s (%d)\n", strerror(keyerror), keyerror);
+				return 0;
+		}
+
+		if (pipe(wakepipe) == -1)
+		{
+				fprintf(stderr, "Failed to start logging: %s (%d)\n", strerror(errno), errno);
+				return 0;
+		}
+
+		for (int i = 0; i < 2; ++i)
+		{
+				fcntl(wakepipe[i], F_SETFD, FD_CLOEXEC);
+				fcntl(wakepipe[i], F_SETFL, O_NONBLOCK);
+		}
+
+		vec_init(&rings);
+		atomic_store(&stopping, 0);
+		atomic_store(&sleeping, 0);
+
+		int error = pthread_create(&writer, NULL, LogThread, NULL);
+		if (error)
+		{
+				fprintf(stderr, "Failed to start logging: %s (%d)\n", strerror(error), error);
+				close(wakepipe[0]);
+				close(wakepipe[1]);
+				wakepipe[0] = wakepipe[1] = -1;
+				return 0;
+		}
+
+		atomic_store_explicit(&running, 1, memory_order_release);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: StopLogging                                           *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Writes out everything still waiting and stops the  *
+ * writer, later messages are written straight to stderr. Call it  *
+ * once every other thread has stopped logging. Does nothing if    *
+ * logging wasn't started.                                         *
+ *                                                                 *
+ *******************************************************************/
+void StopLogging(void)
+{
+		if (!atomic_load(&running))
+				return;
+
+		atomic_store(&running, 0);
+		atomic_store(&stopping, 1);
+
+		char c = 0;
+		ssize_t written = write(wakepipe[1], &c, 1);
+		(void)written;
+		pthread_join(writer, NULL);
+
+		close(wakepipe[0]);
+		close(wakepipe[1]);
+		wakepipe[0] = wakepipe[1] = -1;
+
+		// The writer emptied them, anything left was logged after it looked.
+		static char buf[LOG_WRITE_BUFFER];
+		DrainRings(buf);
+
+		pthread_mutex_lock(&ringlock);
+		for (int i = 0; i < rings.length; ++i)
+				free(rings.data[i]);
+		vec_deinit(&rings);
+		pthread_mutex_unlock(&ringlock);
+
+		// Every thread still holding a ring finds out it's gone.
+		atomic_fetch_add_explicit(&generation, 1, memory_order_release);
+		pthread_setspecific(ringkey, NULL);
+		threadring = NULL;
+}
+
+/*******************************************************************
+ * Function: SetLogLevel                                           *
+ *                                                                 *
+ * Arguments: (loglevel_t) level                                   *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Only logs messages at least this important from    *
+ * now on. Anything below LOG_COMPILED_LEVEL is never logged.      *
+ *                                                                 *
+ *******************************************************************/
+void SetLogLevel(loglevel_t level)
+{
+		assert(level >= 0 && level < LOGLEVELS);
+		atomic_store_explicit(&loglevel, level, memory_order_relaxed);
+}
+
+/*******************************************************************
+ * Function: ParseLogLevel                                         *
+ *                                                                 *
+ * Arguments: (const char*) name, eg. "warning"                    *
+ *                                                                 *
+ * Returns: (int) The loglevel_t it names or -1 if it's not one.   *
+ *                                                                 *
+ * Description: Turns the name of a level into the level.          *
+ *                                                                 *
+ *******************************************************************/
+int ParseLogLevel(const char *name)
+{
+		for (int i = 0; i < LOGLEVELS; ++i)
+				if (!strcmp(name, levelnames[i]))
+						return i;
+		return -1;
+}
+
+/*******************************************************************
+ * Function: SetLogThreadName                                      *
+ *                                                                 *
+ * Arguments: (const char*) name, cut to 15 characters             *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Names the calling thread in what it logs. Call it  *
+ * before the thread first logs, the name is copied into its ring. *
+ *                                                                 *
+ *******************************************************************/
+void SetLogThreadName(const char *name)
+{
+		snprintf(threadname, sizeof(threadname), "%s", name);
+}
@@ -2,42 +2,861 @@
 // and access things like printing to terminal.
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
 // Include our socket code to handle TCP/IP data packets.
 #include "socket/socket.h"
+// Include the event loop threads each network is handed to.
+#include "eventloop/shard.h"
+// Include the worker threads which run commands for the event loops.
+#include "thread/workers.h"
+#include "irc/job.h"
+// Include the IRC parser which splits lines into their parts.
+#include "irc/parser.h"
+// Include the network state which tracks who is in which channel.
+#include "irc/state.h"
+// Include the reconnect manager which brings lost connections back.
+#include "irc/reconnect.h"
+// Include the module loader which finds the handlers for each message.
+#include "module/module.h"
+// Include the channel logs which !last, !seen and !grep read.
+#include "irc/chanlog.h"
+// Include the metrics, which we serve to whoever asks.
+#include "metrics/metrics.h"
+// Include the logging, everything we have to say goes through it.
+#include "log/log.h"
+// Include the hostmask matching, for the people we ignore.
+#include "irc/hostmask.h"
+// Include the snapshots, which let us pick up where we left off.
+#include "irc/snapshot.h"
 
+// Who we are on IRC.
+#define IRC_NICKNAME "psychic-ninja"
+#define IRC_REALNAME "psychic-ninja IRC bot"
+
+// Where we connect to if we aren't told otherwise.
+#define IRC_DEFAULT_SERVER "irc.chatspike.net"
+#define IRC_DEFAULT_PORT   "6667"
+
+// The port TLS connections use unless we're told otherwise.
+#define IRC_DEFAULT_TLS_PORT "6697"
+
+// How many threads run commands unless we're told otherwise.
+#define WORKERS_DEFAULT 4
+
+// How many lines !last shows unless it's told otherwise, and at most.
+#define LAST_DEFAULT 3
+#define LAST_MAX     10
+
+// How many lines !grep shows at most.
+#define GREP_MAX 5
+
+// One IRC network we connect to. Apart from `shard', everything in here
+// belongs to the shard's thread once the network was handed to it.
+typedef struct
+{
+	char *host;       // The server's hostname.
+	char *port;       // The port we connect on.
+	int tls;          // Whether we talk TLS to the server.
+	shard_t *shard;   // The event loop thread the connection lives on.
+	socket_t *sock;   // The connection, NULL once we gave up on it.
+	ircstate_t state; // Who is in which channel on the network.
+	ircreconnect_t reconnect; // Brings the connection back when we lose it.
+	chanlog_t log;    // What was said in the channels we're in.
+	int logging;      // Whether `log' was opened.
+	ircsnapshot_t snapshot; // A copy of `state' on disk.
+	int snapshotting; // Whether `snapshot' was set up.
+} network_t;
+
+static network_t *networks;
+static int nnetworks;
+
+// Whether to accept any certificate a TLS server shows us.
+static int insecure;
+
+// The channels to join on every network, separated by commas.
+static const char *channels;
+
+// Where the channels are logged, NULL if they aren't.
+static const char *logdir;
+
+// Where the metrics are served, NULL if they aren't.
+static const char *metricspath;
+
+// Where the networks' state is kept between runs, NULL if it isn't.
+static const char *statedir;
+
+// Whose commands we don't run, filled in before any thread starts and
+// only read afterwards.
+static ircmaskset_t ignored;
+
+// How many networks we haven't given up on. Once there are none left we
+// exit, unless we're already quitting because someone asked us to.
+static atomic_int active;
+static atomic_int quitting;
+
+// While shutting down, how many networks have been told to stop. The
+// main thread waits for all of them before stopping the workers.
+static pthread_mutex_t stoplock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stopcond = PTHREAD_COND_INITIALIZER;
+static int stopped;
+
+// Called on a network's shard when it no longer has a connection.
+static void NetworkGone(void)
+{
+	// The main thread is waiting for a signal, give it one.
+	if (atomic_fetch_sub(&active, 1) == 1 && !atomic_load(&quitting))
+		kill(getpid(), SIGTERM);
+}
+
+// Called on the network's shard when we're done with it for good.
+static void CloseNetwork(network_t *net)
+{
+	if (!net->sock)
+		return;
+
+	// The workers may still be reading the log, it's freed once they stop.
+	if (net->logging)
+		CloseChannelLog(&net->log);
+
+	// The snapshot is freed once the workers stop, one may be writing it.
+	if (net->snapshotting)
+		CloseSnapshot(&net->snapshot);
+
+	DestroyReconnect(&net->reconnect);
+	DestroySocket(net->sock);
+	DestroyIRCState(&net->state);
+	net->sock = NULL;
+	NetworkGone();
+}
+
+// Called on the network's shard once its connection has gone away (or we
+// couldn't make one), connects again after a while unless we're quitting.
+static void LoseConnection(network_t *net)
+{
+	if (atomic_load(&quitting))
+	{
+		CloseNetwork(net);
+		return;
+	}
+
+	int64_t delay = ScheduleReconnect(&net->reconnect, &net->state);
+	ClearIRCState(&net->state);
+	LogInfo("Reconnecting to %s in %.1f seconds", net->host, delay / 1000.0);
+}
+
+// The nick in nick!user@host.
+static strview_t PrefixNick(const ircmsg_t *msg)
+{
+	strview_t nick = IRCSpan(msg, msg->prefix);
+	const char *bang = memchr(nick.ptr, '!', nick.len);
+	if (bang)
+		nick.len = bang - nick.ptr;
+	return nick;
+}
+
+// Where to answer a message: the channel, or whoever messaged us privately.
+static strview_t ReplyTarget(const ircmsg_t *msg)
+{
+	strview_t target = IRCSpan(msg, msg->params[0]);
+	if (!target.len || !strchr("#&+!", target.ptr[0]))
+		target = PrefixNick(msg);
+
+	return target;
+}
+
+// Send a PRIVMSG back to wherever the command came from.
+static void Reply(const ircjob_t *job, const char *text)
+{
+	strview_t target = ReplyTarget(&job->msg);
+	char reply[512];
+	int len = snprintf(reply, sizeof(reply), "PRIVMSG %.*s :%s\r\n", (int)target.len, target.ptr, text);
+
+	// Cut anything too long for a line short instead of not answering.
+	if (len > 0 && (size_t)len >= sizeof(reply))
+	{
+		len = sizeof(reply) - 1;
+		reply[len - 2] = '\r';
+		reply[len - 1] = '\n';
+	}
+
+	if (len > 0)
+		ReplyToIRCJob(job, FLOOD_LANE_REPLY, reply, len);
+}
+
+// The word after the trigger (eg, "nick" in "!seen nick"), if there is one.
+static strview_t CommandArgument(const ircmsg_t *msg)
+{
+	strview_t text = IRCSpan(msg, msg->params[1]);
+	const char *space = memchr(text.ptr, ' ', text.len);
+	strview_t arg = { text.ptr + text.len, 0 };
+	if (space)
+	{
+		arg.ptr = space + 1;
+		arg.len = text.ptr + text.len - arg.ptr;
+		const char *end = memchr(arg.ptr, ' ', arg.len);
+		if (end)
+			arg.len = end - arg.ptr;
+	}
+
+	return arg;
+}
+
+// Everything after the trigger (eg, "some words" in "!grep some words").
+static strview_t CommandText(const ircmsg_t *msg)
+{
+	strview_t text = IRCSpan(msg, msg->params[1]);
+	const char *space = memchr(text.ptr, ' ', text.len);
+	if (!space)
+		return (strview_t){ text.ptr + text.len, 0 };
+
+	return (strview_t){ space + 1, text.ptr + text.len - (space + 1) };
+}
+
+// Called on a worker thread when someone says !ping.
+static void HandlePing(const ircjob_t *job)
+{
+	Reply(job, "pong");
+}
+
+// What !last is collecting, newest first.
+typedef struct
+{
+	const ircjob_t *job;
+	int skip;              // Whether the !last itself is still to come.
+	int want;
+	int count;
+	char *lines[LAST_MAX];
+} lastquery_t;
+
+static int CollectLast(int64_t time, strview_t line, void *data)
+{
+	lastquery_t *q = data;
+	ircmsg_t msg;
+
+	// The newest line is the one asking, it was logged before we got it.
+	if (q->skip && line.len == q->job->len && !memcmp(line.ptr, q->job->line, line.len))
+	{
+		q->skip = 0;
+		return 1;
+	}
+
+	if (!ParseIRCMessage(line, &msg) || !IRCSpanEquals(&msg, msg.command, "PRIVMSG") || msg.nparams < 2)
+		return 1;
+
+	time_t secs = time / 1000;
+	struct tm tm;
+	char when[32];
+	gmtime_r(&secs, &tm);
+	strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &tm);
+
+	strview_t nick = PrefixNick(&msg);
+	strview_t text = IRCSpan(&msg, msg.params[1]);
+	char buffer[512];
+	snprintf(buffer, sizeof(buffer), "[%s] <%.*s> %.*s", when, (int)nick.len, nick.ptr, (int)text.len, text.ptr);
+
+	// The lines only have to last until the replies are sent.
+	q->lines[q->count] = ArenaStrndup(GetWorkerArena(), buffer, strlen(buffer));
+	if (q->lines[q->count])
+		q->count++;
+	return q->count < q->want;
+}
+
+// Called on a worker thread for "!last [lines]", repeats what was said
+// in the channel before.
+static void HandleLast(const ircjob_t *job)
+{
+	network_t *net = job->owner;
+	strview_t channel = IRCSpan(&job->msg, job->msg.params[0]);
+	if (!net->logging || !channel.len || !strchr("#&+!", channel.ptr[0]))
+		return;
+
+	lastquery_t q = { job, 1, LAST_DEFAULT, 0, { NULL } };
+	strview_t arg = CommandArgument(&job->msg);
+	if (arg.len)
+	{
+		// The argument isn't NUL terminated, so no atoi.
+		q.want = 0;
+		for (size_t i = 0; i < arg.len && arg.ptr[i] >= '0' && arg.ptr[i] <= '9' && q.want <= LAST_MAX; ++i)
+			q.want = q.want * 10 + arg.ptr[i] - '0';
+		q.want = q.want < 1 ? 1 : q.want > LAST_MAX ? LAST_MAX : q.want;
+	}
+
+	ReadChannelLogBackwards(&net->log, channel, CollectLast, &q);
+
+	if (!q.count)
+		Reply(job, "Nothing was said here yet.");
+
+	for (int i = q.count - 1; i >= 0; --i)
+		Reply(job, q.lines[i]);
+}
+
+// Called on a worker thread for "!grep words", repeats the last lines
+// said in the channel with all of the words in them.
+static void HandleGrep(const ircjob_t *job)
+{
+	network_t *net = job->owner;
+	strview_t channel = IRCSpan(&job->msg, job->msg.params[0]);
+	if (!net->logging || !channel.len || !strchr("#&+!", channel.ptr[0]))
+		return;
+
+	lastquery_t q = { job, 1, GREP_MAX, 0, { NULL } };
+	if (!SearchChannelLog(&net->log, channel, CommandText(&job->msg), CollectLast, &q) && errno == EINVAL)
+		return;
+
+	if (!q.count)
+		Reply(job, "No matches.");
+
+	for (int i = q.count - 1; i >= 0; --i)
+		Reply(job, q.lines[i]);
+}
+
+// What !seen is looking for.
+typedef struct
+{
+	const ircjob_t *job;
+	strview_t nick;
+	int found;
+	int64_t time;
+	char what[400];
+} seenquery_t;
+
+static int FindSeen(int64_t time, strview_t line, void *data)
+{
+	seenquery_t *q = data;
+	ircmsg_t msg;
+
+	if (!ParseIRCMessage(line, &msg) || !msg.prefix.len)
+		return 1;
+
+	strview_t nick = PrefixNick(&msg);
+	if (!IRCStringEquals(GetIRCCaseMap(IRC_CASEMAP_RFC1459), nick.ptr, nick.len, q->nick.ptr, q->nick.len))
+		return 1;
+
+	// Asking about someone doesn't count as them being around.
+	if (line.len == q->job->len && !memcmp(line.ptr, q->job->line, line.len))
+		return 1;
+
+	strview_t command = IRCSpan(&msg, msg.command);
+	strview_t text = msg.nparams >= 2 ? IRCSpan(&msg, msg.params[msg.nparams - 1]) : (strview_t){ "", 0 };
+	if (IRCSpanEquals(&msg, msg.command, "PRIVMSG"))
+		snprintf(q->what, sizeof(q->what), "saying: %.*s", (int)text.len, text.ptr);
+	else if (IRCSpanEquals(&msg, msg.command, "JOIN"))
+		snprintf(q->what, sizeof(q->what), "joining");
+	else if (IRCSpanEquals(&msg, msg.command, "PART"))
+		snprintf(q->what, sizeof(q->what), "leaving");
+	else
+		snprintf(q->what, sizeof(q->what), "sending a %.*s", (int)command.len, command.ptr);
+
+	q->found = 1;
+	q->time = time;
+	return 0;
+}
+
+// Called on a worker thread for "!seen nick", says when they were last
+// seen in the channel.
+static void HandleSeen(const ircjob_t *job)
+{
+	network_t *net = job->owner;
+	strview_t channel = IRCSpan(&job->msg, job->msg.params[0]);
+	if (!net->logging || !channel.len || !strchr("#&+!", channel.ptr[0]))
+		return;
+
+	seenquery_t q = { job, CommandArgument(&job->msg), 0, 0, "" };
+	if (!q.nick.len)
+		return;
+
+	ReadChannelLogBackwards(&net->log, channel, FindSeen, &q);
+
+	char reply[512];
+	if (!q.found)
+		snprintf(reply, sizeof(reply), "I haven't seen %.*s here.", (int)q.nick.len, q.nick.ptr);
+	else
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		int64_t ago = ((int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - q.time) / 1000;
+		if (ago < 0)
+			ago = 0;
+
+		snprintf(reply, sizeof(reply), "%.*s was last seen %lldd %lldh %lldm ago, %s", (int)q.nick.len, q.nick.ptr,
+			(long long)(ago / 86400), (long long)(ago / 3600 % 24), (long long)(ago / 60 % 60), q.what);
+	}
+
+	Reply(job, reply);
+}
+
+// The commands built into the bot, anything else comes from modules.
+static const modulehook_t builtinhooks[] = {
+	{ MODULE_HOOK_TRIGGER, "!ping", HandlePing },
+	{ MODULE_HOOK_TRIGGER, "!last", HandleLast },
+	{ MODULE_HOOK_TRIGGER, "!seen", HandleSeen },
+	{ MODULE_HOOK_TRIGGER, "!grep", HandleGrep },
+	{ 0, NULL, NULL }
+};
+
+static const moduleinfo_t builtins = { MODULE_ABI_VERSION, "builtin", builtinhooks, NULL, NULL };
+
+// Whether the message is something worth keeping in the channel logs.
+static int IsLoggedCommand(const ircmsg_t *msg)
+{
+	static const char *const commands[] = { "PRIVMSG", "NOTICE", "JOIN", "PART", "KICK", "TOPIC", "MODE" };
+	for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i)
+		if (IRCSpanEquals(msg, msg->command, commands[i]))
+			return 1;
+
+	return 0;
+}
+
+// Called by the event loop when the server sent us something.
+static void OnSocketReadable(socket_t *sock)
+{
+	network_t *net = sock->data;
+	size_t bytes = ReceiveSocket(sock);
+
+	// Nothing to read after all, wait for the next event.
+	if (bytes == -1UL && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+
+	// 0 bytes means the server closed the connection, -1 an error.
+	if (bytes == 0 || bytes == -1UL)
+	{
+		LogInfo("Connection to %s closed", sock->host);
+		LoseConnection(net);
+		return;
+	}
+
+	// Handle each complete line the server sent us.
+	strview_t line;
+	ircmsg_t msg;
+	while (ReadSocketLine(sock, &line))
+	{
+		LogDebug("[%s] %.*s", net->host, (int)line.len, line.ptr);
+
+		if (!ParseIRCMessage(line, &msg))
+			continue;
+
+		UpdateIRCState(&net->state, &msg);
+
+		// Log what happens in channels before the commands run, so that
+		// !last and !seen see everything up to the line asking.
+		if (net->logging && msg.nparams && IsLoggedCommand(&msg))
+		{
+			strview_t target = IRCSpan(&msg, msg.params[0]);
+			if (target.len && strchr("#&+!", target.ptr[0]) && !AppendChannelLog(&net->log, target, line))
+				LogError("Failed to log a line from %s: %s (%d)", net->host, strerror(errno), errno);
+		}
+
+		// The server let us in, get back into our channels.
+		if (IRCSpanEquals(&msg, msg.command, "001"))
+			FinishReconnect(&net->reconnect);
+
+		// Commands may take a while so they're run by the workers,
+		// we have sockets to read. Nothing from someone we ignore is.
+		strview_t prefix = IRCSpan(&msg, msg.prefix);
+		if (prefix.len && MatchIRCMaskSet(&ignored, prefix))
+			LogDebug("Ignoring %.*s on %s", (int)prefix.len, prefix.ptr, net->host);
+		else if (!DispatchIRCMessage(sock, line, &msg))
+			LogWarning("Dropped a command from %s, the workers are too busy", net->host);
+
+		// Servers disconnect us if we don't answer their PINGs.
+		if (IRCSpanEquals(&msg, msg.command, "PING") && msg.nparams)
+		{
+			strview_t token = IRCSpan(&msg, msg.params[0]);
+			char reply[512];
+			int len = snprintf(reply, sizeof(reply), "PONG :%.*s\r\n", (int)token.len, token.ptr);
+			if (len > 0 && (size_t)len < sizeof(reply))
+				QueueSocketMessage(sock, FLOOD_LANE_URGENT, reply, len);
+		}
+	}
+}
+
+// Called by the event loop once we're connected to the server.
+static void OnSocketConnected(socket_t *sock)
+{
+	if (sock->ssl)
+		LogInfo("Connected to %s:%hd over TLS%s%s", sock->host, sock->port, sock->resumed ? ", resumed" : "", sock->offloaded ? ", kTLS" : "");
+	else
+		LogInfo("Connected to %s:%hd", sock->host, sock->port);
+
+	// Register with the server. These jump ahead of anything else we
+	// might have queued since the server won't talk to us until it has them.
+	static const char nick[] = "NICK " IRC_NICKNAME "\r\n";
+	static const char user[] = "USER " IRC_NICKNAME " 0 * :" IRC_REALNAME "\r\n";
+	QueueSocketMessage(sock, FLOOD_LANE_URGENT, nick, sizeof(nick) - 1);
+	QueueSocketMessage(sock, FLOOD_LANE_URGENT, user, sizeof(user) - 1);
+}
+
+// Called by the event loop when the socket had an error.
+static void OnSocketError(socket_t *sock)
+{
+	LogError("Error on connection to %s", sock->host);
+	LoseConnection(sock->data);
+}
+
+// Sent to a network's shard to start connecting to it.
+static void StartNetwork(shard_t *shard, void *data)
+{
+	network_t *net = data;
+
+	if (!InitializeIRCState(&net->state))
+	{
+		LogError("Failed to set up the state for %s", net->host);
+		NetworkGone();
+		return;
+	}
+
+	// Create a socket with our host and port we need to connect to
+	net->sock = CreateSocket(net->host, net->port);
+	if (!net->sock)
+	{
+		LogError("Failed to create the socket for %s", net->host);
+		DestroyIRCState(&net->state);
+		NetworkGone();
+		return;
+	}
+
+	// Tell the event loop what to do when something happens on the socket.
+	net->sock->OnConnected = OnSocketConnected;
+	net->sock->OnReadable  = OnSocketReadable;
+	net->sock->OnError     = OnSocketError;
+	net->sock->data        = net;
+	net->sock->tls         = net->tls;
+	net->sock->tlsinsecure = insecure;
+
+	if (logdir && !(net->logging = InitializeChannelLog(&net->log, logdir, net->host)))
+		LogWarning("Not logging the channels on %s", net->host);
+
+	// Join our channels once we're in, and again every time we reconnect.
+	InitializeReconnect(&net->reconnect, net->sock);
+	for (const char *name = channels; name; )
+	{
+		const char *end = strchr(name, ',');
+		char *copy = strndup(name, end ? (size_t)(end - name) : strlen(name));
+		if (copy && copy[0])
+			AddReconnectChannel(&net->reconnect, copy);
+		free(copy);
+		name = end ? end + 1 : NULL;
+	}
+
+	// Start out knowing whatever we knew when we last ran, and get back
+	// into the channels we were in.
+	if (statedir && !(net->snapshotting = InitializeSnapshot(&net->snapshot, statedir, net->host, &net->state)))
+		LogWarning("Not keeping the state of %s", net->host);
+	else if (net->snapshotting && !LoadSnapshot(&net->snapshot, &net->reconnect) && errno != ENOENT)
+		LogWarning("Failed to restore the state of %s: %s (%d)", net->host, strerror(errno), errno);
+
+	// Attempt to connect to the socket, this finishes in the event loop.
+	if (!ConnectSocket(net->sock))
+	{
+		LogError("Failed to connect to %s", net->host);
+		LoseConnection(net);
+	}
+}
+
+// Sent to a network's shard when we're shutting down.
+static void StopNetwork(shard_t *shard, void *data)
+{
+	network_t *net = data;
+
+	if (net->sock)
+	{
+		// Say goodbye. The shard stops soon after this so send it now
+		// instead of waiting for the event loop to get around to it.
+		if (net->sock->state == SOCKET_CONNECTED)
+		{
+			static const char quit[] = "QUIT :Shutting down\r\n";
+			QueueSocketMessage(net->sock, FLOOD_LANE_URGENT, quit, sizeof(quit) - 1);
+			FlushSocket(net->sock);
+		}
+
+		CloseNetwork(net);
+	}
+
+	// Nothing on this network can give the workers more to do now.
+	pthread_mutex_lock(&stoplock);
+	stopped++;
+	pthread_cond_signal(&stopcond);
+	pthread_mutex_unlock(&stoplock);
+}
+
+// Split "host", "host:port" or "[ipv6]:port" into its parts. A port
+// starting with + (eg, "host:+6697") means TLS.
+static int ParseServer(const char *arg, network_t *net)
+{
+	const char *colon = strrchr(arg, ':');
+	const char *host = arg;
+	size_t hostlen = strlen(arg);
+
+	// A bare IPv6 address has several colons but no port.
+	if (colon && strchr(arg, ':') != colon && arg[0] != '[')
+		colon = NULL;
+
+	if (colon)
+		hostlen = colon - arg;
+
+	if (arg[0] == '[' && hostlen >= 2 && arg[hostlen - 1] == ']')
+	{
+		host++;
+		hostlen -= 2;
+	}
+
+	const char *port = colon ? colon + 1 : "";
+	if (port[0] == '+')
+	{
+		net->tls = 1;
+		port++;
+	}
+
+	net->host = strndup(host, hostlen);
+	net->port = strdup(port[0] ? port : net->tls ? IRC_DEFAULT_TLS_PORT : IRC_DEFAULT_PORT);
+	return net->host && net->port && hostlen;
+}
+
+// Add every mask in a comma separated list to the ignore list.
+static int ParseIgnores(const char *arg)
+{
+	while (*arg)
+	{
+		size_t len = strcspn(arg, ",");
+		if (len && !AddIRCMask(&ignored, (strview_t){ arg, len }, NULL))
+			return 0;
+		arg += len + (arg[len] == ',');
+	}
+
+	return 1;
+}
+
+// Tell the user how to run us.
+static void Usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-t threads] [-w workers] [-k] [-c #chan[,#chan...]] [-m module.so ...] [-l logdir] [-s metrics.sock] [-d statedir] [-v level] [-i mask[,mask...]] [server[:[+]port] ...]\n", argv0);
+	fprintf(stderr, "Connects to every server given (%s:%s if none are), spread over\n", IRC_DEFAULT_SERVER, IRC_DEFAULT_PORT);
+	fprintf(stderr, "that many event loop threads (one per CPU by default). Commands\n");
+	fprintf(stderr, "are run by the worker threads (%d by default).\n", WORKERS_DEFAULT);
+	fprintf(stderr, "A + before the port connects over TLS (port %s if it's left out),\n", IRC_DEFAULT_TLS_PORT);
+	fprintf(stderr, "-k accepts certificates we can't verify.\n");
+	fprintf(stderr, "-c joins the channels given on every server. Lost connections are\n");
+	fprintf(stderr, "brought back (backing off while they keep failing) and every\n");
+	fprintf(stderr, "channel we were in is joined again.\n");
+	fprintf(stderr, "-m loads a module with more commands, it can be given more than\n");
+	fprintf(stderr, "once. Send us SIGHUP to reload every module without reconnecting.\n");
+	fprintf(stderr, "-l logs every channel we're in to the directory, for !last, !seen\n");
+	fprintf(stderr, "and !grep.\n");
+	fprintf(stderr, "-s serves counters and latencies in the Prometheus text format\n");
+	fprintf(stderr, "on a Unix socket, eg. curl --unix-socket metrics.sock http://localhost/metrics\n");
+	fprintf(stderr, "-d keeps a snapshot of every network's channels and who is in\n");
+	fprintf(stderr, "them in the directory, so a restart picks up where we left off.\n");
+	fprintf(stderr, "-v only logs messages at least this important: debug, info (the\n");
+	fprintf(stderr, "default), warning or error.\n");
+	fprintf(stderr, "-i ignores everyone matching one of the masks (eg. *!*@*.example.com,\n");
+	fprintf(stderr, "? and * are wildcards), it can be given more than once.\n");
+}
 
 // The entry point to the application.
 int main(int argc, char **argv)
 {
-	// Initialize the sockets
-	InitializeSockets();
+	int nthreads = 0, nworkers = WORKERS_DEFAULT;
+	int nmodules = 0, opt, level;
+	char **modules = calloc(argc, sizeof(char*));
+	if (!modules || !InitializeIRCMaskSet(&ignored, GetIRCCaseMap(IRC_CASEMAP_RFC1459)))
+		return EXIT_FAILURE;
 
-	// Create a socket with our host and port we need to connect to
-	socket_t *sock = CreateSocket("irc.chatspike.net", "6667");
+	while ((opt = getopt(argc, argv, "t:w:kc:m:l:s:d:v:i:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 't':
+				nthreads = atoi(optarg);
+				if (nthreads < 1 || nthreads > SHARD_MAX)
+				{
+					fprintf(stderr, "The number of threads must be between 1 and %d.\n", SHARD_MAX);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'w':
+				nworkers = atoi(optarg);
+				if (nworkers < 1 || nworkers > WORKER_MAX)
+				{
+					fprintf(stderr, "The number of workers must be between 1 and %d.\n", WORKER_MAX);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'k':
+				insecure = 1;
+				break;
+			case 'c':
+				channels = optarg;
+				break;
+			case 'm':
+				modules[nmodules++] = optarg;
+				break;
+			case 'l':
+				logdir = optarg;
+				break;
+			case 's':
+				metricspath = optarg;
+				break;
+			case 'd':
+				statedir = optarg;
+				break;
+			case 'v':
+				if ((level = ParseLogLevel(optarg)) == -1)
+				{
+					fprintf(stderr, "The log level must be debug, info, warning or error.\n");
+					return EXIT_FAILURE;
+				}
+				SetLogLevel(level);
+				break;
+			case 'i':
+				if (!ParseIgnores(optarg))
+				{
+					fprintf(stderr, "Failed to add the masks \"%s\".\n", optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			default:
+				Usage(argv[0]);
+				return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	// Work out which networks to connect to.
+	nnetworks = optind < argc ? argc - optind : 1;
+	networks = calloc(nnetworks, sizeof(network_t));
+	if (!networks)
+		return EXIT_FAILURE;
 
-	// Make sure we got a valid socket, otherwise exit.
-	if (!sock)
+	for (int i = 0; i < nnetworks; ++i)
 	{
-			fprintf(stderr, "Failed to create to the socket.\n");
+		const char *arg = optind < argc ? argv[optind + i] : IRC_DEFAULT_SERVER ":" IRC_DEFAULT_PORT;
+		if (!ParseServer(arg, &networks[i]))
+		{
+			fprintf(stderr, "Invalid server \"%s\".\n", arg);
 			return EXIT_FAILURE;
+		}
 	}
-	
-	// Attempt to connect to the socket
-	if (!ConnectSocket(sock))
+
+	// One event loop per CPU, but there's no point having more loops
+	// than networks.
+	if (!nthreads)
 	{
-			fprintf(stderr, "Failed to connect to the socket.\n");
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = cpus < 1 ? 1 : cpus > SHARD_MAX ? SHARD_MAX : cpus;
+	}
+
+	if (nthreads > nnetworks)
+		nthreads = nnetworks;
+
+	// Every thread inherits this mask, so ^C and friends are only ever
+	// picked up below by sigwait instead of landing in some event loop.
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	// Everything logged from here on is written out by a thread of its
+	// own, whichever way we exit what's still waiting gets written.
+	SetLogThreadName("main");
+	if (!StartLogging())
+		return EXIT_FAILURE;
+	atexit(StopLogging);
+
+	// OpenSSL writes to its sockets with write(), which raises SIGPIPE when
+	// the server has gone away. We'd rather just get EPIPE.
+	signal(SIGPIPE, SIG_IGN);
+
+	// Nothing is running yet so there's nothing to wait for while the
+	// handlers are added.
+	if (!RegisterModule(&builtins))
+		return EXIT_FAILURE;
+
+	for (int i = 0; i < nmodules; ++i)
+		if (!LoadModule(modules[i]))
 			return EXIT_FAILURE;
+	free(modules);
+
+	// Start the workers first, the event loops hand them commands.
+	if (!StartWorkerPool(nworkers))
+		return EXIT_FAILURE;
+
+	// Start the event loop threads.
+	if (!StartShards(nthreads))
+	{
+		StopWorkerPool();
+		return EXIT_FAILURE;
+	}
+
+	if (metricspath && !StartMetricsServer(metricspath))
+	{
+		StopShards();
+		StopWorkerPool();
+		return EXIT_FAILURE;
 	}
 
-	// Now we can enter our event-loop and process data
-	while (1)
+	// Hand the networks out to the shards round robin. Each connection
+	// stays on its shard for good so nothing about it needs locking.
+	atomic_store(&active, nnetworks);
+	int started = 0;
+	for (int i = 0; i < nnetworks; ++i)
 	{
+		networks[i].shard = GetShard(i % nthreads);
+		if (SendToShard(networks[i].shard, StartNetwork, &networks[i], NULL))
+			started++;
+		else
+			atomic_fetch_sub(&active, 1);
+	}
 
+	// Sleep until we're asked to exit or every connection closed.
+	// SIGHUP reloads the modules, the connections stay up meanwhile.
+	int sig = 0;
+	while (started && (!sig || sig == SIGHUP))
+	{
+		sigwait(&signals, &sig);
+		if (sig == SIGHUP)
+		{
+			LogInfo("Reloading modules");
+			ReloadModules();
+		}
 	}
 
-	// Close out any sockets before we exit.
-	DestroySockets();
+	// Close out any connections before we exit.
+	atomic_store(&quitting, 1);
+	int stopping = 0;
+	for (int i = 0; i < nnetworks; ++i)
+		stopping += SendToShard(networks[i].shard, StopNetwork, &networks[i], NULL);
+
+	// Once no network can submit anything, let the workers finish what
+	// they have. Their replies go to the event loops which are still
+	// running, and are dropped there since the connections are gone.
+	pthread_mutex_lock(&stoplock);
+	while (stopped < stopping)
+		pthread_cond_wait(&stopcond, &stoplock);
+	pthread_mutex_unlock(&stoplock);
+
+	StopMetricsServer();
+	StopWorkerPool();
+	StopShards();
+	DestroyModules();
+
+	for (int i = 0; i < nnetworks; ++i)
+	{
+		if (networks[i].logging)
+			DestroyChannelLog(&networks[i].log);
+		if (networks[i].snapshotting)
+			DestroySnapshot(&networks[i].snapshot);
+		free(networks[i].host);
+		free(networks[i].port);
+	}
+	free(networks);
+	DestroyIRCMaskSet(&ignored);
 	return EXIT_SUCCESS;
 }
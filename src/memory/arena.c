@@ -0,0 +1,328 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <assert.h>
+
+// Include our arena types and function declarations.
+#include "memory/arena.h"
+
+// Round `n' up to the next multiple of `align' (which is a power of 2).
+#define ALIGN_UP(n, align) (((n) + (align) - 1) & ~((size_t)(align) - 1))
+
+/*******************************************************************
+ * Function: InitializeArena                                       *
+ *                                                                 *
+ * Arguments: arena_t*, (size_t) block size (0 for the default)    *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Sets up an empty arena, nothing is allocated until *
+ * the first ArenaAlloc.                                           *
+ *                                                                 *
+ *******************************************************************/
+void InitializeArena(arena_t *arena, size_t blocksize)
+{
+		assert(arena);
+		memset(arena, 0, sizeof(arena_t));
+		arena->blocksize = blocksize ? blocksize : ARENA_BLOCK_SIZE;
+}
+
+/*******************************************************************
+ * Function: DestroyArena                                          *
+ *                                                                 *
+ * Arguments: arena_t*                                             *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+void DestroyArena(arena_t *arena)
+{
+		assert(arena);
+
+		arenablock_t *block = arena->first;
+		while (block)
+		{
+				arenablock_t *next = block->next;
+				free(block);
+				block = next;
+		}
+
+		arena->first = arena->current = NULL;
+		arena->last = NULL;
+}
+
+/*******************************************************************
+ * Function: ResetArena                                            *
+ *                                                                 *
+ * Arguments: arena_t*                                             *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Frees everything allocated from the arena at once. *
+ * The normal sized blocks are kept for next time, oversized ones  *
+ * made for a single big allocation are given back so one huge     *
+ * line doesn't keep its memory around forever.                    *
+ *                                                                 *
+ *******************************************************************/
+void ResetArena(arena_t *arena)
+{
+		assert(arena);
+
+		arenablock_t **link = &arena->first;
+		while (*link)
+		{
+				arenablock_t *block = *link;
+				if (block->size > arena->blocksize)
+				{
+						*link = block->next;
+						free(block);
+						continue;
+				}
+
+				block->used = 0;
+				link = &block->next;
+		}
+
+		arena->current = arena->first;
+		arena->last = NULL;
+}
+
+/*******************************************************************
+ * Function: ArenaAllocAligned                                     *
+ *                                                                 *
+ * Arguments: arena_t*, (size_t) size, (size_t) alignment          *
+ *                                                                 *
+ * Returns: (void*) The memory or NULL if we ran out of memory.    *
+ *                                                                 *
+ * Description: Hands out `size' bytes aligned to `align', which   *
+ * must be a power of 2 no bigger than max_align_t's alignment.    *
+ *                                                                 *
+ *******************************************************************/
+void *ArenaAllocAligned(arena_t *arena, size_t size, size_t align)
+{
+		assert(arena && align && !(align & (align - 1)) && align <= _Alignof(max_align_t));
+
+		arenablock_t *block = arena->current;
+
+		// Move on to the next block until we find one with room. Blocks
+		// after the current one are left over from before the last reset.
+		while (block)
+		{
+				size_t offset = ALIGN_UP(block->used, align);
+				if (offset <= block->size && size <= block->size - offset)
+				{
+						block->used = offset + size;
+						arena->current = block;
+						arena->last = block->data + offset;
+						return arena->last;
+				}
+
+				if (!block->next)
+						break;
+				block = block->next;
+		}
+
+		// Nothing has room, add a block big enough for this allocation.
+		size_t blocksize = size > arena->blocksize ? size : arena->blocksize;
+		if (blocksize > SIZE_MAX - sizeof(arenablock_t))
+		{
+				errno = ENOMEM;
+				return NULL;
+		}
+
+		arenablock_t *nblock = malloc(sizeof(arenablock_t) + blocksize);
+		if (!nblock)
+				return NULL;
+
+		nblock->next = NULL;
+		nblock->size = blocksize;
+		nblock->used = size;
+
+		if (block)
+				block->next = nblock;
+		else
+				arena->first = nblock;
+
+		arena->current = nblock;
+		arena->last = nblock->data;
+		return arena->last;
+}
+
+/*******************************************************************
+ * Function: ArenaAlloc                                            *
+ *                                                                 *
+ * Arguments: arena_t*, (size_t) size                              *
+ *                                                                 *
+ * Returns: (void*) The memory or NULL if we ran out of memory.    *
+ *                                                                 *
+ * Description: Like malloc, the memory is suitably aligned for    *
+ * any type.                                                       *
+ *                                                                 *
+ *******************************************************************/
+void *ArenaAlloc(arena_t *arena, size_t size)
+{
+		return ArenaAllocAligned(arena, size, _Alignof(max_align_t));
+}
+
+/*******************************************************************
+ * Function: ArenaRealloc                                          *
+ *                                                                 *
+ * Arguments: arena_t*, void*, (size_t) old size,                  *
+ *            (size_t) new size                                    *
+ *                                                                 *
+ * Returns: (void*) The memory or NULL if we ran out of memory, in *
+ * which case the old memory is untouched.                         *
+ *                                                                 *
+ * Description: Grows (or shrinks) a previous allocation. If it    *
+ * was the most recent one and there's room it grows in place,     *
+ * otherwise it's copied somewhere new. Unlike realloc we need to  *
+ * be told how big the old allocation was.                         *
+ *                                                                 *
+ *******************************************************************/
+void *ArenaRealloc(arena_t *arena, void *ptr, size_t oldsize, size_t newsize)
+{
+		assert(arena);
+
+		if (!ptr)
+				return ArenaAlloc(arena, newsize);
+
+		arenablock_t *block = arena->current;
+		if (ptr == arena->last && block)
+		{
+				size_t offset = (char*)ptr - block->data;
+				if (newsize <= block->size - offset)
+				{
+						block->used = offset + newsize;
+						return ptr;
+				}
+		}
+
+		void *nptr = ArenaAlloc(arena, newsize);
+		if (nptr)
+				memcpy(nptr, ptr, oldsize < newsize ? oldsize : newsize);
+		return nptr;
+}
+
+/*******************************************************************
+ * Function: ArenaStrndup                                          *
+ *                                                                 *
+ * Arguments: arena_t*, (const char*) string, (size_t) length      *
+ *                                                                 *
+ * Returns: (char*) A null-terminated copy of the first `length'   *
+ * bytes of the string or NULL if we ran out of memory.            *
+ *                                                                 *
+ * Description: Handy for turning a strview_t into a C string.     *
+ *                                                                 *
+ *******************************************************************/
+char *ArenaStrndup(arena_t *arena, const char *str, size_t len)
+{
+		assert(arena && (str || !len));
+
+		if (len == SIZE_MAX)
+		{
+				errno = ENOMEM;
+				return NULL;
+		}
+
+		char *copy = ArenaAllocAligned(arena, len + 1, 1);
+		if (!copy)
+				return NULL;
+
+		memcpy(copy, str, len);
+		copy[len] = '\0';
+		return copy;
+}
+
+/*******************************************************************
+ * Function: SaveArena                                             *
+ *                                                                 *
+ * Arguments: const arena_t*                                       *
+ *                                                                 *
+ * Returns: (arenamark_t) Where the arena is up to.                *
+ *                                                                 *
+ * Description: RestoreArena with the mark frees everything which  *
+ * was allocated after it, so a function can clean up after itself *
+ * without throwing away what its caller allocated.                *
+ *                                                                 *
+ *******************************************************************/
+arenamark_t SaveArena(const arena_t *arena)
+{
+		assert(arena);
+		arenamark_t mark = { arena->current, arena->current ? arena->current->used : 0 };
+		return mark;
+}
+
+/*******************************************************************
+ * Function: RestoreArena                                          *
+ *                                                                 *
+ * Arguments: arena_t*, arenamark_t                                *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+void RestoreArena(arena_t *arena, arenamark_t mark)
+{
+		assert(arena);
+
+		// Nothing had been allocated when the mark was made.
+		if (!mark.block)
+		{
+				ResetArena(arena);
+				return;
+		}
+
+		// Every block after the marked one is empty again.
+		for (arenablock_t *block = mark.block->next; block; block = block->next)
+				block->used = 0;
+
+		mark.block->used = mark.used;
+		arena->current = mark.block;
+		arena->last = NULL;
+}
+
+/*******************************************************************
+ * Function: vec_arena_expand_                                     *
+ *                                                                 *
+ * Arguments: The unpacked vector, arena_t*, (int) elements needed *
+ *                                                                 *
+ * Returns: (int) 0 on success or -1 if we ran out of memory.      *
+ *                                                                 *
+ * Description: The arena version of vec_expand_/vec_reserve_ used *
+ * by vec_arena_push and vec_arena_reserve.                        *
+ *                                                                 *
+ *******************************************************************/
+int vec_arena_expand_(char **data, int *length, int *capacity, int memsz, arena_t *arena, int n)
+{
+		assert(data && length && capacity && memsz && arena);
+
+		if (n <= *capacity)
+				return 0;
+
+		// Double the capacity like vec_t normally would.
+		int ncapacity = *capacity ? *capacity : 4;
+		while (ncapacity < n)
+		{
+				if (ncapacity > INT_MAX / 2)
+				{
+						ncapacity = n;
+						break;
+				}
+				ncapacity *= 2;
+		}
+
+		if ((size_t)ncapacity > SIZE_MAX / memsz)
+		{
+				errno = ENOMEM;
+				return -1;
+		}
+
+		char *ndata = ArenaRealloc(arena, *data, (size_t)*capacity * memsz, (size_t)ncapacity * memsz);
+		if (!ndata)
+				return -1;
+
+		*data = ndata;
+		*capacity = ncapacity;
+		return 0;
+}
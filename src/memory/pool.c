@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include "log/log.h"
+
+// Include our pool types and function declarations.
+#include "memory/pool.h"
+
+// Round `n' up to the next multiple of `align' (which is a power of 2).
+#define ALIGN_UP(n, align) (((n) + (align) - 1) & ~((align) - 1))
+
+/*******************************************************************
+ * Function: InitializePool                                        *
+ *                                                                 *
+ * Arguments: pool_t*, (size_t) object size, (size_t) alignment,   *
+ *            (size_t) objects per slab                            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sets up a pool of objects of the given size. The   *
+ * alignment must be a power of 2 (0 means whatever malloc would   *
+ * give us) and POOL_CACHELINE keeps objects on their own cache    *
+ * lines. No memory is allocated until the first PoolAlloc.        *
+ *                                                                 *
+ *******************************************************************/
+int InitializePool(pool_t *pool, size_t objsize, size_t align, size_t perslab)
+{
+		assert(pool && objsize);
+
+		if (!align)
+				align = _Alignof(max_align_t);
+
+		// The alignment has to be a power of 2.
+		if (align & (align - 1))
+				return 0;
+
+		memset(pool, 0, sizeof(pool_t));
+
+		// Free objects store the freelist pointer inside themselves so
+		// they need to be at least big enough to hold it.
+		if (objsize < sizeof(void*))
+				objsize = sizeof(void*);
+
+		if (align < _Alignof(void*))
+				align = _Alignof(void*);
+
+		pool->align   = align;
+		pool->objsize = ALIGN_UP(objsize, align);
+		pool->perslab = perslab ? perslab : POOL_SLAB_OBJECTS;
+		pool->header  = ALIGN_UP(sizeof(void*), align);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: DestroyPool                                           *
+ *                                                                 *
+ * Arguments: pool_t*                                              *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Gives every slab back to the system. Any objects   *
+ * which haven't been freed yet are gone after this.               *
+ *                                                                 *
+ *******************************************************************/
+void DestroyPool(pool_t *pool)
+{
+		assert(pool);
+
+		if (pool->inuse)
+				LogWarning("Destroying a pool with %zu objects still in use", pool->inuse);
+
+		void *slab = pool->slabs;
+		while (slab)
+		{
+				void *next = *(void**)slab;
+				free(slab);
+				slab = next;
+		}
+
+		pool->slabs = pool->freelist = NULL;
+		pool->inuse = pool->total = 0;
+}
+
+/*******************************************************************
+ * Function: GrowPool                                              *
+ *                                                                 *
+ * Arguments: pool_t*                                              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Allocates another slab and puts all of its objects *
+ * on the freelist.                                                *
+ *                                                                 *
+ *******************************************************************/
+static int GrowPool(pool_t *pool)
+{
+		size_t size = pool->header + pool->objsize * pool->perslab;
+
+		// aligned_alloc wants the size to be a multiple of the alignment,
+		// which it always is since both parts are rounded up to it.
+		char *slab = aligned_alloc(pool->align, size);
+		if (!slab)
+				return 0;
+
+		*(void**)slab = pool->slabs;
+		pool->slabs = slab;
+
+		// Push the objects in reverse so they're handed out in address
+		// order, which is a little kinder to the cache.
+		char *obj = slab + pool->header + pool->objsize * pool->perslab;
+		for (size_t i = 0; i < pool->perslab; ++i)
+		{
+				obj -= pool->objsize;
+				*(void**)obj = pool->freelist;
+				pool->freelist = obj;
+		}
+
+		pool->total += pool->perslab;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ReservePool                                           *
+ *                                                                 *
+ * Arguments: pool_t*, (size_t) count                              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Makes sure `count' objects can be handed out       *
+ * without allocating, eg. at startup so the first burst of        *
+ * connections doesn't have to wait on malloc.                     *
+ *                                                                 *
+ *******************************************************************/
+int ReservePool(pool_t *pool, size_t count)
+{
+		assert(pool && pool->objsize);
+
+		while (pool->total - pool->inuse < count)
+				if (!GrowPool(pool))
+						return 0;
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: PoolAlloc                                             *
+ *                                                                 *
+ * Arguments: pool_t*                                              *
+ *                                                                 *
+ * Returns: (void*) An object or NULL if we ran out of memory.     *
+ *                                                                 *
+ * Description: Hands out a free object. This is just popping the  *
+ * freelist unless every slab is full.                             *
+ *                                                                 *
+ *******************************************************************/
+void *PoolAlloc(pool_t *pool)
+{
+		assert(pool && pool->objsize);
+
+		if (!pool->freelist && !GrowPool(pool))
+		{
+				errno = ENOMEM;
+				return NULL;
+		}
+
+		void *obj = pool->freelist;
+		pool->freelist = *(void**)obj;
+		pool->inuse++;
+		return obj;
+}
+
+/*******************************************************************
+ * Function: PoolCalloc                                            *
+ *                                                                 *
+ * Arguments: pool_t*                                              *
+ *                                                                 *
+ * Returns: (void*) A zeroed object or NULL if we ran out of       *
+ * memory.                                                         *
+ *                                                                 *
+ *******************************************************************/
+void *PoolCalloc(pool_t *pool)
+{
+		void *obj = PoolAlloc(pool);
+		if (obj)
+				memset(obj, 0, pool->objsize);
+		return obj;
+}
+
+/*******************************************************************
+ * Function: PoolFree                                              *
+ *                                                                 *
+ * Arguments: pool_t*, void*                                       *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Puts an object back so the next PoolAlloc can hand *
+ * it out again. Like free, passing NULL does nothing.             *
+ *                                                                 *
+ *******************************************************************/
+void PoolFree(pool_t *pool, void *ptr)
+{
+		assert(pool);
+
+		if (!ptr)
+				return;
+
+		assert(pool->inuse);
+		*(void**)ptr = pool->freelist;
+		pool->freelist = ptr;
+		pool->inuse--;
+}
@@ -0,0 +1,684 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "vector/vec.h"
+#include "memory/pool.h" // for POOL_CACHELINE
+#include "log/log.h"
+
+// Include our metrics types and function declarations.
+#include "metrics/metrics.h"
+
+// Round `n' up to the next multiple of `align' (which is a power of 2).
+#define ALIGN_UP(n, align) (((n) + (align) - 1) & ~((align) - 1))
+
+// What every metric is called, prefixed with this.
+#define METRICS_PREFIX "psychic_ninja_"
+
+// How long (in milliseconds) we wait for a client to say whether it's
+// talking HTTP, and for it to take what we send.
+#define METRICS_REQUEST_TIMEOUT 100
+#define METRICS_CLIENT_TIMEOUT  1000
+
+typedef vec_t(char) metricstext_t;
+
+// How the counters are exported, and which kind of set has them.
+static const struct
+{
+		const char *name;
+		const char *type;
+		const char *help;
+		metricskind_t kind;
+} counters[METRICS_COUNT] = {
+		[METRIC_WAKEUPS]      = { "loop_wakeups_total", "counter", "Times the event loop woke up from waiting for events.", METRICS_LOOP },
+		[METRIC_EVENTS]       = { "loop_events_total", "counter", "Events and timers the event loop handled.", METRICS_LOOP },
+		[METRIC_SYSCALLS]     = { "loop_syscalls_total", "counter", "Waits, reads and writes the event loop made (divide by loop_events_total for syscalls per event).", METRICS_LOOP },
+		[METRIC_JOBS_DROPPED] = { "loop_jobs_dropped_total", "counter", "Commands dropped because the workers had no room for them.", METRICS_LOOP },
+		[METRIC_JOBS]         = { "worker_jobs_total", "counter", "Commands the worker ran.", METRICS_WORKER },
+		[METRIC_BYTES_IN]     = { "socket_received_bytes_total", "counter", "Bytes received from the server.", METRICS_SOCKET },
+		[METRIC_BYTES_OUT]    = { "socket_sent_bytes_total", "counter", "Bytes sent to the server.", METRICS_SOCKET },
+		[METRIC_LINES_IN]     = { "socket_received_lines_total", "counter", "Lines received from the server.", METRICS_SOCKET },
+		[METRIC_LINES_OUT]    = { "socket_sent_lines_total", "counter", "Messages queued to be sent to the server.", METRICS_SOCKET },
+		[METRIC_READS]        = { "socket_reads_total", "counter", "Times we read from the socket.", METRICS_SOCKET },
+		[METRIC_WRITES]       = { "socket_writes_total", "counter", "Times we wrote to the socket.", METRICS_SOCKET },
+		[METRIC_ERRORS]       = { "socket_errors_total", "counter", "Reads and writes which failed.", METRICS_SOCKET },
+		[METRIC_FLOOD_STALL]  = { "socket_flood_stall_milliseconds_total", "counter", "Time messages spent held back by the server's flood limits.", METRICS_SOCKET },
+		[METRIC_SENDQ_BYTES]  = { "socket_send_queue_bytes", "gauge", "Bytes waiting for the kernel to take them.", METRICS_SOCKET },
+		[METRIC_FLOOD_QUEUED] = { "socket_flood_queue_messages", "gauge", "Messages waiting for the server's flood limits.", METRICS_SOCKET },
+};
+
+// How the histograms are exported. They're added up over every set of
+// the kind, quantiles of different threads can't be added up afterwards.
+static const struct
+{
+		const char *name;
+		const char *help;
+		metricskind_t kind;
+} histograms[METRICS_HISTOGRAMS] = {
+		[HISTOGRAM_LOOP_BUSY]   = { "loop_busy_microseconds", "Time the event loop spent on each batch of events.", METRICS_LOOP },
+		[HISTOGRAM_FLOOD_STALL] = { "flood_stall_microseconds", "How long the flood limits held messages back each time.", METRICS_LOOP },
+		[HISTOGRAM_HANDLER]     = { "handler_latency_microseconds", "Time each command took to run.", METRICS_WORKER },
+};
+
+// The quantiles we export for each histogram.
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+// What the sets of each kind are labelled with.
+static const char *labels[METRICS_KINDS] = { "loop", "worker", "socket" };
+
+// Every set of metrics there is, guarded by the lock.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static vec_t(metrics_t*) sets;
+
+_Thread_local metrics_t *threadmetrics;
+
+// The server, see StartMetricsServer.
+static int listenfd = -1;
+static int stoppipe[2] = { -1, -1 };
+static char *listenpath;
+static pthread_t thread;
+
+/*******************************************************************
+ * Function: CreateMetrics                                         *
+ *                                                                 *
+ * Arguments: metricskind_t, (const char*) name                    *
+ *                                                                 *
+ * Returns: (metrics_t*) The new set, NULL if we ran out of       *
+ * memory.                                                         *
+ *                                                                 *
+ * Description: Creates a set of metrics which is exported until   *
+ * it's destroyed. Event loops and workers get histograms as well  *
+ * as counters, sockets only get counters.                         *
+ *                                                                 *
+ *******************************************************************/
+metrics_t *CreateMetrics(metricskind_t kind, const char *name)
+{
+		assert(kind < METRICS_KINDS && name);
+
+		// Each set on its own cache lines, they're written by different threads.
+		metrics_t *m = aligned_alloc(POOL_CACHELINE, ALIGN_UP(sizeof(metrics_t), POOL_CACHELINE));
+		if (!m)
+				return NULL;
+
+		memset(m, 0, sizeof(metrics_t));
+		m->kind = kind;
+		snprintf(m->name, sizeof(m->name), "%s", name);
+
+		if (kind != METRICS_SOCKET)
+		{
+				size_t size = METRICS_HISTOGRAMS * sizeof(metricshistogram_t);
+				m->histograms = aligned_alloc(POOL_CACHELINE, ALIGN_UP(size, POOL_CACHELINE));
+				if (!m->histograms)
+				{
+						free(m);
+						return NULL;
+				}
+				memset(m->histograms, 0, size);
+		}
+
+		pthread_mutex_lock(&lock);
+		m->index = sets.length;
+		int failed = vec_push(&sets, m);
+		pthread_mutex_unlock(&lock);
+
+		if (failed)
+		{
+				free(m->histograms);
+				free(m);
+				return NULL;
+		}
+
+		return m;
+}
+
+/*******************************************************************
+ * Function: DestroyMetrics                                        *
+ *                                                                 *
+ * Arguments: metrics_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Stops exporting the set and frees it. Does nothing *
+ * if it's NULL.                                                   *
+ *                                                                 *
+ *******************************************************************/
+void DestroyMetrics(metrics_t *m)
+{
+		if (!m)
+				return;
+
+		// Move the last set into its place, like DestroySocket does.
+		pthread_mutex_lock(&lock);
+		assert(sets.data[m->index] == m);
+		metrics_t *last = vec_pop(&sets);
+		if (last != m)
+		{
+				sets.data[m->index] = last;
+				last->index = m->index;
+		}
+
+		if (!sets.length)
+				vec_deinit(&sets);
+		pthread_mutex_unlock(&lock);
+
+		free(m->histograms);
+		free(m);
+}
+
+/*******************************************************************
+ * Function: GetBucket                                             *
+ *                                                                 *
+ * Arguments: (uint64_t) value                                     *
+ *                                                                 *
+ * Returns: (int) The histogram bucket the value is counted in.    *
+ *                                                                 *
+ *******************************************************************/
+static int GetBucket(uint64_t value)
+{
+		if (value < METRICS_EXACT)
+				return (int)value;
+
+		// Find the highest bit set.
+		int power = 0;
+		for (int shift = 32; shift; shift >>= 1)
+		{
+				if (value >> (power + shift))
+						power += shift;
+		}
+
+		if (power >= METRICS_MAX_POWER)
+				return METRICS_BUCKETS - 1;
+
+		// The 4 bits after the highest one pick the linear bucket.
+		return METRICS_EXACT + (power - 5) * METRICS_SUB_BUCKETS + (int)((value >> (power - 4)) & (METRICS_SUB_BUCKETS - 1));
+}
+
+/*******************************************************************
+ * Function: GetBucketValue                                        *
+ *                                                                 *
+ * Arguments: (int) bucket                                         *
+ *                                                                 *
+ * Returns: (uint64_t) The biggest value counted in the bucket.    *
+ *                                                                 *
+ *******************************************************************/
+static uint64_t GetBucketValue(int bucket)
+{
+		if (bucket < METRICS_EXACT)
+				return (uint64_t)bucket;
+
+		int power = (bucket - METRICS_EXACT) / METRICS_SUB_BUCKETS + 5;
+		uint64_t sub = (bucket - METRICS_EXACT) % METRICS_SUB_BUCKETS;
+		return ((METRICS_SUB_BUCKETS + sub + 1) << (power - 4)) - 1;
+}
+
+/*******************************************************************
+ * Function: RecordMetric                                          *
+ *                                                                 *
+ * Arguments: metrics_t*, metrichistogram_t, (uint64_t) value      *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Counts a value in one of the set's histograms,     *
+ * only ever call this from the thread the set belongs to. Does    *
+ * nothing if `m' is NULL or has no histograms.                    *
+ *                                                                 *
+ *******************************************************************/
+void RecordMetric(metrics_t *m, metrichistogram_t histogram, uint64_t value)
+{
+		if (!m || !m->histograms)
+				return;
+
+		metricshistogram_t *h = &m->histograms[histogram];
+		_Atomic uint64_t *bucket = &h->buckets[GetBucket(value)];
+
+		atomic_store_explicit(bucket, atomic_load_explicit(bucket, memory_order_relaxed) + 1, memory_order_relaxed);
+		atomic_store_explicit(&h->sum, atomic_load_explicit(&h->sum, memory_order_relaxed) + value, memory_order_relaxed);
+		atomic_store_explicit(&h->count, atomic_load_explicit(&h->count, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/*******************************************************************
+ * Function: GetMetricsClock                                       *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (uint64_t) Monotonic time in microseconds.             *
+ *                                                                 *
+ * Description: What the histograms are timed with, the event loop *
+ * clock only goes down to milliseconds.                           *
+ *                                                                 *
+ *******************************************************************/
+uint64_t GetMetricsClock(void)
+{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*******************************************************************
+ * Function: Print                                                 *
+ *                                                                 *
+ * Arguments: metricstext_t*, (const char*) format, ...            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ *******************************************************************/
+static int Print(metricstext_t *text, const char *format, ...)
+{
+		va_list ap;
+
+		for (;;)
+		{
+				size_t room = text->capacity - text->length;
+				va_start(ap, format);
+				int len = vsnprintf(text->data + text->length, room, format, ap);
+				va_end(ap);
+
+				if (len < 0)
+						return 0;
+
+				if ((size_t)len < room)
+				{
+						text->length += len;
+						return 1;
+				}
+
+				if (vec_reserve(text, text->capacity * 2 > text->length + len + 1 ? text->capacity * 2 : text->length + len + 1))
+						return 0;
+		}
+}
+
+/*******************************************************************
+ * Function: PrintLabel                                            *
+ *                                                                 *
+ * Arguments: metricstext_t*, const metrics_t*                     *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Prints which set a value is from, eg. {loop="0"},  *
+ * escaping the name the way Prometheus wants.                     *
+ *                                                                 *
+ *******************************************************************/
+static int PrintLabel(metricstext_t *text, const metrics_t *m)
+{
+		if (!Print(text, "{%s=\"", labels[m->kind]))
+				return 0;
+
+		for (const char *p = m->name; *p; ++p)
+		{
+				int ok = *p == '\\' ? Print(text, "\\\\") :
+						*p == '"' ? Print(text, "\\\"") :
+						*p == '\n' ? Print(text, "\\n") :
+						Print(text, "%c", *p);
+				if (!ok)
+						return 0;
+		}
+
+		return Print(text, "\"}");
+}
+
+/*******************************************************************
+ * Function: PrintHistogram                                        *
+ *                                                                 *
+ * Arguments: metricstext_t*, metrichistogram_t                    *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Adds up the histogram of every set which has it    *
+ * and prints it as a summary. Must be called with the lock held.  *
+ *                                                                 *
+ *******************************************************************/
+static int PrintHistogram(metricstext_t *text, metrichistogram_t histogram)
+{
+		uint64_t buckets[METRICS_BUCKETS] = { 0 };
+		uint64_t count = 0, sum = 0;
+
+		metrics_t *m;
+		int i;
+		vec_foreach(&sets, m, i)
+		{
+				if (m->kind != histograms[histogram].kind || !m->histograms)
+						continue;
+
+				metricshistogram_t *h = &m->histograms[histogram];
+				count += atomic_load_explicit(&h->count, memory_order_relaxed);
+				sum += atomic_load_explicit(&h->sum, memory_order_relaxed);
+				for (int b = 0; b < METRICS_BUCKETS; ++b)
+						buckets[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+		}
+
+		const char *name = histograms[histogram].name;
+		if (!Print(text, "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s summary\n", name, histograms[histogram].help, name))
+				return 0;
+
+		// The buckets are read one by one while they're being written, so
+		// add them up again rather than trusting `count' to match.
+		uint64_t total = 0;
+		for (int b = 0; b < METRICS_BUCKETS; ++b)
+				total += buckets[b];
+
+		int b = 0;
+		uint64_t seen = 0;
+		for (size_t q = 0; q < sizeof(quantiles) / sizeof(*quantiles); ++q)
+		{
+				uint64_t rank = (uint64_t)(quantiles[q] * total + 0.5);
+				if (rank < 1)
+						rank = 1;
+
+				while (b < METRICS_BUCKETS - 1 && seen + buckets[b] < rank)
+						seen += buckets[b++];
+
+				if (!Print(text, METRICS_PREFIX "%s{quantile=\"%g\"} %llu\n", name, quantiles[q], total ? (unsigned long long)GetBucketValue(b) : 0ULL))
+						return 0;
+		}
+
+		return Print(text, METRICS_PREFIX "%s_sum %llu\n" METRICS_PREFIX "%s_count %llu\n", name, (unsigned long long)sum, name, (unsigned long long)count);
+}
+
+/*******************************************************************
+ * Function: FormatMetrics                                         *
+ *                                                                 *
+ * Arguments: (size_t*) length                                     *
+ *                                                                 *
+ * Returns: (char*) The metrics as text, for the caller to free.   *
+ * NULL if we ran out of memory.                                   *
+ *                                                                 *
+ * Description: Reads every set of metrics and prints them in the  *
+ * Prometheus text format. Counters are printed per set, the       *
+ * histograms of every set of a kind are added up first. The sets  *
+ * are read while their threads carry on writing them, so a value  *
+ * can be a moment behind but is never torn.                       *
+ *                                                                 *
+ *******************************************************************/
+char *FormatMetrics(size_t *len)
+{
+		metricstext_t text;
+		vec_init(&text);
+		if (vec_reserve(&text, 16384))
+				return NULL;
+
+		int ok = 1;
+		pthread_mutex_lock(&lock);
+
+		for (int c = 0; ok && c < METRICS_COUNT; ++c)
+		{
+				ok = Print(&text, "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX "%s %s\n", counters[c].name, counters[c].help, counters[c].name, counters[c].type);
+
+				metrics_t *m;
+				int i;
+				vec_foreach(&sets, m, i)
+				{
+						if (!ok)
+								break;
+						if (m->kind != counters[c].kind)
+								continue;
+
+						ok = Print(&text, METRICS_PREFIX "%s", counters[c].name) && PrintLabel(&text, m) &&
+							Print(&text, " %llu\n", (unsigned long long)atomic_load_explicit(&m->values[c], memory_order_relaxed));
+				}
+		}
+
+		for (int h = 0; ok && h < METRICS_HISTOGRAMS; ++h)
+				ok = PrintHistogram(&text, h);
+
+		pthread_mutex_unlock(&lock);
+
+		if (!ok)
+		{
+				vec_deinit(&text);
+				return NULL;
+		}
+
+		*len = text.length;
+		return text.data;
+}
+
+/*******************************************************************
+ * Function: SendAll                                               *
+ *                                                                 *
+ * Arguments: (int) fd, const void*, size_t                        *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ *******************************************************************/
+static int SendAll(int fd, const void *data, size_t len)
+{
+		const char *p = data;
+		while (len)
+		{
+				ssize_t sent = send(fd, p, len, MSG_NOSIGNAL);
+				if (sent == -1 && errno == EINTR)
+						continue;
+				if (sent <= 0)
+						return 0;
+
+				p += sent;
+				len -= sent;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ServeClient                                           *
+ *                                                                 *
+ * Arguments: (int) fd                                             *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Sends the metrics to someone who connected. If     *
+ * they start with an HTTP request we wait for the rest of it and  *
+ * answer in HTTP, if they don't say anything for a moment they    *
+ * get the text on its own.                                        *
+ *                                                                 *
+ *******************************************************************/
+static void ServeClient(int fd)
+{
+		struct timeval tv = { METRICS_CLIENT_TIMEOUT / 1000, (METRICS_CLIENT_TIMEOUT % 1000) * 1000 };
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+		char request[2048];
+		size_t got = 0;
+		int http = 0;
+		int timeout = METRICS_REQUEST_TIMEOUT;
+
+		for (;;)
+		{
+				struct pollfd pfd = { fd, POLLIN, 0 };
+				if (got == sizeof(request) - 1 || poll(&pfd, 1, timeout) <= 0)
+						break;
+
+				ssize_t n = recv(fd, request + got, sizeof(request) - 1 - got, 0);
+				if (n <= 0)
+						break;
+
+				got += n;
+				request[got] = 0;
+				http = got >= 4 && !memcmp(request, "GET ", 4);
+
+				// Anything else talking to us gets the text as it is.
+				if (!http || strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+						break;
+
+				// They're sending a request, give them longer to finish it.
+				timeout = METRICS_CLIENT_TIMEOUT;
+		}
+
+		size_t len = 0;
+		char *text = FormatMetrics(&len);
+
+		if (http)
+		{
+				char header[256];
+				int hlen = text ?
+						snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", len) :
+						snprintf(header, sizeof(header), "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+				if (!SendAll(fd, header, hlen))
+				{
+						free(text);
+						return;
+				}
+		}
+
+		if (text)
+				SendAll(fd, text, len);
+
+		free(text);
+}
+
+/*******************************************************************
+ * Function: MetricsThread                                         *
+ *                                                                 *
+ * Arguments: void* (unused)                                       *
+ *                                                                 *
+ * Returns: (void*) Always NULL.                                   *
+ *                                                                 *
+ * Description: Answers whoever connects to the metrics socket,    *
+ * one at a time, until StopMetricsServer writes to the pipe.      *
+ *                                                                 *
+ *******************************************************************/
+static void *MetricsThread(void *unused)
+{
+		SetLogThreadName("metrics");
+
+		for (;;)
+		{
+				struct pollfd pfds[2] = { { listenfd, POLLIN, 0 }, { stoppipe[0], POLLIN, 0 } };
+				if (poll(pfds, 2, -1) == -1)
+				{
+						if (errno == EINTR)
+								continue;
+
+						LogError("Failed to wait for metrics clients: %s (%d)", strerror(errno), errno);
+						break;
+				}
+
+				if (pfds[1].revents)
+						break;
+
+				int fd = accept(listenfd, NULL, NULL);
+				if (fd == -1)
+						continue;
+
+				ServeClient(fd);
+				close(fd);
+		}
+
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: StartMetricsServer                                    *
+ *                                                                 *
+ * Arguments: (const char*) path                                   *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Listens on a Unix socket at the path and serves    *
+ * the metrics to everyone who connects, from a thread of its own  *
+ * so the event loops never wait on a slow client. A socket left   *
+ * behind by an earlier run is replaced, anything else at the path *
+ * is left alone. Only our user can connect.                       *
+ *                                                                 *
+ *******************************************************************/
+int StartMetricsServer(const char *path)
+{
+		assert(path && listenfd == -1);
+
+		struct sockaddr_un sun;
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		if (strlen(path) >= sizeof(sun.sun_path))
+		{
+				errno = ENAMETOOLONG;
+				LogError("Failed to listen on %s: %s (%d)", path, strerror(errno), errno);
+				return 0;
+		}
+		strcpy(sun.sun_path, path);
+
+		struct stat st;
+		if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+				unlink(path);
+
+		listenpath = strdup(path);
+		listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (!listenpath || listenfd == -1)
+				goto failed;
+
+		fcntl(listenfd, F_SETFD, FD_CLOEXEC);
+
+		if (bind(listenfd, (struct sockaddr*)&sun, sizeof(sun)) == -1)
+				goto failed;
+
+		if (chmod(path, 0600) == -1 || listen(listenfd, 8) == -1 || pipe(stoppipe) == -1)
+				goto failedbound;
+
+		fcntl(stoppipe[0], F_SETFD, FD_CLOEXEC);
+		fcntl(stoppipe[1], F_SETFD, FD_CLOEXEC);
+
+		int error = pthread_create(&thread, NULL, MetricsThread, NULL);
+		if (error)
+		{
+				errno = error;
+				close(stoppipe[0]);
+				close(stoppipe[1]);
+				stoppipe[0] = stoppipe[1] = -1;
+				goto failedbound;
+		}
+
+		return 1;
+
+failedbound:
+		unlink(path);
+failed:
+		LogError("Failed to listen on %s: %s (%d)", path, strerror(errno), errno);
+		if (listenfd != -1)
+				close(listenfd);
+		listenfd = -1;
+		free(listenpath);
+		listenpath = NULL;
+		return 0;
+}
+
+/*******************************************************************
+ * Function: StopMetricsServer                                     *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Stops serving the metrics and removes the socket.  *
+ * Does nothing if the server isn't running.                       *
+ *                                                                 *
+ *******************************************************************/
+void StopMetricsServer(void)
+{
+		if (listenfd == -1)
+				return;
+
+		char c = 0;
+		ssize_t written = write(stoppipe[1], &c, 1);
+		(void)written;
+		pthread_join(thread, NULL);
+
+		close(stoppipe[0]);
+		close(stoppipe[1]);
+		stoppipe[0] = stoppipe[1] = -1;
+		close(listenfd);
+		listenfd = -1;
+
+		unlink(listenpath);
+		free(listenpath);
+		listenpath = NULL;
+}
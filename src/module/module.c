@@ -0,0 +1,611 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "vector/vec.h"
+#include "eventloop/shard.h"
+#include "log/log.h"
+
+// Include our module types and function declarations.
+#include "module/module.h"
+
+#ifdef HAVE_DLFCN_H
+#include <dlfcn.h>
+#endif
+
+typedef struct module_s module_t;
+
+// A handler along with the module it belongs to. These live as long as
+// the module does so jobs can keep pointing at them after the table
+// they were found in has been replaced.
+typedef struct
+{
+		IRCJobHandler handler;
+		module_t *module;
+} modulehandler_t;
+
+struct module_s
+{
+		char *path;                 // Where we loaded it from, NULL if it's built in.
+		void *handle;               // What dlopen gave us, NULL if it's built in.
+		const moduleinfo_t *info;   // The module's description of itself.
+		modulehandler_t *handlers;  // One for each of the module's hooks.
+		atomic_int refs;            // How many of its handlers are queued or running.
+};
+
+// One hook in the dispatch table. The key is upper cased so looking it
+// up is a plain memcmp.
+typedef struct
+{
+		modulehooktype_t type;
+		size_t keylen;
+		char key[MODULE_KEY_MAX];
+		const modulehandler_t *handler;
+} dispatchentry_t;
+
+// Sorted by type, then key length, then key.
+typedef struct
+{
+		size_t count;
+		dispatchentry_t entries[];
+} dispatchtable_t;
+
+// Only ever touched by the main thread.
+static vec_t(module_t*) modules;
+
+// What the event loops look messages up in, NULL while it's empty.
+static _Atomic(dispatchtable_t*) table;
+
+/*******************************************************************
+ * Function: FoldKey                                               *
+ *                                                                 *
+ * Arguments: (char*) out, (const char*) key, (size_t) length      *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Upper cases the key into `out', which must have    *
+ * room for MODULE_KEY_MAX bytes. Only ASCII is folded, commands   *
+ * and triggers never need more.                                   *
+ *                                                                 *
+ *******************************************************************/
+static void FoldKey(char *out, const char *key, size_t len)
+{
+		for (size_t i = 0; i < len; ++i)
+				out[i] = key[i] >= 'a' && key[i] <= 'z' ? key[i] - ('a' - 'A') : key[i];
+}
+
+/*******************************************************************
+ * Function: CompareEntry                                          *
+ *                                                                 *
+ * Arguments: (modulehooktype_t), (const char*) key, (size_t) len, *
+ *            (const dispatchentry_t*)                             *
+ *                                                                 *
+ * Returns: (int) less than, equal to or greater than zero         *
+ *                                                                 *
+ * Description: The order of the dispatch table. Only the lengths  *
+ * are compared until they match, so most probes never look at     *
+ * the keys at all.                                                *
+ *                                                                 *
+ *******************************************************************/
+static int CompareEntry(modulehooktype_t type, const char *key, size_t len, const dispatchentry_t *entry)
+{
+		if (type != entry->type)
+				return type < entry->type ? -1 : 1;
+
+		if (len != entry->keylen)
+				return len < entry->keylen ? -1 : 1;
+
+		return memcmp(key, entry->key, len);
+}
+
+/*******************************************************************
+ * Function: SortEntries                                           *
+ *                                                                 *
+ * Arguments: (const void*), (const void*)                         *
+ *                                                                 *
+ * Returns: (int) less than, equal to or greater than zero         *
+ *                                                                 *
+ * Description: qsort comparator for building the dispatch table.  *
+ *                                                                 *
+ *******************************************************************/
+static int SortEntries(const void *a, const void *b)
+{
+		const dispatchentry_t *x = a;
+		return CompareEntry(x->type, x->key, x->keylen, b);
+}
+
+/*******************************************************************
+ * Function: PublishTable                                          *
+ *                                                                 *
+ * Arguments: (const module_t*) a module to leave out, or NULL     *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Builds a new dispatch table out of every module's  *
+ * hooks and hands it to the event loops. The table it replaces is *
+ * freed once none of them can still be looking at it. Returns     *
+ * false if we ran out of memory, the old table is kept then.      *
+ *                                                                 *
+ *******************************************************************/
+static int PublishTable(const module_t *skip)
+{
+		size_t count = 0;
+		module_t *mod;
+		int i;
+
+		vec_foreach(&modules, mod, i)
+		{
+				if (mod == skip)
+						continue;
+
+				for (const modulehook_t *hook = mod->info->hooks; hook && hook->key; ++hook)
+						count++;
+		}
+
+		dispatchtable_t *t = NULL;
+		if (count)
+		{
+				t = malloc(sizeof(dispatchtable_t) + count * sizeof(dispatchentry_t));
+				if (!t)
+				{
+						LogError("Failed to allocate the dispatch table: %s (%d)", strerror(errno), errno);
+						return 0;
+				}
+
+				t->count = 0;
+				vec_foreach(&modules, mod, i)
+				{
+						if (mod == skip)
+								continue;
+
+						for (size_t h = 0; mod->info->hooks && mod->info->hooks[h].key; ++h)
+						{
+								dispatchentry_t *entry = &t->entries[t->count++];
+								entry->type = mod->info->hooks[h].type;
+								entry->keylen = strlen(mod->info->hooks[h].key);
+								FoldKey(entry->key, mod->info->hooks[h].key, entry->keylen);
+								entry->handler = &mod->handlers[h];
+						}
+				}
+
+				qsort(t->entries, t->count, sizeof(dispatchentry_t), SortEntries);
+		}
+
+		dispatchtable_t *old = atomic_exchange_explicit(&table, t, memory_order_acq_rel);
+
+		// An event loop in the middle of a lookup might still be using it.
+		SyncShards();
+		free(old);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: AddModule                                             *
+ *                                                                 *
+ * Arguments: (const char*) path or NULL, (void*) handle or NULL,  *
+ *            (const moduleinfo_t*)                                *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Checks the module's hooks, lets it set itself up   *
+ * and starts dispatching to it. If anything went wrong the module *
+ * is left as it was (ie, the caller still has to dlclose it).     *
+ *                                                                 *
+ *******************************************************************/
+static int AddModule(const char *path, void *handle, const moduleinfo_t *info)
+{
+		const char *name = info->name ? info->name : path;
+
+		if (info->abi != MODULE_ABI_VERSION)
+		{
+				LogError("Module %s was built for version %d of the module interface, we're on %d", name, info->abi, MODULE_ABI_VERSION);
+				errno = EINVAL;
+				return 0;
+		}
+
+		size_t nhooks = 0;
+		for (const modulehook_t *hook = info->hooks; hook && hook->key; ++hook, ++nhooks)
+		{
+				size_t len = strlen(hook->key);
+				if (!len || len > MODULE_KEY_MAX || !hook->handler || (hook->type != MODULE_HOOK_COMMAND && hook->type != MODULE_HOOK_TRIGGER))
+				{
+						LogError("Module %s has an invalid hook \"%s\"", name, hook->key);
+						errno = EINVAL;
+						return 0;
+				}
+		}
+
+		module_t *mod = calloc(1, sizeof(module_t));
+		if (!mod || (nhooks && !(mod->handlers = calloc(nhooks, sizeof(modulehandler_t)))) || (path && !(mod->path = strdup(path))))
+		{
+				LogError("Failed to allocate module %s: %s (%d)", name, strerror(errno), errno);
+				goto fail;
+		}
+
+		mod->handle = handle;
+		mod->info = info;
+		atomic_init(&mod->refs, 0);
+		for (size_t h = 0; h < nhooks; ++h)
+		{
+				mod->handlers[h].handler = info->hooks[h].handler;
+				mod->handlers[h].module = mod;
+		}
+
+		if (info->OnLoad && !info->OnLoad())
+		{
+				LogError("Module %s failed to load", name);
+				errno = ECANCELED;
+				goto fail;
+		}
+
+		if (vec_push(&modules, mod))
+				goto unload;
+
+		if (!PublishTable(NULL))
+		{
+				vec_truncate(&modules, modules.length - 1);
+				goto unload;
+		}
+
+		return 1;
+
+unload:
+		if (info->OnUnload)
+				info->OnUnload();
+fail:
+		if (mod)
+		{
+				free(mod->handlers);
+				free(mod->path);
+		}
+		free(mod);
+		return 0;
+}
+
+/*******************************************************************
+ * Function: CloseModule                                           *
+ *                                                                 *
+ * Arguments: module_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Lets the module clean up after itself and closes   *
+ * it. Nothing may be able to call into it any more.               *
+ *                                                                 *
+ *******************************************************************/
+static void CloseModule(module_t *mod)
+{
+		if (mod->info->OnUnload)
+				mod->info->OnUnload();
+
+#ifdef HAVE_DLFCN_H
+		if (mod->handle)
+				dlclose(mod->handle);
+#endif
+
+		free(mod->handlers);
+		free(mod->path);
+		free(mod);
+}
+
+/*******************************************************************
+ * Function: RemoveModule                                          *
+ *                                                                 *
+ * Arguments: (int) index into modules                             *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Stops dispatching to the module, waits for the     *
+ * workers to finish with anything of it they already had, and     *
+ * closes it. Returns false if the dispatch table couldn't be      *
+ * rebuilt, the module is still loaded then.                       *
+ *                                                                 *
+ *******************************************************************/
+static int RemoveModule(int idx)
+{
+		module_t *mod = modules.data[idx];
+
+		if (!PublishTable(mod))
+				return 0;
+
+		// Every event loop has moved on, so no new jobs can reference the
+		// module. The ones already handed to the workers still might.
+		struct timespec pause = { 0, 1000000 };
+		while (atomic_load_explicit(&mod->refs, memory_order_acquire))
+				nanosleep(&pause, NULL);
+
+		vec_splice(&modules, idx, 1);
+		CloseModule(mod);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: FindModule                                            *
+ *                                                                 *
+ * Arguments: (const char*) path                                   *
+ *                                                                 *
+ * Returns: (int) The module's index, -1 if it isn't loaded.       *
+ *                                                                 *
+ *******************************************************************/
+static int FindModule(const char *path)
+{
+		module_t *mod;
+		int i;
+		vec_foreach(&modules, mod, i)
+				if (mod->path && !strcmp(mod->path, path))
+						return i;
+
+		return -1;
+}
+
+/*******************************************************************
+ * Function: RunHook                                               *
+ *                                                                 *
+ * Arguments: const ircjob_t*                                      *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called on a worker thread to run a module's        *
+ * handler, then lets the module go so it can be unloaded.         *
+ *                                                                 *
+ *******************************************************************/
+static void RunHook(const ircjob_t *job)
+{
+		const modulehandler_t *handler = job->data;
+
+		handler->handler(job);
+		atomic_fetch_sub_explicit(&handler->module->refs, 1, memory_order_release);
+}
+
+/*******************************************************************
+ * Function: RegisterModule                                        *
+ *                                                                 *
+ * Arguments: (const moduleinfo_t*)                                *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Adds a module which is built into the bot. It      *
+ * can't be unloaded or reloaded, the info has to stay around      *
+ * until DestroyModules. Must be called from the main thread.      *
+ *                                                                 *
+ *******************************************************************/
+int RegisterModule(const moduleinfo_t *info)
+{
+		assert(info && !GetCurrentShard());
+		return AddModule(NULL, NULL, info);
+}
+
+/*******************************************************************
+ * Function: LoadModule                                            *
+ *                                                                 *
+ * Arguments: (const char*) path to the shared object              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Loads the module and starts dispatching messages   *
+ * to its hooks. Must be called from the main thread, it's safe to *
+ * do so while the event loops are running.                        *
+ *                                                                 *
+ *******************************************************************/
+int LoadModule(const char *path)
+{
+		assert(path && !GetCurrentShard());
+
+		if (FindModule(path) != -1)
+		{
+				LogError("Module %s is already loaded", path);
+				errno = EEXIST;
+				return 0;
+		}
+
+#ifdef HAVE_DLFCN_H
+		// RTLD_NOW so a missing symbol fails here and not in some worker.
+		void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+		if (!handle)
+		{
+				LogError("Failed to load module %s: %s", path, dlerror());
+				errno = ENOENT;
+				return 0;
+		}
+
+		const moduleinfo_t *info = dlsym(handle, MODULE_SYMBOL);
+		if (!info)
+		{
+				LogError("Module %s has no %s", path, MODULE_SYMBOL);
+				dlclose(handle);
+				errno = EINVAL;
+				return 0;
+		}
+
+		if (!AddModule(path, handle, info))
+		{
+				dlclose(handle);
+				return 0;
+		}
+
+		LogInfo("Loaded module %s from %s", info->name ? info->name : path, path);
+		return 1;
+#else
+		LogError("Can't load module %s, we were built without dlopen", path);
+		errno = ENOTSUP;
+		return 0;
+#endif
+}
+
+/*******************************************************************
+ * Function: UnloadModule                                          *
+ *                                                                 *
+ * Arguments: (const char*) the path it was loaded from            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Stops dispatching to the module and closes it once *
+ * the workers are done with it. This blocks until they are. Must  *
+ * be called from the main thread.                                 *
+ *                                                                 *
+ *******************************************************************/
+int UnloadModule(const char *path)
+{
+		assert(path && !GetCurrentShard());
+
+		int idx = FindModule(path);
+		if (idx == -1)
+		{
+				errno = ENOENT;
+				return 0;
+		}
+
+		return RemoveModule(idx);
+}
+
+/*******************************************************************
+ * Function: ReloadModules                                         *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Unloads every module which came from a file and    *
+ * loads it again, picking up whatever is there now. A module is   *
+ * closed before it's opened again since dlopen would only hand    *
+ * us the old one back, so its hooks are missed for a moment.      *
+ * Replace the file instead of writing over it (eg, with mv or     *
+ * install), the old one is still mapped until then. Returns false *
+ * if any of them failed, those are left unloaded.                 *
+ *                                                                 *
+ *******************************************************************/
+int ReloadModules(void)
+{
+		assert(!GetCurrentShard());
+
+		vec_t(char*) paths;
+		vec_init(&paths);
+
+		module_t *mod;
+		int i, ok = 1;
+		vec_foreach(&modules, mod, i)
+		{
+				if (!mod->path)
+						continue;
+
+				char *path = strdup(mod->path);
+				if (!path || vec_push(&paths, path))
+				{
+						free(path);
+						ok = 0;
+				}
+		}
+
+		char *path;
+		vec_foreach(&paths, path, i)
+		{
+				if (!UnloadModule(path) || !LoadModule(path))
+						ok = 0;
+				free(path);
+		}
+
+		vec_deinit(&paths);
+		return ok;
+}
+
+/*******************************************************************
+ * Function: DestroyModules                                        *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Unloads everything, including the built in         *
+ * modules. Only call this once the event loops and workers have   *
+ * stopped.                                                        *
+ *                                                                 *
+ *******************************************************************/
+void DestroyModules(void)
+{
+		assert(!GetCurrentShard());
+
+		free(atomic_exchange(&table, NULL));
+
+		// Newest first, in case a module uses one loaded before it.
+		while (modules.length)
+				CloseModule(vec_pop(&modules));
+
+		vec_deinit(&modules);
+}
+
+/*******************************************************************
+ * Function: DispatchIRCMessage                                    *
+ *                                                                 *
+ * Arguments: socket_t*, strview_t line, const ircmsg_t*           *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Hands the message to every hook for its command    *
+ * and, for a PRIVMSG, its first word. Must be called from the     *
+ * event loop the socket belongs to. Returns false if a hook was   *
+ * skipped because the workers are too far behind.                 *
+ *                                                                 *
+ *******************************************************************/
+int DispatchIRCMessage(socket_t *sock, strview_t line, const ircmsg_t *msg)
+{
+		const dispatchtable_t *t = atomic_load_explicit(&table, memory_order_acquire);
+		if (!t)
+				return 1;
+
+		struct { modulehooktype_t type; strview_t key; } lookups[2];
+		int nlookups = 0;
+
+		lookups[nlookups].type = MODULE_HOOK_COMMAND;
+		lookups[nlookups++].key = IRCSpan(msg, msg->command);
+
+		if (IRCSpanEquals(msg, msg->command, "PRIVMSG") && msg->nparams >= 2 && msg->prefix.len)
+		{
+				strview_t text = IRCSpan(msg, msg->params[1]);
+				const char *space = memchr(text.ptr, ' ', text.len);
+				if (space)
+						text.len = space - text.ptr;
+
+				lookups[nlookups].type = MODULE_HOOK_TRIGGER;
+				lookups[nlookups++].key = text;
+		}
+
+		int ok = 1;
+		for (int l = 0; l < nlookups; ++l)
+		{
+				if (!lookups[l].key.len || lookups[l].key.len > MODULE_KEY_MAX)
+						continue;
+
+				char key[MODULE_KEY_MAX];
+				size_t len = lookups[l].key.len;
+				FoldKey(key, lookups[l].key.ptr, len);
+
+				// Find the first entry which isn't less than the key, every hook
+				// for it follows on from there.
+				size_t lo = 0, hi = t->count;
+				while (lo < hi)
+				{
+						size_t mid = lo + (hi - lo) / 2;
+						if (CompareEntry(lookups[l].type, key, len, &t->entries[mid]) > 0)
+								lo = mid + 1;
+						else
+								hi = mid;
+				}
+
+				for (; lo < t->count && !CompareEntry(lookups[l].type, key, len, &t->entries[lo]); ++lo)
+				{
+						const modulehandler_t *handler = t->entries[lo].handler;
+
+						atomic_fetch_add_explicit(&handler->module->refs, 1, memory_order_relaxed);
+						if (!SubmitIRCMessage(sock, line, msg, RunHook, (void*)handler))
+						{
+								atomic_fetch_sub_explicit(&handler->module->refs, 1, memory_order_release);
+								ok = 0;
+						}
+				}
+		}
+
+		return ok;
+}
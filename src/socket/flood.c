@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Include our flood control types and function declarations.
+#include "socket/flood.h"
+
+/*******************************************************************
+ * Function: InitializeFloodControl                                *
+ *                                                                 *
+ * Arguments: floodctl_t*                                          *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+void InitializeFloodControl(floodctl_t *f)
+{
+		assert(f);
+		memset(f, 0, sizeof(floodctl_t));
+
+		for (int i = 0; i < FLOOD_LANES; ++i)
+		{
+				vec_init(&f->lanes[i].bytes);
+				vec_init(&f->lanes[i].lengths);
+		}
+
+		f->penalty     = FLOOD_PENALTY;
+		f->bytepenalty = FLOOD_PENALTY_BYTES;
+		f->burst       = FLOOD_BURST;
+}
+
+/*******************************************************************
+ * Function: ClearFloodControl                                     *
+ *                                                                 *
+ * Arguments: floodctl_t*                                          *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Throws away every waiting message and resets the   *
+ * timer, eg. when we reconnect and the server starts afresh.      *
+ *                                                                 *
+ *******************************************************************/
+void ClearFloodControl(floodctl_t *f)
+{
+		assert(f);
+
+		for (int i = 0; i < FLOOD_LANES; ++i)
+		{
+				vec_clear(&f->lanes[i].bytes);
+				vec_clear(&f->lanes[i].lengths);
+				f->lanes[i].head = f->lanes[i].next = 0;
+		}
+
+		f->timer = 0;
+}
+
+/*******************************************************************
+ * Function: DestroyFloodControl                                   *
+ *                                                                 *
+ * Arguments: floodctl_t*                                          *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+void DestroyFloodControl(floodctl_t *f)
+{
+		assert(f);
+
+		for (int i = 0; i < FLOOD_LANES; ++i)
+		{
+				vec_deinit(&f->lanes[i].bytes);
+				vec_deinit(&f->lanes[i].lengths);
+		}
+}
+
+/*******************************************************************
+ * Function: QueueFloodMessage                                     *
+ *                                                                 *
+ * Arguments: floodctl_t*, floodlane_t, (const void*) message,     *
+ *            (size_t) length                                      *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Copies a complete message (including its \r\n)     *
+ * onto the end of a lane. It waits there until                    *
+ * ReleaseFloodMessages decides the server will accept it.         *
+ *                                                                 *
+ *******************************************************************/
+int QueueFloodMessage(floodctl_t *f, floodlane_t lane, const void *data, size_t len)
+{
+		assert(f && lane < FLOOD_LANES && data && len);
+
+		floodqueue_t *q = &f->lanes[lane];
+
+		// Messages are taken off the front without moving anything, only
+		// shuffle the rest down when we'd have to grow to fit this one.
+		if (q->head && q->bytes.length + (int)len > q->bytes.capacity)
+		{
+				vec_splice(&q->bytes, 0, q->head);
+				q->head = 0;
+		}
+
+		if (q->next && q->lengths.length == q->lengths.capacity)
+		{
+				vec_splice(&q->lengths, 0, q->next);
+				q->next = 0;
+		}
+
+		// Grow by doubling so a steady stream of messages doesn't realloc every time.
+		int needed = q->bytes.length + (int)len;
+		if (needed > q->bytes.capacity)
+		{
+				int capacity = q->bytes.capacity ? q->bytes.capacity * 2 : SENDQ_CHUNK_SIZE;
+				if (vec_reserve(&q->bytes, capacity > needed ? capacity : needed))
+						return 0;
+		}
+
+		if (vec_push(&q->lengths, (int)len))
+				return 0;
+
+		memcpy(q->bytes.data + q->bytes.length, data, len);
+		q->bytes.length += len;
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ReleaseFloodMessages                                  *
+ *                                                                 *
+ * Arguments: floodctl_t*, (int64_t) now, sendq_t*                 *
+ *                                                                 *
+ * Returns: (int) The number of messages moved to the send queue.  *
+ *                                                                 *
+ * Description: Moves as many messages onto the send queue as the  *
+ * server's penalty timer allows, urgent ones first. Call it again *
+ * at GetFloodDeadline to send the rest.                           *
+ *                                                                 *
+ *******************************************************************/
+int ReleaseFloodMessages(floodctl_t *f, int64_t now, sendq_t *out)
+{
+		assert(f && out);
+
+		// The timer never lags behind the clock, being quiet for a minute
+		// doesn't earn us the right to send 30 messages at once.
+		if (f->timer < now)
+				f->timer = now;
+
+		int released = 0;
+
+		for (int i = 0; i < FLOOD_LANES; ++i)
+		{
+				floodqueue_t *q = &f->lanes[i];
+
+				while (q->next < q->lengths.length && f->timer - now < f->burst)
+				{
+						int len = q->lengths.data[q->next];
+						if (!AppendSendQueue(out, q->bytes.data + q->head, len))
+								return released;
+
+						q->head += len;
+						q->next++;
+						released++;
+
+						f->timer += f->penalty;
+						if (f->bytepenalty)
+								f->timer += (int64_t)(len / f->bytepenalty) * 1000;
+				}
+
+				// Everything in the lane was sent, start from the beginning again.
+				if (q->next == q->lengths.length)
+				{
+						vec_clear(&q->bytes);
+						vec_clear(&q->lengths);
+						q->head = q->next = 0;
+				}
+
+				if (f->timer - now >= f->burst)
+						break;
+		}
+
+		return released;
+}
+
+/*******************************************************************
+ * Function: GetFloodQueued                                        *
+ *                                                                 *
+ * Arguments: const floodctl_t*                                    *
+ *                                                                 *
+ * Returns: (int) How many messages are waiting in all lanes.      *
+ *                                                                 *
+ *******************************************************************/
+int GetFloodQueued(const floodctl_t *f)
+{
+		assert(f);
+
+		int queued = 0;
+		for (int i = 0; i < FLOOD_LANES; ++i)
+				queued += f->lanes[i].lengths.length - f->lanes[i].next;
+
+		return queued;
+}
+
+/*******************************************************************
+ * Function: GetFloodDeadline                                      *
+ *                                                                 *
+ * Arguments: const floodctl_t*                                    *
+ *                                                                 *
+ * Returns: (int64_t) When (in monotonic milliseconds) the next    *
+ * message may be sent or -1 if nothing is waiting.                *
+ *                                                                 *
+ *******************************************************************/
+int64_t GetFloodDeadline(const floodctl_t *f)
+{
+		assert(f);
+
+		if (!GetFloodQueued(f))
+				return -1;
+
+		// The first moment where `timer - now < burst' holds.
+		return f->timer - f->burst + 1;
+}
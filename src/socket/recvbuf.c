@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdint.h>
+
+// Include our receive buffer types and function declarations.
+#include "socket/recvbuf.h"
+
+/*******************************************************************
+ * Function: InitializeRecvBuffer                                  *
+ *                                                                 *
+ * Arguments: recvbuf_t*, (size_t) size in bytes                   *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Allocates the memory the buffer reads into.        *
+ *                                                                 *
+ *******************************************************************/
+int InitializeRecvBuffer(recvbuf_t *buf, size_t size)
+{
+		assert(buf && size);
+
+		memset(buf, 0, sizeof(recvbuf_t));
+		buf->data = malloc(size);
+		if (!buf->data)
+				return 0;
+
+		buf->size = size;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: DestroyRecvBuffer                                     *
+ *                                                                 *
+ * Arguments: recvbuf_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+void DestroyRecvBuffer(recvbuf_t *buf)
+{
+		assert(buf);
+		free(buf->data);
+		memset(buf, 0, sizeof(recvbuf_t));
+}
+
+/*******************************************************************
+ * Function: ResetRecvBuffer                                       *
+ *                                                                 *
+ * Arguments: recvbuf_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Throws away everything in the buffer, eg. when we  *
+ * reconnect and don't want half a line from the old connection.   *
+ *                                                                 *
+ *******************************************************************/
+void ResetRecvBuffer(recvbuf_t *buf)
+{
+		assert(buf);
+		buf->head = buf->tail = buf->scanned = 0;
+		buf->discarding = 0;
+}
+
+/*******************************************************************
+ * Function: PrepareRecvBuffer                                     *
+ *                                                                 *
+ * Arguments: recvbuf_t*, (size_t*) set to how much room there is  *
+ *                                                                 *
+ * Returns: (char*) Where the next read from the kernel goes.      *
+ *                                                                 *
+ * Description: Makes as much room as it can at the end of the     *
+ * buffer for the next read. Once the read is done, say how much   *
+ * it got with CommitRecvBuffer. Any lines handed out by           *
+ * NextRecvLine before this are no longer valid.                   *
+ *                                                                 *
+ *******************************************************************/
+char *PrepareRecvBuffer(recvbuf_t *buf, size_t *len)
+{
+		assert(buf && buf->data && len);
+
+		// Everything was handed out, start from the beginning again.
+		if (buf->head == buf->tail)
+				buf->head = buf->tail = buf->scanned = 0;
+
+		// Out of room at the end, move the unfinished line to the front.
+		// This is at most one partial line so it's a very small copy.
+		if (buf->tail == buf->size && buf->head > 0)
+		{
+				memmove(buf->data, buf->data + buf->head, buf->tail - buf->head);
+				buf->tail -= buf->head;
+				buf->head = 0;
+		}
+
+		// The whole buffer is one line with no end in sight. Nothing sends lines
+		// this long on purpose so throw it away up until the next newline.
+		if (buf->tail == buf->size)
+		{
+				buf->head = buf->tail = buf->scanned = 0;
+				buf->discarding = 1;
+		}
+
+		*len = buf->size - buf->tail;
+		return buf->data + buf->tail;
+}
+
+/*******************************************************************
+ * Function: CommitRecvBuffer                                      *
+ *                                                                 *
+ * Arguments: recvbuf_t*, (size_t) bytes read                      *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Adds what was read into the space given out by     *
+ * PrepareRecvBuffer to the buffer.                                *
+ *                                                                 *
+ *******************************************************************/
+void CommitRecvBuffer(recvbuf_t *buf, size_t bytes)
+{
+		assert(buf && bytes <= buf->size - buf->tail);
+		buf->tail += bytes;
+}
+
+/*******************************************************************
+ * Function: FillRecvBufferWith                                    *
+ *                                                                 *
+ * Arguments: recvbuf_t*, RecvFunction, void* (passed to it)       *
+ *                                                                 *
+ * Returns: (size_t) The number of bytes read, 0 if the other end  *
+ * closed the connection or -1 with errno set on error (EAGAIN if  *
+ * there was nothing to read).                                     *
+ *                                                                 *
+ * Description: Reads as much as fits into the buffer. Any lines   *
+ * handed out by NextRecvLine before this are no longer valid.     *
+ *                                                                 *
+ *******************************************************************/
+size_t FillRecvBufferWith(recvbuf_t *buf, RecvFunction receiver, void *data)
+{
+		size_t room;
+		char *space = PrepareRecvBuffer(buf, &room);
+
+		ssize_t bytes = receiver(data, space, room);
+		if (bytes > 0)
+				CommitRecvBuffer(buf, bytes);
+
+		return (size_t)bytes;
+}
+
+/*******************************************************************
+ * Function: ReadDescriptor                                        *
+ *                                                                 *
+ * Arguments: void* (the file descriptor), void* buffer, size_t    *
+ *                                                                 *
+ * Returns: (ssize_t) What read returned.                          *
+ *                                                                 *
+ *******************************************************************/
+static ssize_t ReadDescriptor(void *data, void *buffer, size_t len)
+{
+		return read((int)(intptr_t)data, buffer, len);
+}
+
+/*******************************************************************
+ * Function: FillRecvBuffer                                        *
+ *                                                                 *
+ * Arguments: recvbuf_t*, (int) file descriptor                    *
+ *                                                                 *
+ * Returns: (size_t) The number of bytes read, 0 if the other end  *
+ * closed the connection or -1 with errno set on error (EAGAIN if  *
+ * there was nothing to read).                                     *
+ *                                                                 *
+ * Description: Reads as much as fits into the buffer straight     *
+ * from the kernel, see FillRecvBufferWith.                        *
+ *                                                                 *
+ *******************************************************************/
+size_t FillRecvBuffer(recvbuf_t *buf, int fd)
+{
+		return FillRecvBufferWith(buf, ReadDescriptor, (void*)(intptr_t)fd);
+}
+
+/*******************************************************************
+ * Function: NextRecvLine                                          *
+ *                                                                 *
+ * Arguments: recvbuf_t*, strview_t*                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Hands out the next complete line in the buffer     *
+ * without its line ending. IRC lines end with \r\n but we accept  *
+ * a bare \n too since some servers send that. The line points     *
+ * directly into the buffer, which is only valid until the next    *
+ * FillRecvBuffer. Returns false when there are no complete lines. *
+ *                                                                 *
+ *******************************************************************/
+int NextRecvLine(recvbuf_t *buf, strview_t *line)
+{
+		assert(buf && line);
+
+		for (;;)
+		{
+				// Only look at bytes we haven't already looked at. memchr is
+				// vectorised by the C library so this is as fast as it gets.
+				char *start = buf->data + buf->head;
+				char *from  = start + buf->scanned;
+				char *nl    = memchr(from, '\n', buf->tail - buf->head - buf->scanned);
+
+				if (!nl)
+				{
+						buf->scanned = buf->tail - buf->head;
+						return 0;
+				}
+
+				size_t len = nl - start;
+				buf->head += len + 1;
+				buf->scanned = 0;
+
+				// This was the end of a line we're throwing away.
+				if (buf->discarding)
+				{
+						buf->discarding = 0;
+						continue;
+				}
+
+				// Strip the \r from \r\n
+				if (len && start[len - 1] == '\r')
+						len--;
+
+				// Skip empty lines, they don't mean anything in IRC.
+				if (!len)
+						continue;
+
+				line->ptr = start;
+				line->len = len;
+				return 1;
+		}
+}
@@ -0,0 +1,781 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+#include <signal.h>
+#include <pthread.h>
+#include "vector/vec.h"
+#include "eventloop/eventloop.h"
+#include "log/log.h"
+
+// Include our resolver types and function declarations.
+#include "socket/resolver.h"
+
+// Someone waiting on a lookup to finish.
+typedef struct
+{
+		ResolveCallback callback;
+		void *data;
+} waiter_t;
+
+typedef struct resolverloop_s resolverloop_t;
+
+// A lookup which has been handed to the worker threads.
+typedef struct lookup_s
+{
+		resolverloop_t *owner;    // The event loop which asked for it.
+		char *host;               // The host we're looking up.
+		char *port;               // The port (or service name) we want to connect to.
+		vec_sbo_t(waiter_t, 2) waiters; // Everyone waiting on this lookup (owner's thread only), rarely more than one.
+
+		// Filled in by the worker thread.
+		struct addrinfo *result;  // The addresses we found.
+		int error;                // The getaddrinfo error if we didn't find any.
+		struct lookup_s *next;    // The next lookup in the owner's `finished' list.
+} lookup_t;
+
+// A remembered answer to a previous lookup.
+typedef struct
+{
+		char *host;
+		char *port;
+		struct addrinfo *adr;     // The addresses, or NULL if the host doesn't exist.
+		int error;                // The getaddrinfo error when `adr' is NULL.
+		int64_t expires;          // When (in monotonic milliseconds) we stop trusting this.
+} cacheentry_t;
+
+// Each thread running an event loop has its own pending lookups and cache
+// so it never has to lock anything to use them. The worker threads are
+// shared by all of them.
+struct resolverloop_s
+{
+		// These are only ever touched by the thread running the event loop.
+		vec_t(lookup_t*) pending;   // Lookups the workers haven't finished yet.
+		vec_t(cacheentry_t) cache;  // Answers to previous lookups.
+		lookup_t *dispatching;      // The lookup whose waiters we're calling right now.
+
+		// These are shared with the worker threads and protected by `lock'.
+		lookup_t *finished;         // Lookups the workers are done with, newest first.
+		int running;                // How many of our lookups the workers are in the middle of.
+
+		// The workers write a byte to this pipe whenever they finish a lookup so
+		// the event loop wakes up and hands the result to whoever asked for it.
+		int notifypipe[2];
+};
+
+// The calling thread's share of the resolver.
+static _Thread_local resolverloop_t *loop;
+
+// These are shared with the worker threads and protected by `lock'.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER; // Signalled when a loop's last running lookup finished.
+static vec_t(lookup_t*) jobs;       // Lookups waiting for a worker to pick them up.
+static int stopping;                // Set when the workers should exit.
+
+// Starting and stopping the workers is protected by `startlock' instead,
+// the workers need `lock' to exit so we can't hold it while joining them.
+static pthread_mutex_t startlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t threads[RESOLVER_THREADS];
+static int nthreads;
+static int users;                   // How many event loops are using the workers.
+
+/*******************************************************************
+ * Function: CopyAddresses                                         *
+ *                                                                 *
+ * Arguments: const struct addrinfo*                               *
+ *                                                                 *
+ * Returns: (struct addrinfo*) A copy of the list or NULL if we    *
+ * ran out of memory.                                              *
+ *                                                                 *
+ * Description: getaddrinfo's lists can only be freed by           *
+ * freeaddrinfo so we make our own copy which can be handed out to *
+ * many sockets. Each entry and its address share one allocation.  *
+ *                                                                 *
+ *******************************************************************/
+struct addrinfo *CopyAddresses(const struct addrinfo *list)
+{
+		struct addrinfo *head = NULL, **tail = &head;
+
+		for (; list; list = list->ai_next)
+		{
+				struct addrinfo *adr = malloc(sizeof(struct addrinfo) + list->ai_addrlen);
+				if (!adr)
+				{
+						FreeAddresses(head);
+						return NULL;
+				}
+
+				*adr = *list;
+				adr->ai_addr = (struct sockaddr*)(adr + 1);
+				memcpy(adr->ai_addr, list->ai_addr, list->ai_addrlen);
+				adr->ai_canonname = list->ai_canonname ? strdup(list->ai_canonname) : NULL;
+				adr->ai_next = NULL;
+
+				*tail = adr;
+				tail = &adr->ai_next;
+		}
+
+		return head;
+}
+
+/*******************************************************************
+ * Function: FreeAddresses                                         *
+ *                                                                 *
+ * Arguments: struct addrinfo*                                     *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Frees a list made by CopyAddresses.                *
+ *                                                                 *
+ *******************************************************************/
+void FreeAddresses(struct addrinfo *list)
+{
+		while (list)
+		{
+				struct addrinfo *next = list->ai_next;
+				free(list->ai_canonname);
+				free(list);
+				list = next;
+		}
+}
+
+/*******************************************************************
+ * Function: SortAddresses                                         *
+ *                                                                 *
+ * Arguments: struct addrinfo*                                     *
+ *                                                                 *
+ * Returns: (struct addrinfo*) The new head of the list.           *
+ *                                                                 *
+ * Description: Re-links the addresses getaddrinfo gave us so the  *
+ * address families alternate (eg, IPv6, IPv4, IPv6, ...) as RFC   *
+ * 8305 section 4 asks. getaddrinfo already sorted them by         *
+ * preference so we start with whichever family it put first. If   *
+ * one family is broken, the very next attempt uses the other.     *
+ *                                                                 *
+ *******************************************************************/
+static struct addrinfo *SortAddresses(struct addrinfo *list)
+{
+		if (!list)
+				return NULL;
+
+		// Split the list in two, keeping the order within each family.
+		int first = list->ai_family;
+		struct addrinfo *preferred = NULL, **ptail = &preferred;
+		struct addrinfo *other = NULL, **otail = &other;
+
+		for (struct addrinfo *adr = list, *next; adr; adr = next)
+		{
+				next = adr->ai_next;
+				adr->ai_next = NULL;
+
+				if (adr->ai_family == first)
+				{
+						*ptail = adr;
+						ptail = &adr->ai_next;
+				}
+				else
+				{
+						*otail = adr;
+						otail = &adr->ai_next;
+				}
+		}
+
+		// Now zip them back together, one of each at a time.
+		struct addrinfo *head = NULL, **tail = &head;
+		while (preferred || other)
+		{
+				if (preferred)
+				{
+						*tail = preferred;
+						tail = &preferred->ai_next;
+						preferred = preferred->ai_next;
+				}
+
+				if (other)
+				{
+						*tail = other;
+						tail = &other->ai_next;
+						other = other->ai_next;
+				}
+		}
+
+		*tail = NULL;
+		return head;
+}
+
+/*******************************************************************
+ * Function: ResolverThread                                        *
+ *                                                                 *
+ * Arguments: void* (unused)                                       *
+ *                                                                 *
+ * Returns: (void*) Always NULL.                                   *
+ *                                                                 *
+ * Description: The worker threads. Each one waits for a lookup to *
+ * be queued, calls getaddrinfo (which may block for seconds) and  *
+ * hands the result back to the loop which asked through its pipe. *
+ *                                                                 *
+ *******************************************************************/
+static void *ResolverThread(void *unused)
+{
+		SetLogThreadName("resolver");
+		pthread_mutex_lock(&lock);
+
+		for (;;)
+		{
+				while (!jobs.length && !stopping)
+						pthread_cond_wait(&wakeup, &lock);
+
+				if (stopping)
+						break;
+
+				// Take the oldest lookup off the queue.
+				lookup_t *lookup = vec_first(&jobs);
+				vec_splice(&jobs, 0, 1);
+				lookup->owner->running++;
+				pthread_mutex_unlock(&lock);
+
+				// Tell it what kind of socket(s) we want.
+				struct addrinfo hints, *servinfo = NULL;
+				memset(&hints, 0, sizeof(hints));
+				hints.ai_family = AF_UNSPEC;     // IPv4 or IPv6, we race them in ConnectSocket.
+				hints.ai_socktype = SOCK_STREAM; // Streaming socket.
+				hints.ai_flags = AI_ADDRCONFIG;  // Only give us families this host can actually use.
+
+				lookup->error = getaddrinfo(lookup->host, lookup->port, &hints, &servinfo);
+				if (!lookup->error)
+				{
+						lookup->result = SortAddresses(CopyAddresses(servinfo));
+						freeaddrinfo(servinfo);
+
+						if (!lookup->result)
+								lookup->error = EAI_MEMORY;
+				}
+
+				pthread_mutex_lock(&lock);
+				resolverloop_t *owner = lookup->owner;
+				// The list is threaded through the lookups so adding to it can't fail.
+				lookup->next = owner->finished;
+				owner->finished = lookup;
+
+				// Wake the event loop up. If the pipe is full it already has
+				// plenty of wake ups waiting so it doesn't matter if this fails.
+				char c = 0;
+				ssize_t written = write(owner->notifypipe[1], &c, 1);
+				(void)written;
+
+				// The loop may be waiting for us to finish so it can shut down.
+				if (!--owner->running)
+						pthread_cond_broadcast(&idle);
+		}
+
+		pthread_mutex_unlock(&lock);
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: FreeLookup                                            *
+ *                                                                 *
+ * Arguments: lookup_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void FreeLookup(lookup_t *lookup)
+{
+		FreeAddresses(lookup->result);
+		vec_sbo_deinit(&lookup->waiters);
+		free(lookup->host);
+		free(lookup->port);
+		free(lookup);
+}
+
+/*******************************************************************
+ * Function: FindCacheEntry                                        *
+ *                                                                 *
+ * Arguments: (const char*) host, (const char*) port               *
+ *                                                                 *
+ * Returns: (int) The index of the entry or -1 if there isn't one. *
+ *                                                                 *
+ *******************************************************************/
+static int FindCacheEntry(const char *host, const char *port)
+{
+		cacheentry_t *entry;
+		int i;
+		vec_foreach_ptr(&loop->cache, entry, i)
+		{
+				if (!strcmp(entry->host, host) && !strcmp(entry->port, port))
+						return i;
+		}
+
+		return -1;
+}
+
+/*******************************************************************
+ * Function: RemoveCacheEntry                                      *
+ *                                                                 *
+ * Arguments: (int) index                                          *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void RemoveCacheEntry(int idx)
+{
+		cacheentry_t *entry = &loop->cache.data[idx];
+		FreeAddresses(entry->adr);
+		free(entry->host);
+		free(entry->port);
+		vec_splice(&loop->cache, idx, 1);
+}
+
+/*******************************************************************
+ * Function: CacheLookup                                           *
+ *                                                                 *
+ * Arguments: lookup_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Remembers the answer to a finished lookup. Hosts   *
+ * which don't exist are remembered for a short while so a storm   *
+ * of reconnects to a typo doesn't hammer the DNS servers, other   *
+ * errors (eg, the DNS server timed out) are never cached.         *
+ *                                                                 *
+ *******************************************************************/
+static void CacheLookup(lookup_t *lookup)
+{
+		int ttl;
+		if (!lookup->error)
+				ttl = RESOLVER_CACHE_TTL;
+		else if (lookup->error == EAI_NONAME)
+				ttl = RESOLVER_NEGATIVE_TTL;
+		else
+				return;
+
+		int idx = FindCacheEntry(lookup->host, lookup->port);
+		if (idx != -1)
+				RemoveCacheEntry(idx);
+
+		cacheentry_t entry;
+		entry.host    = strdup(lookup->host);
+		entry.port    = strdup(lookup->port);
+		entry.adr     = lookup->result ? CopyAddresses(lookup->result) : NULL;
+		entry.error   = lookup->error;
+		entry.expires = GetMonotonicTime() + ttl * 1000;
+
+		// If we couldn't copy the addresses, just don't cache them.
+		if (!entry.host || !entry.port || (lookup->result && !entry.adr))
+		{
+				FreeAddresses(entry.adr);
+				free(entry.host);
+				free(entry.port);
+				return;
+		}
+
+		vec_push(&loop->cache, entry);
+}
+
+/*******************************************************************
+ * Function: ResolverEventHandler                                  *
+ *                                                                 *
+ * Arguments: (int) fd, (int) events, void* (unused)               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called by the event loop when a worker finished a  *
+ * lookup. Caches the answer and calls everyone waiting on it.     *
+ *                                                                 *
+ *******************************************************************/
+static void ResolverEventHandler(int fd, int events, void *unused)
+{
+		// Empty the pipe, we only care that we were woken up.
+		char buffer[64];
+		while (read(fd, buffer, sizeof(buffer)) > 0)
+				;
+
+		// Take everything the workers finished so we don't hold the lock while
+		// calling callbacks (which may well queue more lookups).
+		pthread_mutex_lock(&lock);
+		lookup_t *done = loop->finished;
+		loop->finished = NULL;
+		pthread_mutex_unlock(&lock);
+
+		// Answer them in the order they finished.
+		lookup_t *lookup = NULL;
+		while (done)
+		{
+				lookup_t *next = done->next;
+				done->next = lookup;
+				lookup = done;
+				done = next;
+		}
+
+		while (lookup)
+		{
+				lookup_t *next = lookup->next;
+				vec_remove(&loop->pending, lookup);
+				CacheLookup(lookup);
+
+				// Give everyone their own copy of the addresses.
+				loop->dispatching = lookup;
+				waiter_t *waiter;
+				int j;
+				vec_foreach_ptr(&lookup->waiters, waiter, j)
+				{
+						// Cancelled while we were calling an earlier waiter.
+						if (!waiter->callback)
+								continue;
+
+						struct addrinfo *adr = lookup->result ? CopyAddresses(lookup->result) : NULL;
+						int error = lookup->result && !adr ? EAI_MEMORY : lookup->error;
+						waiter->callback(adr, error, waiter->data);
+				}
+				loop->dispatching = NULL;
+
+				FreeLookup(lookup);
+				lookup = next;
+		}
+}
+
+/*******************************************************************
+ * Function: StartWorkers                                          *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Starts the worker threads for the first event loop *
+ * to use the resolver, later loops share them. Must be called     *
+ * with `startlock' held.                                          *
+ *                                                                 *
+ *******************************************************************/
+static int StartWorkers(void)
+{
+		if (users++)
+				return 1;
+
+		stopping = 0;
+
+		// Block every signal while we create the threads so they inherit that
+		// and signals (eg, ^C) keep being delivered to the event loop's thread.
+		sigset_t all, old;
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+
+		for (nthreads = 0; nthreads < RESOLVER_THREADS; ++nthreads)
+		{
+				int error = pthread_create(&threads[nthreads], NULL, ResolverThread, NULL);
+				if (error)
+				{
+						LogError("Failed to start a resolver thread: %s (%d)", strerror(error), error);
+						break;
+				}
+		}
+
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+		if (!nthreads)
+				users--;
+		return nthreads > 0;
+}
+
+/*******************************************************************
+ * Function: StopWorkers                                           *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Stops the worker threads once the last event loop  *
+ * using them is done. Must be called with `startlock' held.       *
+ *                                                                 *
+ *******************************************************************/
+static void StopWorkers(void)
+{
+		if (--users)
+				return;
+
+		pthread_mutex_lock(&lock);
+		stopping = 1;
+		pthread_cond_broadcast(&wakeup);
+		pthread_mutex_unlock(&lock);
+
+		for (int i = 0; i < nthreads; ++i)
+				pthread_join(threads[i], NULL);
+		nthreads = 0;
+		vec_deinit(&jobs);
+}
+
+/*******************************************************************
+ * Function: InitializeResolver                                    *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sets up the calling thread's pending lookups and   *
+ * cache and adds the pipe the workers wake it up with to its      *
+ * event loop, so InitializeEventLoop must be called first. The    *
+ * worker threads are started if no other thread did already.      *
+ *                                                                 *
+ *******************************************************************/
+int InitializeResolver(void)
+{
+		assert(!loop);
+
+		loop = calloc(1, sizeof(resolverloop_t));
+		if (!loop)
+				return 0;
+
+		vec_init(&loop->pending);
+		vec_init(&loop->cache);
+		loop->notifypipe[0] = loop->notifypipe[1] = -1;
+
+		// Neither end of the pipe may block: the workers must never wait on the
+		// event loop and the event loop must never wait on the workers.
+		if (pipe(loop->notifypipe) == -1)
+		{
+				LogError("Failed to create the resolver pipe: %s (%d)", strerror(errno), errno);
+				free(loop);
+				loop = NULL;
+				return 0;
+		}
+
+		for (int i = 0; i < 2; ++i)
+		{
+				fcntl(loop->notifypipe[i], F_SETFL, fcntl(loop->notifypipe[i], F_GETFL) | O_NONBLOCK);
+				fcntl(loop->notifypipe[i], F_SETFD, FD_CLOEXEC);
+		}
+
+		int registered = AddEventSource(loop->notifypipe[0], EVENT_READ, ResolverEventHandler, NULL);
+
+		pthread_mutex_lock(&startlock);
+		int started = registered && StartWorkers();
+		pthread_mutex_unlock(&startlock);
+
+		if (!started)
+		{
+				if (registered)
+						RemoveEventSource(loop->notifypipe[0]);
+				close(loop->notifypipe[0]);
+				close(loop->notifypipe[1]);
+				free(loop);
+				loop = NULL;
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: DestroyResolver                                       *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Forgets the calling thread's lookups (waiting for  *
+ * any the workers are in the middle of) and frees its cache. The  *
+ * worker threads are stopped once the last thread using them is   *
+ * gone. Nobody waiting on a lookup is called.                     *
+ *                                                                 *
+ *******************************************************************/
+int DestroyResolver(void)
+{
+		if (!loop)
+				return 1;
+
+		// Take our lookups the workers haven't started on off the queue and
+		// wait for the ones they have, they're writing into them.
+		pthread_mutex_lock(&lock);
+		for (int i = jobs.length - 1; i >= 0; --i)
+		{
+				if (jobs.data[i]->owner == loop)
+						vec_splice(&jobs, i, 1);
+		}
+
+		while (loop->running)
+				pthread_cond_wait(&idle, &lock);
+		pthread_mutex_unlock(&lock);
+
+		pthread_mutex_lock(&startlock);
+		StopWorkers();
+		pthread_mutex_unlock(&startlock);
+
+		// Every lookup is in `pending', whether it's queued or finished.
+		lookup_t *lookup;
+		int i;
+		vec_foreach(&loop->pending, lookup, i)
+				FreeLookup(lookup);
+
+		while (loop->cache.length)
+				RemoveCacheEntry(loop->cache.length - 1);
+
+		vec_deinit(&loop->pending);
+		vec_deinit(&loop->cache);
+
+		RemoveEventSource(loop->notifypipe[0]);
+		close(loop->notifypipe[0]);
+		close(loop->notifypipe[1]);
+
+		free(loop);
+		loop = NULL;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: LookupHostCache                                       *
+ *                                                                 *
+ * Arguments: (const char*) host, (const char*) port,              *
+ *            struct addrinfo**, int*                              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Checks whether we already know the answer for the  *
+ * host. Returns false if we don't (or the answer expired). If we  *
+ * do, `adr' is set to a copy of the addresses (free it with       *
+ * FreeAddresses) or to NULL with `error' set if the host doesn't  *
+ * exist.                                                          *
+ *                                                                 *
+ *******************************************************************/
+int LookupHostCache(const char *host, const char *port, struct addrinfo **adr, int *error)
+{
+		assert(host && port && adr && error && loop);
+
+		int idx = FindCacheEntry(host, port);
+		if (idx == -1)
+				return 0;
+
+		cacheentry_t *entry = &loop->cache.data[idx];
+		if (entry->expires <= GetMonotonicTime())
+		{
+				RemoveCacheEntry(idx);
+				return 0;
+		}
+
+		*adr = NULL;
+		*error = entry->error;
+
+		if (entry->adr)
+		{
+				*adr = CopyAddresses(entry->adr);
+				if (!*adr)
+						*error = EAI_MEMORY;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ResolveHost                                           *
+ *                                                                 *
+ * Arguments: (const char*) host, (const char*) port,              *
+ *            ResolveCallback, void*                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Looks the host up in the background. The callback  *
+ * is called from the calling thread's event loop once the lookup  *
+ * finished, never before ResolveHost returns. If the thread is    *
+ * already looking the same host up we just wait on that lookup,   *
+ * so a hundred sockets reconnecting to one network only cost one  *
+ * DNS query.                                                      *
+ *                                                                 *
+ *******************************************************************/
+int ResolveHost(const char *host, const char *port, ResolveCallback callback, void *data)
+{
+		assert(host && port && callback && loop);
+
+		waiter_t waiter = { callback, data };
+
+		// See if someone already asked for this host.
+		lookup_t *lookup;
+		int i;
+		vec_foreach(&loop->pending, lookup, i)
+		{
+				if (!strcmp(lookup->host, host) && !strcmp(lookup->port, port))
+						return vec_sbo_push(&lookup->waiters, waiter) == 0;
+		}
+
+		lookup = calloc(1, sizeof(lookup_t));
+		if (!lookup)
+				return 0;
+
+		lookup->owner = loop;
+		lookup->host = strdup(host);
+		lookup->port = strdup(port);
+		if (!lookup->host || !lookup->port)
+		{
+				FreeLookup(lookup);
+				return 0;
+		}
+
+		vec_sbo_init(&lookup->waiters);
+		if (vec_sbo_push(&lookup->waiters, waiter) || vec_push(&loop->pending, lookup))
+		{
+				FreeLookup(lookup);
+				return 0;
+		}
+
+		// Hand it to the first worker that's free.
+		pthread_mutex_lock(&lock);
+		int queued = vec_push(&jobs, lookup) == 0;
+		if (queued)
+				pthread_cond_signal(&wakeup);
+		pthread_mutex_unlock(&lock);
+
+		if (!queued)
+		{
+				// It was the last one pushed onto pending.
+				loop->pending.length--;
+				FreeLookup(lookup);
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: CancelResolve                                         *
+ *                                                                 *
+ * Arguments: ResolveCallback, void*                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Makes sure the callback is never called with this  *
+ * data pointer, eg. because the socket waiting on it is going     *
+ * away. The lookup itself carries on and its answer is cached.    *
+ *                                                                 *
+ *******************************************************************/
+void CancelResolve(ResolveCallback callback, void *data)
+{
+		// The resolver was already shut down, there's nothing to cancel.
+		if (!loop)
+				return;
+
+		lookup_t *lookup;
+		int i;
+		vec_foreach(&loop->pending, lookup, i)
+		{
+				for (int j = lookup->waiters.length - 1; j >= 0; --j)
+				{
+						waiter_t *waiter = &lookup->waiters.data[j];
+						if (waiter->callback == callback && waiter->data == data)
+								vec_splice(&lookup->waiters, j, 1);
+				}
+		}
+
+		// The lookup we're calling waiters for isn't pending anymore but it
+		// may still have waiters which haven't been called yet.
+		if (loop->dispatching)
+		{
+				waiter_t *waiter;
+				vec_foreach_ptr(&loop->dispatching->waiters, waiter, i)
+				{
+						if (waiter->callback == callback && waiter->data == data)
+								waiter->callback = NULL;
+				}
+		}
+}
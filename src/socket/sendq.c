@@ -0,0 +1,325 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Include our send queue types and function declarations.
+#include "socket/sendq.h"
+
+/*******************************************************************
+ * Function: InitializeSendQueue                                   *
+ *                                                                 *
+ * Arguments: sendq_t*, pool_t* (of SENDQ_CHUNK_SIZE objects)      *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Sets up an empty queue. Blocks come out of the     *
+ * pool if one is given, which has to hand out objects at least    *
+ * SENDQ_CHUNK_SIZE bytes big, otherwise out of malloc.            *
+ *                                                                 *
+ *******************************************************************/
+void InitializeSendQueue(sendq_t *q, pool_t *pool)
+{
+		assert(q && (!pool || pool->objsize >= SENDQ_CHUNK_SIZE));
+		memset(q, 0, sizeof(sendq_t));
+		vec_init(&q->chunks);
+		q->pool = pool;
+}
+
+/*******************************************************************
+ * Function: FreeChunk                                             *
+ *                                                                 *
+ * Arguments: sendq_t*, (char*) block                              *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void FreeChunk(sendq_t *q, char *data)
+{
+		if (q->pool)
+				PoolFree(q->pool, data);
+		else
+				free(data);
+}
+
+/*******************************************************************
+ * Function: ClearSendQueue                                        *
+ *                                                                 *
+ * Arguments: sendq_t*                                             *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Throws away everything waiting to be sent, eg.     *
+ * because the connection it was meant for is gone.                *
+ *                                                                 *
+ *******************************************************************/
+void ClearSendQueue(sendq_t *q)
+{
+		assert(q);
+
+		for (int i = q->head; i < q->chunks.length; ++i)
+				FreeChunk(q, q->chunks.data[i].data);
+
+		vec_clear(&q->chunks);
+		q->head = 0;
+		q->bytes = 0;
+}
+
+/*******************************************************************
+ * Function: DestroySendQueue                                      *
+ *                                                                 *
+ * Arguments: sendq_t*                                             *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+void DestroySendQueue(sendq_t *q)
+{
+		assert(q);
+		ClearSendQueue(q);
+		vec_deinit(&q->chunks);
+		FreeChunk(q, q->spare);
+		q->spare = NULL;
+}
+
+/*******************************************************************
+ * Function: NewChunk                                              *
+ *                                                                 *
+ * Arguments: sendq_t*                                             *
+ *                                                                 *
+ * Returns: (sendchunk_t*) The new (empty) block at the end of the *
+ * queue or NULL if we ran out of memory.                          *
+ *                                                                 *
+ *******************************************************************/
+static sendchunk_t *NewChunk(sendq_t *q)
+{
+		// Slide the live blocks back to the start of the array instead of
+		// growing it when there's room left over from blocks we've sent.
+		if (q->head > 0 && q->chunks.length == q->chunks.capacity)
+		{
+				memmove(q->chunks.data, q->chunks.data + q->head, (q->chunks.length - q->head) * sizeof(sendchunk_t));
+				q->chunks.length -= q->head;
+				q->head = 0;
+		}
+
+		sendchunk_t chunk = { q->spare, 0, 0 };
+		q->spare = NULL;
+
+		if (!chunk.data)
+				chunk.data = q->pool ? PoolAlloc(q->pool) : malloc(SENDQ_CHUNK_SIZE);
+
+		if (!chunk.data)
+				return NULL;
+
+		if (vec_push(&q->chunks, chunk))
+		{
+				FreeChunk(q, chunk.data);
+				return NULL;
+		}
+
+		return &vec_last(&q->chunks);
+}
+
+/*******************************************************************
+ * Function: AppendSendQueue                                       *
+ *                                                                 *
+ * Arguments: sendq_t*, (const void*) data, (size_t) length        *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Copies the data onto the end of the queue. It is   *
+ * packed in right behind whatever was queued before it so a       *
+ * burst of lines ends up in a few large blocks.                   *
+ *                                                                 *
+ *******************************************************************/
+int AppendSendQueue(sendq_t *q, const void *data, size_t len)
+{
+		assert(q && (data || !len));
+
+		const char *p = data;
+		while (len)
+		{
+				sendchunk_t *chunk = q->chunks.length > q->head ? &vec_last(&q->chunks) : NULL;
+
+				// The last block is full (or there isn't one), start another.
+				if (!chunk || chunk->end == SENDQ_CHUNK_SIZE)
+						if (!(chunk = NewChunk(q)))
+								return 0;
+
+				size_t room = SENDQ_CHUNK_SIZE - chunk->end;
+				size_t n = len < room ? len : room;
+				memcpy(chunk->data + chunk->end, p, n);
+
+				chunk->end += n;
+				q->bytes += n;
+				p += n;
+				len -= n;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: GatherSendQueue                                       *
+ *                                                                 *
+ * Arguments: sendq_t*, struct iovec*, (int) entries in the array, *
+ *            (size_t*) set to how many bytes they cover           *
+ *                                                                 *
+ * Returns: (int) How many entries were filled in.                 *
+ *                                                                 *
+ * Description: Points the array at the oldest blocks, ready to be *
+ * handed to the kernel. The blocks stay where they are until      *
+ * ConsumeSendQueue is told they were sent, data appended in the   *
+ * meantime goes after them and doesn't disturb them.              *
+ *                                                                 *
+ *******************************************************************/
+int GatherSendQueue(const sendq_t *q, struct iovec *iov, int max, size_t *bytes)
+{
+		assert(q && iov && bytes);
+
+		int count = 0;
+		*bytes = 0;
+		for (int i = q->head; i < q->chunks.length && count < max; ++i, ++count)
+		{
+				sendchunk_t *chunk = &q->chunks.data[i];
+				iov[count].iov_base = chunk->data + chunk->start;
+				iov[count].iov_len  = chunk->end - chunk->start;
+				*bytes += iov[count].iov_len;
+		}
+
+		return count;
+}
+
+/*******************************************************************
+ * Function: ConsumeSendQueue                                      *
+ *                                                                 *
+ * Arguments: sendq_t*, (size_t) bytes sent                        *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Drops what was sent off the front of the queue. If *
+ * a block was only partly sent we remember exactly where we got   *
+ * to so the next send carries on mid-line instead of putting a    *
+ * partial line on the wire.                                       *
+ *                                                                 *
+ *******************************************************************/
+void ConsumeSendQueue(sendq_t *q, size_t sent)
+{
+		assert(q && sent <= q->bytes);
+
+		q->bytes -= sent;
+
+		// Drop every block which was sent completely.
+		while (sent)
+		{
+				sendchunk_t *chunk = &q->chunks.data[q->head];
+				size_t remaining = chunk->end - chunk->start;
+				if (sent < remaining)
+				{
+						chunk->start += sent;
+						break;
+				}
+
+				sent -= remaining;
+
+				// Keep one empty block around for the next burst.
+				if (!q->spare)
+						q->spare = chunk->data;
+				else
+						FreeChunk(q, chunk->data);
+				q->head++;
+		}
+
+		if (q->head == q->chunks.length)
+		{
+				vec_clear(&q->chunks);
+				q->head = 0;
+		}
+}
+
+/*******************************************************************
+ * Function: FlushSendQueueWith                                    *
+ *                                                                 *
+ * Arguments: sendq_t*, SendFunction, void* (passed to it)         *
+ *                                                                 *
+ * Returns: (size_t) The number of bytes sent or -1 with errno set *
+ * on error (EAGAIN if there was no room for anything).            *
+ *                                                                 *
+ * Description: Hands as much of the queue to the send function as *
+ * it will take, up to SENDQ_MAX_IOV blocks per call.              *
+ *                                                                 *
+ *******************************************************************/
+size_t FlushSendQueueWith(sendq_t *q, SendFunction sender, void *data)
+{
+		assert(q);
+
+		size_t total = 0;
+
+		while (q->bytes)
+		{
+				struct iovec iov[SENDQ_MAX_IOV];
+				size_t wanted;
+				int count = GatherSendQueue(q, iov, SENDQ_MAX_IOV, &wanted);
+
+				ssize_t sent = sender(data, iov, count);
+				if (sent == -1)
+				{
+						if (errno == EINTR)
+								continue;
+
+						// We sent something before the kernel ran out of room, that's a success.
+						return total ? total : (size_t)-1;
+				}
+
+				total += sent;
+				ConsumeSendQueue(q, sent);
+
+				// Out of room, trying again would just get EAGAIN.
+				if ((size_t)sent < wanted)
+						break;
+		}
+
+		return total;
+}
+
+/*******************************************************************
+ * Function: SendDescriptor                                        *
+ *                                                                 *
+ * Arguments: void* (the file descriptor), const struct iovec*,    *
+ *            (int) count                                          *
+ *                                                                 *
+ * Returns: (ssize_t) What sendmsg returned.                       *
+ *                                                                 *
+ *******************************************************************/
+static ssize_t SendDescriptor(void *data, const struct iovec *iov, int count)
+{
+		// sendmsg is writev with flags, MSG_NOSIGNAL stops the kernel from
+		// killing us with SIGPIPE if the other end has gone away.
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov    = (struct iovec*)iov;
+		msg.msg_iovlen = count;
+
+		return sendmsg((int)(intptr_t)data, &msg, MSG_NOSIGNAL);
+}
+
+/*******************************************************************
+ * Function: FlushSendQueue                                        *
+ *                                                                 *
+ * Arguments: sendq_t*, (int) file descriptor                      *
+ *                                                                 *
+ * Returns: (size_t) The number of bytes sent or -1 with errno set *
+ * on error (EAGAIN if the kernel had no room for anything).       *
+ *                                                                 *
+ * Description: Hands as much of the queue to the kernel as it     *
+ * will take, see FlushSendQueueWith.                              *
+ *                                                                 *
+ *******************************************************************/
+size_t FlushSendQueue(sendq_t *q, int fd)
+{
+		return FlushSendQueueWith(q, SendDescriptor, (void*)(intptr_t)fd);
+}
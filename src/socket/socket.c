@@ -7,31 +7,92 @@
 #include <assert.h>
 #include <errno.h>
 #include <arpa/inet.h>
+#include <stdatomic.h>
 #include "vector/vec.h"
+#include "eventloop/eventloop.h"
+#include "socket/resolver.h"
+#include "socket/tls.h"
+#include "memory/pool.h"
+#include "hash/hashtable.h"
+#include "log/log.h"
 
 // Include our socket types and function declarations.
 #include "socket/socket.h"
 
-// A global vector to store our socket structures.
-vec_t(socket_t*) sockets;
+// A vector to store our socket structures. Like the event loop, this is
+// per thread: sockets belong to the thread which created them.
+_Thread_local vec_t(socket_t*) sockets;
 
-static const char *GetIPAddress(struct addrinfo *adr)
+// Sockets and everything of a fixed size that comes with them are kept in
+// pools so connecting and disconnecting over and over doesn't churn the heap.
+static _Thread_local pool_t socketpool;  // socket_t structures, one per cache line (or few).
+static _Thread_local pool_t addrpool;    // sockaddr_t for each socket's connected address.
+static _Thread_local pool_t chunkpool;   // Send queue blocks.
+
+// The id the next socket gets. Shared by every thread so ids are unique
+// across the whole process.
+static _Atomic uint64_t nextid = 1;
+
+// This thread's sockets by their id, see FindSocket.
+static _Thread_local hashtable_t socketids;
+
+/*******************************************************************
+ * Function: HashSocketId                                          *
+ *                                                                 *
+ * Arguments: (uint64_t) socket id                                 *
+ *                                                                 *
+ * Returns: (uint32_t) The id's hash.                              *
+ *                                                                 *
+ * Description: Ids are handed out in order, multiplying spreads   *
+ * them over the whole table.                                      *
+ *                                                                 *
+ *******************************************************************/
+static inline uint32_t HashSocketId(uint64_t id)
+{
+		return (uint32_t)((id * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/*******************************************************************
+ * Function: MatchSocketId                                         *
+ *                                                                 *
+ * Arguments: (const void*) the socket_t, (const void*) the id     *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Whether the socket has the id, for socketids.      *
+ *                                                                 *
+ *******************************************************************/
+static int MatchSocketId(const void *item, const void *key)
 {
-		// Buffer big enough to read a human-readable IPv6 address (more than enough room for IPv4)
-		static char txt[INET6_ADDRSTRLEN];
+		return ((const socket_t*)item)->id == *(const uint64_t*)key;
+}
 
-		// Clear the buffer to make sure it is completely empty from any previous IP address resolutions.
-		memset(txt, 0, sizeof(txt));
+/*******************************************************************
+ * Function: GetIPAddress                                          *
+ *                                                                 *
+ * Arguments: struct addrinfo*, (char*) buffer of at least         *
+ * INET6_ADDRSTRLEN bytes                                          *
+ *                                                                 *
+ * Returns: (const char*) The buffer, holding the address as text. *
+ *                                                                 *
+ * Description: Converts the binary form of the address into the   *
+ * human-readable form. The caller brings the buffer so every      *
+ * event loop thread can do this at once. An address we can't      *
+ * convert comes out as "?".                                       *
+ *                                                                 *
+ *******************************************************************/
+static const char *GetIPAddress(const struct addrinfo *adr, char *txt)
+{
+		// inet_ntop wants the address itself, not the sockaddr around it.
+		const void *addr = NULL;
+		if (adr->ai_family == AF_INET)
+				addr = &((const struct sockaddr_in*)adr->ai_addr)->sin_addr;
+		else if (adr->ai_family == AF_INET6)
+				addr = &((const struct sockaddr_in6*)adr->ai_addr)->sin6_addr;
 
-		// call inet_ntop to convert the binary form of the address to the human-readable form.
-		if (!inet_ntop(adr->ai_family, adr->ai_addr, txt, sizeof(txt)))
-		{
-				// We had an issue, tell the user about it for debug-reasons.
-				fprintf(stderr, "Failed to convert ip address from binary to text: %s (%d)\n", strerror(errno), errno);
-				return NULL;
-		}
+		if (!addr || !inet_ntop(adr->ai_family, addr, txt, INET6_ADDRSTRLEN))
+				strcpy(txt, "?");
 
-		// We now have our text address
 		return txt;
 }
 
@@ -52,6 +113,22 @@ int InitializeSockets(void)
 		// Initialize our global sockets variable so we can start
 		// adding data (eg, socket_t structures) to it.
 		vec_init(&sockets);
+
+		// Set up the pools the sockets are allocated from.
+		if (!InitializePool(&socketpool, sizeof(socket_t), POOL_CACHELINE, 0) ||
+			!InitializePool(&addrpool, sizeof(sockaddr_t), 0, 0) ||
+			!InitializePool(&chunkpool, SENDQ_CHUNK_SIZE, POOL_CACHELINE, 16))
+		{
+				LogError("Failed to initialize the socket pools");
+				return 0;
+		}
+
+		if (!InitializeHashTable(&socketids, 0))
+		{
+				LogError("Failed to initialize the socket table: %s (%d)", strerror(errno), errno);
+				return 0;
+		}
+
 		// Return that we succeeded the above operation.
 		return 1;
 }
@@ -73,206 +150,1395 @@ int DestroySockets(void)
 {
 		// Iterate over all our sockets and make sure they're closed
 		// so we don't leak file descriptors or memory.
-		socket_t *socket; // Socket variable used for iteration of our type
-		int i;           // 'i' for 'iterator' used to determine how many items we've iterated.
-		vec_foreach(&sockets, socket, i)
-		{
-				DestroySocket(socket);
-		}
+		// DestroySocket takes the socket out of the vector so keep destroying
+		// the last one until there are none left, this never moves anything.
+		while (sockets.length)
+				DestroySocket(vec_last(&sockets));
 
 		// Deallocate our global vector
 		vec_deinit(&sockets);
+		DestroyHashTable(&socketids);
+
+		// And the memory the sockets lived in.
+		DestroyPool(&chunkpool);
+		DestroyPool(&addrpool);
+		DestroyPool(&socketpool);
+
+		// The sessions we'd resume next time are no use once we exit.
+		DestroyTLS();
 		return 1;
 }
 
 /*******************************************************************
  * Function: CreateSocket                                          *
  *                                                                 *
- * Arguments: sockaddr_t union                                     *
+ * Arguments: (const char*) host, (const char*) port               *
  *                                                                 *
  * Returns: (socket_t) A pointer to the socket_t structure with a  *
  * newly created socket ready to start a connection or NULL if     *
  * there was an error creating the socket.                         *
  *                                                                 *
- * Description: Creates a socket with the operating system, ready  *
- * for a connection to be established over it. No data can be sent *
- * over this socket quite yet and must be called by ConnectSocket  *
- * before data may be sent or received.                            *
+ * Description: Creates a socket structure, ready for a            *
+ * connection to be established over it. No data can be sent over  *
+ * this socket quite yet and ConnectSocket must be called before   *
+ * data may be sent or received.                                   *
  *                                                                 *
  *******************************************************************/
+static void SocketTimerHandler(evtimer_t *timer, void *data);
 socket_t *CreateSocket(const char *host, const char *port)
 {
-		// Allocate the socket structure.
-		socket_t *sock = malloc(sizeof(socket_t));
-
-		// Tell it what kind of socket(s) we want.
-		struct addrinfo hints;
-		struct addrinfo *servinfo;
-		servinfo = malloc(sizeof(struct addrinfo));
-		hints.ai_family = AF_INET;       // IPv4 socket
-		hints.ai_socktype = SOCK_STREAM; // Streaming socket.
-		// Resolve the addresses
-		int rv = 1;
-		rv = getaddrinfo(host, port, &hints, &servinfo);
-		
-		// Check if there was an error and return a failure state.
-		if (rv != 0)
+		// Allocate the socket structure, PoolCalloc makes sure all the
+		// callbacks and pointers start out as NULL.
+		socket_t *sock = PoolCalloc(&socketpool);
+		if (!sock)
 				return NULL;
 
-		// Include the address information struct into our socket struct.
-		sock->adr = servinfo;
-		sock->sa->sa = *servinfo->ai_addr;
+		// Remember who we're connecting to, the host is looked up by ConnectSocket.
+		sock->host = strdup(host);
+		sock->port = (short int)atoi(port);
+		sock->sa = PoolCalloc(&addrpool);
 
-		// call the UNIX socket() syscall to acquire a file descriptor.
-		// here, we create a IPv4 socket (AF_INET), tell it that we want
-		// a streaming socket with dynamic-length packets, and tell it
-		// that we're using TCP/IP
-		sock->fd  = socket(sock->adr->ai_family, sock->adr->ai_socktype, sock->adr->ai_protocol);
+		// Sockets are labelled by who they connect to in the metrics.
+		char name[sizeof(sock->metrics->name)];
+		snprintf(name, sizeof(name), "%s:%s", host, port);
+		sock->metrics = CreateMetrics(METRICS_SOCKET, name);
 
-		// Check if the socket failed to be created.
-		if (sock->fd == -1)
-				return NULL;
+		// FindSocket looks sockets up by their id.
+		sock->id = atomic_fetch_add_explicit(&nextid, 1, memory_order_relaxed);
+
+		if (!sock->host || !sock->sa || !sock->metrics || !InitializeRecvBuffer(&sock->recvbuf, RECVBUF_SIZE) ||
+			!InsertHashItem(&socketids, HashSocketId(sock->id), sock))
+				goto fail;
+
+		InitializeSendQueue(&sock->sendq, &chunkpool);
+		InitializeFloodControl(&sock->flood);
+		InitializeTimer(&sock->timer, SocketTimerHandler, sock);
+
+		// We don't have a file descriptor until ConnectSocket picks an address.
+		sock->fd = -1;
+		sock->state = SOCKET_CLOSED;
+		sock->connecttimeout = SOCKET_CONNECT_TIMEOUT;
 
-		// Add the socket to the vector.
-		vec_push(&sockets, sock);
+		// Add the socket to the vector, remembering where it is so
+		// DestroySocket can take it out again without searching.
+		// DestroySocket swaps the last socket into this slot, so a socket
+		// which isn't in the vector must never be handed out.
+		sock->index = sockets.length;
+		if (vec_push(&sockets, sock))
+		{
+				RemoveHashItem(&socketids, HashSocketId(sock->id), MatchSocketId, &sock->id);
+				goto fail;
+		}
 
 		return sock;
+
+fail:
+		DestroyRecvBuffer(&sock->recvbuf);
+		DestroyMetrics(sock->metrics);
+		free(sock->host);
+		PoolFree(&addrpool, sock->sa);
+		PoolFree(&socketpool, sock);
+		return NULL;
 }
 
 /*******************************************************************
- * Function: ConnectSocket                                         *
+ * Function: OpenSocket                                            *
+ *                                                                 *
+ * Arguments: struct addrinfo*                                     *
+ *                                                                 *
+ * Returns: (int) A non-blocking file descriptor or -1 on error.   *
+ *                                                                 *
+ * Description: Asks the kernel for a socket which can talk to the *
+ * address given. The socket is non-blocking so that connect(),    *
+ * read() and send() never put the whole bot to sleep waiting on   *
+ * a single slow server.                                           *
+ *                                                                 *
+ *******************************************************************/
+static int OpenSocket(struct addrinfo *adr)
+{
+		// call the UNIX socket() syscall to acquire a file descriptor.
+		// here, we create a socket with the family the address needs (IPv4 or
+		// IPv6), tell it that we want a streaming socket with dynamic-length
+		// packets, and tell it that we're using TCP/IP
+#ifdef SOCK_NONBLOCK
+		// Linux and the BSDs let us make the socket non-blocking in the same syscall.
+		return socket(adr->ai_family, adr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, adr->ai_protocol);
+#else
+		int fd = socket(adr->ai_family, adr->ai_socktype, adr->ai_protocol);
+		if (fd == -1)
+				return -1;
+
+		// Everyone else has to use fcntl to set the flags afterwards.
+		if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1 || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+		{
+				close(fd);
+				return -1;
+		}
+
+		return fd;
+#endif
+}
+
+/*******************************************************************
+ * Function: ReceivesThroughRing                                   *
+ *                                                                 *
+ * Arguments: (const socket_t*)                                    *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Whether the event loop reads for us, which it only *
+ * does on plaintext connections. kTLS only has the kernel do the  *
+ * encrypting, what we receive still goes through OpenSSL.         *
+ *                                                                 *
+ *******************************************************************/
+static int ReceivesThroughRing(const socket_t *sock)
+{
+		return sock->ringio && !sock->ssl;
+}
+
+/*******************************************************************
+ * Function: SendsThroughRing                                      *
+ *                                                                 *
+ * Arguments: (const socket_t*)                                    *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Whether the event loop sends for us, which it does *
+ * whenever what we send goes to the kernel as it is: on plaintext *
+ * connections and when kTLS does the encrypting.                  *
+ *                                                                 *
+ *******************************************************************/
+static int SendsThroughRing(const socket_t *sock)
+{
+		return sock->ringio && (!sock->ssl || sock->offloaded);
+}
+
+/*******************************************************************
+ * Function: StartRingSend                                         *
  *                                                                 *
  * Arguments: socket_t*                                            *
  *                                                                 *
- * Returns: (boolean) Attempts to connect to the resolved host for *
- * the addresses provided and returns a boolean on whether it was  *
- * successful or not.                                              *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
  *                                                                 *
- * Description: Creates a connection to a socket so data can be    *
- * transmitted over a connection. Once this function is successfully
- * called then the read and write functions can be used.           *
+ * Description: Hands the front of the send queue to the event     *
+ * loop to send, unless it's still busy with the last send. The    *
+ * rest goes once FlushSocket hears how much of that was sent.     *
  *                                                                 *
  *******************************************************************/
-int ConnectSocket(socket_t *sock)
+static int StartRingSend(socket_t *sock)
 {
-		// Make sure someone didn't biff.
-		assert(sock);
+		if (sock->sending || !sock->sendq.bytes)
+				return 1;
+
+		size_t bytes;
+		memset(&sock->sendhdr, 0, sizeof(sock->sendhdr));
+		sock->sendhdr.msg_iov    = sock->sendiov;
+		sock->sendhdr.msg_iovlen = GatherSendQueue(&sock->sendq, sock->sendiov, SENDQ_MAX_IOV, &bytes);
+
+		if (!SendOnEventSource(sock->fd, &sock->sendhdr))
+		{
+				LogError("Failed to send bytes to socket %d: %s (%d)", sock->fd, strerror(errno), errno);
+				return 0;
+		}
+
+		sock->sending = 1;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: WatchWritable                                         *
+ *                                                                 *
+ * Arguments: socket_t*, (size_t) bytes queued before              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: If the send queue just stopped being empty the     *
+ * event loop isn't watching for us to become writable yet, so ask *
+ * it to. If it sends for us, the data is handed straight over.    *
+ *                                                                 *
+ *******************************************************************/
+static int WatchWritable(socket_t *sock, size_t queued)
+{
+		if (!sock->registered)
+				return 1;
+
+		if (SendsThroughRing(sock))
+				return StartRingSend(sock);
+
+		if (queued || !sock->sendq.bytes)
+				return 1;
+
+		return UpdateSocket(sock, EVENT_READ | EVENT_WRITE);
+}
+
+/*******************************************************************
+ * Function: GetSocketDeadline                                     *
+ *                                                                 *
+ * Arguments: (const socket_t*)                                    *
+ *                                                                 *
+ * Returns: (int64_t) When (in monotonic milliseconds) the socket  *
+ * next has something to do, or -1 if it's not waiting on any.     *
+ *                                                                 *
+ * Description: That's the flood limits letting the next message   *
+ * through while connected, the handshake timing out, or an        *
+ * attempt timing out or the next address being raced while        *
+ * we're connecting.                                               *
+ *                                                                 *
+ *******************************************************************/
+static int64_t GetSocketDeadline(const socket_t *sock)
+{
+		if (sock->state == SOCKET_CONNECTED)
+				return GetFloodDeadline(&sock->flood);
+
+		if (sock->state == SOCKET_HANDSHAKING)
+				return sock->handshakedeadline;
+
+		if (sock->state != SOCKET_CONNECTING)
+				return -1;
+
+		int64_t deadline = sock->nextaddr ? sock->nextattempt : -1;
+
+		const connattempt_t *attempt;
+		int i;
+		vec_foreach_ptr(&sock->attempts, attempt, i)
+		{
+				if (deadline == -1 || attempt->deadline < deadline)
+						deadline = attempt->deadline;
+		}
+
+		return deadline;
+}
+
+/*******************************************************************
+ * Function: ArmSocketTimer                                        *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Makes the socket's timer due at its next deadline. *
+ * Called whenever one of the deadlines was set, a timer which     *
+ * fires early because a deadline went away just finds nothing to  *
+ * do and is armed again.                                          *
+ *                                                                 *
+ *******************************************************************/
+static void ArmSocketTimer(socket_t *sock)
+{
+		int64_t deadline = GetSocketDeadline(sock);
+
+		if (deadline == -1)
+				StopTimer(&sock->timer);
+		else if (!IsTimerPending(&sock->timer) || sock->timer.deadline != deadline)
+				StartTimerAt(&sock->timer, deadline);
+}
+
+/*******************************************************************
+ * Function: EndFloodStall                                         *
+ *                                                                 *
+ * Arguments: socket_t*, (int64_t) now                             *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Counts how long the flood limits held messages     *
+ * back for, once they've all gone out (or were thrown away).      *
+ *                                                                 *
+ *******************************************************************/
+static void EndFloodStall(socket_t *sock, int64_t now)
+{
+		AddMetric(sock->metrics, METRIC_FLOOD_STALL, now - sock->stallcounted);
+		RecordMetric(threadmetrics, HISTOGRAM_FLOOD_STALL, (uint64_t)(now - sock->stalled) * 1000);
+		sock->stalled = 0;
+}
+
+/*******************************************************************
+ * Function: ReleaseSocketMessages                                 *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Moves the messages the server's flood limits allow *
+ * right now onto the send queue.                                  *
+ *                                                                 *
+ *******************************************************************/
+static void ReleaseSocketMessages(socket_t *sock)
+{
+		if (sock->state != SOCKET_CONNECTED)
+				return;
+
+		int64_t now = GetMonotonicTime();
+		size_t queued = sock->sendq.bytes;
+		if (ReleaseFloodMessages(&sock->flood, now, &sock->sendq))
+				WatchWritable(sock, queued);
 
-		// Check to make sure we connected to something.
-		int ConnectionSuccessful = 0;
+		// Keep track of how long the flood limits hold us back for.
+		int waiting = GetFloodQueued(&sock->flood);
+		if (waiting && !sock->stalled)
+				sock->stalled = sock->stallcounted = now;
+		else if (waiting)
+		{
+				// Count long stalls as they go, not only once they're over.
+				AddMetric(sock->metrics, METRIC_FLOOD_STALL, now - sock->stallcounted);
+				sock->stallcounted = now;
+		}
+		else if (sock->stalled)
+				EndFloodStall(sock, now);
+
+		SetMetric(sock->metrics, METRIC_FLOOD_QUEUED, waiting);
+		SetMetric(sock->metrics, METRIC_SENDQ_BYTES, sock->sendq.bytes);
+
+		// Wake up when the flood limits let the next one through.
+		ArmSocketTimer(sock);
+}
 
+/*******************************************************************
+ * Function: StartAttempt                                          *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Starts a connection attempt to the next address we *
+ * haven't tried, skipping over any which fail straight away.      *
+ * Returns false once we've run out of addresses to try. The       *
+ * event loop tells us (through AttemptEventHandler) how it went.  *
+ *                                                                 *
+ *******************************************************************/
+static void AttemptEventHandler(int fd, int events, void *data);
+static int StartAttempt(socket_t *sock)
+{
 		// Since some hostnames can resolve to multiple addresses (eg, Round-Robin DNS)
-		// this for-loop is required to iterate to one which works.
-		for (struct addrinfo *adr = sock->adr; adr; adr = adr->ai_next)
+		// this loop is required to iterate to one which works.
+		while (sock->nextaddr)
 		{
-				// Here we check if connect failed, if it did, print an error and continue
-				// otherwise we set the ConnectionSuccessful variable to indicate we can leave the loop.
-				if (connect(sock->fd, adr->ai_addr, adr->ai_addrlen) == -1)
+				struct addrinfo *adr = sock->nextaddr;
+				sock->nextaddr = adr->ai_next;
+
+				char ip[INET6_ADDRSTRLEN];
+				int fd = OpenSocket(adr);
+				if (fd == -1)
+				{
+						LogError("Failed to create a socket for %s:%hd: %s (%d)", GetIPAddress(adr, ip), sock->port, strerror(errno), errno);
+						continue;
+				}
+
+				// A non-blocking connect returns EINPROGRESS straight away and the
+				// kernel carries on connecting in the background. Anything else is
+				// a real error (eg, the network is unreachable) so try the next one.
+				if (connect(fd, adr->ai_addr, adr->ai_addrlen) == -1 && errno != EINPROGRESS)
 				{
-						// Print to stderr instead of stdout for shell-routing reasons.
-						fprintf(stderr, "Connection to %s:%hd was unsuccessful: %s (%d)\n", GetIPAddress(adr), sock->port, strerror(errno), errno);
+						LogWarning("Connection to %s:%hd was unsuccessful: %s (%d)", GetIPAddress(adr, ip), sock->port, strerror(errno), errno);
+						close(fd);
+						continue;
 				}
-				else
+
+				// The socket becomes writable once the kernel is done connecting.
+				if (!AddEventSource(fd, EVENT_WRITE, AttemptEventHandler, sock))
 				{
-						// Our connection was a success, set the variable and break from the loop.
-						ConnectionSuccessful = 1;
-						break;
+						close(fd);
+						continue;
 				}
-		}
 
-		// Did we find a successful address to connect to?
-		if (!ConnectionSuccessful)
-		{
-				fprintf(stderr, "Failed to find an address to connect to successfully from host %s:%hd\n", sock->host, sock->port);
-				return 0;
+				int64_t now = GetMonotonicTime();
+				connattempt_t attempt = { fd, adr, now + sock->connecttimeout };
+				if (vec_sbo_push(&sock->attempts, attempt))
+				{
+						RemoveEventSource(fd);
+						close(fd);
+						continue;
+				}
+
+				// If this one hasn't connected in a little while, start on the next one too.
+				sock->nextattempt = now + SOCKET_ATTEMPT_DELAY;
+				ArmSocketTimer(sock);
+				return 1;
 		}
 
-		return 1;
+		// Out of addresses, the attempts still racing may give up yet.
+		ArmSocketTimer(sock);
+		return 0;
 }
 
 /*******************************************************************
- * Function: DestroySocket                                         *
+ * Function: DropAttempt                                           *
  *                                                                 *
- * Arguments: socket_t*                                            *
+ * Arguments: socket_t*, (int) index, (int) error number           *
  *                                                                 *
  * Returns: (void) No return.                                      *
  *                                                                 *
- * Description: Destroys the socket structure safely and           *
- * deallocates any resources used by the structure.                *
+ * Description: Gives up on a connection attempt. An error number  *
+ * of 0 means the attempt is being dropped because another one won *
+ * the race, anything else is printed.                             *
  *                                                                 *
  *******************************************************************/
-void DestroySocket(socket_t *sock)
+static void DropAttempt(socket_t *sock, int idx, int error)
 {
-		assert(sock);
-		
-		// Close the socket so we don't have an untracked file descriptors
-		close(sock->fd);
+		connattempt_t *attempt = &sock->attempts.data[idx];
 
-		// Deallocate anything we allocated.
-		if (sock->adr)
-				freeaddrinfo(sock->adr);
+		char ip[INET6_ADDRSTRLEN];
+		if (error)
+				LogWarning("Connection to %s:%hd was unsuccessful: %s (%d)", GetIPAddress(attempt->adr, ip), sock->port, strerror(error), error);
 
-		if (sock->host)
-				free(sock->host);
+		RemoveEventSource(attempt->fd);
+		close(attempt->fd);
+		vec_splice(&sock->attempts, idx, 1);
+}
+
+/*******************************************************************
+ * Function: ContinueConnect                                       *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called after an attempt failed. Starts the next    *
+ * address straight away instead of waiting out the attempt delay, *
+ * and if nothing is left racing then the whole connection failed  *
+ * and we call the socket's OnError callback.                      *
+ *                                                                 *
+ *******************************************************************/
+static void ContinueConnect(socket_t *sock)
+{
+		if (StartAttempt(sock) || sock->attempts.length)
+				return;
 
-		// Finally, deallocate the socket structure itself.
-		free(sock);
+		sock->state = SOCKET_CLOSED;
+		LogError("Failed to find an address to connect to successfully from host %s:%hd", sock->host, sock->port);
 
-		// Remove it out of the vector.
-		vec_remove(&sockets, sock);
+		if (sock->OnError)
+				sock->OnError(sock);
 }
 
 /*******************************************************************
- * Function: ReadSocket                                            *
+ * Function: FinishConnect                                         *
  *                                                                 *
- * Arguments: socket_t*, void*, size_t                             *
+ * Arguments: socket_t*                                            *
  *                                                                 *
- * Returns: (size_t) Returns the number of bytes read or -1 for an *
- * error status from errno.                                        *
+ * Returns: (void) No return.                                      *
  *                                                                 *
- * Description: Reads data from a socket and fills the buffer,     *
- * once the buffer is filled, it returns the number of bytes read  *
- * from the socket or it returns -1 upon an error condition.       *
+ * Description: Called once the connection is ready for data (the  *
+ * TLS handshake is done too if there was one), hands the socket   *
+ * to the event loop and tells the owner.                          *
  *                                                                 *
  *******************************************************************/
-size_t ReadSocket(socket_t *sock, void *buffer, size_t bufferlen)
+static void FinishConnect(socket_t *sock)
 {
-		assert(buffer && sock);
+		sock->state = SOCKET_CONNECTED;
 
-		// Fill the buffer with bytes from the socket
-		size_t bytes = read(sock->fd, buffer, bufferlen);
-		// Check for errors
-		if (bytes == -1UL)
-				fprintf(stderr, "Failed to read bytes from socket %d: %s (%d)\n", sock->fd, strerror(errno), errno);
+		// Don't let half a line from an old connection get glued onto the new one.
+		ResetRecvBuffer(&sock->recvbuf);
 
-		// Return the number of bytes, if bytes == -1 then we had an error and should
-		// handle accordingly in the functions which call this function.
-		return bytes;
+		// The server starts a fresh penalty timer for every connection.
+		sock->flood.timer = 0;
+		ReleaseSocketMessages(sock);
+
+		// Now we only care about data arriving, unless something was
+		// written while we were still connecting. If the event loop reads
+		// and writes for us, it starts on both straight away instead.
+		sock->ringio = EventLoopDoesIO();
+		int events = ReceivesThroughRing(sock) ? 0 : EVENT_READ;
+		if (sock->sendq.bytes && !SendsThroughRing(sock))
+				events |= EVENT_WRITE;
+
+		if (!RegisterSocket(sock, events) || !ContinueReceiving(sock) || !StartRingSend(sock))
+		{
+				sock->state = SOCKET_CLOSED;
+				if (sock->OnError)
+						sock->OnError(sock);
+				return;
+		}
+
+		if (sock->OnConnected)
+				sock->OnConnected(sock);
 }
 
 /*******************************************************************
- * Function: WriteSocket                                           *
+ * Function: FailHandshake                                         *
  *                                                                 *
- * Arguments: socket_t*, const void*, size_t                       *
+ * Arguments: socket_t*                                            *
  *                                                                 *
- * Returns: (size_t) Returns the number of bytes written to the    *
- * socket or -1 for an error condition.                            *
+ * Returns: (void) No return.                                      *
  *                                                                 *
- * Description: The inverse of the `ReadSocket` function in that   *
- * it writes data to the socket. It returns -1 upon failure and    *
- * returns the number of bytes written upon success.               *
+ * Description: Gives up on the connection after the TLS handshake *
+ * didn't work out and calls the socket's OnError callback.        *
  *                                                                 *
  *******************************************************************/
-size_t WriteSocket(socket_t *sock, const void *buffer, size_t bufferlen)
+static void FailHandshake(socket_t *sock)
 {
-		assert(sock && buffer);
+		RemoveEventSource(sock->fd);
+		CloseTLS(sock);
+		close(sock->fd);
+		sock->fd = -1;
+		sock->state = SOCKET_CLOSED;
 
-		// Write the buffer out the socket and return how many bytes we
-		// wrote or any error codes if we had an error.
-		size_t bytes = send(sock->fd, buffer, bufferlen, 0);
-		// error check again
-		if (bytes == -1UL)
-				fprintf(stderr, "Failed to send bytes to socket %d: %s (%d)\n", sock->fd, strerror(errno), errno);
+		if (sock->OnError)
+				sock->OnError(sock);
+}
 
-		return bytes;
+/*******************************************************************
+ * Function: HandshakeEventHandler                                 *
+ *                                                                 *
+ * Arguments: (int) fd, (int) events, void* (the socket_t)         *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called by the event loop whenever the server has   *
+ * answered (or there's room to send it more) during the TLS       *
+ * handshake. We only ever watch for whichever of the two OpenSSL  *
+ * is waiting on.                                                  *
+ *                                                                 *
+ *******************************************************************/
+static void HandshakeEventHandler(int fd, int events, void *data)
+{
+		socket_t *sock = data;
+
+		int wanted;
+		if (ContinueTLSHandshake(sock, &wanted))
+		{
+				RemoveEventSource(fd);
+				FinishConnect(sock);
+				return;
+		}
+
+		if (errno != EAGAIN || !ModifyEventSource(fd, wanted))
+				FailHandshake(sock);
+}
+
+/*******************************************************************
+ * Function: StartHandshake                                        *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Starts the TLS handshake once the connection has   *
+ * been made. It finishes in the event loop and gets as long as a  *
+ * connection attempt does.                                        *
+ *                                                                 *
+ *******************************************************************/
+static void StartHandshake(socket_t *sock)
+{
+		sock->state = SOCKET_HANDSHAKING;
+		sock->handshakedeadline = GetMonotonicTime() + sock->connecttimeout;
+		ArmSocketTimer(sock);
+
+		if (!StartTLS(sock))
+		{
+				close(sock->fd);
+				sock->fd = -1;
+				sock->state = SOCKET_CLOSED;
+
+				if (sock->OnError)
+						sock->OnError(sock);
+				return;
+		}
+
+		// We speak first: the socket is writable straight away and that's
+		// when the ClientHello goes out.
+		if (!AddEventSource(sock->fd, EVENT_WRITE, HandshakeEventHandler, sock))
+		{
+				CloseTLS(sock);
+				close(sock->fd);
+				sock->fd = -1;
+				sock->state = SOCKET_CLOSED;
+
+				if (sock->OnError)
+						sock->OnError(sock);
+		}
+}
+
+/*******************************************************************
+ * Function: AttemptEventHandler                                   *
+ *                                                                 *
+ * Arguments: (int) fd, (int) events, void* (the socket_t)         *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called by the event loop when one of the racing    *
+ * attempts became writable. Asks the kernel whether the connect   *
+ * worked. The first attempt to succeed wins: every other attempt  *
+ * is closed and the winner's descriptor becomes the socket's.     *
+ *                                                                 *
+ *******************************************************************/
+static void AttemptEventHandler(int fd, int events, void *data)
+{
+		socket_t *sock = data;
+
+		// Find which of the attempts this is, there's only ever a few.
+		int idx;
+		for (idx = 0; idx < sock->attempts.length; ++idx)
+				if (sock->attempts.data[idx].fd == fd)
+						break;
+
+		assert(idx < sock->attempts.length);
+
+		// SO_ERROR holds the result of the connect() we started earlier.
+		int error = 0;
+		socklen_t len = sizeof(error);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+				error = errno;
+
+		if (error)
+		{
+				DropAttempt(sock, idx, error);
+				ContinueConnect(sock);
+				return;
+		}
+
+		// We have a winner! Remember where we connected to.
+		connattempt_t winner = sock->attempts.data[idx];
+		memcpy(sock->sa, winner.adr->ai_addr, winner.adr->ai_addrlen);
+		RemoveEventSource(winner.fd);
+		vec_splice(&sock->attempts, idx, 1);
+
+		// Everyone else lost the race.
+		while (sock->attempts.length)
+				DropAttempt(sock, sock->attempts.length - 1, 0);
+
+		sock->fd       = winner.fd;
+		sock->nextaddr = NULL;
+
+		if (sock->tls)
+				StartHandshake(sock);
+		else
+				FinishConnect(sock);
+}
+
+/*******************************************************************
+ * Function: RotateAddresses                                       *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Re-links the socket's addresses so the one after   *
+ * the address we were last connected to comes first. When a       *
+ * server splits from its network every client it had reconnects   *
+ * at once, this spreads us over the other servers behind the name *
+ * instead of everyone trying the same one first.                  *
+ *                                                                 *
+ *******************************************************************/
+static void RotateAddresses(socket_t *sock)
+{
+		struct addrinfo *last = sock->adr;
+		for (; last; last = last->ai_next)
+		{
+				if (last->ai_addrlen <= sizeof(sockaddr_t) && !memcmp(last->ai_addr, sock->sa, last->ai_addrlen))
+						break;
+		}
+
+		// Never connected, or the one after it is already first.
+		if (!last || !last->ai_next)
+				return;
+
+		struct addrinfo *tail = last->ai_next;
+		while (tail->ai_next)
+				tail = tail->ai_next;
+
+		tail->ai_next = sock->adr;
+		sock->adr = last->ai_next;
+		last->ai_next = NULL;
+}
+
+/*******************************************************************
+ * Function: UseAddresses                                          *
+ *                                                                 *
+ * Arguments: socket_t*, struct addrinfo*, (int) error             *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Replaces the socket's addresses with the ones we   *
+ * just looked up. If the lookup failed we keep the addresses from *
+ * the last time, a DNS outage shouldn't stop us reconnecting to   *
+ * servers which are most likely still there. Returns false if     *
+ * there are no addresses to connect to at all.                    *
+ *                                                                 *
+ *******************************************************************/
+static int UseAddresses(socket_t *sock, struct addrinfo *adr, int error)
+{
+		if (adr)
+		{
+				if (sock->adr)
+						FreeAddresses(sock->adr);
+				sock->adr = adr;
+				return 1;
+		}
+
+		LogError("Failed to resolve %s:%hd: %s", sock->host, sock->port, gai_strerror(error));
+
+		if (!sock->adr)
+				return 0;
+
+		LogWarning("Trying the addresses we had for %s:%hd instead", sock->host, sock->port);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: BeginConnect                                          *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Starts racing the socket's addresses once we know  *
+ * what they are.                                                  *
+ *                                                                 *
+ *******************************************************************/
+static int BeginConnect(socket_t *sock)
+{
+		RotateAddresses(sock);
+
+		sock->state    = SOCKET_CONNECTING;
+		sock->nextaddr = sock->adr;
+
+		if (!StartAttempt(sock))
+		{
+				sock->state = SOCKET_CLOSED;
+				LogError("Failed to find an address to connect to successfully from host %s:%hd", sock->host, sock->port);
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: OnHostResolved                                        *
+ *                                                                 *
+ * Arguments: struct addrinfo*, (int) error, void* (the socket_t)  *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called by the resolver once it looked up the host  *
+ * of a socket which is waiting to connect.                        *
+ *                                                                 *
+ *******************************************************************/
+static void OnHostResolved(struct addrinfo *adr, int error, void *data)
+{
+		socket_t *sock = data;
+
+		if (!UseAddresses(sock, adr, error))
+		{
+				sock->state = SOCKET_CLOSED;
+
+				if (sock->OnError)
+						sock->OnError(sock);
+				return;
+		}
+
+		if (!BeginConnect(sock) && sock->OnError)
+				sock->OnError(sock);
+}
+
+/*******************************************************************
+ * Function: ConnectSocket                                         *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (boolean) Starts connecting to the host and returns    *
+ * whether a connection attempt is now in progress.                *
+ *                                                                 *
+ * Description: Starts a connection to the host so data can be     *
+ * transmitted over it. A socket which was connected before must   *
+ * be closed with CloseSocket first. The host's addresses come     *
+ * from the resolver's cache, or are looked up in the background   *
+ * if we don't know them (or they expired). The addresses are then *
+ * raced against each other as RFC 8305 (Happy Eyeballs)           *
+ * describes: a new address is tried every SOCKET_ATTEMPT_DELAY    *
+ * milliseconds (or straight away when one fails) and the first to *
+ * connect wins. The connection is finished in the background by   *
+ * the event loop: OnConnected is called once it is established,   *
+ * or OnError if every address failed.                             *
+ *                                                                 *
+ *******************************************************************/
+int ConnectSocket(socket_t *sock)
+{
+		// Make sure someone didn't biff.
+		assert(sock && sock->state == SOCKET_CLOSED);
+
+		char port[8];
+		snprintf(port, sizeof(port), "%hu", (unsigned short)sock->port);
+
+		// The addresses from the last time we connected are only replaced once
+		// we know what the host's addresses are now, the cache knows whether
+		// they're still good.
+		struct addrinfo *adr;
+		int error;
+		if (LookupHostCache(sock->host, port, &adr, &error))
+		{
+				if (!UseAddresses(sock, adr, error))
+						return 0;
+
+				return BeginConnect(sock);
+		}
+
+		// We have to ask the DNS servers, this finishes in the event loop.
+		if (!ResolveHost(sock->host, port, OnHostResolved, sock))
+				return 0;
+
+		sock->state = SOCKET_RESOLVING;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: SocketTimerHandler                                    *
+ *                                                                 *
+ * Arguments: evtimer_t*, void* (the socket_t)                     *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called by the event loop once the socket's next    *
+ * deadline is due. Gives up on connection attempts or handshakes  *
+ * which took longer than their timeout, starts racing the next    *
+ * address once the attempt delay has passed and sends messages    *
+ * the flood limits were holding back. Whatever we call sets the   *
+ * timer for the next deadline, unless it destroyed the socket.    *
+ *                                                                 *
+ *******************************************************************/
+static void SocketTimerHandler(evtimer_t *timer, void *data)
+{
+		socket_t *sock = data;
+		int64_t now = GetMonotonicTime();
+
+		if (sock->state == SOCKET_CONNECTED)
+		{
+				ReleaseSocketMessages(sock);
+				return;
+		}
+
+		if (sock->state == SOCKET_HANDSHAKING && sock->handshakedeadline <= now)
+		{
+				LogError("TLS handshake with %s:%hd timed out", sock->host, sock->port);
+				FailHandshake(sock);
+				return;
+		}
+
+		if (sock->state == SOCKET_CONNECTING)
+		{
+				int failed = 0;
+				for (int j = sock->attempts.length - 1; j >= 0; --j)
+				{
+						if (sock->attempts.data[j].deadline <= now)
+						{
+								DropAttempt(sock, j, ETIMEDOUT);
+								failed = 1;
+						}
+				}
+
+				if (failed)
+				{
+						ContinueConnect(sock);
+						return;
+				}
+
+				if (sock->nextaddr && sock->nextattempt <= now)
+				{
+						StartAttempt(sock);
+						return;
+				}
+		}
+
+		// We were woken up early, the deadline must have moved.
+		ArmSocketTimer(sock);
+}
+
+/*******************************************************************
+ * Function: FindSocket                                            *
+ *                                                                 *
+ * Arguments: (uint64_t) socket id                                 *
+ *                                                                 *
+ * Returns: (socket_t*) The socket with the id or NULL if it has   *
+ * been destroyed (or belongs to another thread).                  *
+ *                                                                 *
+ * Description: Lets code which only kept a socket's id (eg, a     *
+ * worker thread replying to a message) find out whether the       *
+ * socket is still there. Every reply looks its socket up so this  *
+ * is a hash table lookup rather than a walk over the sockets.     *
+ *                                                                 *
+ *******************************************************************/
+socket_t *FindSocket(uint64_t id)
+{
+		return FindHashItem(&socketids, HashSocketId(id), MatchSocketId, &id);
+}
+
+/*******************************************************************
+ * Function: CloseSocket                                           *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Closes the connection (or stops connecting) but    *
+ * keeps the socket so ConnectSocket can be called on it again.    *
+ * The host's addresses, the buffers and the callbacks stay, what  *
+ * was still waiting to be sent is thrown away. The socket gets a  *
+ * new id so nothing meant for the old connection finds the next.  *
+ *                                                                 *
+ *******************************************************************/
+void CloseSocket(socket_t *sock)
+{
+		assert(sock);
+
+		// Stop the event loop from telling us about a connection which is going
+		// away. It's done with our buffers once this returns.
+		UnregisterSocket(sock);
+		StopTimer(&sock->timer);
+		sock->ringio = sock->receiving = sock->sending = 0;
+
+		// The handshake is watched directly rather than through the socket.
+		if (sock->state == SOCKET_HANDSHAKING)
+				RemoveEventSource(sock->fd);
+
+		// Say goodbye to the server if we were talking TLS.
+		CloseTLS(sock);
+
+		// Close the socket so we don't have an untracked file descriptors
+		if (sock->fd != -1)
+				close(sock->fd);
+		sock->fd = -1;
+
+		// Stop any connection attempts which are still racing.
+		while (sock->attempts.length)
+				DropAttempt(sock, sock->attempts.length - 1, 0);
+		sock->nextaddr = NULL;
+
+		// Make sure the resolver doesn't call us back once we're gone.
+		CancelResolve(OnHostResolved, sock);
+
+		// The server starts afresh with the next connection.
+		ClearSendQueue(&sock->sendq);
+		ClearFloodControl(&sock->flood);
+		ResetRecvBuffer(&sock->recvbuf);
+
+		if (sock->stalled)
+				EndFloodStall(sock, GetMonotonicTime());
+		SetMetric(sock->metrics, METRIC_SENDQ_BYTES, 0);
+		SetMetric(sock->metrics, METRIC_FLOOD_QUEUED, 0);
+
+		sock->state = SOCKET_CLOSED;
+
+		// Taking the old id out leaves room for the new one, this can't fail.
+		RemoveHashItem(&socketids, HashSocketId(sock->id), MatchSocketId, &sock->id);
+		sock->id = atomic_fetch_add_explicit(&nextid, 1, memory_order_relaxed);
+		InsertHashItem(&socketids, HashSocketId(sock->id), sock);
+}
+
+/*******************************************************************
+ * Function: DestroySocket                                         *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Destroys the socket structure safely and           *
+ * deallocates any resources used by the structure.                *
+ *                                                                 *
+ *******************************************************************/
+void DestroySocket(socket_t *sock)
+{
+		assert(sock);
+
+		CloseSocket(sock);
+		RemoveHashItem(&socketids, HashSocketId(sock->id), MatchSocketId, &sock->id);
+		vec_sbo_deinit(&sock->attempts);
+
+		// Deallocate anything we allocated.
+		if (sock->adr)
+				FreeAddresses(sock->adr);
+
+		if (sock->host)
+				free(sock->host);
+
+		PoolFree(&addrpool, sock->sa);
+
+		DestroyRecvBuffer(&sock->recvbuf);
+		DestroySendQueue(&sock->sendq);
+		DestroyFloodControl(&sock->flood);
+		DestroyMetrics(sock->metrics);
+
+		// Remove it out of the vector by moving the last socket into its
+		// place, so it doesn't matter how many sockets we have.
+		assert(sockets.data[sock->index] == sock);
+		socket_t *last = vec_pop(&sockets);
+		if (last != sock)
+		{
+				sockets.data[sock->index] = last;
+				last->index = sock->index;
+		}
+
+		// Finally, give the socket structure back to the pool.
+		PoolFree(&socketpool, sock);
+}
+
+/*******************************************************************
+ * Function: RecvTLS                                               *
+ *                                                                 *
+ * Arguments: void* (the socket_t), void* buffer, size_t           *
+ *                                                                 *
+ * Returns: (ssize_t) What ReadTLS returned.                       *
+ *                                                                 *
+ *******************************************************************/
+static ssize_t RecvTLS(void *data, void *buffer, size_t len)
+{
+		return ReadTLS(data, buffer, len);
+}
+
+/*******************************************************************
+ * Function: SendTLS                                               *
+ *                                                                 *
+ * Arguments: void* (the socket_t), const struct iovec*,           *
+ *            (int) count                                          *
+ *                                                                 *
+ * Returns: (ssize_t) The number of bytes sent or -1 with errno    *
+ * set (EAGAIN if nothing could be sent).                          *
+ *                                                                 *
+ * Description: Sends the send queue's blocks through OpenSSL, one *
+ * record per block, until it stops taking them.                   *
+ *                                                                 *
+ *******************************************************************/
+static ssize_t SendTLS(void *data, const struct iovec *iov, int count)
+{
+		ssize_t total = 0;
+
+		for (int i = 0; i < count; ++i)
+		{
+				ssize_t sent = WriteTLS(data, iov[i].iov_base, iov[i].iov_len);
+				if (sent == -1)
+						return total ? total : -1;
+
+				total += sent;
+				if ((size_t)sent < iov[i].iov_len)
+						break;
+		}
+
+		return total;
+}
+
+/*******************************************************************
+ * Function: CountRead                                             *
+ *                                                                 *
+ * Arguments: socket_t*, (size_t) what the read returned           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void CountRead(socket_t *sock, size_t bytes)
+{
+		AddMetric(sock->metrics, METRIC_READS, 1);
+
+		if (bytes != -1UL)
+				AddMetric(sock->metrics, METRIC_BYTES_IN, bytes);
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+				AddMetric(sock->metrics, METRIC_ERRORS, 1);
+}
+
+/*******************************************************************
+ * Function: ReadSocket                                            *
+ *                                                                 *
+ * Arguments: socket_t*, void*, size_t                             *
+ *                                                                 *
+ * Returns: (size_t) Returns the number of bytes read or -1 for an *
+ * error status from errno. errno is EAGAIN if there was no data.  *
+ *                                                                 *
+ * Description: Reads data from a socket and fills the buffer,     *
+ * once the buffer is filled, it returns the number of bytes read  *
+ * from the socket or it returns -1 upon an error condition.       *
+ *                                                                 *
+ *******************************************************************/
+size_t ReadSocket(socket_t *sock, void *buffer, size_t bufferlen)
+{
+		assert(buffer && sock);
+
+		// Fill the buffer with bytes from the socket
+		size_t bytes = sock->ssl ? ReadTLS(sock, buffer, bufferlen) : read(sock->fd, buffer, bufferlen);
+		CountRead(sock, bytes);
+		AddMetric(threadmetrics, METRIC_SYSCALLS, 1);
+		// Check for errors, running out of data on a non-blocking socket isn't one.
+		if (bytes == -1UL && errno != EAGAIN && errno != EWOULDBLOCK)
+				LogError("Failed to read bytes from socket %d: %s (%d)", sock->fd, strerror(errno), errno);
+
+		// Return the number of bytes, if bytes == -1 then we had an error and should
+		// handle accordingly in the functions which call this function.
+		return bytes;
+}
+
+/*******************************************************************
+ * Function: WriteSocket                                           *
+ *                                                                 *
+ * Arguments: socket_t*, const void*, size_t                       *
+ *                                                                 *
+ * Returns: (size_t) Returns the number of bytes queued or -1 for  *
+ * an error condition.                                             *
+ *                                                                 *
+ * Description: The inverse of the `ReadSocket` function in that   *
+ * it sends data over the socket. The data is copied onto the      *
+ * socket's send queue and goes out the next time the kernel has   *
+ * room for it, so lots of small writes (eg. replies to a burst of *
+ * lines) are sent together with a single system call. Data        *
+ * written before the socket is connected is sent once it is.      *
+ *                                                                 *
+ *******************************************************************/
+size_t WriteSocket(socket_t *sock, const void *buffer, size_t bufferlen)
+{
+		assert(sock && buffer);
+
+		size_t queued = sock->sendq.bytes;
+
+		if (!AppendSendQueue(&sock->sendq, buffer, bufferlen))
+		{
+				LogError("Failed to queue %zu bytes for socket %d: %s (%d)", bufferlen, sock->fd, strerror(ENOMEM), ENOMEM);
+				errno = ENOMEM;
+				return -1;
+		}
+
+		if (!WatchWritable(sock, queued))
+				return -1;
+
+		SetMetric(sock->metrics, METRIC_SENDQ_BYTES, sock->sendq.bytes);
+		return bufferlen;
+}
+
+/*******************************************************************
+ * Function: FlushSocket                                           *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sends as much of the socket's send queue as the    *
+ * kernel will take. This is called by the event loop when the     *
+ * socket becomes writable. Once the queue is empty we stop asking *
+ * about writability so we aren't woken up for nothing. If the     *
+ * event loop sends for us it calls this once a send finished, we  *
+ * drop what was sent and hand it the rest. Returns false if the   *
+ * connection failed.                                              *
+ *                                                                 *
+ *******************************************************************/
+int FlushSocket(socket_t *sock)
+{
+		assert(sock);
+
+		if (!sock->sendq.bytes || sock->state != SOCKET_CONNECTED)
+				return 1;
+
+		if (SendsThroughRing(sock))
+		{
+				size_t bytes;
+				if (!sock->sending || !TakeEventResult(sock->fd, EVENT_WRITE, &bytes))
+						return 1;
+
+				sock->sending = 0;
+				AddMetric(sock->metrics, METRIC_WRITES, 1);
+
+				if (bytes == -1UL && errno != EAGAIN && errno != EWOULDBLOCK)
+				{
+						AddMetric(sock->metrics, METRIC_ERRORS, 1);
+						LogError("Failed to send bytes to socket %d: %s (%d)", sock->fd, strerror(errno), errno);
+						return 0;
+				}
+
+				if (bytes != -1UL)
+				{
+						ConsumeSendQueue(&sock->sendq, bytes);
+						AddMetric(sock->metrics, METRIC_BYTES_OUT, bytes);
+						SetMetric(sock->metrics, METRIC_SENDQ_BYTES, sock->sendq.bytes);
+				}
+
+				return StartRingSend(sock);
+		}
+
+		// With kTLS the kernel encrypts whatever we send it, so only go through
+		// OpenSSL when it has to do the encrypting.
+		size_t bytes;
+		if (sock->ssl && !sock->offloaded)
+				bytes = FlushSendQueueWith(&sock->sendq, SendTLS, sock);
+		else
+				bytes = FlushSendQueue(&sock->sendq, sock->fd);
+
+		AddMetric(sock->metrics, METRIC_WRITES, 1);
+		AddMetric(threadmetrics, METRIC_SYSCALLS, 1);
+		SetMetric(sock->metrics, METRIC_SENDQ_BYTES, sock->sendq.bytes);
+		if (bytes != -1UL)
+				AddMetric(sock->metrics, METRIC_BYTES_OUT, bytes);
+
+		// A full kernel buffer on a non-blocking socket isn't an error, we'll be told when there's room.
+		if (bytes == -1UL && errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+				AddMetric(sock->metrics, METRIC_ERRORS, 1);
+				LogError("Failed to send bytes to socket %d: %s (%d)", sock->fd, strerror(errno), errno);
+				return 0;
+		}
+
+		if (!sock->sendq.bytes)
+				return UpdateSocket(sock, EVENT_READ);
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: GetSocketQueueDepth                                   *
+ *                                                                 *
+ * Arguments: const socket_t*                                      *
+ *                                                                 *
+ * Returns: (size_t) The number of bytes waiting to be sent.       *
+ *                                                                 *
+ * Description: Lets callers see how far behind the connection is, *
+ * eg. to stop generating output for a peer which isn't reading.   *
+ *                                                                 *
+ *******************************************************************/
+size_t GetSocketQueueDepth(const socket_t *sock)
+{
+		assert(sock);
+		return sock->sendq.bytes;
+}
+
+/*******************************************************************
+ * Function: QueueSocketMessage                                    *
+ *                                                                 *
+ * Arguments: socket_t*, floodlane_t, (const void*) message,       *
+ *            (size_t) length                                      *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sends a complete IRC message (including its \r\n)  *
+ * as fast as the server's flood limits allow. Messages that would *
+ * get us disconnected for flooding wait in their lane and go out  *
+ * once the penalty timer has caught up, urgent lanes first. Use   *
+ * WriteSocket for data which mustn't be held back.                *
+ *                                                                 *
+ *******************************************************************/
+int QueueSocketMessage(socket_t *sock, floodlane_t lane, const void *message, size_t len)
+{
+		assert(sock && message);
+
+		if (!QueueFloodMessage(&sock->flood, lane, message, len))
+		{
+				LogError("Failed to queue %zu bytes for socket %d: %s (%d)", len, sock->fd, strerror(ENOMEM), ENOMEM);
+				errno = ENOMEM;
+				return 0;
+		}
+
+		AddMetric(sock->metrics, METRIC_LINES_OUT, 1);
+		ReleaseSocketMessages(sock);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ReceiveSocket                                         *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (size_t) Returns the number of bytes received, 0 if    *
+ * the connection was closed or -1 for an error status from errno. *
+ * errno is EAGAIN if there was no data.                           *
+ *                                                                 *
+ * Description: Reads whatever the kernel has for us into the      *
+ * socket's receive buffer, the complete lines can then be taken   *
+ * out of it with ReadSocketLine. If the event loop reads for us,  *
+ * this picks up what its last read got.                           *
+ *                                                                 *
+ *******************************************************************/
+size_t ReceiveSocket(socket_t *sock)
+{
+		assert(sock);
+
+		if (ReceivesThroughRing(sock))
+		{
+				size_t bytes;
+				if (!sock->receiving || !TakeEventResult(sock->fd, EVENT_READ, &bytes))
+				{
+						errno = EAGAIN;
+						return -1;
+				}
+
+				sock->receiving = 0;
+				if (bytes != -1UL)
+						CommitRecvBuffer(&sock->recvbuf, bytes);
+
+				CountRead(sock, bytes);
+				if (bytes == -1UL && errno != EAGAIN && errno != EWOULDBLOCK)
+						LogError("Failed to read bytes from socket %d: %s (%d)", sock->fd, strerror(errno), errno);
+				return bytes;
+		}
+
+		if (!sock->ssl)
+		{
+				size_t bytes = FillRecvBuffer(&sock->recvbuf, sock->fd);
+				CountRead(sock, bytes);
+				AddMetric(threadmetrics, METRIC_SYSCALLS, 1);
+				// Check for errors, running out of data on a non-blocking socket isn't one.
+				if (bytes == -1UL && errno != EAGAIN && errno != EWOULDBLOCK)
+						LogError("Failed to read bytes from socket %d: %s (%d)", sock->fd, strerror(errno), errno);
+				return bytes;
+		}
+
+		size_t bytes = FillRecvBufferWith(&sock->recvbuf, RecvTLS, sock);
+		CountRead(sock, bytes);
+		AddMetric(threadmetrics, METRIC_SYSCALLS, 1);
+		if (bytes == -1UL && errno != EAGAIN && errno != EWOULDBLOCK)
+				LogError("Failed to read bytes from socket %d: %s (%d)", sock->fd, strerror(errno), errno);
+
+		// OpenSSL may have decrypted more than fit, the kernel won't tell the
+		// event loop about that so we have to.
+		if (GetTLSPending(sock))
+				QueueEvent(sock->fd, EVENT_READ);
+
+		return bytes;
+}
+
+/*******************************************************************
+ * Function: ContinueReceiving                                     *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: If the event loop reads for us and isn't already,  *
+ * hands it the free end of the receive buffer to read into next.  *
+ * Called by the event loop once OnReadable is done with the last  *
+ * read, lines taken out before this are no longer valid. Returns  *
+ * false if the read couldn't be started.                          *
+ *                                                                 *
+ *******************************************************************/
+int ContinueReceiving(socket_t *sock)
+{
+		assert(sock);
+
+		if (!ReceivesThroughRing(sock) || sock->receiving || sock->state != SOCKET_CONNECTED)
+				return 1;
+
+		size_t room;
+		char *space = PrepareRecvBuffer(&sock->recvbuf, &room);
+		if (!ReceiveOnEventSource(sock->fd, space, room))
+		{
+				LogError("Failed to read bytes from socket %d: %s (%d)", sock->fd, strerror(errno), errno);
+				return 0;
+		}
+
+		sock->receiving = 1;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ReadSocketLine                                        *
+ *                                                                 *
+ * Arguments: socket_t*, strview_t*                                *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Takes the next complete line out of the socket's   *
+ * receive buffer. The line is not copied or null-terminated, it   *
+ * points straight into the buffer and is only valid until the     *
+ * next call to ReceiveSocket (or the end of OnReadable). Returns  *
+ * false when there are no complete lines left.                    *
+ *                                                                 *
+ *******************************************************************/
+int ReadSocketLine(socket_t *sock, strview_t *line)
+{
+		assert(sock && line);
+
+		if (!NextRecvLine(&sock->recvbuf, line))
+				return 0;
+
+		AddMetric(sock->metrics, METRIC_LINES_IN, 1);
+		return 1;
 }
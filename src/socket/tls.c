@@ -0,0 +1,518 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <arpa/inet.h>
+#include "vector/vec.h"
+#include "eventloop/eventloop.h"
+#include "socket/socket.h"
+#include "log/log.h"
+
+// Include our TLS types and function declarations.
+#include "socket/tls.h"
+
+#ifdef HAVE_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+// The session we got the last time we connected to a host. Resuming a
+// session skips checking the certificate, so one we got without checking
+// it is never used for a connection which should have.
+typedef struct
+{
+		char *host;
+		short int port;
+		int insecure;
+		SSL_SESSION *session;
+} tlssession_t;
+
+// Like the resolver, each event loop thread has its own context and cache
+// so nothing here needs locking. The context is only created once the
+// thread actually connects somewhere over TLS.
+static _Thread_local SSL_CTX *context;
+static _Thread_local vec_t(tlssession_t) sessions;
+
+/*******************************************************************
+ * Function: PrintTLSError                                         *
+ *                                                                 *
+ * Arguments: (const char*) what we were doing, socket_t*          *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Prints why OpenSSL failed and empties its queue of *
+ * errors so they don't get blamed on the next call.               *
+ *                                                                 *
+ *******************************************************************/
+static void PrintTLSError(const char *what, socket_t *sock)
+{
+		char reason[256] = "unknown error";
+		unsigned long error = ERR_get_error();
+		if (error)
+				ERR_error_string_n(error, reason, sizeof(reason));
+
+		LogError("%s %s:%hd failed: %s", what, sock->host, sock->port, reason);
+		ERR_clear_error();
+}
+
+/*******************************************************************
+ * Function: FindSession                                           *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (int) The index of the socket's host's session or -1   *
+ * if there isn't one.                                             *
+ *                                                                 *
+ *******************************************************************/
+static int FindSession(socket_t *sock)
+{
+		tlssession_t *entry;
+		int i;
+		vec_foreach_ptr(&sessions, entry, i)
+		{
+				if (entry->port == sock->port && entry->insecure == sock->tlsinsecure && !strcmp(entry->host, sock->host))
+						return i;
+		}
+
+		return -1;
+}
+
+/*******************************************************************
+ * Function: ForgetSession                                         *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ *******************************************************************/
+static void ForgetSession(socket_t *sock)
+{
+		int idx = FindSession(sock);
+		if (idx == -1)
+				return;
+
+		tlssession_t *entry = &sessions.data[idx];
+		SSL_SESSION_free(entry->session);
+		free(entry->host);
+		vec_splice(&sessions, idx, 1);
+}
+
+/*******************************************************************
+ * Function: OnNewSession                                          *
+ *                                                                 *
+ * Arguments: SSL*, SSL_SESSION*                                   *
+ *                                                                 *
+ * Returns: (int) 1 if we kept the session, 0 if OpenSSL should    *
+ * free it.                                                        *
+ *                                                                 *
+ * Description: Called by OpenSSL whenever the server gives us a   *
+ * session we can resume. With TLS 1.3 that's after the handshake  *
+ * (the server sends tickets whenever it likes) so we just keep    *
+ * the newest one for each host.                                   *
+ *                                                                 *
+ *******************************************************************/
+static int OnNewSession(SSL *ssl, SSL_SESSION *session)
+{
+		socket_t *sock = SSL_get_app_data(ssl);
+		if (!sock || !SSL_SESSION_is_resumable(session))
+				return 0;
+
+		int idx = FindSession(sock);
+		if (idx != -1)
+		{
+				SSL_SESSION_free(sessions.data[idx].session);
+				sessions.data[idx].session = session;
+				return 1;
+		}
+
+		tlssession_t entry = { strdup(sock->host), sock->port, sock->tlsinsecure, session };
+		if (!entry.host || vec_push(&sessions, entry))
+		{
+				free(entry.host);
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: GetContext                                            *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (SSL_CTX*) The calling thread's context or NULL if we  *
+ * couldn't create one.                                            *
+ *                                                                 *
+ * Description: Creates the context the first time a thread needs  *
+ * it. Certificates are checked against the system's trusted CAs.  *
+ *                                                                 *
+ *******************************************************************/
+static SSL_CTX *GetContext(void)
+{
+		if (context)
+				return context;
+
+		SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+		if (!ctx)
+		{
+				LogError("Failed to create the TLS context: %s", ERR_error_string(ERR_get_error(), NULL));
+				return NULL;
+		}
+
+		SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+		if (!SSL_CTX_set_default_verify_paths(ctx))
+				LogError("Failed to load the trusted certificates: %s", ERR_error_string(ERR_get_error(), NULL));
+
+		// Partial writes let the send queue carry on from wherever SSL_write
+		// stopped, which means retrying with a buffer that has moved on.
+		SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+		// OpenSSL's own session cache is for servers, we keep ours by host.
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(ctx, OnNewSession);
+
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+		// Plenty of servers just close the connection without saying goodbye.
+		SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+#ifdef HAVE_SSL_OP_ENABLE_KTLS
+		SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+		vec_init(&sessions);
+		context = ctx;
+		return ctx;
+}
+
+/*******************************************************************
+ * Function: ConfigureTLS                                          *
+ *                                                                 *
+ * Arguments: socket_t*, SSL*                                      *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Tells the connection who we're talking to, so the  *
+ * server can pick its certificate by name (SNI) and we can check  *
+ * that the certificate is really for that name.                   *
+ *                                                                 *
+ *******************************************************************/
+static int ConfigureTLS(socket_t *sock, SSL *ssl)
+{
+		if (!SSL_set_fd(ssl, sock->fd))
+				return 0;
+
+		// There's no name to send for an IP address.
+		unsigned char addr[sizeof(struct in6_addr)];
+		int literal = inet_pton(AF_INET, sock->host, addr) == 1 || inet_pton(AF_INET6, sock->host, addr) == 1;
+		if (!literal && !SSL_set_tlsext_host_name(ssl, sock->host))
+				return 0;
+
+		if (sock->tlsinsecure)
+				return 1;
+
+		SSL_set_verify(ssl, SSL_VERIFY_PEER, NULL);
+		if (literal)
+				return X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), sock->host);
+
+		return SSL_set1_host(ssl, sock->host);
+}
+
+/*******************************************************************
+ * Function: StartTLS                                              *
+ *                                                                 *
+ * Arguments: socket_t* (connected)                                *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sets up TLS on the socket's connection, resuming   *
+ * the last session we had with the host if we have one. The       *
+ * handshake is done by ContinueTLSHandshake.                      *
+ *                                                                 *
+ *******************************************************************/
+int StartTLS(socket_t *sock)
+{
+		assert(sock && !sock->ssl && sock->fd != -1);
+
+		SSL_CTX *ctx = GetContext();
+		if (!ctx)
+				return 0;
+
+		SSL *ssl = SSL_new(ctx);
+		if (!ssl || !ConfigureTLS(sock, ssl))
+		{
+				PrintTLSError("Setting up TLS for", sock);
+				SSL_free(ssl);
+				return 0;
+		}
+
+		SSL_set_app_data(ssl, sock);
+		SSL_set_connect_state(ssl);
+
+		int idx = FindSession(sock);
+		if (idx != -1)
+				SSL_set_session(ssl, sessions.data[idx].session);
+
+		sock->ssl       = ssl;
+		sock->resumed   = 0;
+		sock->offloaded = 0;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: ContinueTLSHandshake                                  *
+ *                                                                 *
+ * Arguments: socket_t*, (int*) events                             *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Carries on with the handshake and returns true     *
+ * once it's done. Otherwise errno is EAGAIN if it's waiting on    *
+ * the server, and `events' says whether for EVENT_READ or         *
+ * EVENT_WRITE, anything else means the handshake failed.          *
+ *                                                                 *
+ *******************************************************************/
+int ContinueTLSHandshake(socket_t *sock, int *events)
+{
+		assert(sock && sock->ssl && events);
+
+		ERR_clear_error();
+		int ret = SSL_do_handshake(sock->ssl);
+		if (ret == 1)
+		{
+				sock->resumed   = SSL_session_reused(sock->ssl);
+#ifdef HAVE_SSL_OP_ENABLE_KTLS
+				sock->offloaded = BIO_get_ktls_send(SSL_get_wbio(sock->ssl)) > 0;
+#else
+				sock->offloaded = 0;
+#endif
+				return 1;
+		}
+
+		int error = SSL_get_error(sock->ssl, ret);
+		if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+		{
+				*events = error == SSL_ERROR_WANT_READ ? EVENT_READ : EVENT_WRITE;
+				errno = EAGAIN;
+				return 0;
+		}
+
+		long verify = SSL_get_verify_result(sock->ssl);
+		if (verify != X509_V_OK)
+				LogError("The certificate of %s:%hd was rejected: %s", sock->host, sock->port, X509_verify_cert_error_string(verify));
+		else if (error == SSL_ERROR_SYSCALL && !ERR_peek_error())
+				LogError("TLS handshake with %s:%hd failed: %s", sock->host, sock->port, errno ? strerror(errno) : "connection closed");
+		else
+				PrintTLSError("TLS handshake with", sock);
+
+		// Whatever went wrong, the session we offered won't help next time.
+		ERR_clear_error();
+		ForgetSession(sock);
+		errno = EPROTO;
+		return 0;
+}
+
+/*******************************************************************
+ * Function: ReadTLS                                               *
+ *                                                                 *
+ * Arguments: socket_t*, void* buffer, size_t                      *
+ *                                                                 *
+ * Returns: (ssize_t) Like read(): the number of bytes read, 0 if  *
+ * the server closed the connection or -1 with errno set (EAGAIN   *
+ * if there was nothing to read).                                  *
+ *                                                                 *
+ *******************************************************************/
+ssize_t ReadTLS(socket_t *sock, void *buffer, size_t len)
+{
+		assert(sock && sock->ssl && buffer);
+
+		ERR_clear_error();
+		int ret = SSL_read(sock->ssl, buffer, len > INT_MAX ? INT_MAX : (int)len);
+		if (ret > 0)
+				return ret;
+
+		switch (SSL_get_error(sock->ssl, ret))
+		{
+				case SSL_ERROR_WANT_READ:
+				case SSL_ERROR_WANT_WRITE:
+						errno = EAGAIN;
+						return -1;
+				case SSL_ERROR_ZERO_RETURN:
+						return 0;
+				case SSL_ERROR_SYSCALL:
+						// errno says what happened, unless the server just went away.
+						if (!ERR_peek_error())
+								return ret == 0 ? 0 : -1;
+						// Fall through.
+				default:
+						PrintTLSError("Reading from", sock);
+						errno = EPROTO;
+						return -1;
+		}
+}
+
+/*******************************************************************
+ * Function: WriteTLS                                              *
+ *                                                                 *
+ * Arguments: socket_t*, const void* buffer, size_t                *
+ *                                                                 *
+ * Returns: (ssize_t) Like write(): the number of bytes written or *
+ * -1 with errno set (EAGAIN if the kernel had no room).           *
+ *                                                                 *
+ * Description: If this fails with EAGAIN, the same bytes have to  *
+ * be written again once there's room (more may follow them).      *
+ *                                                                 *
+ *******************************************************************/
+ssize_t WriteTLS(socket_t *sock, const void *buffer, size_t len)
+{
+		assert(sock && sock->ssl && buffer);
+
+		if (!len)
+				return 0;
+
+		ERR_clear_error();
+		int ret = SSL_write(sock->ssl, buffer, len > INT_MAX ? INT_MAX : (int)len);
+		if (ret > 0)
+				return ret;
+
+		switch (SSL_get_error(sock->ssl, ret))
+		{
+				case SSL_ERROR_WANT_READ:
+				case SSL_ERROR_WANT_WRITE:
+						errno = EAGAIN;
+						return -1;
+				case SSL_ERROR_ZERO_RETURN:
+						errno = EPIPE;
+						return -1;
+				case SSL_ERROR_SYSCALL:
+						if (!ERR_peek_error())
+						{
+								if (!errno)
+										errno = EPIPE;
+								return -1;
+						}
+						// Fall through.
+				default:
+						PrintTLSError("Writing to", sock);
+						errno = EPROTO;
+						return -1;
+		}
+}
+
+/*******************************************************************
+ * Function: GetTLSPending                                         *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (size_t) How many bytes OpenSSL has decrypted that we  *
+ * haven't read yet.                                               *
+ *                                                                 *
+ * Description: A record can hold more than the caller had room    *
+ * for and the kernel doesn't know about those bytes (they've been *
+ * read from the socket already) so the event loop won't tell us   *
+ * about them either.                                              *
+ *                                                                 *
+ *******************************************************************/
+size_t GetTLSPending(socket_t *sock)
+{
+		assert(sock);
+		return sock->ssl ? (size_t)SSL_pending(sock->ssl) : 0;
+}
+
+/*******************************************************************
+ * Function: CloseTLS                                              *
+ *                                                                 *
+ * Arguments: socket_t*                                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Tells the server we're done (if we got as far as   *
+ * talking to it) and frees the connection. Saying goodbye is best *
+ * effort, we don't wait around for the server to answer.          *
+ *                                                                 *
+ *******************************************************************/
+void CloseTLS(socket_t *sock)
+{
+		assert(sock);
+
+		if (!sock->ssl)
+				return;
+
+		if (sock->state == SOCKET_CONNECTED)
+				SSL_shutdown(sock->ssl);
+
+		SSL_free(sock->ssl);
+		ERR_clear_error();
+		sock->ssl = NULL;
+}
+
+/*******************************************************************
+ * Function: DestroyTLS                                            *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Frees the calling thread's context and sessions.   *
+ * Every socket of the thread must have been closed already.       *
+ *                                                                 *
+ *******************************************************************/
+void DestroyTLS(void)
+{
+		tlssession_t *entry;
+		int i;
+		vec_foreach_ptr(&sessions, entry, i)
+		{
+				SSL_SESSION_free(entry->session);
+				free(entry->host);
+		}
+		vec_deinit(&sessions);
+
+		SSL_CTX_free(context);
+		context = NULL;
+}
+
+#else
+
+// Built without OpenSSL, all we can do is say so.
+
+int StartTLS(socket_t *sock)
+{
+		LogError("Can't connect to %s:%hd over TLS, we were built without OpenSSL", sock->host, sock->port);
+		errno = ENOTSUP;
+		return 0;
+}
+
+int ContinueTLSHandshake(socket_t *sock, int *events)
+{
+		errno = ENOTSUP;
+		return 0;
+}
+
+ssize_t ReadTLS(socket_t *sock, void *buffer, size_t len)
+{
+		errno = ENOTSUP;
+		return -1;
+}
+
+ssize_t WriteTLS(socket_t *sock, const void *buffer, size_t len)
+{
+		errno = ENOTSUP;
+		return -1;
+}
+
+size_t GetTLSPending(socket_t *sock)
+{
+		return 0;
+}
+
+void CloseTLS(socket_t *sock)
+{
+}
+
+void DestroyTLS(void)
+{
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include <stddef.h>
+#include <assert.h>
+
+// Include our queue types and function declarations.
+#include "thread/mpscqueue.h"
+
+/*******************************************************************
+ * Function: InitializeMPSCQueue                                   *
+ *                                                                 *
+ * Arguments: mpscqueue_t*                                         *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Sets up an empty queue. The queue doesn't own any  *
+ * memory so there is nothing to destroy.                          *
+ *                                                                 *
+ *******************************************************************/
+void InitializeMPSCQueue(mpscqueue_t *q)
+{
+		assert(q);
+		atomic_init(&q->stub.next, NULL);
+		atomic_init(&q->head, &q->stub);
+		q->tail = &q->stub;
+}
+
+/*******************************************************************
+ * Function: PushMPSCQueue                                         *
+ *                                                                 *
+ * Arguments: mpscqueue_t*, mpscnode_t*                            *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Adds a node to the queue. Safe to call from any    *
+ * number of threads at once and never blocks.                     *
+ *                                                                 *
+ *******************************************************************/
+void PushMPSCQueue(mpscqueue_t *q, mpscnode_t *node)
+{
+		assert(q && node);
+		atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+
+		// Everything written to the node before this is visible to the popper
+		// once it sees the node, the release in the store below makes sure.
+		mpscnode_t *prev = atomic_exchange_explicit(&q->head, node, memory_order_acq_rel);
+		atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+/*******************************************************************
+ * Function: PopMPSCQueue                                          *
+ *                                                                 *
+ * Arguments: mpscqueue_t*                                         *
+ *                                                                 *
+ * Returns: (mpscnode_t*) The oldest node or NULL if the queue is  *
+ * empty (or a push is half way through, see mpscqueue.h).         *
+ *                                                                 *
+ * Description: Takes the oldest node off the queue. Only one      *
+ * thread may pop from a queue.                                    *
+ *                                                                 *
+ *******************************************************************/
+mpscnode_t *PopMPSCQueue(mpscqueue_t *q)
+{
+		assert(q);
+
+		mpscnode_t *tail = q->tail;
+		mpscnode_t *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+		// Skip over the stub, it's not a real node.
+		if (tail == &q->stub)
+		{
+				if (!next)
+						return NULL;
+
+				q->tail = next;
+				tail = next;
+				next = atomic_load_explicit(&tail->next, memory_order_acquire);
+		}
+
+		if (next)
+		{
+				q->tail = next;
+				return tail;
+		}
+
+		// `tail' is the last node we can see. If it isn't the head someone is
+		// in the middle of pushing after it, try again once they're done.
+		if (tail != atomic_load_explicit(&q->head, memory_order_acquire))
+				return NULL;
+
+		// Put the stub back behind the last node so we can take the node
+		// without leaving the queue empty.
+		PushMPSCQueue(q, &q->stub);
+
+		next = atomic_load_explicit(&tail->next, memory_order_acquire);
+		if (next)
+		{
+				q->tail = next;
+				return tail;
+		}
+
+		return NULL;
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include "log/log.h"
+
+// Include our ring types and function declarations.
+#include "thread/mpscring.h"
+
+/*******************************************************************
+ * Function: InitializeMPSCRing                                    *
+ *                                                                 *
+ * Arguments: mpscring_t*, (size_t) number of items it holds       *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Sets up an empty ring. The size is rounded up to a *
+ * power of two so positions can be masked instead of divided.     *
+ *                                                                 *
+ *******************************************************************/
+int InitializeMPSCRing(mpscring_t *ring, size_t size)
+{
+		assert(ring && size);
+
+		size_t ncells = 2;
+		while (ncells < size)
+				ncells <<= 1;
+
+		// Every cell is written by whoever pushes last so keep them on
+		// cache lines which nothing else uses.
+		size_t bytes = ncells * sizeof(mpsccell_t);
+		bytes = (bytes + POOL_CACHELINE - 1) & ~(size_t)(POOL_CACHELINE - 1);
+
+		ring->cells = aligned_alloc(POOL_CACHELINE, bytes);
+		if (!ring->cells)
+		{
+				LogError("Failed to allocate a ring of %zu items: %s (%d)", ncells, strerror(errno), errno);
+				return 0;
+		}
+
+		for (size_t i = 0; i < ncells; ++i)
+		{
+				atomic_init(&ring->cells[i].seq, i);
+				ring->cells[i].data = NULL;
+		}
+
+		ring->mask = ncells - 1;
+		atomic_init(&ring->tail, 0);
+		ring->head = 0;
+		return 1;
+}
+
+/*******************************************************************
+ * Function: DestroyMPSCRing                                       *
+ *                                                                 *
+ * Arguments: mpscring_t*                                          *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Frees the ring, anything still in it belongs to    *
+ * the caller and is left alone.                                   *
+ *                                                                 *
+ *******************************************************************/
+void DestroyMPSCRing(mpscring_t *ring)
+{
+		assert(ring);
+		free(ring->cells);
+		ring->cells = NULL;
+		ring->mask = 0;
+}
+
+/*******************************************************************
+ * Function: PushMPSCRing                                          *
+ *                                                                 *
+ * Arguments: mpscring_t*, void* item                              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Adds an item to the ring. Safe to call from any    *
+ * number of threads at once. Returns false straight away if the   *
+ * ring is full.                                                   *
+ *                                                                 *
+ *******************************************************************/
+int PushMPSCRing(mpscring_t *ring, void *item)
+{
+		assert(ring && item);
+
+		size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		mpsccell_t *cell;
+
+		for (;;)
+		{
+				cell = &ring->cells[pos & ring->mask];
+				size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+				intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+				// The cell is free for this position, try to claim it.
+				if (!diff)
+				{
+						if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+								break;
+				}
+				// The popper hasn't got to this cell since it last went round.
+				else if (diff < 0)
+						return 0;
+				// Someone else claimed it first, try wherever the tail is now.
+				else
+						pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		}
+
+		// Publish it, the release makes `data' visible before the popper
+		// sees the new sequence.
+		cell->data = item;
+		atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: PopMPSCRing                                           *
+ *                                                                 *
+ * Arguments: mpscring_t*                                          *
+ *                                                                 *
+ * Returns: (void*) The oldest item or NULL if the ring is empty   *
+ * (or the oldest push is half way through).                       *
+ *                                                                 *
+ * Description: Takes the oldest item out of the ring. Only one    *
+ * thread may pop from a ring.                                     *
+ *                                                                 *
+ *******************************************************************/
+void *PopMPSCRing(mpscring_t *ring)
+{
+		assert(ring);
+
+		mpsccell_t *cell = &ring->cells[ring->head & ring->mask];
+		size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+
+		if (seq != ring->head + 1)
+				return NULL;
+
+		void *item = cell->data;
+
+		// Hand the cell to whoever pushes to it on the next time round.
+		atomic_store_explicit(&cell->seq, ring->head + ring->mask + 1, memory_order_release);
+		ring->head++;
+		return item;
+}
@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <signal.h>
+
+// Include our worker pool types and function declarations.
+#include "thread/workers.h"
+#include "thread/wsdeque.h"
+#include "metrics/metrics.h"
+#include "log/log.h"
+
+// How many jobs a worker moves from its queue into its deque at once.
+#define WORKER_BATCH 32
+
+// One worker thread and the jobs waiting for it.
+typedef struct
+{
+		mpscring_t queue;        // Jobs the event loops submitted to this worker.
+		wsdeque_t deque;         // Jobs the worker has yet to run, idle workers steal from it.
+		atomic_int busy;         // Set while the worker is running a job.
+		atomic_int sleeping;     // Set while the worker is (about to be) waiting on `wakeup'.
+		atomic_int stopping;     // Set when the worker should exit once it's run out of jobs.
+		pthread_mutex_t lock;    // Only protects sleeping on `wakeup'.
+		pthread_cond_t wakeup;
+		pthread_t thread;
+		arena_t scratch;         // Temporary memory for the job being run.
+} worker_t;
+
+// Every worker we started. Only changed by StartWorkerPool and StopWorkerPool.
+static worker_t *workers;
+static int nworkers;
+static int nthreads;
+
+// How many workers are asleep, so we know whether to bother waking one
+// up to steal something.
+static atomic_int sleepers;
+
+// The worker running on the calling thread, NULL on any other thread.
+static _Thread_local worker_t *self;
+
+// Where the calling worker starts looking for something to steal.
+static _Thread_local uint32_t seed;
+
+/*******************************************************************
+ * Function: WakeWorker                                            *
+ *                                                                 *
+ * Arguments: worker_t*                                            *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Wakes the worker if it's sleeping, returns false   *
+ * if it wasn't. Most of the time it's busy and this is a single   *
+ * load, the lock is only taken when the worker really has to be   *
+ * woken up.                                                       *
+ *                                                                 *
+ *******************************************************************/
+static int WakeWorker(worker_t *worker)
+{
+		atomic_thread_fence(memory_order_seq_cst);
+		if (!atomic_load(&worker->sleeping) || !atomic_exchange(&worker->sleeping, 0))
+				return 0;
+
+		atomic_fetch_sub(&sleepers, 1);
+		pthread_mutex_lock(&worker->lock);
+		pthread_cond_signal(&worker->wakeup);
+		pthread_mutex_unlock(&worker->lock);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: WakeThief                                             *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Called by a worker with more jobs than it can run  *
+ * right now, wakes one sleeping worker to steal some of them. If  *
+ * a worker falls asleep just as we look it misses out, but the    *
+ * jobs still get run by their owner so that's harmless.           *
+ *                                                                 *
+ *******************************************************************/
+static void WakeThief(void)
+{
+		if (!atomic_load(&sleepers))
+				return;
+
+		for (int i = 0; i < nworkers; ++i)
+				if (&workers[i] != self && WakeWorker(&workers[i]))
+						return;
+}
+
+/*******************************************************************
+ * Function: FindWork                                              *
+ *                                                                 *
+ * Arguments: worker_t*                                            *
+ *                                                                 *
+ * Returns: (workjob_t*) The job to run next or NULL if there's    *
+ * nothing to do anywhere.                                         *
+ *                                                                 *
+ * Description: Looks in the worker's own deque first, then in its *
+ * queue (moving a batch of jobs from it into the deque so others  *
+ * can steal them while we're busy) and finally steals the oldest  *
+ * job from one of the other workers.                              *
+ *                                                                 *
+ *******************************************************************/
+static workjob_t *FindWork(worker_t *worker)
+{
+		workjob_t *job = TakeWSDeque(&worker->deque);
+		if (job)
+				return job;
+
+		job = PopMPSCRing(&worker->queue);
+		if (job)
+		{
+				int moved = 0;
+				workjob_t *more;
+				while (moved < WORKER_BATCH && (more = PopMPSCRing(&worker->queue)))
+				{
+						// The deque only fails if it can't grow, run the job now
+						// rather than lose it.
+						if (PushWSDeque(&worker->deque, more))
+								moved++;
+						else
+						{
+								more->run(more);
+								ResetArena(&worker->scratch);
+						}
+				}
+
+				if (moved)
+						WakeThief();
+				return job;
+		}
+
+		// Start with a different worker each time so the thieves don't all
+		// go for the same one.
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		for (int i = 0; i < nworkers; ++i)
+		{
+				worker_t *victim = &workers[(seed + i) % nworkers];
+				if (victim == worker)
+						continue;
+
+				job = StealWSDeque(&victim->deque);
+				if (job)
+						return job;
+		}
+
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: WorkerThread                                          *
+ *                                                                 *
+ * Arguments: void* (the worker_t)                                 *
+ *                                                                 *
+ * Returns: (void*) Always NULL.                                   *
+ *                                                                 *
+ * Description: Runs jobs until there are none left anywhere, then *
+ * sleeps. Before going to sleep the worker says so and looks for  *
+ * work once more: a job submitted after that look sees the flag   *
+ * and wakes us, one submitted before it is found by it.           *
+ *                                                                 *
+ *******************************************************************/
+static void *WorkerThread(void *arg)
+{
+		worker_t *worker = arg;
+		self = worker;
+		seed = (uint32_t)(worker - workers + 1) * 2654435761U;
+
+		char name[16];
+		snprintf(name, sizeof(name), "worker%d", (int)(worker - workers));
+		SetLogThreadName(name);
+
+		// The worker carries on without metrics if there's no memory for them.
+		snprintf(name, sizeof(name), "%d", (int)(worker - workers));
+		threadmetrics = CreateMetrics(METRICS_WORKER, name);
+		InitializeArena(&worker->scratch, 0);
+
+		for (;;)
+		{
+				workjob_t *job = FindWork(worker);
+				if (!job)
+				{
+						// Only exit once everything that was queued for us has run.
+						if (atomic_load(&worker->stopping))
+								break;
+
+						atomic_fetch_add(&sleepers, 1);
+						atomic_store(&worker->sleeping, 1);
+						atomic_thread_fence(memory_order_seq_cst);
+
+						job = FindWork(worker);
+						if (!job)
+						{
+								pthread_mutex_lock(&worker->lock);
+								while (atomic_load(&worker->sleeping) && !atomic_load(&worker->stopping))
+										pthread_cond_wait(&worker->wakeup, &worker->lock);
+								pthread_mutex_unlock(&worker->lock);
+						}
+
+						// Whoever clears the flag takes us off the sleepers count.
+						if (atomic_exchange(&worker->sleeping, 0))
+								atomic_fetch_sub(&sleepers, 1);
+
+						if (!job)
+								continue;
+				}
+
+				atomic_store(&worker->busy, 1);
+				job->run(job);
+				ResetArena(&worker->scratch);
+				atomic_store(&worker->busy, 0);
+		}
+
+		DestroyArena(&worker->scratch);
+		DestroyMetrics(threadmetrics);
+		threadmetrics = NULL;
+		self = NULL;
+		return NULL;
+}
+
+/*******************************************************************
+ * Function: StartWorkerPool                                       *
+ *                                                                 *
+ * Arguments: (int) number of workers                              *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Starts the worker threads. They're started with    *
+ * every signal blocked so signals go to the calling thread.       *
+ *                                                                 *
+ *******************************************************************/
+int StartWorkerPool(int count)
+{
+		assert(!workers && count > 0 && count <= WORKER_MAX);
+
+		// The queues are cache line aligned so the workers must be too.
+		workers = aligned_alloc(POOL_CACHELINE, count * sizeof(worker_t));
+		if (!workers)
+		{
+				LogError("Failed to allocate the workers: %s (%d)", strerror(errno), errno);
+				return 0;
+		}
+		memset(workers, 0, count * sizeof(worker_t));
+		atomic_store(&sleepers, 0);
+
+		// Thieves go through every worker so they must all be set up
+		// before the first thread starts.
+		for (nworkers = 0; nworkers < count; ++nworkers)
+		{
+				worker_t *worker = &workers[nworkers];
+				if (!InitializeMPSCRing(&worker->queue, WORKER_QUEUE_SIZE))
+						break;
+
+				if (!InitializeWSDeque(&worker->deque, WORKER_QUEUE_SIZE))
+				{
+						DestroyMPSCRing(&worker->queue);
+						break;
+				}
+
+				atomic_init(&worker->busy, 0);
+				atomic_init(&worker->sleeping, 0);
+				atomic_init(&worker->stopping, 0);
+				pthread_mutex_init(&worker->lock, NULL);
+				pthread_cond_init(&worker->wakeup, NULL);
+		}
+
+		if (nworkers < count)
+		{
+				StopWorkerPool();
+				return 0;
+		}
+
+		sigset_t all, old;
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &old);
+
+		for (nthreads = 0; nthreads < count; ++nthreads)
+		{
+				worker_t *worker = &workers[nthreads];
+				int error = pthread_create(&worker->thread, NULL, WorkerThread, worker);
+				if (error)
+				{
+						LogError("Failed to start a worker thread: %s (%d)", strerror(error), error);
+						break;
+				}
+		}
+
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+		if (nthreads < count)
+		{
+				StopWorkerPool();
+				return 0;
+		}
+
+		return 1;
+}
+
+/*******************************************************************
+ * Function: StopWorkerPool                                        *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Lets every worker finish the jobs already queued   *
+ * and waits for them to exit. Nothing may call SubmitWork once    *
+ * this has been called.                                           *
+ *                                                                 *
+ *******************************************************************/
+void StopWorkerPool(void)
+{
+		for (int i = 0; i < nworkers; ++i)
+		{
+				worker_t *worker = &workers[i];
+				atomic_store(&worker->stopping, 1);
+
+				pthread_mutex_lock(&worker->lock);
+				pthread_cond_signal(&worker->wakeup);
+				pthread_mutex_unlock(&worker->lock);
+		}
+
+		for (int i = 0; i < nthreads; ++i)
+				pthread_join(workers[i].thread, NULL);
+
+		for (int i = 0; i < nworkers; ++i)
+		{
+				worker_t *worker = &workers[i];
+				pthread_mutex_destroy(&worker->lock);
+				pthread_cond_destroy(&worker->wakeup);
+				DestroyWSDeque(&worker->deque);
+				DestroyMPSCRing(&worker->queue);
+		}
+
+		free(workers);
+		workers = NULL;
+		nworkers = 0;
+		nthreads = 0;
+}
+
+/*******************************************************************
+ * Function: GetWorkerCount                                        *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (int) How many workers are running.                    *
+ *                                                                 *
+ *******************************************************************/
+int GetWorkerCount(void)
+{
+		return nworkers;
+}
+
+/*******************************************************************
+ * Function: GetWorkerArena                                        *
+ *                                                                 *
+ * Arguments: (None)                                               *
+ *                                                                 *
+ * Returns: (arena_t*) The calling worker's scratch arena.         *
+ *                                                                 *
+ * Description: The workers' counterpart to GetEventArena, jobs    *
+ * can allocate whatever temporary data they need from this        *
+ * without freeing it. It's all thrown away once the job returns.  *
+ * Only call it from a job.                                        *
+ *                                                                 *
+ *******************************************************************/
+arena_t *GetWorkerArena(void)
+{
+		assert(self);
+		return &self->scratch;
+}
+
+/*******************************************************************
+ * Function: SubmitWork                                            *
+ *                                                                 *
+ * Arguments: workjob_t*, (uint32_t) key                           *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Queues the job. From an event loop the key picks   *
+ * the worker, so jobs with the same key tend to run on the same   *
+ * worker unless it's busy and another one is asleep. From a       *
+ * worker (eg, a job splitting itself up) the job goes on that     *
+ * worker's own deque. Idle workers steal whatever the busy ones   *
+ * haven't got to, so jobs may run in any order. Never blocks: if  *
+ * the worker's queue is full this returns false and the job still *
+ * belongs to the caller.                                          *
+ *                                                                 *
+ *******************************************************************/
+int SubmitWork(workjob_t *job, uint32_t key)
+{
+		assert(job && job->run && nworkers);
+
+		if (self)
+		{
+				if (!PushWSDeque(&self->deque, job))
+						return 0;
+
+				WakeThief();
+				return 1;
+		}
+
+		// Don't queue behind a slow job while someone has nothing to do.
+		worker_t *worker = &workers[key % nworkers];
+		if (atomic_load(&worker->busy) && atomic_load(&sleepers))
+		{
+				for (int i = 0; i < nworkers; ++i)
+				{
+						if (atomic_load(&workers[i].sleeping))
+						{
+								worker = &workers[i];
+								break;
+						}
+				}
+		}
+
+		if (!PushMPSCRing(&worker->queue, job))
+		{
+				errno = EAGAIN;
+				return 0;
+		}
+
+		WakeWorker(worker);
+		return 1;
+}
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include "log/log.h"
+
+// Include our deque types and function declarations.
+#include "thread/wsdeque.h"
+
+/*******************************************************************
+ * Function: AllocateArray                                         *
+ *                                                                 *
+ * Arguments: (int64_t) number of items, a power of two            *
+ *                                                                 *
+ * Returns: (wsarray_t*) The array or NULL if we ran out of memory.*
+ *                                                                 *
+ *******************************************************************/
+static wsarray_t *AllocateArray(int64_t size)
+{
+		wsarray_t *array = malloc(sizeof(wsarray_t) + size * sizeof(void*));
+		if (!array)
+				return NULL;
+
+		array->mask = size - 1;
+		for (int64_t i = 0; i < size; ++i)
+				atomic_init(&array->items[i], NULL);
+
+		return array;
+}
+
+/*******************************************************************
+ * Function: InitializeWSDeque                                     *
+ *                                                                 *
+ * Arguments: wsdeque_t*, (int64_t) how many items it starts with  *
+ *            room for                                             *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ *******************************************************************/
+int InitializeWSDeque(wsdeque_t *d, int64_t size)
+{
+		assert(d && size > 0);
+
+		int64_t n = 2;
+		while (n < size)
+				n <<= 1;
+
+		wsarray_t *array = AllocateArray(n);
+		if (!array)
+		{
+				LogError("Failed to allocate a deque of %lld items: %s (%d)", (long long)n, strerror(errno), errno);
+				return 0;
+		}
+
+		atomic_init(&d->top, 0);
+		atomic_init(&d->bottom, 0);
+		atomic_init(&d->array, array);
+		vec_init(&d->retired);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: DestroyWSDeque                                        *
+ *                                                                 *
+ * Arguments: wsdeque_t*                                           *
+ *                                                                 *
+ * Returns: (void) No return.                                      *
+ *                                                                 *
+ * Description: Frees the deque. Nobody may be stealing from it    *
+ * and anything still in it belongs to the caller.                 *
+ *                                                                 *
+ *******************************************************************/
+void DestroyWSDeque(wsdeque_t *d)
+{
+		assert(d);
+
+		wsarray_t *array;
+		int i;
+		vec_foreach(&d->retired, array, i)
+				free(array);
+		vec_deinit(&d->retired);
+
+		free(atomic_load(&d->array));
+		atomic_store(&d->array, NULL);
+}
+
+/*******************************************************************
+ * Function: GrowArray                                             *
+ *                                                                 *
+ * Arguments: wsdeque_t*, wsarray_t* (the current array),          *
+ *            (int64_t) top, (int64_t) bottom                      *
+ *                                                                 *
+ * Returns: (wsarray_t*) The new array or NULL if we ran out of    *
+ * memory.                                                         *
+ *                                                                 *
+ * Description: Copies the items into an array twice the size.     *
+ * Items keep their positions (top and bottom don't change) so     *
+ * thieves can carry on with either array.                         *
+ *                                                                 *
+ *******************************************************************/
+static wsarray_t *GrowArray(wsdeque_t *d, wsarray_t *old, int64_t top, int64_t bottom)
+{
+		wsarray_t *array = AllocateArray((old->mask + 1) * 2);
+		if (!array)
+				return NULL;
+
+		if (vec_push(&d->retired, old))
+		{
+				free(array);
+				return NULL;
+		}
+
+		for (int64_t i = top; i < bottom; ++i)
+		{
+				void *item = atomic_load_explicit(&old->items[i & old->mask], memory_order_relaxed);
+				atomic_store_explicit(&array->items[i & array->mask], item, memory_order_relaxed);
+		}
+
+		// Thieves which see the new array must see its items too.
+		atomic_store_explicit(&d->array, array, memory_order_release);
+		return array;
+}
+
+/*******************************************************************
+ * Function: PushWSDeque                                           *
+ *                                                                 *
+ * Arguments: wsdeque_t*, void* item                               *
+ *                                                                 *
+ * Returns: (int) a true or false value where true = 1, false = 0  *
+ *                                                                 *
+ * Description: Adds an item at the bottom. Only the owner may     *
+ * push. Returns false if the deque had to grow and couldn't.      *
+ *                                                                 *
+ *******************************************************************/
+int PushWSDeque(wsdeque_t *d, void *item)
+{
+		assert(d && item);
+
+		int64_t bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+		int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+		wsarray_t *array = atomic_load_explicit(&d->array, memory_order_relaxed);
+
+		if (bottom - top > array->mask)
+		{
+				array = GrowArray(d, array, top, bottom);
+				if (!array)
+						return 0;
+		}
+
+		atomic_store_explicit(&array->items[bottom & array->mask], item, memory_order_relaxed);
+
+		// Publish the item before the new bottom says it's there.
+		atomic_store_explicit(&d->bottom, bottom + 1, memory_order_release);
+		return 1;
+}
+
+/*******************************************************************
+ * Function: TakeWSDeque                                           *
+ *                                                                 *
+ * Arguments: wsdeque_t*                                           *
+ *                                                                 *
+ * Returns: (void*) The newest item or NULL if the deque is empty. *
+ *                                                                 *
+ * Description: Takes the item at the bottom. Only the owner may   *
+ * take. If a thief goes for the last item at the same time only   *
+ * one of us gets it.                                              *
+ *                                                                 *
+ *******************************************************************/
+void *TakeWSDeque(wsdeque_t *d)
+{
+		assert(d);
+
+		// Claim the bottom item before looking at the top, the fence makes
+		// sure a thief either sees our claim or we see its steal.
+		int64_t bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+		wsarray_t *array = atomic_load_explicit(&d->array, memory_order_relaxed);
+		atomic_store_explicit(&d->bottom, bottom, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+		int64_t top = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+		// It was empty already.
+		if (top > bottom)
+		{
+				atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+				return NULL;
+		}
+
+		void *item = atomic_load_explicit(&array->items[bottom & array->mask], memory_order_relaxed);
+
+		// The last item, race the thieves for it the same way they race
+		// each other.
+		if (top == bottom)
+		{
+				if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+						item = NULL;
+				atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+		}
+
+		return item;
+}
+
+/*******************************************************************
+ * Function: StealWSDeque                                          *
+ *                                                                 *
+ * Arguments: wsdeque_t*                                           *
+ *                                                                 *
+ * Returns: (void*) The oldest item or NULL if the deque is empty  *
+ * or someone else took the item first.                            *
+ *                                                                 *
+ * Description: Takes the item at the top. Any thread may steal.   *
+ *                                                                 *
+ *******************************************************************/
+void *StealWSDeque(wsdeque_t *d)
+{
+		assert(d);
+
+		int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+		atomic_thread_fence(memory_order_seq_cst);
+		int64_t bottom = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+		if (top >= bottom)
+				return NULL;
+
+		wsarray_t *array = atomic_load_explicit(&d->array, memory_order_acquire);
+		void *item = atomic_load_explicit(&array->items[top & array->mask], memory_order_relaxed);
+
+		if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+				return NULL;
+
+		return item;
+}
+
+/*******************************************************************
+ * Function: GetWSDequeSize                                        *
+ *                                                                 *
+ * Arguments: wsdeque_t*                                           *
+ *                                                                 *
+ * Returns: (int64_t) Roughly how many items are in the deque, it  *
+ * may have changed by the time the caller looks at it.            *
+ *                                                                 *
+ *******************************************************************/
+int64_t GetWSDequeSize(wsdeque_t *d)
+{
+		int64_t bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+		int64_t top = atomic_load_explicit(&d->top, memory_order_relaxed);
+		return bottom > top ? bottom - top : 0;
+}
@@ -43,44 +43,112 @@
 #include "vector/vec.h"
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
 
 void *reallocarray(void *optr, size_t nmemb, size_t size);
 
 #define VEC_MIN_CAPACITY 4
 
-void vec_expand_(char **data, int *length, int *capacity, int memsz)
+/* Works out how big a vector of `capacity' elements should grow to so it
+ * holds at least `needed', following VEC_GROWTH_NUM / VEC_GROWTH_DEN. */
+static size_t vec_grow_(size_t capacity, size_t needed, size_t max)
+{
+	size_t grown;
+	/* capacity * NUM / DEN without overflowing on huge vectors. */
+	size_t increase = capacity / VEC_GROWTH_DEN * VEC_GROWTH_NUM +
+		capacity % VEC_GROWTH_DEN * VEC_GROWTH_NUM / VEC_GROWTH_DEN;
+
+	if (capacity == 0)
+		grown = VEC_MIN_CAPACITY;
+	else if (increase > max - capacity)
+		grown = max;
+	else
+		grown = capacity + increase;
+
+	/* Small growth factors can round down to no growth at all. */
+	if (grown <= capacity)
+		grown = capacity + 1;
+
+	return grown < needed ? needed : grown;
+}
+
+
+/* Resizes the vector's memory to `capacity' elements. If the data lives in
+ * the small buffer `sbo' it's copied out to the heap instead. Nothing is
+ * changed if we run out of memory. */
+static int vec_resize_(char **data, size_t length, size_t *capacity, size_t memsz, char *sbo, size_t ncapacity)
+{
+	void *ndata;
+
+	if (sbo && *data == sbo)
+	{
+		ndata = reallocarray(NULL, ncapacity, memsz);
+		if (ndata)
+			memcpy(ndata, sbo, length * memsz);
+	}
+	else
+		ndata = reallocarray(*data, ncapacity, memsz);
+
+	if (!ndata)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+
+	*data = ndata;
+	*capacity = ncapacity;
+	return 0;
+}
+
+
+/* The int-sized vectors share the size_t code, these move between the two. */
+static int vec_resize_int_(char **data, int *length, int *capacity, int memsz, char *sbo, size_t ncapacity)
+{
+	size_t cap = *capacity;
+
+	if (ncapacity > INT_MAX)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (vec_resize_(data, *length, &cap, memsz, sbo, ncapacity))
+		return -1;
+
+	*capacity = (int)cap;
+	return 0;
+}
+
+
+int vec_expand_(char **data, int *length, int *capacity, int memsz)
 {
 	assert(data && length && capacity && memsz);
 	
 	if (*length + 1 > *capacity)
 	{
-		if (*capacity == 0)
-			*capacity = VEC_MIN_CAPACITY;
-		else
-			*capacity <<= 1;
-	
-		void *ndata = reallocarray(*data, *capacity, memsz);
-		*data = ndata ? ndata : *data;
-		
-		if (!ndata)
+		if (*length == INT_MAX)
+		{
 			errno = ENOMEM;
+			return -1;
+		}
+
+		return vec_resize_int_(data, length, capacity, memsz, NULL,
+			vec_grow_(*capacity, *length + 1, INT_MAX));
 	}
+
+	return 0;
 }
 
 
-void vec_reserve_(char **data, int *length, int *capacity, int memsz, int n)
+int vec_reserve_(char **data, int *length, int *capacity, int memsz, int n)
 {
 	assert(data && length && capacity && memsz);
 	
 	if (n > *capacity)
-	{
-		*capacity = n;
-		void *ndata = reallocarray(*data, *capacity, memsz);
-		*data = ndata ? ndata : *data;
-		
-		if (!ndata)
-			errno = ENOMEM;
-	}
+		return vec_resize_int_(data, length, capacity, memsz, NULL, n);
+
+	return 0;
 }
 
 
@@ -96,11 +164,8 @@ void vec_compact_(char **data, int *length, int *capacity, int memsz)
 		return;
 	}
 	
-	*capacity = *length;
-	void *ndata = reallocarray(*data, *capacity, memsz);
-	*data = ndata ? ndata : *data;
-	if (!ndata)
-		errno = ENOMEM;
+	/* Shrinking can't really fail, if it does we just keep the bigger block. */
+	vec_resize_int_(data, length, capacity, memsz, NULL, *length);
 }
 
 
@@ -114,33 +179,251 @@ void vec_splice_(char **data, int *length, int *capacity, int memsz, int start,
 }
 
 
-void vec_insert_(char **data, int *length, int *capacity, int memsz, int idx)
+int vec_insert_(char **data, int *length, int *capacity, int memsz, int idx)
 {
 	assert(data && length && capacity && memsz);
-	vec_expand_(data, length, capacity, memsz);
+
 	// No reason to crash when trying to expand...
-	if (errno == ENOMEM)
-		return;
+	if (vec_expand_(data, length, capacity, memsz))
+		return -1;
 	
 	memmove(*data + (idx + 1) * memsz,
 		*data + idx * memsz,
 		(*length - idx) * memsz);
+	return 0;
+}
+
+
+/* How many bytes of an element we swap at a time. Elements bigger than this
+ * are swapped in pieces so we never need more than this on the stack. */
+#define VEC_SWAP_CHUNK 64
+
+/* How many bytes vec_rotate_ copies aside on the stack, rotating by more
+ * than this is done by reversing instead. */
+#define VEC_ROTATE_STACK 256
+
+
+static void vec_swap_bytes_(char *a, char *b, size_t n)
+{
+	char tmp[VEC_SWAP_CHUNK];
+
+	while (n)
+	{
+		size_t len = n < sizeof(tmp) ? n : sizeof(tmp);
+		memcpy(tmp, a, len);
+		memcpy(a, b, len);
+		memcpy(b, tmp, len);
+		a += len;
+		b += len;
+		n -= len;
+	}
+}
+
+
+/* Reverses `count' elements starting at `data'. */
+static void vec_reverse_range_(char *data, size_t count, size_t memsz)
+{
+	if (count < 2)
+		return;
+
+	char *lo = data;
+	char *hi = data + (count - 1) * memsz;
+	while (lo < hi)
+	{
+		vec_swap_bytes_(lo, hi, memsz);
+		lo += memsz;
+		hi -= memsz;
+	}
 }
 
 
 void vec_swap_(char **data, int *length, int *capacity, int memsz, int idx1, int idx2)
 {
 	assert(data && length && capacity && memsz);
-	char *tmp;
-	vec_expand_(data, length, capacity, memsz);
-	// No reason to crash when trying to expand...
-	if (errno == ENOMEM)
+	assert(idx1 >= 0 && idx1 < *length && idx2 >= 0 && idx2 < *length);
+
+	if (idx1 != idx2)
+		vec_swap_bytes_(*data + idx1 * memsz, *data + idx2 * memsz, memsz);
+}
+
+
+void vec_reverse_(char **data, int *length, int *capacity, int memsz)
+{
+	assert(data && length && capacity && memsz);
+	vec_reverse_range_(*data, *length, memsz);
+}
+
+
+void vec_rotate_(char **data, int *length, int *capacity, int memsz, int n)
+{
+	assert(data && length && capacity && memsz);
+
+	if (*length < 2)
 		return;
-	
-	tmp = *data + *length * memsz;
-	memcpy(tmp, *data + (idx1 * memsz), memsz);
-	memcpy(*data + (idx1 * memsz), *data + (idx2 * memsz), memsz);
-	memcpy(*data + (idx2 * memsz), tmp, memsz);
+
+	/* Turn it into a rotation towards the front by 0 <= n < length. */
+	n %= *length;
+	if (n < 0)
+		n += *length;
+	if (n == 0)
+		return;
+
+	size_t front = (size_t)n * memsz;
+	size_t back  = (size_t)(*length - n) * memsz;
+
+	/* If the smaller side fits on the stack copy it aside and slide the
+	 * rest over it, that's one memmove instead of touching everything twice. */
+	if (front <= VEC_ROTATE_STACK)
+	{
+		char tmp[VEC_ROTATE_STACK];
+		memcpy(tmp, *data, front);
+		memmove(*data, *data + front, back);
+		memcpy(*data + back, tmp, front);
+	}
+	else if (back <= VEC_ROTATE_STACK)
+	{
+		char tmp[VEC_ROTATE_STACK];
+		memcpy(tmp, *data + front, back);
+		memmove(*data + back, *data, front);
+		memcpy(*data, tmp, back);
+	}
+	else
+	{
+		/* Reversing both halves and then the whole thing is a rotation. */
+		vec_reverse_range_(*data, n, memsz);
+		vec_reverse_range_(*data + front, *length - n, memsz);
+		vec_reverse_range_(*data, *length, memsz);
+	}
+}
+
+
+int vecz_expand_(char **data, size_t *length, size_t *capacity, size_t memsz)
+{
+	assert(data && length && capacity && memsz);
+
+	if (*length + 1 > *capacity)
+	{
+		if (*length == SIZE_MAX)
+		{
+			errno = ENOMEM;
+			return -1;
+		}
+
+		return vec_resize_(data, *length, capacity, memsz, NULL,
+			vec_grow_(*capacity, *length + 1, SIZE_MAX));
+	}
+
+	return 0;
+}
+
+
+int vecz_reserve_(char **data, size_t *length, size_t *capacity, size_t memsz, size_t n)
+{
+	assert(data && length && capacity && memsz);
+
+	if (n > *capacity)
+		return vec_resize_(data, *length, capacity, memsz, NULL, n);
+
+	return 0;
+}
+
+
+void vecz_compact_(char **data, size_t *length, size_t *capacity, size_t memsz)
+{
+	assert(data && length && capacity && memsz);
+
+	if (*length == 0)
+	{
+		free(*data);
+		*data = NULL;
+		*capacity = 0;
+		return;
+	}
+
+	vec_resize_(data, *length, capacity, memsz, NULL, *length);
+}
+
+
+void vecz_splice_(char **data, size_t *length, size_t *capacity, size_t memsz, size_t start, size_t count)
+{
+	assert(data && length && capacity && memsz && count);
+
+	memmove(*data + start * memsz,
+		*data + (start + count) * memsz,
+		(*length - start - count) * memsz);
+}
+
+
+int vecz_insert_(char **data, size_t *length, size_t *capacity, size_t memsz, size_t idx)
+{
+	assert(data && length && capacity && memsz);
+
+	if (vecz_expand_(data, length, capacity, memsz))
+		return -1;
+
+	memmove(*data + (idx + 1) * memsz,
+		*data + idx * memsz,
+		(*length - idx) * memsz);
+	return 0;
+}
+
+
+/* A zeroed small buffer vector has no data pointer yet, point it at the
+ * buffer inside the structure. */
+static void vec_sbo_prepare_(char **data, int *capacity, char *sbo, int sbocap)
+{
+	if (!*data)
+	{
+		*data = sbo;
+		*capacity = sbocap;
+	}
+}
+
+
+int vec_sbo_expand_(char **data, int *length, int *capacity, int memsz, char *sbo, int sbocap)
+{
+	assert(data && length && capacity && memsz && sbo);
+	vec_sbo_prepare_(data, capacity, sbo, sbocap);
+
+	if (*length + 1 > *capacity)
+	{
+		if (*length == INT_MAX)
+		{
+			errno = ENOMEM;
+			return -1;
+		}
+
+		return vec_resize_int_(data, length, capacity, memsz, sbo,
+			vec_grow_(*capacity, *length + 1, INT_MAX));
+	}
+
+	return 0;
+}
+
+
+int vec_sbo_reserve_(char **data, int *length, int *capacity, int memsz, char *sbo, int sbocap, int n)
+{
+	assert(data && length && capacity && memsz && sbo);
+	vec_sbo_prepare_(data, capacity, sbo, sbocap);
+
+	if (n > *capacity)
+		return vec_resize_int_(data, length, capacity, memsz, sbo, n);
+
+	return 0;
+}
+
+
+int vec_sbo_insert_(char **data, int *length, int *capacity, int memsz, char *sbo, int sbocap, int idx)
+{
+	assert(data && length && capacity && memsz && sbo);
+
+	if (vec_sbo_expand_(data, length, capacity, memsz, sbo, sbocap))
+		return -1;
+
+	memmove(*data + (idx + 1) * memsz,
+		*data + idx * memsz,
+		(*length - idx) * memsz);
+	return 0;
 }
 
 /********************************************************************************